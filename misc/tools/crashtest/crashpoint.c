@@ -0,0 +1,87 @@
+/* crashpoint.c -- Kill a process at a given write, rename or fsync call
+ *
+ * This file is part of CliFM
+ *
+ * An LD_PRELOAD shim used by crashtest.py to check that state files are
+ * never left truncated or half written, no matter where clifm dies while
+ * saving them. Each call to write(2) on a regular file, rename(2), and
+ * fsync(2) is a crash point: the process is sent SIGKILL right before
+ * the CRASHPOINT_N-th one is made.
+ *
+ * Environment:
+ *   CRASHPOINT_N    Crash point at which the process is killed (1-based).
+ *                   If unset or zero, the process is never killed.
+ *   CRASHPOINT_LOG  If set, a file created when the process is killed.
+ *
+ * Build (see the Makefile in the parent directory):
+ *   cc -shared -fPIC -o crashpoint.so crashpoint.c -ldl
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static long calls = 0;
+static long target = -1;
+
+static void
+crash_point(void)
+{
+	if (target == -1) {
+		const char *n = getenv("CRASHPOINT_N");
+		target = n ? atol(n) : 0;
+	}
+
+	if (target <= 0 || ++calls != target)
+		return;
+
+	const char *log = getenv("CRASHPOINT_LOG");
+	if (log) {
+		const int fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd != -1)
+			close(fd);
+	}
+
+	kill(getpid(), SIGKILL);
+}
+
+ssize_t
+write(int fd, const void *buf, size_t count)
+{
+	static ssize_t (*real_write)(int, const void *, size_t) = NULL;
+	if (!real_write)
+		*(void **)&real_write = dlsym(RTLD_NEXT, "write");
+
+	/* Writes to the terminal are no crash points */
+	struct stat a;
+	if (fstat(fd, &a) == 0 && S_ISREG(a.st_mode))
+		crash_point();
+
+	return real_write(fd, buf, count);
+}
+
+int
+rename(const char *oldpath, const char *newpath)
+{
+	static int (*real_rename)(const char *, const char *) = NULL;
+	if (!real_rename)
+		*(void **)&real_rename = dlsym(RTLD_NEXT, "rename");
+
+	crash_point();
+	return real_rename(oldpath, newpath);
+}
+
+int
+fsync(int fd)
+{
+	static int (*real_fsync)(int) = NULL;
+	if (!real_fsync)
+		*(void **)&real_fsync = dlsym(RTLD_NEXT, "fsync");
+
+	crash_point();
+	return real_fsync(fd);
+}
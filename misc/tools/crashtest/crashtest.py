@@ -0,0 +1,144 @@
+#!/usr/bin/python3
+# -*- coding: utf-8 -*-
+
+# This file is part of CliFM
+
+""" Crash test for clifm state files
+
+Run clifm under the crashpoint.so shim, killing it at every crash point
+(write, rename, fsync) in turn, while it changes directories and selects
+files. After each run, every state file must hold either its old
+contents or its complete new contents. Temporary files left behind by a
+kill between their creation and their renaming are reported, but they
+are not failures: the original file is intact.
+
+Usage: crashtest.py [CLIFM_BINARY [CRASHPOINT_SO]]
+
+Requires pexpect (https://pexpect.readthedocs.io).
+"""
+
+import os
+import re
+import shutil
+import sys
+import tempfile
+import time
+
+import pexpect
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+CLIFM = sys.argv[1] if len(sys.argv) > 1 else 'clifm'
+SHIM = os.path.abspath(sys.argv[2]) if len(sys.argv) > 2 \
+    else os.path.join(HERE, 'crashpoint.so')
+MAX_POINTS = 500
+
+
+def setup(root):
+    """ Create a fresh home and working tree, and the old state files """
+    home = os.path.join(root, 'home')
+    shutil.rmtree(root, ignore_errors=True)
+    for d in ('a', 'b'):
+        os.makedirs(os.path.join(root, d))
+    for f in ('f1', 'f2'):
+        open(os.path.join(root, 'a', f), 'w').close()
+
+    conf = os.path.join(home, '.config', 'clifm')
+    prof = os.path.join(conf, 'profiles', 'default')
+    os.makedirs(prof)
+    old = os.path.join(root, 'old')
+    open(old, 'w').close()
+
+    states = {
+        os.path.join(prof, 'selbox.clifm'): old + '\n',
+        os.path.join(prof, 'jump.clifm'): '3:1700000000:1700000000:/tmp\n@0\n',
+        os.path.join(prof, 'dirhist.clifm'): root + '\n',
+        os.path.join(prof, '.last'): '*0:' + root + '\n',
+        os.path.join(conf, '.last'): '*0:' + root + '\n',
+    }
+    for path, data in states.items():
+        with open(path, 'w') as f:
+            f.write(data)
+    return home, conf, prof
+
+
+def run(root, home, point):
+    """ Run the session, killing clifm at crash point POINT. Return True
+    if clifm was killed """
+    log = os.path.join(root, 'killed')
+    env = dict(os.environ, HOME=home, LD_PRELOAD=SHIM,
+               CRASHPOINT_N=str(point), CRASHPOINT_LOG=log)
+    p = pexpect.spawn(CLIFM, ['--no-clear-screen', '--cd-on-quit'],
+                      cwd=root, env=env, encoding='utf-8', timeout=5,
+                      dimensions=(50, 160))
+    for cmd in ('cd ' + os.path.join(root, 'a'), 's f1',
+                'cd ' + os.path.join(root, 'b'),
+                's ' + os.path.join(root, 'a', 'f2'), 'q'):
+        time.sleep(0.25)
+        if not p.isalive():
+            break
+        p.sendline(cmd)
+    try:
+        p.expect(pexpect.EOF, timeout=5)
+    except pexpect.TIMEOUT:
+        p.terminate(force=True)
+    return os.path.exists(log)
+
+
+def leftovers(conf, prof):
+    """ Return the list of temporary files left behind """
+    tmp = re.compile(r'\.[A-Za-z0-9]{6}$')
+    return [n for d in (conf, prof) for n in os.listdir(d) if tmp.search(n)]
+
+
+def check(root, conf, prof):
+    """ Return a list of problems found in the state files """
+    bad = []
+    a = os.path.join(root, 'a')
+
+    with open(os.path.join(prof, 'selbox.clifm')) as f:
+        sel = f.read()
+    old = os.path.join(root, 'old') + '\n'
+    if sel not in (old, old + a + '/f1\n', old + a + '/f1\n' + a + '/f2\n'):
+        bad.append('selbox: %r' % sel)
+
+    with open(os.path.join(prof, 'jump.clifm')) as f:
+        lines = f.read().splitlines()
+    if not lines or not lines[-1].startswith('@'):
+        bad.append('jump: %r' % lines[-1:])
+
+    for last in (os.path.join(prof, '.last'), os.path.join(conf, '.last')):
+        with open(last) as f:
+            data = f.read().strip()
+        if data not in ('*0:' + root, '*0:' + os.path.join(root, 'b')):
+            bad.append('%s: %r' % (last, data))
+
+    with open(os.path.join(prof, 'dirhist.clifm')) as f:
+        if f.readline().rstrip('\n') != root:
+            bad.append('dirhist')
+
+    return bad
+
+
+def main():
+    root = tempfile.mkdtemp(prefix='clifm-crashtest.')
+    failures = 0
+    try:
+        for point in range(1, MAX_POINTS + 1):
+            home, conf, prof = setup(root)
+            killed = run(root, home, point)
+            bad = check(root, conf, prof)
+            left = leftovers(conf, prof)
+            print('crash point %d: %s%s' % (point,
+                  ', '.join(bad) if bad else 'OK',
+                  ' (left behind: %s)' % ', '.join(left) if left else ''))
+            failures += len(bad) > 0
+            if not killed:
+                break
+    finally:
+        shutil.rmtree(root, ignore_errors=True)
+
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,133 @@
+/* filter_bench.c -- Time file filters against a plain regexec(3) loop
+ *
+ * This file is part of CliFM
+ *
+ * Generates BENCH_NAMES random file names (a mix of common extensions)
+ * and, for a few typical name filters, reports the time taken by a single
+ * regexec(3) call per name (what clifm used to do) and by the compiled
+ * filter program (eval_filter_prog()). Match counts are printed as well:
+ * both must be the same.
+ *
+ * Build and run (see the Makefile in the parent directory):
+ *   make filterbench
+ */
+
+#include "helpers.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "filter.h"
+
+#define BENCH_NAMES 500000
+#define NAME_MAX_LEN 32
+
+static char names[BENCH_NAMES][NAME_MAX_LEN];
+
+static double
+now_ms(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec * 1000.0 + (double)t.tv_nsec / 1000000.0;
+}
+
+static void
+make_names(void)
+{
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz_-0123456789";
+	static const char *ext[] = {".c", ".h", ".txt", ".pdf", ".tar.gz",
+		".o", ""};
+	size_t i;
+
+	srand(3);
+	for (i = 0; i < BENCH_NAMES; i++) {
+		const int len = 4 + rand() % 14;
+		int j;
+		for (j = 0; j < len; j++)
+			names[i][j] = chars[rand() % (int)(sizeof(chars) - 1)];
+		snprintf(names[i] + len, NAME_MAX_LEN - (size_t)len, "%s",
+			ext[rand() % (int)(sizeof(ext) / sizeof(ext[0]))]);
+	}
+}
+
+/* Return the number of names matching PROG, and the time taken in *MS */
+static size_t
+run_filter(const struct filter_prog_t *prog, double *ms)
+{
+	size_t i, n = 0;
+	const double start = now_ms();
+
+	for (i = 0; i < BENCH_NAMES; i++) {
+		struct filter_file_t f;
+		memset(&f, 0, sizeof(struct filter_file_t));
+		f.name = names[i];
+		f.dirfd = -1;
+		n += (size_t)eval_filter_prog(prog, &f);
+	}
+
+	*ms = now_ms() - start;
+	return n;
+}
+
+int
+main(void)
+{
+	static const char *regexes[] = {"\\.pdf$", "^foo", "\\.tar\\.gz$",
+		"^[a-f].*\\.c$", "report.*2023", NULL};
+	static const char *exprs[] = {"name:*.c", "name:*.c or name:*.h",
+		"name:a*b*.txt", NULL};
+	size_t i, r;
+
+	make_names();
+	printf("%d names\n\n", BENCH_NAMES);
+	printf("%-22s %12s %12s %10s\n", "Filter", "regexec(ms)", "filter(ms)",
+		"Matches");
+
+	for (r = 0; regexes[r]; r++) {
+		regex_t re;
+		if (regcomp(&re, regexes[r], REG_NOSUB | REG_EXTENDED) != 0)
+			continue;
+
+		size_t m1 = 0;
+		const double start = now_ms();
+		for (i = 0; i < BENCH_NAMES; i++)
+			m1 += regexec(&re, names[i], 0, NULL, 0) == 0;
+		const double re_ms = now_ms() - start;
+		regfree(&re);
+
+		struct filter_prog_t p;
+		const char *err = (const char *)NULL;
+		memset(&p, 0, sizeof(struct filter_prog_t));
+		if (compile_filter_prog(regexes[r], FILTER_FILE_NAME, &p, &err) != 0) {
+			printf("%-22s %s\n", regexes[r], err ? err : "compile error");
+			continue;
+		}
+
+		double ms;
+		const size_t m2 = run_filter(&p, &ms);
+		free_filter_prog(&p);
+
+		printf("%-22s %12.1f %12.1f %10zu%s\n", regexes[r], re_ms, ms, m2,
+			m1 != m2 ? " (MISMATCH)" : "");
+	}
+
+	for (r = 0; exprs[r]; r++) {
+		struct filter_prog_t p;
+		const char *err = (const char *)NULL;
+		memset(&p, 0, sizeof(struct filter_prog_t));
+		if (compile_filter_prog(exprs[r], FILTER_EXPR, &p, &err) != 0) {
+			printf("%-22s %s\n", exprs[r], err ? err : "compile error");
+			continue;
+		}
+
+		double ms;
+		const size_t m = run_filter(&p, &ms);
+		free_filter_prog(&p);
+
+		printf("%-22s %12s %12.1f %10zu\n", exprs[r], "-", ms, m);
+	}
+
+	return 0;
+}
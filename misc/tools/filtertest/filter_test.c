@@ -0,0 +1,409 @@
+/* filter_test.c -- Check the file filter compiler and evaluator
+ *
+ * This file is part of CliFM
+ *
+ * Checks, against clifm's own filter.c:
+ *   1. The literal extracted from regular expressions (set_regex_literal()
+ *      and set_pure_literal()): the string itself, where it must be found,
+ *      and whether it alone decides the match.
+ *   2. That name regexes and globs accept exactly the same names as
+ *      regexec(3) and fnmatch(3), over a fixed list of tricky names plus a
+ *      few thousand random ones.
+ *   3. The expression parser: valid expressions compile to the expected
+ *      number of nodes, and invalid ones fail with the expected error.
+ *   4. The evaluator on real files (type, size, and boolean operators).
+ *
+ * Prints every failure and exits with 1 if there is any.
+ *
+ * Build and run (see the Makefile in the parent directory):
+ *   make filtertest
+ */
+
+#include "helpers.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "filter.h"
+
+#define RANDOM_NAMES 4000
+#define NAME_MAX_LEN 24
+
+static int failures = 0;
+
+static void
+fail(const char *fmt, const char *a, const char *b)
+{
+	printf("FAIL: ");
+	printf(fmt, a, b);
+	putchar('\n');
+	failures++;
+}
+
+/* 1. Literal extraction */
+
+struct lit_case_t {
+	const char *re;
+	const char *lit;
+	int pos;
+	int only;
+};
+
+static const struct lit_case_t lit_cases[] = {
+	{"\\.c$", ".c", FLIT_SUFFIX, 1},
+	{"^foo", "foo", FLIT_PREFIX, 1},
+	{"abc", "abc", FLIT_ANY, 1},
+	{"\\.tar\\.gz$", ".tar.gz", FLIT_SUFFIX, 1},
+	{"^$", "", FLIT_EXACT, 1},
+	{"^\\.hid", ".hid", FLIT_PREFIX, 1},
+	{"a\\+b", "a+b", FLIT_ANY, 1},
+	{"^\\(a\\)$", "(a)", FLIT_EXACT, 1},
+	{"^a.*b$", "a", FLIT_ANY, 0},
+	{"a{2}b", "b", FLIT_ANY, 0},
+	{"(ab|cd)e", "e", FLIT_ANY, 0},
+	{"a|b", "", FLIT_ANY, 0},
+	{"[0-9]+\\.txt$", ".txt", FLIT_ANY, 0},
+	{"fo*bar", "bar", FLIT_ANY, 0},
+	{"(a)b*cd", "cd", FLIT_ANY, 0},
+	{"x.y.z$", "x", FLIT_ANY, 0},
+	{NULL, NULL, 0, 0}
+};
+
+static void
+test_literals(void)
+{
+	const struct lit_case_t *c;
+	for (c = lit_cases; c->re; c++) {
+		struct filter_prog_t p;
+		const char *err = (const char *)NULL;
+		memset(&p, 0, sizeof(struct filter_prog_t));
+
+		if (compile_filter_prog(c->re, FILTER_FILE_NAME, &p, &err) != 0) {
+			fail("%s: %s", c->re, err ? err : "compile error");
+			continue;
+		}
+
+		const struct filter_node_t *n = &p.nodes[p.root];
+		const char *lit = n->lit ? n->lit : "";
+		if (strcmp(lit, c->lit) != 0 || n->lit_pos != c->pos
+		|| n->lit_only != c->only) {
+			char got[128];
+			snprintf(got, sizeof(got), "'%s' pos %d only %d (expected '%s' "
+				"pos %d only %d)", lit, n->lit_pos, n->lit_only, c->lit,
+				c->pos, c->only);
+			fail("literal of %s: %s", c->re, got);
+		}
+
+		free_filter_prog(&p);
+	}
+}
+
+/* 2. Differential tests against regexec(3) and fnmatch(3) */
+
+static const char *regexes[] = {
+	"\\.c$", "^foo", "abc", "^a.*b$", "x+y", "ab?c", "a{2}b", "(ab|cd)e",
+	"\\.tar\\.gz$", "^$", "a|b", "[0-9]+\\.txt$", "\\bfoo", "fo*bar",
+	"\xc3\xb1u*x", "^\\.hid", "a\\+b", "[[:digit:]]x", "(a)b*cd", "^REA",
+	"ME$", "c.d", "x.y.z$", "^\\(a\\)$", "aa*b", NULL
+};
+
+static const char *globs[] = {
+	"*.c", "a*b*c", "[ab]x*", "*foo?bar*", "\\*x*", "*", "???", "f[!o]o*",
+	"*.tar.*z", NULL
+};
+
+static const char *fixed_names[] = {
+	"foo.c", "foobar", "xaaby", "abc", "a.tar.gz", "", "ab", "aab", "acde",
+	"x.y.z", "fobar", "foooobar", "\xc3\xb1ux", "\xc3\xb1uuux", ".hid",
+	"a+b", "1x", "abcd", "README", "ME", "cxd", "(a)", "*xyz", "fzo1", NULL
+};
+
+static char names[RANDOM_NAMES][NAME_MAX_LEN];
+static size_t names_n = 0;
+
+static void
+make_names(void)
+{
+	static const char alpha[] = "abcdefoxyz.0123-+*()txgz\xc3\xb1";
+	size_t i;
+
+	for (i = 0; fixed_names[i]; i++)
+		snprintf(names[names_n++], NAME_MAX_LEN, "%s", fixed_names[i]);
+
+	/* Deterministic, so that failures can be reproduced */
+	srand(7);
+	while (names_n < RANDOM_NAMES) {
+		const int len = rand() % 10;
+		int j;
+		for (j = 0; j < len; j++)
+			names[names_n][j] = alpha[rand() % (int)(sizeof(alpha) - 1)];
+		names[names_n][len] = '\0';
+		names_n++;
+	}
+}
+
+static int
+eval_name(const struct filter_prog_t *p, const char *name)
+{
+	struct filter_file_t f;
+	memset(&f, 0, sizeof(struct filter_file_t));
+	f.name = name;
+	f.dirfd = -1;
+	return eval_filter_prog(p, &f);
+}
+
+static void
+test_regexes(void)
+{
+	size_t r, i;
+	for (r = 0; regexes[r]; r++) {
+		struct filter_prog_t p;
+		const char *err = (const char *)NULL;
+		memset(&p, 0, sizeof(struct filter_prog_t));
+
+		if (compile_filter_prog(regexes[r], FILTER_FILE_NAME, &p, &err) != 0) {
+			fail("%s: %s", regexes[r], err ? err : "compile error");
+			continue;
+		}
+
+		regex_t re;
+		regcomp(&re, regexes[r], REG_NOSUB | REG_EXTENDED);
+
+		for (i = 0; i < names_n; i++) {
+			const int a = eval_name(&p, names[i]);
+			const int b = regexec(&re, names[i], 0, NULL, 0) == 0;
+			if (a != b)
+				fail("regex %s, name '%s': differs from regexec", regexes[r],
+					names[i]);
+		}
+
+		regfree(&re);
+		free_filter_prog(&p);
+	}
+}
+
+static void
+test_globs(void)
+{
+	size_t g, i;
+	for (g = 0; globs[g]; g++) {
+		char expr[64];
+		snprintf(expr, sizeof(expr), "name:%s", globs[g]);
+
+		struct filter_prog_t p;
+		const char *err = (const char *)NULL;
+		memset(&p, 0, sizeof(struct filter_prog_t));
+
+		if (compile_filter_prog(expr, FILTER_EXPR, &p, &err) != 0) {
+			fail("%s: %s", expr, err ? err : "compile error");
+			continue;
+		}
+
+		for (i = 0; i < names_n; i++) {
+			const int a = eval_name(&p, names[i]);
+			const int b = fnmatch(globs[g], names[i], 0) == 0;
+			if (a != b)
+				fail("glob %s, name '%s': differs from fnmatch", globs[g],
+					names[i]);
+		}
+
+		free_filter_prog(&p);
+	}
+}
+
+/* 3. Parser */
+
+struct parse_case_t {
+	const char *expr;
+	const char *err; /* NULL if the expression is valid */
+	size_t nodes;
+};
+
+static const struct parse_case_t parse_cases[] = {
+	{"a b", NULL, 3},
+	{"size:>=1k", NULL, 1},
+	{"mtime:1y", NULL, 1},
+	{"x and (y or z) not w", NULL, 7},
+	{"re:(a b)", NULL, 1},
+	{"'name:a b'", NULL, 1},
+	{"!!name:x", NULL, 3},
+	{"(a", "Missing closing parenthesis", 0},
+	{"a or", "Missing operand", 0},
+	{"not", "Missing operand", 0},
+	{"name:", "Missing value", 0},
+	{"size:1..", "Invalid range", 0},
+	{"size:2k..1k", "Invalid range", 0},
+	{"type:z", "Invalid file type", 0},
+	{"\"unterminated", "Unterminated quote", 0},
+	{"a ) b", "Syntax error", 0},
+	{NULL, NULL, 0}
+};
+
+static void
+test_parser(void)
+{
+	const struct parse_case_t *c;
+	for (c = parse_cases; c->expr; c++) {
+		struct filter_prog_t p;
+		const char *err = (const char *)NULL;
+		memset(&p, 0, sizeof(struct filter_prog_t));
+
+		const int ret = compile_filter_prog(c->expr, FILTER_EXPR, &p, &err);
+		char got[128];
+
+		if (c->err && (ret == 0 || !err || strcmp(err, c->err) != 0)) {
+			snprintf(got, sizeof(got), "got '%s', expected '%s'",
+				ret == 0 ? "ok" : (err ? err : "?"), c->err);
+			fail("%s: %s", c->expr, got);
+		} else if (!c->err && (ret != 0 || p.n != c->nodes)) {
+			snprintf(got, sizeof(got), "got '%s' (%zu nodes), expected "
+				"%zu nodes", ret == 0 ? "ok" : (err ? err : "?"), p.n,
+				c->nodes);
+			fail("%s: %s", c->expr, got);
+		}
+
+		free_filter_prog(&p);
+	}
+}
+
+/* 4. Evaluator on real files */
+
+struct eval_case_t {
+	const char *expr;
+	const char *matches; /* Files in the test directory matching EXPR */
+};
+
+static const struct eval_case_t eval_cases[] = {
+	{"type:d", "dir"},
+	{"type:f", "big.txt small.txt"},
+	{"not type:d", "big.txt small.txt"},
+	{"size:>=1k and type:f", "big.txt"},
+	{"type:f and size:<1k", "small.txt"},
+	{"name:*.txt and not size:>=1k", "small.txt"},
+	{"type:d or name:b*", "big.txt dir"},
+	{"re:^s and type:f", "small.txt"},
+	{"mtime:<1d", "big.txt dir small.txt"},
+	{NULL, NULL}
+};
+
+static void
+eval_dir(const char *path, const struct filter_prog_t *p, const int use_dtype,
+	char *buf, const size_t size)
+{
+	/* Entries are sorted by name, so that the result is stable */
+	static const char *files[] = {"big.txt", "dir", "small.txt", NULL};
+	const int fd = open(path, O_RDONLY | O_DIRECTORY);
+	size_t i;
+
+	*buf = '\0';
+	for (i = 0; files[i]; i++) {
+		struct stat a;
+		struct filter_file_t f;
+		memset(&f, 0, sizeof(struct filter_file_t));
+		f.name = files[i];
+		f.attr = &a;
+		f.dirfd = fd;
+		f.stat_flags = AT_SYMLINK_NOFOLLOW;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (use_dtype == 1)
+			f.d_type = *files[i] == 'd' ? DT_DIR : DT_REG;
+#else
+		UNUSED(use_dtype);
+#endif /* _DIRENT_HAVE_D_TYPE */
+
+		if (eval_filter_prog(p, &f) == 1) {
+			const size_t len = strlen(buf);
+			snprintf(buf + len, size - len, "%s%s", len > 0 ? " " : "",
+				files[i]);
+		}
+	}
+
+	close(fd);
+}
+
+static void
+test_eval(void)
+{
+	char dir[] = "/tmp/filtertest.XXXXXX";
+	if (!mkdtemp(dir)) {
+		fail("%s: %s", "mkdtemp", strerror(errno));
+		return;
+	}
+
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/dir", dir);
+	mkdir(path, 0700);
+
+	snprintf(path, sizeof(path), "%s/small.txt", dir);
+	FILE *fp = fopen(path, "w");
+	if (fp) {
+		fputs("x", fp);
+		fclose(fp);
+	}
+
+	snprintf(path, sizeof(path), "%s/big.txt", dir);
+	fp = fopen(path, "w");
+	if (fp) {
+		int i;
+		for (i = 0; i < 2048; i++)
+			fputc('x', fp);
+		fclose(fp);
+	}
+
+	const struct eval_case_t *c;
+	for (c = eval_cases; c->expr; c++) {
+		struct filter_prog_t p;
+		const char *err = (const char *)NULL;
+		memset(&p, 0, sizeof(struct filter_prog_t));
+
+		if (compile_filter_prog(c->expr, FILTER_EXPR, &p, &err) != 0) {
+			fail("%s: %s", c->expr, err ? err : "compile error");
+			continue;
+		}
+
+		/* Once with file types from readdir(3), once from stat(2) */
+		int use_dtype;
+		for (use_dtype = 0; use_dtype <= 1; use_dtype++) {
+			char got[256];
+			eval_dir(dir, &p, use_dtype, got, sizeof(got));
+			if (strcmp(got, c->matches) != 0)
+				fail("%s: matched '%s'", c->expr, got);
+		}
+
+		free_filter_prog(&p);
+	}
+
+	snprintf(path, sizeof(path), "%s/dir", dir);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/small.txt", dir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/big.txt", dir);
+	unlink(path);
+	rmdir(dir);
+}
+
+int
+main(void)
+{
+	make_names();
+
+	test_literals();
+	test_regexes();
+	test_globs();
+	test_parser();
+	test_eval();
+
+	if (failures > 0) {
+		printf("%d failure(s)\n", failures);
+		return 1;
+	}
+
+	puts("All filter tests passed");
+	return 0;
+}
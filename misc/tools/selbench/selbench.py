@@ -0,0 +1,112 @@
+#!/usr/bin/python3
+# -*- coding: utf-8 -*-
+
+# This file is part of CliFM
+
+""" Selection benchmark for clifm
+
+Generate directories holding N files each, half of them matching '*.o',
+and time, for each N, how long clifm takes to select:
+
+  invert-cwd    's !*.o' run from the directory (the files listing is
+                matched)
+  invert-path   's !*.o :DIR' run from elsewhere (DIR is scanned)
+  regex-path    's .*\\.c$ :DIR' (a regular expression, since no file name
+                matches it as a glob)
+
+Every command selects N/2 files. The time of each is measured from the
+moment the command is sent until clifm reports the total of selected
+files. If selection scales linearly, the time per file (last column)
+stays about the same as N grows.
+
+Usage: selbench.py [CLIFM_BINARY [N...]]
+
+N defaults to 10000 20000 40000 80000. Run it against two builds to
+compare them. Requires pexpect (https://pexpect.readthedocs.io).
+"""
+
+import os
+import shutil
+import sys
+import tempfile
+import time
+
+import pexpect
+
+CLIFM = sys.argv[1] if len(sys.argv) > 1 else 'clifm'
+SIZES = [int(n) for n in sys.argv[2:]] or [10000, 20000, 40000, 80000]
+
+
+def generate(root, n):
+    """ Create ROOT/N holding N empty files: N/2 '*.c' and N/2 '*.o' """
+    path = os.path.join(root, str(n))
+    os.makedirs(path)
+    for i in range(n // 2):
+        for ext in ('.c', '.o'):
+            open(os.path.join(path, 'f%d%s' % (i, ext)), 'w').close()
+    return path
+
+
+def start(root, home):
+    """ Start clifm in ROOT with HOME as home directory """
+    p = pexpect.spawn(CLIFM, ['--no-clear-screen'], cwd=root,
+                      env=dict(os.environ, HOME=home), encoding='utf-8',
+                      timeout=600, dimensions=(50, 160),
+                      searchwindowsize=256)
+    time.sleep(1)
+    return p
+
+
+def timed(p, cmd, expected):
+    """ Run CMD, wait for the selection total, and deselect all files.
+    Return the time taken by CMD, or None if it did not select EXPECTED
+    files """
+    t = time.time()
+    p.sendline(cmd)
+    p.expect(r'(\d+) total selected')
+    elapsed = time.time() - t
+    ok = int(p.match.group(1)) == expected
+
+    p.sendline('ds *')
+    p.expect('total selected')
+    return elapsed if ok else None
+
+
+def main():
+    root = tempfile.mkdtemp(prefix='clifm-selbench.')
+    home = os.path.join(root, 'home')
+    os.makedirs(home)
+    failures = 0
+
+    print('%8s %-12s %10s %14s' % ('Files', 'Command', 'Time (s)',
+                                   'us per file'))
+    try:
+        for n in SIZES:
+            path = generate(root, n)
+            p = start(root, home)
+            for name, setup, cmd in (
+                    ('invert-cwd', 'cd ' + path, 's !*.o'),
+                    ('invert-path', 'cd ' + root, 's !*.o :' + path),
+                    ('regex-path', None, 's .*\\.c$ :' + path)):
+                if setup:
+                    # Let the directory be listed before timing starts
+                    p.sendline(setup)
+                    time.sleep(1 + n / 20000)
+                secs = timed(p, cmd, n // 2)
+                if secs is None:
+                    print('%8d %-12s %10s' % (n, name, 'wrong count'))
+                    failures += 1
+                else:
+                    print('%8d %-12s %10.3f %14.2f' % (n, name, secs,
+                                                       secs * 1e6 / n))
+            p.sendline('q')
+            p.expect(pexpect.EOF)
+            shutil.rmtree(path)
+    finally:
+        shutil.rmtree(root, ignore_errors=True)
+
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
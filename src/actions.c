@@ -37,6 +37,7 @@
 
 #include "aux.h"
 #include "checks.h"
+#include "cursor.h"
 #include "exec.h"
 #include "file_operations.h"
 #include "init.h"
@@ -167,6 +168,8 @@ run_action(char *action, char **args)
 		 * #    4) LET THE PARENT READ THE PIPE   #
 		 * ######################################## */
 
+	invalidate_cursor_model();
+
 	/* Parent: read-only end of the pipe */
 	int rfd;
 
@@ -217,19 +220,22 @@ run_action(char *action, char **args)
 		size_t old_args = args_n;
 		args_n = 0;
 
-		char **_cmd = parse_input_str(buf);
+		char *raw = (char *)NULL;
+		char **_cmd = parse_input_str(buf, &raw);
 		if (_cmd) {
 			size_t i;
-			char **alias_cmd = check_for_alias(_cmd);
+			char **alias_cmd = check_for_alias(_cmd, &raw);
 			if (alias_cmd) {
-				exit_status = exec_cmd(alias_cmd);
+				exit_status = exec_cmd(alias_cmd, raw);
+				free(raw);
 				for (i = 0; alias_cmd[i]; i++)
 					free(alias_cmd[i]);
 				free(alias_cmd);
 			} else {
 				if (!(flags & FAILED_ALIAS))
-					exit_status = exec_cmd(_cmd);
+					exit_status = exec_cmd(_cmd, raw);
 				flags &= ~FAILED_ALIAS;
+				free(raw);
 				for (i = 0; i <= args_n; i++)
 					free(_cmd[i]);
 				free(_cmd);
@@ -297,13 +303,7 @@ edit_actions(char *app)
 		return EXIT_FAILURE;
 
 	/* Reload PATH commands as well to add new action(s) */
-	if (bin_commands) {
-		size_t i;
-		for (i = 0; bin_commands[i]; i++)
-			free(bin_commands[i]);
-		free(bin_commands);
-		bin_commands = (char **)NULL;
-	}
+	free_bin_commands();
 
 	if (paths) {
 		size_t i;
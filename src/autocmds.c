@@ -26,7 +26,7 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <glob.h>
+#include <regex.h>
 #include <readline/tilde.h>
 #include <limits.h>
 
@@ -52,147 +52,528 @@ reset_opts(void)
 	opts.sort_reverse = conf.sort_reverse;
 }
 
-/* Run autocommands for the current directory */
-int
-check_autocmds(void)
+/* Autocommand patterns are compiled only once, the first time they are
+ * needed after being loaded (see compile_autocmds()), into:
+ * 1. A byte trie holding the literal prefix of "PREFIX/\**" patterns.
+ * 2. A hash table holding literal (non-glob) patterns.
+ * 3. A list of pre-built regular expressions for everything else
+ * (glob and negated patterns).
+ * Finding the autocommand for a directory is then a trie walk plus a hash
+ * lookup, and regexes are only run if they precede (in the config file)
+ * the best match found so far. */
+
+#define AC_NONE ((size_t)-1)
+#define AC_WS_SLOTS 10 /* @wsN, where N is a single digit */
+
+struct ac_trie_t {
+	struct ac_trie_t *child; /* First child */
+	struct ac_trie_t *next;  /* Next sibling */
+	size_t index; /* Lowest autocmd index for the prefix ending here */
+	char c;
+	char pad[7];
+};
+
+struct ac_exact_t {
+	char *path;
+	size_t index;
+	uint32_t hash;
+	int pad;
+};
+
+struct ac_match_t {
+	regex_t regex;
+	char *str;    /* Literal pattern, used if there is no regex */
+	size_t index;
+	int negate;   /* The pattern starts with '!' */
+	int regex_ok; /* REGEX was successfully compiled */
+};
+
+static struct ac_index_t {
+	struct ac_trie_t *trie;
+	struct ac_exact_t *exact;
+	struct ac_match_t *match;
+	size_t exact_size; /* Amount of slots (a power of two) */
+	size_t match_n;
+	size_t ws[AC_WS_SLOTS];
+	int ready;
+	int pad;
+} ac_index;
+
+static void
+free_ac_trie(struct ac_trie_t *node)
 {
-	if (!autocmds || autocmds_n == 0)
-		return EXIT_SUCCESS;
+	while (node) {
+		struct ac_trie_t *next = node->next;
+		free_ac_trie(node->child);
+		free(node);
+		node = next;
+	}
+}
 
+/* Free the compiled version of autocommand patterns. They will be
+ * recompiled the next time they are needed */
+void
+free_autocmd_patterns(void)
+{
 	size_t i;
-	int found = 0;
 
-	for (i = 0; i < autocmds_n; i++) {
-		if (!autocmds[i].pattern)
-			continue;
+	free_ac_trie(ac_index.trie);
 
-		int rev = 0;
-		char *p = autocmds[i].pattern;
-		if (*p == '!') {
-			++p;
-			rev = 1;
-		}
+	for (i = 0; i < ac_index.exact_size; i++)
+		free(ac_index.exact[i].path);
+	free(ac_index.exact);
 
-		/* Check workspaces (@wsN)*/
-		if (*autocmds[i].pattern == '@' && autocmds[i].pattern[1] == 'w'
-		&& autocmds[i].pattern[2] == 's' && autocmds[i].pattern[3]
-		/* char '1' - 48 (or '0') == int 1 */
-		&& autocmds[i].pattern[3] - 48 == cur_ws + 1) {
-			found = 1;
-			goto RUN_AUTOCMD;
+	for (i = 0; i < ac_index.match_n; i++) {
+		free(ac_index.match[i].str);
+		if (ac_index.match[i].regex_ok == 1)
+			regfree(&ac_index.match[i].regex);
+	}
+	free(ac_index.match);
+
+	memset(&ac_index, 0, sizeof(struct ac_index_t));
+}
+
+static struct ac_trie_t *
+new_ac_trie_node(const char c)
+{
+	struct ac_trie_t *node = (struct ac_trie_t *)xcalloc(1,
+		sizeof(struct ac_trie_t));
+	node->c = c;
+	node->index = AC_NONE;
+	return node;
+}
+
+static void
+add_ac_prefix(const char *prefix, const size_t index)
+{
+	if (!ac_index.trie)
+		ac_index.trie = new_ac_trie_node(0);
+
+	struct ac_trie_t *node = ac_index.trie;
+	const char *p = prefix;
+
+	for (; *p; p++) {
+		struct ac_trie_t *child = node->child;
+		while (child && child->c != *p)
+			child = child->next;
+
+		if (!child) {
+			child = new_ac_trie_node(*p);
+			child->next = node->child;
+			node->child = child;
 		}
 
-		/* Double asterisk: match everything starting with PATTERN
-		 * (less double asterisk itself and ending slash)*/
-		size_t plen = strlen(p), n = 0;
-		if (!rev && plen >= 3 && p[plen - 1] == '*' && p[plen - 2] == '*') {
-			n = 2;
-			if (p[plen - 3] == '/')
-				n++;
-			if (*p == '~') {
-				p[plen - n] = '\0';
-				char *path = tilde_expand(p);
-				if (!path)
-					continue;
-				p[plen - n] = (n == 2 ? '*' : '/');
-				size_t tlen = strlen(path);
-				int ret = strncmp(path, workspaces[cur_ws].path, tlen);
-				free(path);
-				if (ret == 0) {
-					found = 1;
-					goto RUN_AUTOCMD;
-				}
-			} else { /* We have an absolute path */
-				/* If (plen - n) == 0 we have "/\**", that is, match everything:
-				 * no need to perform any check. */
-				if (plen - n == 0
-				|| strncmp(autocmds[i].pattern, workspaces[cur_ws].path, plen - n) == 0) {
-					found = 1;
-					goto RUN_AUTOCMD;
-				}
-			}
+		node = child;
+	}
+
+	if (node->index == AC_NONE)
+		node->index = index;
+}
+
+/* Return the lowest autocmd index among prefixes of PATH, or AC_NONE */
+static size_t
+find_ac_prefix(const char *path)
+{
+	struct ac_trie_t *node = ac_index.trie;
+	if (!node)
+		return AC_NONE;
+
+	size_t best = node->index;
+	const char *p = path;
+
+	for (; *p; p++) {
+		node = node->child;
+		while (node && node->c != *p)
+			node = node->next;
+
+		if (!node)
+			break;
+
+		if (node->index < best)
+			best = node->index;
+	}
+
+	return best;
+}
+
+static void
+add_ac_exact(char *path, const size_t index)
+{
+	const uint32_t hash = hashme32(path, HASH_SEED);
+	size_t mask = ac_index.exact_size - 1;
+	size_t slot = (size_t)hash & mask;
+
+	while (ac_index.exact[slot].path) {
+		if (ac_index.exact[slot].hash == hash
+		&& strcmp(ac_index.exact[slot].path, path) == 0) {
+			/* Only the first autocommand for a path can be run */
+			free(path);
+			return;
 		}
+		slot = (slot + 1) & mask;
+	}
 
-		/* Glob expression or plain text for PATTERN */
-		glob_t g;
-		int ret = glob(p, GLOB_NOSORT | GLOB_NOCHECK | GLOB_TILDE | GLOB_BRACE, NULL, &g);
+	ac_index.exact[slot].path = path;
+	ac_index.exact[slot].hash = hash;
+	ac_index.exact[slot].index = index;
+}
 
-		if (ret != EXIT_SUCCESS) {
-			globfree(&g);
-			continue;
+static size_t
+find_ac_exact(const char *path)
+{
+	if (ac_index.exact_size == 0)
+		return AC_NONE;
+
+	const uint32_t hash = hashme32(path, HASH_SEED);
+	size_t mask = ac_index.exact_size - 1;
+	size_t slot = (size_t)hash & mask;
+
+	while (ac_index.exact[slot].path) {
+		if (ac_index.exact[slot].hash == hash
+		&& strcmp(ac_index.exact[slot].path, path) == 0)
+			return ac_index.exact[slot].index;
+		slot = (slot + 1) & mask;
+	}
+
+	return AC_NONE;
+}
+
+static int
+is_glob_pattern(const char *str)
+{
+	return (strpbrk(str, "*?[{\\") != NULL);
+}
+
+/* Return 1 if the brace expression starting at STR (pointing to '{')
+ * has a matching closing brace and at least one comma, in which case
+ * glob(3) would expand it. Otherwise, return 0 */
+static int
+is_brace_group(const char *str)
+{
+	int depth = 0, comma = 0;
+	const char *p = str;
+
+	for (; *p; p++) {
+		if (*p == '\\' && p[1]) {
+			p++;
+		} else if (*p == '{') {
+			depth++;
+		} else if (*p == '}') {
+			if (--depth == 0)
+				return comma;
+		} else if (*p == ',' && depth == 1) {
+			comma = 1;
 		}
+	}
+
+	return 0;
+}
+
+/* Translate the glob expression PATTERN (as understood by glob(3) with
+ * GLOB_BRACE) into an anchored extended regular expression.
+ * As glob(3) does, wildcards at the beginning of a path component do not
+ * match a leading dot. Returns a malloc'ed string */
+static char *
+glob_to_regex(const char *pattern)
+{
+	/* Each char takes at most 13 bytes ("([^./][^/]*)?"), plus "^$" */
+	char *buf = (char *)xnmalloc((strlen(pattern) * 13) + 3, sizeof(char));
+	const char *p = pattern;
+	size_t len = 0;
+	int comp_start = 1, braces = 0;
+
+	buf[len++] = '^';
+
+	for (; *p; p++) {
+		int c = (int)*p;
+		int at_start = comp_start;
+		comp_start = (c == '/');
+
+		switch (c) {
+		case '*':
+			if (at_start == 1) {
+				memcpy(buf + len, "([^./][^/]*)?", 13); len += 13;
+			} else {
+				memcpy(buf + len, "[^/]*", 5); len += 5;
+			}
+			break;
 
-		size_t j;
-		for (j = 0; j < g.gl_pathc; j++) {
-			if (*workspaces[cur_ws].path == *g.gl_pathv[j]
-			&& strcmp(workspaces[cur_ws].path, g.gl_pathv[j]) == 0) {
-				found = 1;
+		case '?':
+			if (at_start == 1) {
+				memcpy(buf + len, "[^./]", 5); len += 5;
+			} else {
+				memcpy(buf + len, "[^/]", 4); len += 4;
+			}
+			break;
+
+		case '[': {
+			const char *q = p + 1;
+			if (*q == '!' || *q == '^')
+				q++;
+			if (*q == ']')
+				q++;
+			q = strchr(q, ']');
+			if (!q) {
+				buf[len++] = '\\'; buf[len++] = '[';
 				break;
 			}
-		}
-		globfree(&g);
 
-		if (rev == 0) {
-			if (found == 0)
-				continue;
-		} else if (found == 1) {
-			continue;
+			buf[len++] = '[';
+			p++;
+			if (*p == '!' || *p == '^') {
+				buf[len++] = '^';
+				p++;
+			}
+			while (p < q)
+				buf[len++] = *p++;
+			buf[len++] = ']';
+			}
+			break;
+
+		case '{':
+			if (is_brace_group(p) == 1) {
+				braces++;
+				buf[len++] = '(';
+			} else {
+				buf[len++] = '\\'; buf[len++] = '{';
+			}
+			break;
+
+		case ',':
+			buf[len++] = braces > 0 ? '|' : ',';
+			break;
+
+		case '}':
+			if (braces > 0) {
+				braces--;
+				buf[len++] = ')';
+			} else {
+				buf[len++] = '\\'; buf[len++] = '}';
+			}
+			break;
+
+		case '\\':
+			if (!p[1])
+				break;
+			p++;
+			c = (int)*p;
+			/* fallthrough */
+		default:
+			if (strchr(".^$+()|{}[]\\", c))
+				buf[len++] = '\\';
+			buf[len++] = (char)c;
+			break;
 		}
+	}
+
+	buf[len++] = '$';
+	buf[len] = '\0';
+
+	return buf;
+}
+
+/* Return a malloc'ed copy of STR with a leading tilde expanded */
+static char *
+expand_ac_tilde(const char *str)
+{
+	if (*str == '~') {
+		char *p = tilde_expand(str);
+		if (p)
+			return p;
+	}
 
-RUN_AUTOCMD:
-		if (autocmd_set == 0) {
-			/* Backup current options, only if there was no autocmd for
-			 * this directory */
-			opts.light_mode = conf.light_mode;
-			opts.files_counter = conf.files_counter;
-			opts.long_view = conf.long_view;
-			opts.max_files = max_files;
-			opts.show_hidden = conf.show_hidden;
-			opts.sort = conf.sort;
-			opts.sort_reverse = conf.sort_reverse;
-			opts.max_name_len = conf.max_name_len;
-			opts.pager = conf.pager;
-			opts.only_dirs = conf.only_dirs;
-			if (autocmds[i].color_scheme && cur_cscheme)
-				opts.color_scheme = cur_cscheme;
-			else
-				opts.color_scheme = (char *)NULL;
-			autocmd_set = 1;
+	return savestring(str, strlen(str));
+}
+
+static void
+add_ac_match(const char *pattern, const size_t index, const int negate)
+{
+	ac_index.match = (struct ac_match_t *)xrealloc(ac_index.match,
+		(ac_index.match_n + 1) * sizeof(struct ac_match_t));
+
+	struct ac_match_t *m = &ac_index.match[ac_index.match_n];
+	memset(m, 0, sizeof(struct ac_match_t));
+	m->index = index;
+	m->negate = negate;
+	m->str = expand_ac_tilde(pattern);
+
+	if (is_glob_pattern(m->str)) {
+		char *re = glob_to_regex(m->str);
+		m->regex_ok = regcomp(&m->regex, re, REG_EXTENDED | REG_NOSUB) == 0;
+		free(re);
+	}
+
+	ac_index.match_n++;
+}
+
+/* Compile the pattern of the autocommand at index I */
+static void
+compile_autocmd(const size_t i)
+{
+	char *pattern = autocmds[i].pattern;
+	if (!pattern || !*pattern)
+		return;
+
+	/* Workspaces (@wsN) */
+	if (*pattern == '@' && pattern[1] == 'w' && pattern[2] == 's'
+	&& pattern[3]) {
+		/* char '1' - 48 (or '0') == int 1 */
+		int n = pattern[3] - 48;
+		if (n > 0 && n < AC_WS_SLOTS && ac_index.ws[n] == AC_NONE)
+			ac_index.ws[n] = i;
+		return;
+	}
+
+	if (*pattern == '!') {
+		add_ac_match(pattern + 1, i, 1);
+		return;
+	}
+
+	/* Double asterisk: match everything starting with PATTERN
+	 * (less double asterisk itself and ending slash) */
+	size_t plen = strlen(pattern);
+	if (plen >= 3 && pattern[plen - 1] == '*' && pattern[plen - 2] == '*') {
+		size_t n = pattern[plen - 3] == '/' ? 3 : 2;
+		char c = pattern[plen - n];
+		pattern[plen - n] = '\0';
+
+		if (!is_glob_pattern(pattern)) {
+			char *prefix = expand_ac_tilde(pattern);
+			pattern[plen - n] = c;
+			add_ac_prefix(prefix, i);
+			free(prefix);
+			return;
 		}
 
-		/* Set options for current directory */
-		if (autocmds[i].light_mode != -1)
-			conf.light_mode = autocmds[i].light_mode;
-		if (autocmds[i].files_counter != -1)
-			conf.files_counter = autocmds[i].files_counter;
-		if (autocmds[i].long_view != -1)
-			conf.long_view = autocmds[i].long_view;
-		if (autocmds[i].show_hidden != -1)
-			conf.show_hidden = autocmds[i].show_hidden;
-		if (autocmds[i].only_dirs != -1)
-			conf.only_dirs = autocmds[i].only_dirs;
-		if (autocmds[i].pager != -1)
-			conf.pager = autocmds[i].pager;
-		if (autocmds[i].sort != -1)
-			conf.sort = autocmds[i].sort;
-		if (autocmds[i].sort_reverse != -1)
-			conf.sort_reverse = autocmds[i].sort_reverse;
-		if (autocmds[i].max_name_len != -1)
-			conf.max_name_len = autocmds[i].max_name_len;
-		if (autocmds[i].max_files != -2)
-			max_files = autocmds[i].max_files;
-		if (autocmds[i].color_scheme)
-			set_colors(autocmds[i].color_scheme, 0);
-		if (autocmds[i].cmd) {
-			if (xargs.secure_cmds == 0
-			|| sanitize_cmd(autocmds[i].cmd, SNT_AUTOCMD) == EXIT_SUCCESS)
-				launch_execle(autocmds[i].cmd);
+		pattern[plen - n] = c;
+	}
+
+	if (is_glob_pattern(pattern)) {
+		add_ac_match(pattern, i, 0);
+		return;
+	}
+
+	add_ac_exact(expand_ac_tilde(pattern), i);
+}
+
+static void
+compile_autocmds(void)
+{
+	size_t i;
+
+	free_autocmd_patterns();
+
+	for (i = 0; i < AC_WS_SLOTS; i++)
+		ac_index.ws[i] = AC_NONE;
+
+	ac_index.exact_size = 16;
+	while (ac_index.exact_size < autocmds_n * 2)
+		ac_index.exact_size <<= 1;
+	ac_index.exact = (struct ac_exact_t *)xcalloc(ac_index.exact_size,
+		sizeof(struct ac_exact_t));
+
+	for (i = 0; i < autocmds_n; i++)
+		compile_autocmd(i);
+
+	ac_index.ready = 1;
+}
+
+/* Return the index of the first autocommand (in the config file) whose
+ * pattern matches the directory PATH, or AC_NONE */
+static size_t
+find_autocmd(const char *path)
+{
+	size_t best = AC_NONE, n;
+
+	if (cur_ws + 1 < AC_WS_SLOTS)
+		best = ac_index.ws[cur_ws + 1];
+
+	if ((n = find_ac_prefix(path)) < best)
+		best = n;
+	if ((n = find_ac_exact(path)) < best)
+		best = n;
+
+	/* Match entries are sorted by index */
+	size_t i;
+	for (i = 0; i < ac_index.match_n && ac_index.match[i].index < best; i++) {
+		struct ac_match_t *m = &ac_index.match[i];
+		int found = m->regex_ok == 1
+			? regexec(&m->regex, path, 0, NULL, 0) == 0
+			: strcmp(m->str, path) == 0;
+
+		if (found != m->negate) {
+			best = m->index;
+			break;
 		}
+	}
+
+	return best;
+}
 
-		break;
+/* Run autocommands for the current directory */
+int
+check_autocmds(void)
+{
+	if (!autocmds || autocmds_n == 0 || !workspaces[cur_ws].path)
+		return EXIT_SUCCESS;
+
+	if (ac_index.ready == 0)
+		compile_autocmds();
+
+	size_t i = find_autocmd(workspaces[cur_ws].path);
+	if (i == AC_NONE)
+		return 0;
+
+	if (autocmd_set == 0) {
+		/* Backup current options, only if there was no autocmd for
+		 * this directory */
+		opts.light_mode = conf.light_mode;
+		opts.files_counter = conf.files_counter;
+		opts.long_view = conf.long_view;
+		opts.max_files = max_files;
+		opts.show_hidden = conf.show_hidden;
+		opts.sort = conf.sort;
+		opts.sort_reverse = conf.sort_reverse;
+		opts.max_name_len = conf.max_name_len;
+		opts.pager = conf.pager;
+		opts.only_dirs = conf.only_dirs;
+		if (autocmds[i].color_scheme && cur_cscheme)
+			opts.color_scheme = cur_cscheme;
+		else
+			opts.color_scheme = (char *)NULL;
+		autocmd_set = 1;
+	}
+
+	/* Set options for current directory */
+	if (autocmds[i].light_mode != -1)
+		conf.light_mode = autocmds[i].light_mode;
+	if (autocmds[i].files_counter != -1)
+		conf.files_counter = autocmds[i].files_counter;
+	if (autocmds[i].long_view != -1)
+		conf.long_view = autocmds[i].long_view;
+	if (autocmds[i].show_hidden != -1)
+		conf.show_hidden = autocmds[i].show_hidden;
+	if (autocmds[i].only_dirs != -1)
+		conf.only_dirs = autocmds[i].only_dirs;
+	if (autocmds[i].pager != -1)
+		conf.pager = autocmds[i].pager;
+	if (autocmds[i].sort != -1)
+		conf.sort = autocmds[i].sort;
+	if (autocmds[i].sort_reverse != -1)
+		conf.sort_reverse = autocmds[i].sort_reverse;
+	if (autocmds[i].max_name_len != -1)
+		conf.max_name_len = autocmds[i].max_name_len;
+	if (autocmds[i].max_files != -2)
+		max_files = autocmds[i].max_files;
+	if (autocmds[i].color_scheme)
+		set_colors(autocmds[i].color_scheme, 0);
+	if (autocmds[i].cmd) {
+		if (xargs.secure_cmds == 0
+		|| sanitize_cmd(autocmds[i].cmd, SNT_AUTOCMD) == EXIT_SUCCESS)
+			launch_execle(autocmds[i].cmd);
 	}
 
-	return found;
+	return 1;
 }
 
 /* Revert back to options previous to autocommand */
@@ -316,6 +697,10 @@ parse_autocmd_line(char *cmd)
 
 	*p = '\0';
 
+	/* Patterns are recompiled the next time they are needed */
+	if (ac_index.ready == 1)
+		free_autocmd_patterns();
+
 	autocmds = (struct autocmds_t *)xrealloc(autocmds,
 			(autocmds_n + 1) * sizeof(struct autocmds_t));
 	autocmds[autocmds_n].pattern = savestring(cmd, strlen(cmd));
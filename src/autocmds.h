@@ -29,6 +29,7 @@ __BEGIN_DECLS
 void parse_autocmd_line(char *);
 void reset_opts(void);
 int  check_autocmds(void);
+void free_autocmd_patterns(void);
 void revert_autocmd_opts(void);
 
 __END_DECLS
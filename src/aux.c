@@ -41,6 +41,7 @@
 #include <time.h>
 #include <limits.h>
 #include <readline/readline.h>
+#include <signal.h>
 
 #include "aux.h"
 #include "exec.h"
@@ -742,8 +743,250 @@ count_dir(const char *dir, int pop)
 	return (int)c;
 }
 
+/* Murmur One Byte At A Time 32 bit hashing algorithm
+ * Source: https://github.com/aappleby/smhasher/blob/master/src/Hashes.cpp */
+uint32_t
+hashme32(const char *str, const uint32_t seed)
+{
+	uint32_t h = seed;
+	for (; *str; ++str) {
+		h ^= (uint32_t)*str;
+		h *= 0x5bd1e995;
+		h ^= h >> 15;
+	}
+	return h;
+}
+
+/* Initialize the string set SET to hold about N strings */
+void
+strset_init(struct strset_t *set, const size_t n)
+{
+	/* Keep the load factor below 1/2 */
+	set->size = 16;
+	while (set->size < n * 2)
+		set->size <<= 1;
+
+	set->slots = (const char **)xcalloc(set->size, sizeof(char *));
+	set->hashes = (uint32_t *)xnmalloc(set->size, sizeof(uint32_t));
+	set->n = 0;
+}
+
+void
+strset_free(struct strset_t *set)
+{
+	free(set->slots);
+	free(set->hashes);
+	set->slots = (const char **)NULL;
+	set->hashes = (uint32_t *)NULL;
+	set->size = set->n = 0;
+}
+
+/* Return the slot holding STR (hashed as H) in SET, or the empty slot
+ * where it should go */
+static size_t
+strset_find(const struct strset_t *set, const char *str, const uint32_t h)
+{
+	const size_t mask = set->size - 1;
+	size_t i = (size_t)h & mask;
+
+	while (set->slots[i] && (set->hashes[i] != h
+	|| strcmp(set->slots[i], str) != 0))
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+/* Add STR to SET. Returns 1 if it was added or 0 if already there */
+int
+strset_add(struct strset_t *set, const char *str)
+{
+	if ((set->n + 1) * 2 > set->size) {
+		struct strset_t new_set;
+		strset_init(&new_set, set->n + 1);
+
+		size_t i;
+		for (i = 0; i < set->size; i++) {
+			if (!set->slots[i])
+				continue;
+			const size_t j = strset_find(&new_set, set->slots[i],
+				set->hashes[i]);
+			new_set.slots[j] = set->slots[i];
+			new_set.hashes[j] = set->hashes[i];
+		}
+
+		new_set.n = set->n;
+		strset_free(set);
+		*set = new_set;
+	}
+
+	const uint32_t h = hashme32(str, HASH_SEED);
+	const size_t i = strset_find(set, str, h);
+	if (set->slots[i])
+		return 0;
+
+	set->slots[i] = str;
+	set->hashes[i] = h;
+	set->n++;
+	return 1;
+}
+
+int
+strset_has(const struct strset_t *set, const char *str)
+{
+	if (set->size == 0)
+		return 0;
+
+	const size_t i = strset_find(set, str, hashme32(str, HASH_SEED));
+	return set->slots[i] ? 1 : 0;
+}
+
+/* Cache of resolved command paths used by get_cmd_path(). Both positive
+ * (the directory in PATH where the command was found) and negative (the
+ * command was not found) results are stored.
+ * An entry found in paths[n] is valid as long as neither paths[n] nor any
+ * directory before it in PATH changed (a new program could shadow it). A
+ * negative entry is dropped whenever any directory in PATH changes */
+#define CMD_CACHE_BUCKETS 256 /* Must be a power of two */
+#define CMD_NOT_FOUND     -1
+
+struct cmd_cache_t {
+	char *name;
+	char *path; /* NULL if the command was not found */
+	struct cmd_cache_t *next;
+	uint32_t hash;
+	int dir; /* Index in PATH where NAME was found (or CMD_NOT_FOUND) */
+};
+
+static struct cmd_cache_t *cmd_cache[CMD_CACHE_BUCKETS];
+static time_t *cmd_cache_mtimes = (time_t *)NULL; /* mtime for each path in PATH */
+static size_t cmd_cache_dirs = 0;
+static uint32_t cmd_cache_paths_hash = 0; /* Identifies the current PATH */
+static uint32_t cmd_cache_gen = 1; /* Increased whenever entries are dropped */
+static time_t cmd_cache_check = 0; /* Last time PATH was checked */
+
+/* Drop all entries found in the directory number DIR in PATH or after it,
+ * plus all negative entries. If DIR is zero, the cache is flushed */
+static void
+drop_cmd_cache_entries(const int dir)
+{
+	size_t i;
+	for (i = 0; i < CMD_CACHE_BUCKETS; i++) {
+		struct cmd_cache_t **e = &cmd_cache[i];
+		while (*e) {
+			if ((*e)->dir != CMD_NOT_FOUND && (*e)->dir < dir) {
+				e = &(*e)->next;
+				continue;
+			}
+
+			struct cmd_cache_t *t = *e;
+			*e = t->next;
+			free(t->name);
+			free(t->path);
+			free(t);
+		}
+	}
+
+	cmd_cache_gen++;
+}
+
+/* Check the modification time of each directory in PATH (at most once per
+ * second), and drop entries that may no longer be valid */
+static void
+check_cmd_cache(void)
+{
+	time_t now = time(NULL);
+	if (now == cmd_cache_check && cmd_cache_mtimes)
+		return;
+
+	cmd_cache_check = now;
+
+	size_t i;
+	uint32_t h = HASH_SEED;
+	for (i = 0; i < path_n; i++) {
+		if (paths[i].path)
+			h = (h * 31) ^ hashme32(paths[i].path, HASH_SEED);
+	}
+
+	/* PATH itself changed: rebuild everything */
+	if (h != cmd_cache_paths_hash || path_n != cmd_cache_dirs) {
+		drop_cmd_cache_entries(0);
+		cmd_cache_paths_hash = h;
+		cmd_cache_dirs = path_n;
+		free(cmd_cache_mtimes);
+		cmd_cache_mtimes = (time_t *)xnmalloc(path_n + 1, sizeof(time_t));
+		for (i = 0; i < path_n; i++) {
+			struct stat a;
+			cmd_cache_mtimes[i] = (paths[i].path
+				&& stat(paths[i].path, &a) != -1) ? a.st_mtime : 0;
+		}
+		return;
+	}
+
+	int first_changed = -1;
+	for (i = 0; i < path_n; i++) {
+		struct stat a;
+		time_t t = (paths[i].path && stat(paths[i].path, &a) != -1)
+			? a.st_mtime : 0;
+		if (t == cmd_cache_mtimes[i])
+			continue;
+
+		cmd_cache_mtimes[i] = t;
+		if (first_changed == -1)
+			first_changed = (int)i;
+	}
+
+	if (first_changed != -1)
+		drop_cmd_cache_entries(first_changed);
+}
+
+/* Return a value identifying the current state of the command path cache.
+ * The value changes whenever a cached result is invalidated, so that
+ * callers caching their own data based on get_cmd_path() know when to
+ * discard it */
+uint32_t
+get_cmd_path_stamp(void)
+{
+	check_cmd_cache();
+	return cmd_cache_gen;
+}
+
+/* Free the command path cache */
+void
+free_cmd_path_cache(void)
+{
+	drop_cmd_cache_entries(0);
+	free(cmd_cache_mtimes);
+	cmd_cache_mtimes = (time_t *)NULL;
+	cmd_cache_dirs = 0;
+	cmd_cache_paths_hash = 0;
+}
+
+/* Search for the command CMD in PATH. Return a newly allocated string
+ * with the absolute path of CMD, storing the index of the corresponding
+ * directory in PATH in DIR, or NULL if not found */
+static char *
+search_cmd_path(const char *cmd, int *dir)
+{
+	char *cmd_path = (char *)xnmalloc(PATH_MAX + 1, sizeof(char));
+
+	size_t i;
+	for (i = 0; i < path_n; i++) { /* Check each path in PATH */
+	/* Append cmd to each path and check if it exists and is executable */
+		snprintf(cmd_path, PATH_MAX, "%s/%s", paths[i].path, cmd); /* NOLINT */
+		if (access(cmd_path, X_OK) == 0) {
+			*dir = (int)i;
+			return cmd_path;
+		}
+	}
+
+	*dir = CMD_NOT_FOUND;
+	free(cmd_path);
+	return (char *)NULL;
+}
+
 /* Get the path of a given command from the PATH environment variable.
- * It basically does the same as the 'which' Unix command */
+ * It basically does the same as the 'which' Unix command.
+ * Results (even negative ones) are cached: see check_cmd_cache() */
 char *
 get_cmd_path(const char *cmd)
 {
@@ -759,6 +1002,7 @@ get_cmd_path(const char *cmd)
 		char *p = tilde_expand(cmd);
 		if (p && access(p, X_OK) == 0)
 			cmd_path = savestring(p, strlen(p));
+		free(p);
 		return cmd_path;
 	}
 
@@ -768,29 +1012,45 @@ get_cmd_path(const char *cmd)
 		return cmd_path;
 	}
 
-	cmd_path = (char *)xnmalloc(PATH_MAX + 1, sizeof(char));
+	check_cmd_cache();
 
-	size_t i;
-	for (i = 0; i < path_n; i++) { /* Check each path in PATH */
-	/* Append cmd to each path and check if it exists and is executable */
-		snprintf(cmd_path, PATH_MAX, "%s/%s", paths[i].path, cmd); /* NOLINT */
-		if (access(cmd_path, X_OK) == 0)
-			return cmd_path;
+	uint32_t h = hashme32(cmd, HASH_SEED);
+	struct cmd_cache_t *e = cmd_cache[h & (CMD_CACHE_BUCKETS - 1)];
+
+	for (; e; e = e->next) {
+		if (e->hash != h || *e->name != *cmd || strcmp(e->name, cmd) != 0)
+			continue;
+
+		if (!e->path) {
+			errno = ENOENT;
+			return (char *)NULL;
+		}
+
+		return savestring(e->path, strlen(e->path));
 	}
 
-	errno = ENOENT;
-	free(cmd_path);
-	return (char *)NULL;
+	int dir = CMD_NOT_FOUND;
+	cmd_path = search_cmd_path(cmd, &dir);
+
+	e = (struct cmd_cache_t *)xnmalloc(1, sizeof(struct cmd_cache_t));
+	e->name = savestring(cmd, strlen(cmd));
+	e->path = cmd_path ? savestring(cmd_path, strlen(cmd_path)) : (char *)NULL;
+	e->hash = h;
+	e->dir = dir;
+	e->next = cmd_cache[h & (CMD_CACHE_BUCKETS - 1)];
+	cmd_cache[h & (CMD_CACHE_BUCKETS - 1)] = e;
+
+	if (!cmd_path)
+		errno = ENOENT;
+
+	return cmd_path;
 }
 
-/* Convert SIZE to human readeable form (at most 2 decimal places)
- * Returns a string of at most MAX_UNIT_SIZE, defined in aux.h */
-char *
-get_size_unit(off_t size)
+/* Convert SIZE to human readeable form (at most 2 decimal places) and
+ * write it into STR, which must be at least MAX_UNIT_SIZE bytes long */
+void
+construct_human_size(const off_t size, char *str)
 {
-	/* MAX_UNIT_SIZE == 10 == "1023.99YB\0" */
-	char *str = xnmalloc(MAX_UNIT_SIZE, sizeof(char));
-
 	float base = xargs.si == 1 ? 1000 : 1024;
 
 	size_t n = 0;
@@ -813,10 +1073,505 @@ get_size_unit(off_t size)
 		(double)s,
 		u[n],
 		(u[n] != 'B' && xargs.si == 1) ? 'B' : 0);
+}
 
+/* Convert SIZE to human readeable form (at most 2 decimal places)
+ * Returns a string of at most MAX_UNIT_SIZE, defined in aux.h */
+char *
+get_size_unit(off_t size)
+{
+	/* MAX_UNIT_SIZE == 10 == "1023.99YB\0" */
+	char *str = xnmalloc(MAX_UNIT_SIZE, sizeof(char));
+	construct_human_size(size, str);
 	return str;
 }
 
+void
+inode_set_init(struct inode_set_t *s, const size_t val_size)
+{
+	memset(s, 0, sizeof(struct inode_set_t));
+	s->val_size = val_size;
+}
+
+void
+inode_set_free(struct inode_set_t *s)
+{
+	free(s->devs);
+	free(s->inos);
+	free(s->vals);
+	inode_set_init(s, s->val_size);
+}
+
+/* Return the slot for DEV:INO in S, either the one holding it or the
+ * empty one where it should be stored. S->SIZE must not be zero */
+static size_t
+inode_set_slot(const struct inode_set_t *s, const dev_t dev, const ino_t ino)
+{
+	const size_t mask = s->size - 1;
+	size_t i = (size_t)(((uint64_t)ino * 0x9e3779b97f4a7c15ULL)
+		^ (uint64_t)dev) & mask;
+
+	while (s->inos[i] != 0 && (s->inos[i] != ino || s->devs[i] != dev))
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+/* Return a pointer to the data of the file DEV:INO in S, or NULL if
+ * the file is not in S (or S carries no data) */
+void *
+inode_set_find(const struct inode_set_t *s, const dev_t dev, const ino_t ino)
+{
+	if (s->size == 0 || s->val_size == 0)
+		return NULL;
+
+	const size_t i = inode_set_slot(s, dev, ino);
+	return s->inos[i] != 0 ? s->vals + (i * s->val_size) : NULL;
+}
+
+/* Add the file DEV:INO to S, if not already there, and return a pointer
+ * to its data (zeroed for a new file), valid until the next file is
+ * added. ADDED, if not NULL, is set to 1 if the file was added or to 0
+ * if it was already there */
+void *
+inode_set_get(struct inode_set_t *s, const dev_t dev, const ino_t ino,
+	int *added)
+{
+	size_t i;
+
+	if ((s->n + 1) * 2 > s->size) {
+		struct inode_set_t new_set;
+		inode_set_init(&new_set, s->val_size);
+		new_set.size = s->size == 0 ? 64 : s->size * 2;
+		new_set.devs = (dev_t *)xnmalloc(new_set.size, sizeof(dev_t));
+		new_set.inos = (ino_t *)xcalloc(new_set.size, sizeof(ino_t));
+		if (s->val_size > 0)
+			new_set.vals = (char *)xcalloc(new_set.size, s->val_size);
+
+		for (i = 0; i < s->size; i++) {
+			if (s->inos[i] == 0)
+				continue;
+			const size_t j = inode_set_slot(&new_set, s->devs[i], s->inos[i]);
+			new_set.devs[j] = s->devs[i];
+			new_set.inos[j] = s->inos[i];
+			if (s->val_size > 0)
+				memcpy(new_set.vals + (j * s->val_size),
+					s->vals + (i * s->val_size), s->val_size);
+			new_set.n++;
+		}
+
+		free(s->devs);
+		free(s->inos);
+		free(s->vals);
+		*s = new_set;
+	}
+
+	i = inode_set_slot(s, dev, ino);
+	if (added)
+		*added = (s->inos[i] == 0);
+
+	if (s->inos[i] == 0) {
+		s->devs[i] = dev;
+		s->inos[i] = ino;
+		s->n++;
+	}
+
+	return s->val_size > 0 ? s->vals + (i * s->val_size) : NULL;
+}
+
+/* Return 1 if the file DEV:INO is in the set S, or 0 otherwise */
+int
+inode_set_has(const struct inode_set_t *s, const dev_t dev, const ino_t ino)
+{
+	return (s->size > 0 && s->inos[inode_set_slot(s, dev, ino)] != 0);
+}
+
+/* Add the file DEV:INO to the set S. Returns 1 if it was added, or 0
+ * if it was already there */
+int
+inode_set_add(struct inode_set_t *s, const dev_t dev, const ino_t ino)
+{
+	int added = 0;
+	inode_set_get(s, dev, ino, &added);
+	return added;
+}
+
+static off_t
+tree_size_bytes(const struct stat *a)
+{
+	return conf.apparent_size == 1 ? a->st_size
+		: (off_t)a->st_blocks * S_BLKSIZE;
+}
+
+/* A directory found by tree_size(), waiting to be read */
+struct tree_dir_t {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+};
+
+struct tree_stack_t {
+	struct tree_dir_t *dirs;
+	size_t n;
+	size_t size;
+};
+
+static void
+tree_stack_push(struct tree_stack_t *s, char *path, const struct stat *a)
+{
+	if (s->n == s->size) {
+		s->size = s->size == 0 ? 32 : s->size * 2;
+		s->dirs = (struct tree_dir_t *)xrealloc(s->dirs,
+			s->size * sizeof(struct tree_dir_t));
+	}
+
+	s->dirs[s->n].path = path;
+	s->dirs[s->n].dev = a->st_dev;
+	s->dirs[s->n].ino = a->st_ino;
+	s->n++;
+}
+
+/* Store the error ERR, found while traversing a tree, into TS. Returns
+ * ERR if the traversal must stop, or zero otherwise: running out of file
+ * descriptors or memory would make the result silently short */
+static int
+tree_size_error(struct tree_size_t *ts, const int err)
+{
+	ts->err = err;
+	return (err == EMFILE || err == ENFILE || err == ENOMEM) ? err : 0;
+}
+
+/* Add the contents of the directory DIR to TS, and push its
+ * subdirectories into S. DIR is closed before returning: no more than one
+ * directory is open at a time, no matter how deep the tree is.
+ * Just as du(1), symbolic links are not followed and files with several
+ * hard links are counted only once.
+ * Returns zero, or an errno value if the traversal must stop. If ROOT is
+ * 1 (DIR is the root of the tree), failing to open DIR stops it */
+static int
+tree_size_dir(const struct tree_dir_t *dir, const int root,
+	struct tree_size_t *ts, struct inode_set_t *seen, struct tree_stack_t *s)
+{
+	int err = 0;
+	DIR *dirp = (DIR *)NULL;
+	int fd = open(dir->path, O_RDONLY | O_DIRECTORY);
+
+	/* DIR might have been replaced (say, by a symbolic link) since we
+	 * found it */
+	struct stat a;
+	if (fd == -1 || fstat(fd, &a) == -1)
+		err = errno;
+	else if (a.st_dev != dir->dev || a.st_ino != dir->ino)
+		err = ENOENT;
+	else if (!(dirp = fdopendir(fd)))
+		err = errno;
+
+	if (err != 0) {
+		if (fd != -1)
+			close(fd);
+		return root == 1 ? err : tree_size_error(ts, err);
+	}
+
+	const size_t dir_len = strlen(dir->path);
+	const int slash = (dir_len > 0 && dir->path[dir_len - 1] == '/');
+	int ret = 0;
+
+	struct dirent *ent;
+	while (ret == 0 && (ent = readdir(dirp)) != NULL) {
+		char *n = ent->d_name;
+		if (*n == '.' && (!n[1] || (n[1] == '.' && !n[2])))
+			continue;
+
+		if (fstatat(fd, n, &a, AT_SYMLINK_NOFOLLOW) == -1) {
+			ret = tree_size_error(ts, errno);
+			continue;
+		}
+
+		if (!S_ISDIR(a.st_mode)) {
+			if (a.st_nlink > 1 && inode_set_add(seen, a.st_dev, a.st_ino) == 0)
+				continue;
+			ts->size += tree_size_bytes(&a);
+			ts->files++;
+			continue;
+		}
+
+		ts->size += tree_size_bytes(&a);
+		ts->dirs++;
+
+		const size_t len = dir_len + strlen(n) + 2;
+		char *path = (char *)xnmalloc(len, sizeof(char));
+		snprintf(path, len, "%s%s%s", dir->path, slash == 1 ? "" : "/", n);
+		tree_stack_push(s, path, &a);
+	}
+
+	closedir(dirp);
+	return ret;
+}
+
+/* Compute the disk usage of the file tree PATH into TS, without running
+ * du(1). As with du(1), a symbolic link to a directory is followed only if
+ * PATH ends with a slash. It is safe to call this function from several
+ * threads at once. If CANCEL is not NULL, the traversal stops as soon as
+ * *CANCEL is set (say, by a SIGINT handler).
+ * Returns zero on success, ECANCELED if canceled, or an errno value if
+ * PATH cannot be accessed or the traversal could not be completed (no
+ * more file descriptors or memory). Other errors found while traversing
+ * the tree (say, a subdirectory that cannot be read) are stored in
+ * TS->ERR */
+int
+tree_size(const char *path, struct tree_size_t *ts,
+	volatile sig_atomic_t *cancel)
+{
+	memset(ts, 0, sizeof(struct tree_size_t));
+	if (!path || !*path)
+		return EINVAL;
+
+	const size_t len = strlen(path);
+	const int follow = (len > 1 && path[len - 1] == '/');
+
+	struct stat a;
+	if ((follow == 1 ? stat(path, &a) : lstat(path, &a)) == -1)
+		return errno;
+
+	ts->size = tree_size_bytes(&a);
+
+	if (!S_ISDIR(a.st_mode)) {
+		ts->files = 1;
+		return EXIT_SUCCESS;
+	}
+
+	ts->dirs = 1;
+
+	/* Files with more than one hard link already counted */
+	struct inode_set_t seen;
+	inode_set_init(&seen, 0);
+	struct tree_stack_t s = {NULL, 0, 0};
+	tree_stack_push(&s, savestring(path, len), &a);
+
+	int ret = 0, root = 1;
+	while (s.n > 0) {
+		struct tree_dir_t dir = s.dirs[--s.n];
+
+		if (ret == 0 && cancel && *cancel == 1)
+			ret = ECANCELED;
+		if (ret == 0)
+			ret = tree_size_dir(&dir, root, ts, &seen, &s);
+
+		root = 0;
+		free(dir.path);
+	}
+
+	free(s.dirs);
+	inode_set_free(&seen);
+
+	return ret;
+}
+
+/* Worker pools
+ * Jobs are taken in order, CHUNK at a time, by up to MAX_THREADS threads
+ * (no more than the number of online CPUs). Either the pool is run to
+ * completion by pool_run(), the current thread being a worker as well,
+ * or threads are started by pool_start() and the current thread goes on
+ * with its own work, waiting for single jobs (pool_wait_job()) or for
+ * progress (pool_progress()), before calling pool_finish(). */
+
+#define POOL_JOB_PENDING 0
+#define POOL_JOB_RUNNING 1
+#define POOL_JOB_DONE    2
+
+/* Set up P to run the N jobs JOB_FN(DATA, 0) to JOB_FN(DATA, N - 1) */
+void
+pool_init(struct pool_t *p, const size_t n,
+	void (*job_fn)(void *, const size_t), void *data)
+{
+	memset(p, 0, sizeof(struct pool_t));
+	p->job_fn = job_fn;
+	p->data = data;
+	p->n = n;
+	p->chunk = 1;
+	p->max_threads = POOL_THREADS;
+	p->state = (char *)xcalloc(n + 1, sizeof(char));
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->cond, NULL);
+}
+
+/* Take the next (at most CHUNK) pending jobs into [*START, *END). Must be
+ * called with P->MUTEX held. Returns 0 if there is nothing left to do */
+static int
+pool_take(struct pool_t *p, size_t *start, size_t *end)
+{
+	while (p->next < p->n && p->state[p->next] != POOL_JOB_PENDING)
+		p->next++;
+
+	if (p->next >= p->n || p->stop == 1 || (p->cancel && *p->cancel == 1))
+		return 0;
+
+	size_t e = p->next;
+	while (e < p->n && e - p->next < p->chunk
+	&& p->state[e] == POOL_JOB_PENDING) {
+		p->state[e] = POOL_JOB_RUNNING;
+		e++;
+	}
+
+	*start = p->next;
+	*end = p->next = e;
+	p->running += e - *start;
+	return 1;
+}
+
+/* Mark the jobs in [START, END) as done. Must be called with P->MUTEX
+ * held */
+static void
+pool_done(struct pool_t *p, const size_t start, const size_t end)
+{
+	size_t i;
+	for (i = start; i < end; i++)
+		p->state[i] = POOL_JOB_DONE;
+
+	p->running -= end - start;
+	p->done += end - start;
+	pthread_cond_broadcast(&p->cond);
+}
+
+/* Run pending jobs until there are no more */
+static void *
+pool_worker(void *arg)
+{
+	struct pool_t *p = (struct pool_t *)arg;
+	size_t start, end, i;
+
+	while (1) {
+		pthread_mutex_lock(&p->mutex);
+		const int ret = pool_take(p, &start, &end);
+		pthread_mutex_unlock(&p->mutex);
+		if (ret == 0)
+			break;
+
+		for (i = start; i < end; i++)
+			p->job_fn(p->data, i);
+
+		pthread_mutex_lock(&p->mutex);
+		pool_done(p, start, end);
+		pthread_mutex_unlock(&p->mutex);
+	}
+
+	return NULL;
+}
+
+/* Start the threads of P. If SELF is 1, the current thread will run jobs
+ * as well (one thread less is started). If no thread can be started, jobs
+ * are run by pool_wait_job() and pool_finish() */
+void
+pool_start(struct pool_t *p, const int self)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nthreads = cpus > 1 ? (size_t)cpus : 1;
+	if (nthreads > p->max_threads)
+		nthreads = p->max_threads;
+	if (nthreads > POOL_THREADS)
+		nthreads = POOL_THREADS;
+
+	const size_t chunks = (p->n + p->chunk - 1) / p->chunk;
+	if (nthreads > chunks)
+		nthreads = chunks;
+	if (self == 1 && nthreads > 0)
+		nthreads--;
+
+	for (p->started = 0; p->started < nthreads; p->started++) {
+		if (pthread_create(&p->tid[p->started], NULL, pool_worker, p) != 0)
+			break;
+	}
+}
+
+/* Run the jobs left, wait for the running ones, and release P */
+void
+pool_finish(struct pool_t *p)
+{
+	pool_worker(p);
+
+	pthread_mutex_lock(&p->mutex);
+	while (p->running > 0)
+		pthread_cond_wait(&p->cond, &p->mutex);
+	pthread_mutex_unlock(&p->mutex);
+
+	size_t i;
+	for (i = 0; i < p->started; i++)
+		pthread_join(p->tid[i], NULL);
+
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->mutex);
+	free(p->state);
+	p->state = (char *)NULL;
+	p->started = 0;
+}
+
+/* Run all jobs in P, the current thread included, and release P */
+void
+pool_run(struct pool_t *p)
+{
+	pool_start(p, 1);
+	pool_finish(p);
+}
+
+/* Do not run any more jobs. Running jobs are not interrupted */
+void
+pool_stop(struct pool_t *p)
+{
+	pthread_mutex_lock(&p->mutex);
+	p->stop = 1;
+	pthread_mutex_unlock(&p->mutex);
+}
+
+/* Wait for the job I to be done. If no thread took it yet, run it here.
+ * Returns 1 if the job was run, or 0 if it never will (the pool was
+ * stopped or canceled) */
+int
+pool_wait_job(struct pool_t *p, const size_t i)
+{
+	pthread_mutex_lock(&p->mutex);
+
+	if (p->state[i] == POOL_JOB_PENDING) {
+		if (p->stop == 1 || (p->cancel && *p->cancel == 1)) {
+			pthread_mutex_unlock(&p->mutex);
+			return 0;
+		}
+
+		p->state[i] = POOL_JOB_RUNNING;
+		p->running++;
+		pthread_mutex_unlock(&p->mutex);
+
+		p->job_fn(p->data, i);
+
+		pthread_mutex_lock(&p->mutex);
+		pool_done(p, i, i + 1);
+		pthread_mutex_unlock(&p->mutex);
+		return 1;
+	}
+
+	while (p->state[i] != POOL_JOB_DONE)
+		pthread_cond_wait(&p->cond, &p->mutex);
+
+	pthread_mutex_unlock(&p->mutex);
+	return 1;
+}
+
+/* Wait until more than DONE jobs are done and return the number of done
+ * jobs. If no thread is running, return right away: the rest is left to
+ * pool_finish() */
+size_t
+pool_progress(struct pool_t *p, const size_t done)
+{
+	pthread_mutex_lock(&p->mutex);
+	while (p->started > 0 && p->done <= done && p->done < p->n
+	&& (p->running > 0 || p->next < p->n) && p->stop == 0
+	&& !(p->cancel && *p->cancel == 1))
+		pthread_cond_wait(&p->cond, &p->mutex);
+	const size_t ret = p->done;
+	pthread_mutex_unlock(&p->mutex);
+
+	return ret;
+}
+
 off_t
 dir_size(char *dir, const int size_in_bytes)
 {
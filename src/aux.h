@@ -25,6 +25,9 @@
 #ifndef AUX_H
 #define AUX_H
 
+#include <pthread.h>
+#include <signal.h> /* sig_atomic_t */
+#include <stdint.h>
 #include <time.h>
 
 #ifdef RL_READLINE_VERSION
@@ -33,14 +36,71 @@
 # endif /* RL_READLINE_VERSION >= 0x0801 */
 #endif /* RL_READLINE_VERSION */
 
+/* Seed used by hashme32() for all in-memory lookup tables */
+#define HASH_SEED 13344
+
 /* Max size type length for the value returned by get_size_type() */
 #define MAX_UNIT_SIZE 10 /* "1023.99YB\0" */
 
+/* A set of strings (open addressing). Strings are not copied: they must
+ * outlive the set */
+struct strset_t {
+	const char **slots;
+	uint32_t *hashes;
+	size_t size; /* Always a power of two */
+	size_t n;
+};
+
+/* A set of files, keyed by device and inode number (open addressing).
+ * Each file can carry VAL_SIZE bytes of data (see inode_set_get()) */
+struct inode_set_t {
+	dev_t *devs;
+	ino_t *inos;
+	char *vals;
+	size_t val_size;
+	size_t size; /* Always a power of two */
+	size_t n;
+};
+
+/* Max number of threads run by a worker pool */
+#define POOL_THREADS 8
+
+/* A bounded pool of worker threads running the jobs 0 to N - 1
+ * (JOB_FN(DATA, I)), CHUNK jobs at a time (see pool_init()) */
+struct pool_t {
+	void (*job_fn)(void *, const size_t);
+	void *data;
+	volatile sig_atomic_t *cancel; /* If set, no more jobs are run */
+	char *state;        /* State of each job */
+	size_t n;
+	size_t chunk;       /* Jobs taken at a time by a thread (default: 1) */
+	size_t max_threads; /* Default: POOL_THREADS */
+	size_t next;        /* First job not taken yet */
+	size_t running;     /* Jobs taken but not done yet */
+	size_t done;
+	size_t started;     /* Number of started threads */
+	pthread_t tid[POOL_THREADS];
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stop;
+	int pad;
+};
+
+/* Disk usage of a file tree, as computed by tree_size() */
+struct tree_size_t {
+	off_t size;   /* Total size in bytes (apparent or real, see ApparentSize) */
+	size_t files; /* Non-directory files */
+	size_t dirs;  /* Directories, including the root */
+	int err;      /* Last errno value found while traversing, if any */
+	int pad;
+};
+
 __BEGIN_DECLS
 
 int  _expand_eln(const char *);
 char *abbreviate_file_name(char *);
 void close_fstream(FILE *, int);
+void construct_human_size(const off_t, char *);
 int  count_dir(const char *, int);
 off_t dir_size(char *, const int);
 char from_hex(char);
@@ -48,7 +108,29 @@ char from_hex(char);
 char *gen_date_suffix(struct tm);
 void gen_time_str(char *, const size_t, const time_t);
 char *get_cmd_path(const char *);
+uint32_t get_cmd_path_stamp(void);
+void free_cmd_path_cache(void);
 int  get_rgb(char *, int *, int *, int *, int *);
+uint32_t hashme32(const char *, const uint32_t);
+int  inode_set_add(struct inode_set_t *, const dev_t, const ino_t);
+void *inode_set_find(const struct inode_set_t *, const dev_t, const ino_t);
+void inode_set_free(struct inode_set_t *);
+void *inode_set_get(struct inode_set_t *, const dev_t, const ino_t, int *);
+int  inode_set_has(const struct inode_set_t *, const dev_t, const ino_t);
+void inode_set_init(struct inode_set_t *, const size_t);
+void pool_finish(struct pool_t *);
+void pool_init(struct pool_t *, const size_t,
+	void (*)(void *, const size_t), void *);
+size_t pool_progress(struct pool_t *, const size_t);
+void pool_run(struct pool_t *);
+void pool_start(struct pool_t *, const int);
+void pool_stop(struct pool_t *);
+int  pool_wait_job(struct pool_t *, const size_t);
+int  strset_add(struct strset_t *, const char *);
+void strset_free(struct strset_t *);
+int  strset_has(const struct strset_t *, const char *);
+void strset_init(struct strset_t *, const size_t);
+int  tree_size(const char *, struct tree_size_t *, volatile sig_atomic_t *);
 void clear_term_img(void);
 mode_t get_dt(const mode_t);
 /*int *get_hex_num(const char *str); */
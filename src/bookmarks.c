@@ -41,6 +41,7 @@
 #include "messages.h"
 #include "listing.h"
 #include "misc.h"
+#include "persist.h"
 
 #define NO_BOOKMARKS "bookmarks: There are no bookmarks\nEnter 'bm edit' \
 or press F11 to edit the bookmarks file. You can also enter 'bm add PATH' \
@@ -49,10 +50,204 @@ to add a new bookmark\n"
 #define NO_BM_HEADER    0
 #define BM_SCREEN       1 /* The edit function is called from the bookmarks screen */
 #define NO_BM_SCREEN    0
+#define BM_FORCE_RELOAD 1
+#define BM_LAZY_RELOAD  0
+
+/* Lookup indexes for the bookmarks array, rebuilt by index_bookmarks()
+ * every time bookmarks are (re)loaded */
+static struct bm_index_t {
+	size_t *slots[3]; /* Hash tables on shortcuts, names, and paths: each
+	slot holds an index into the bookmarks array plus one (zero if empty) */
+	size_t *sorted;   /* Named bookmarks, sorted by name (case insensitive) */
+	size_t size;      /* Slots in each hash table (a power of two) */
+	size_t sorted_n;
+	/* The bookmarks file as it was when bookmarks were loaded */
+	char *file;
+	time_t mtime;
+	off_t fsize;
+	ino_t ino;
+} bm_index = {{NULL, NULL, NULL}, NULL, 0, 0, NULL, 0, 0, 0};
+
+static char *
+get_bm_field(const size_t i, const int field)
+{
+	if (field == BM_SHORTCUT)
+		return bookmarks[i].shortcut;
+	if (field == BM_NAME)
+		return bookmarks[i].name;
+	return bookmarks[i].path;
+}
+
+static void
+free_bm_index(void)
+{
+	size_t i;
+	for (i = 0; i < 3; i++) {
+		free(bm_index.slots[i]);
+		bm_index.slots[i] = (size_t *)NULL;
+	}
+
+	free(bm_index.sorted);
+	bm_index.sorted = (size_t *)NULL;
+	bm_index.size = bm_index.sorted_n = 0;
+}
+
+static int
+compare_bm_names(const void *a, const void *b)
+{
+	const size_t x = *(const size_t *)a;
+	const size_t y = *(const size_t *)b;
+
+	const int ret = strcasecmp(bookmarks[x].name, bookmarks[y].name);
+	if (ret != 0)
+		return ret;
+
+	return x < y ? -1 : (x > y);
+}
+
+/* Build the lookup indexes for the bookmarks array, and remember the
+ * current state of the bookmarks file (see reload_bookmarks()) */
+void
+index_bookmarks(void)
+{
+	free_bm_index();
+
+	struct stat a;
+	free(bm_index.file);
+	bm_index.file = (char *)NULL;
+
+	if (bm_file && stat(bm_file, &a) != -1) {
+		bm_index.file = savestring(bm_file, strlen(bm_file));
+		bm_index.mtime = a.st_mtime;
+		bm_index.fsize = a.st_size;
+		bm_index.ino = a.st_ino;
+	}
+
+	if (bm_n == 0 || !bookmarks)
+		return;
+
+	size_t size = 16;
+	while (size < bm_n * 2)
+		size <<= 1;
+	bm_index.size = size;
+
+	size_t i;
+	int f;
+	for (f = BM_SHORTCUT; f <= BM_PATH; f++) {
+		size_t *slots = (size_t *)xcalloc(size, sizeof(size_t));
+
+		for (i = 0; i < bm_n; i++) {
+			const char *key = get_bm_field(i, f);
+			if (!key || !*key)
+				continue;
+
+			/* Keep only the first bookmark for each key, just as a
+			 * linear search would find it */
+			size_t j = hashme32(key, HASH_SEED) & (size - 1);
+			while (slots[j] != 0
+			&& strcmp(get_bm_field(slots[j] - 1, f), key) != 0)
+				j = (j + 1) & (size - 1);
+
+			if (slots[j] == 0)
+				slots[j] = i + 1;
+		}
+
+		bm_index.slots[f] = slots;
+	}
+
+	bm_index.sorted = (size_t *)xnmalloc(bm_n + 1, sizeof(size_t));
+	for (i = 0; i < bm_n; i++) {
+		if (bookmarks[i].name && *bookmarks[i].name)
+			bm_index.sorted[bm_index.sorted_n++] = i;
+	}
+
+	qsort(bm_index.sorted, bm_index.sorted_n, sizeof(size_t),
+		compare_bm_names);
+}
+
+/* Return the index (in the bookmarks array) of the first bookmark whose
+ * FIELD (BM_SHORTCUT, BM_NAME, or BM_PATH) is KEY, or -1 if none */
+ssize_t
+find_bookmark(const int field, const char *key)
+{
+	if (!key || !*key || field < BM_SHORTCUT || field > BM_PATH
+	|| !bm_index.slots[field])
+		return (-1);
+
+	const size_t mask = bm_index.size - 1;
+	const size_t *slots = bm_index.slots[field];
+	size_t j = hashme32(key, HASH_SEED) & mask;
+
+	while (slots[j] != 0) {
+		const char *k = get_bm_field(slots[j] - 1, field);
+		if (*k == *key && strcmp(k, key) == 0)
+			return (ssize_t)slots[j] - 1;
+		j = (j + 1) & mask;
+	}
+
+	return (-1);
+}
+
+/* Get the range of named bookmarks whose name starts with the first LEN
+ * bytes of PREFIX (case insensitively). IDS is set to the first index (in
+ * the bookmarks array) of the range, sorted by name, and the number of
+ * indexes in the range is returned */
+size_t
+get_bm_name_range(const char *prefix, const size_t len, size_t **ids)
+{
+	*ids = bm_index.sorted;
+	if (!prefix || bm_index.sorted_n == 0)
+		return 0;
+
+	const size_t *v = bm_index.sorted;
+
+	/* Lower bound: first name not lower than PREFIX */
+	size_t lo = 0, hi = bm_index.sorted_n;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (strncasecmp(bookmarks[v[mid]].name, prefix, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	const size_t first = lo;
+
+	/* Upper bound: first name greater than PREFIX */
+	hi = bm_index.sorted_n;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (strncasecmp(bookmarks[v[mid]].name, prefix, len) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*ids = bm_index.sorted + first;
+	return lo - first;
+}
+
+/* Return 1 if the bookmarks file changed since bookmarks were last
+ * loaded, or 0 otherwise */
+static int
+bm_file_changed(void)
+{
+	struct stat a;
+	if (!bm_file || stat(bm_file, &a) == -1)
+		return (bm_index.file != NULL);
+
+	return (!bm_index.file || strcmp(bm_index.file, bm_file) != 0
+	|| a.st_mtime != bm_index.mtime || a.st_size != bm_index.fsize
+	|| a.st_ino != bm_index.ino);
+}
 
 void
 free_bookmarks(void)
 {
+	free_bm_index();
+	free(bm_index.file);
+	bm_index.file = (char *)NULL;
+
 	if (bm_n == 0)
 		return;
 
@@ -70,9 +265,15 @@ free_bookmarks(void)
 	return;
 }
 
-void
-reload_bookmarks(void)
+/* Reload bookmarks from the bookmarks file. Unless FORCE is set to
+ * BM_FORCE_RELOAD, nothing is done if the file did not change since
+ * bookmarks were last loaded */
+static void
+reload_bookmarks(const int force)
 {
+	if (force != BM_FORCE_RELOAD && bm_file_changed() == 0)
+		return;
+
 	free_bookmarks();
 	load_bookmarks();
 }
@@ -302,7 +503,7 @@ bookmark_del(char *name)
 			free_del_elements(del_elements);
 			fclose(bm_fp);
 
-			reload_bookmarks();
+			reload_bookmarks(BM_FORCE_RELOAD);
 
 			/* If the argument "*" was specified in command line */
 			if (cmd_line != -1)
@@ -313,20 +514,18 @@ bookmark_del(char *name)
 		}
 	}
 
-	/* Remove single bookmarks */
-	/* Open a temporary file */
-	char *tmp_file = (char *)NULL;
-	tmp_file = (char *)xnmalloc(config_dir_len + 8, sizeof(char));
-	sprintf(tmp_file, "%s/bm_tmp", config_dir); /* NOLINT */
-
-	FILE *tmp_fp = fopen(tmp_file, "w+");
+	/* Remove single bookmarks: the new bookmarks file replaces the old
+	 * one only once completely written */
+	struct persist_t p;
+	FILE *tmp_fp = persist_open(&p, bm_file, PERSIST_SYNC);
 	if (!tmp_fp) {
+		const int saved_errno = errno;
 		free_bms(bms, bmn);
 		free_del_elements(del_elements);
 		fclose(bm_fp);
 		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("bookmarks: Error creating "
-			"temporary file: %s: %s\n"), tmp_file, strerror(errno));
-		return errno;
+			"temporary file: %s: %s\n"), bm_file, strerror(saved_errno));
+		return saved_errno;
 	}
 
 	/* Go back to the beginning of the bookmarks file */
@@ -366,15 +565,15 @@ bookmark_del(char *name)
 	free_bms(bms, bmn);
 
 	fclose(bm_fp);
-	fclose(tmp_fp);
 
-	/* Remove the old bookmarks file and make the tmp file the new
-	 * bookmarks file*/
-	unlink(bm_file);
-	rename(tmp_file, bm_file);
-	free(tmp_file);
+	if (persist_commit(&p) != EXIT_SUCCESS) {
+		const int saved_errno = errno;
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "bookmarks: %s: %s\n",
+			bm_file, strerror(saved_errno));
+		return saved_errno;
+	}
 
-	reload_bookmarks();
+	reload_bookmarks(BM_FORCE_RELOAD);
 
 	/* If the bookmark to be removed was specified in command line */
 	if (cmd_line != -1)
@@ -628,7 +827,7 @@ bookmark_add(char *file)
 	fclose(bm_fp);
 	printf(_("bookmarks: File succesfully bookmarked\n"));
 	free(tmp);
-	reload_bookmarks(); /* Update bookmarks for TAB completion */
+	reload_bookmarks(BM_FORCE_RELOAD); /* Update bookmarks for TAB completion */
 
 	return EXIT_SUCCESS;
 }
@@ -642,7 +841,6 @@ edit_bookmarks(char *cmd, const int flag)
 			strerror(errno));
 		return errno;
 	}
-	time_t prev = a.st_mtime;
 
 	int ret = EXIT_SUCCESS;
 	if (!cmd) {
@@ -661,9 +859,9 @@ edit_bookmarks(char *cmd, const int flag)
 		return ret;
 	}
 
-	stat(bm_file, &a);
-	if (prev != a.st_mtime) {
-		reload_bookmarks();
+	/* Bookmarks are reloaded (and indexed) only if the file was modified */
+	if (bm_file_changed() == 1) {
+		reload_bookmarks(BM_FORCE_RELOAD);
 		if (flag == NO_BM_SCREEN) {
 			reload_dirlist();
 			print_reload_msg(_("File modified. Bookmarks reloaded\n"));
@@ -757,6 +955,20 @@ _edit_bookmarks(char **arg)
 	return EXIT_SUCCESS;
 }
 
+/* Return the index of the first bookmark whose shortcut or name is KEY,
+ * or -1 if none */
+static ssize_t
+find_bm_key(const char *key)
+{
+	const ssize_t s = find_bookmark(BM_SHORTCUT, key);
+	const ssize_t n = find_bookmark(BM_NAME, key);
+
+	if (s == -1 || n == -1)
+		return s == -1 ? n : s;
+
+	return s < n ? s : n;
+}
+
 /* Return a pointer to the bookmark path (in the bookmarks array)
  * corresponding to ARG (either an ELN or a string). Otherwise return NULL
  * The return value of this function must not be free'd */
@@ -774,18 +986,13 @@ get_bm_path(char *arg)
 	}
 
 	/* If string, check shortcuts and names */
-	size_t i;
-	for (i = 0; i < bm_n; i++) {
-		if ((bookmarks[i].shortcut && *arg == *bookmarks[i].shortcut
-		&& strcmp(arg, bookmarks[i].shortcut) == 0)
-		|| (bookmarks[i].name && *arg == *bookmarks[i].name
-		&& strcmp(arg, bookmarks[i].name) == 0)) {
-			if (bookmarks[i].path)
-				return bookmarks[i].path;
-
-			fprintf(stderr, _("%s: Invalid bookmark\n"), arg);
-			return (char *)NULL;
-		}
+	ssize_t i = find_bm_key(arg);
+	if (i != -1) {
+		if (bookmarks[i].path)
+			return bookmarks[i].path;
+
+		fprintf(stderr, _("%s: Invalid bookmark\n"), arg);
+		return (char *)NULL;
 	}
 
 	fprintf(stderr, _("%s: No such bookmark\n"), arg);
@@ -806,6 +1013,7 @@ free_bm_input(char ***p)
 int
 open_bookmark(void)
 {
+	reload_bookmarks(BM_LAZY_RELOAD);
 	if (bm_n == 0) { printf(_(NO_BOOKMARKS)); return EXIT_SUCCESS; }
 	if (conf.clear_screen) CLEAR;
 
@@ -854,33 +1062,22 @@ bm_open(char **cmd)
 	char *p = dequote_str(cmd[1], 0);
 	if (!p) p = cmd[1];
 
-	size_t i;
-	for (i = 0; i < bm_n; i++) {
-		if ((bookmarks[i].shortcut && *p == *bookmarks[i].shortcut
-		&& strcmp(p, bookmarks[i].shortcut) == 0)
-
-		|| (bookmarks[i].name && *p == *bookmarks[i].name
-		&& strcmp(p, bookmarks[i].name) == 0)) {
-
-/*		|| (conf.expand_bookmarks && bookmarks[i].path
-		&& *p == *bookmarks[i].path
-		&& strcmp(p, bookmarks[i].path) == 0)) { */
-
-			if (!bookmarks[i].path) {
-				fprintf(stderr, _("%s: Invalid bookmark\n"), p);
-				if (p != cmd[1]) free(p);
-				return EXIT_FAILURE;
-			}
-
+	const ssize_t i = find_bm_key(p);
+	if (i != -1) {
+		if (!bookmarks[i].path) {
+			fprintf(stderr, _("%s: Invalid bookmark\n"), p);
 			if (p != cmd[1]) free(p);
-
-			char *et = *bookmarks[i].path == '~'
-				? tilde_expand(bookmarks[i].path) : (char *)NULL;
-			char *tmp_cmd[] = {"o", et ? et : bookmarks[i].path, cmd[2], NULL};
-			int ret = open_function(tmp_cmd);
-			free(et);
-			return ret;
+			return EXIT_FAILURE;
 		}
+
+		if (p != cmd[1]) free(p);
+
+		char *et = *bookmarks[i].path == '~'
+			? tilde_expand(bookmarks[i].path) : (char *)NULL;
+		char *tmp_cmd[] = {"o", et ? et : bookmarks[i].path, cmd[2], NULL};
+		int ret = open_function(tmp_cmd);
+		free(et);
+		return ret;
 	}
 
 	fprintf(stderr, _("%s: No such bookmark\n"), p);
@@ -897,17 +1094,13 @@ check_bm_path(char *file)
 	char *p = normalize_path(file, strlen(file));
 	char *f = p ? p : file;
 
-	int i = (int)bm_n;
-	while (--i >= 0) {
-		if (!bookmarks[i].path)
-			continue;
-		if (*f == *bookmarks[i].path && strcmp(f, bookmarks[i].path) == 0) {
-			fprintf(stderr, "bookmarks: %s: Path already "
-				"bookmarked as '%s'\n", f, bookmarks[i].name
-				? bookmarks[i].name : "unnamed");
-			free(p);
-			return 0;
-		}
+	const ssize_t i = find_bookmark(BM_PATH, f);
+	if (i != -1) {
+		fprintf(stderr, "bookmarks: %s: Path already "
+			"bookmarked as '%s'\n", f, bookmarks[i].name
+			? bookmarks[i].name : "unnamed");
+		free(p);
+		return 0;
 	}
 
 	free(p);
@@ -940,15 +1133,9 @@ check_bm_name(const char *name)
 	if (name_is_reserved_keyword(name) == 1)
 		return 0;
 
-	int i = (int)bm_n;
-	while (--i >= 0) {
-		if (!bookmarks[i].name)
-			continue;
-		if (*name == *bookmarks[i].name
-		&& strcmp(name, bookmarks[i].name) == 0) {
-			fprintf(stderr, _("bookmarks: %s: Name already taken\n"), name);
-			return 0;
-		}
+	if (find_bookmark(BM_NAME, name) != -1) {
+		fprintf(stderr, _("bookmarks: %s: Name already taken\n"), name);
+		return 0;
 	}
 
 	return 1;
@@ -963,16 +1150,10 @@ check_bm_shortcut(const char *shortcut)
 	if (name_is_reserved_keyword(shortcut) == 1)
 		return 0;
 
-	int i = (int)bm_n;
-	while (--i >= 0) {
-		if (!bookmarks[i].shortcut)
-			continue;
-		if (*shortcut == *bookmarks[i].shortcut
-		&& strcmp(shortcut, bookmarks[i].shortcut) == 0) {
-			fprintf(stderr, _("bookmarks: %s: Shortcut already taken\n"),
-				shortcut);
-			return 0;
-		}
+	if (find_bookmark(BM_SHORTCUT, shortcut) != -1) {
+		fprintf(stderr, _("bookmarks: %s: Shortcut already taken\n"),
+			shortcut);
+		return 0;
 	}
 
 	return 1;
@@ -1049,7 +1230,7 @@ add_bookmark_not_interactive(char *file, char *name, char *shortcut)
 	free(p);
 	free(q);
 
-	reload_bookmarks(); /* Update bookmarks for TAB completion */
+	reload_bookmarks(BM_FORCE_RELOAD); /* Update bookmarks for TAB completion */
 
 	return EXIT_SUCCESS;
 }
@@ -1120,7 +1301,7 @@ bookmarks_function(char **cmd)
 		return edit_bookmarks(cmd[2], NO_BM_SCREEN);
 
 	if (*cmd[1] == 'r' && (!cmd[1][1] || strcmp(cmd[1], "reload") == 0)) {
-		reload_bookmarks();
+		reload_bookmarks(BM_FORCE_RELOAD);
 		return EXIT_SUCCESS;
 	}
 
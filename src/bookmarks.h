@@ -25,11 +25,19 @@
 #ifndef BOOKMARKS_H
 #define BOOKMARKS_H
 
+/* Fields looked up by find_bookmark() */
+#define BM_SHORTCUT 0
+#define BM_NAME     1
+#define BM_PATH     2
+
 __BEGIN_DECLS
 
 int  bookmarks_function(char **);
-int  open_bookmark(void);
+ssize_t find_bookmark(const int, const char *);
 void free_bookmarks(void);
+size_t get_bm_name_range(const char *, const size_t, size_t **);
+void index_bookmarks(void);
+int  open_bookmark(void);
 
 __END_DECLS
 
@@ -855,9 +855,12 @@ check_regex(char *str)
 }
 
 /* Returns the parsed aliased command in an array of strings if
- * matching alias is found, or NULL if not */
+ * matching alias is found, or NULL if not.
+ * *RAW is the raw names array of ARGS (see parse_input_str()). If an alias
+ * is found, both ARGS and *RAW are freed, and *RAW is set to the raw names
+ * array of the returned command */
 char **
-check_for_alias(char **args)
+check_for_alias(char **args, char **raw)
 {
 	/* Do not expand alias is first word is an ELN */
 	if (aliases_n == 0 || !aliases || !args || flags & FIRST_WORD_IS_ELN)
@@ -886,9 +889,9 @@ check_for_alias(char **args)
 		args_n = 0; /* Reset args_n to be used by parse_input_str() */
 
 		/* Parse the aliased cmd */
-		char **alias_comm = parse_input_str(aliases[i].cmd);
+		char *alias_raw = (char *)NULL;
+		char **alias_comm = parse_input_str(aliases[i].cmd, &alias_raw);
 		if (!alias_comm) {
-//			args_n = 0;
 			/* The error message should have been printed by parse_input_str()
 			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: Aliased command exited
 				with error\n"), PROGRAM_NAME); */
@@ -897,23 +900,37 @@ check_for_alias(char **args)
 			return (char **)NULL;
 		}
 
-		size_t j;
-		/* Add input parameters, if any, to alias_comm */
-		if (args[1]) {
-			for (j = 1; args[j]; j++) {
-				alias_comm = (char **)xrealloc(alias_comm,
-				    (++args_n + 2) * sizeof(char *));
-				alias_comm[args_n] = savestring(args[j], strlen(args[j]));
-			}
+		size_t j, argsc = 0;
+		while (args[argsc])
+			argsc++;
+
+		/* Add input parameters, if any, to the aliased command. It might
+		 * build a shell command line out of them: escape raw file names */
+		const size_t alias_words = args_n + 1;
+		alias_comm = (char **)xrealloc(alias_comm,
+			(args_n + argsc + 1) * sizeof(char *));
+		for (j = 1; j < argsc; j++) {
+			char *p = is_raw_arg(*raw, j) == 1 ? escape_str(args[j])
+				: (char *)NULL;
+			alias_comm[++args_n] = p ? p : savestring(args[j], strlen(args[j]));
 		}
 
 		/* Add a terminating NULL string */
 		alias_comm[args_n + 1] = (char *)NULL;
 
+		/* Raw names in the aliased command itself remain raw: the
+		 * parameters just added are not */
+		if (alias_raw) {
+			alias_raw = (char *)xrealloc(alias_raw, (args_n + 1) * sizeof(char));
+			memset(alias_raw + alias_words, 0, args_n + 1 - alias_words);
+		}
+
 		/* Free original command */
-		for (j = 0; args[j]; j++)
+		for (j = 0; j < argsc; j++)
 			free(args[j]);
 		free(args);
+		free(*raw);
+		*raw = alias_raw;
 		return alias_comm;
 	}
 
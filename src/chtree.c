@@ -0,0 +1,584 @@
+/* chtree.c -- change permissions and ownership of file trees */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The engine behind 'pc' and 'oc'. Files given as arguments are changed
+ * by the current thread (symbolic links are followed, as chmod(1) and
+ * chown(1) do). In recursive mode, directories are then pushed onto a
+ * shared stack and walked by the threads of a worker pool. Each directory
+ * is read through its own file descriptor, and its entries are stat'ed
+ * and changed relative to it (fstatat, fchmodat, fchownat), so that no
+ * full path is built except to report errors.
+ *
+ * Files already having the requested attributes are not written to.
+ * Symbolic links found in the tree are never followed: they are skipped
+ * by mode changes (just as chmod(1) does), and changed themselves by
+ * ownership changes (as chown -R does). Since a file may be replaced by a
+ * symbolic link between the time it is stat'ed and the time it is
+ * changed, modes are changed without following NAME as well. */
+
+#include "helpers.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aux.h"
+#include "chtree.h"
+
+/* Max number of directories waiting in the stack with an open file
+ * descriptor. Directories pushed beyond this limit are reopened by path
+ * when popped */
+#define CHTREE_QUEUED_FDS 256
+
+#define CHMOD_BITS (S_ISUID | S_ISGID | S_ISVTX | S_IRWXU | S_IRWXG | S_IRWXO)
+
+/* A directory waiting to be walked */
+struct chtree_dir_t {
+	char *path;
+	struct chtree_dir_t *next;
+	int fd; /* -1 if the directory must be opened by path */
+	int pad;
+};
+
+struct chtree_run_t {
+	const struct chtree_op_t *op;
+	struct chtree_stats_t *st;
+	struct chtree_dir_t *stack;
+	size_t queued_fds;
+	size_t busy; /* Threads currently walking a directory */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+/* Per thread counters, merged into the run stats when the thread is done */
+struct chtree_count_t {
+	size_t changed;
+	size_t unchanged;
+};
+
+/*
+ * Mode compilation
+ */
+
+static void
+add_mode_op(struct mode_spec_t *spec, const struct mode_op_t *o)
+{
+	spec->ops = (struct mode_op_t *)xrealloc(spec->ops,
+		(spec->ops_n + 1) * sizeof(struct mode_op_t));
+	spec->ops[spec->ops_n] = *o;
+	spec->ops_n++;
+}
+
+/* Parse the permission letters at *S (e.g. "rwX" in "u+rwX") into O,
+ * advancing *S */
+static void
+parse_mode_perms(const char **s, struct mode_op_t *o)
+{
+	const char *p = *s;
+
+	/* A single class letter copies the bits of that class ("g=u") */
+	if (*p == 'u' || *p == 'g' || *p == 'o') {
+		o->flag = MODE_OP_COPY;
+		o->value = *p == 'u' ? S_IRWXU : (*p == 'g' ? S_IRWXG : S_IRWXO);
+		*s = p + 1;
+		return;
+	}
+
+	for (; *p; p++) {
+		switch (*p) {
+		case 'r': o->value |= S_IRUSR | S_IRGRP | S_IROTH; break;
+		case 'w': o->value |= S_IWUSR | S_IWGRP | S_IWOTH; break;
+		case 'x': o->value |= S_IXUSR | S_IXGRP | S_IXOTH; break;
+		case 'X': o->flag = MODE_OP_X; break;
+		case 's': o->value |= S_ISUID | S_ISGID; break;
+		case 't': o->value |= S_ISVTX; break;
+		default: *s = p; return;
+		}
+	}
+
+	*s = p;
+}
+
+/* Compile the symbolic mode S (e.g. "u+rwX,go-w") into SPEC.
+ * The grammar is the one used by chmod(1) */
+static int
+compile_symbolic_mode(const char *s, struct mode_spec_t *spec)
+{
+	const char *p = s;
+
+	while (1) {
+		mode_t who = 0;
+		for (; *p == 'u' || *p == 'g' || *p == 'o' || *p == 'a'; p++) {
+			switch (*p) {
+			case 'u': who |= S_ISUID | S_IRWXU; break;
+			case 'g': who |= S_ISGID | S_IRWXG; break;
+			case 'o': who |= S_ISVTX | S_IRWXO; break;
+			default: who |= CHMOD_BITS; break;
+			}
+		}
+
+		if (*p != '+' && *p != '-' && *p != '=')
+			return EXIT_FAILURE;
+
+		while (*p == '+' || *p == '-' || *p == '=') {
+			struct mode_op_t o;
+			memset(&o, 0, sizeof(struct mode_op_t));
+			o.op = *p;
+			o.who = who;
+			o.flag = MODE_OP_ORDINARY;
+			p++;
+
+			parse_mode_perms(&p, &o);
+			o.mentioned = who != 0 ? (who & o.value) : o.value;
+			add_mode_op(spec, &o);
+		}
+
+		if (*p == '\0')
+			break;
+		if (*p != ',')
+			return EXIT_FAILURE;
+		p++;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* Compile the mode S, either in octal ("644") or symbolic ("u+rwX,go-w")
+ * notation, into SPEC.
+ * Returns EXIT_SUCCESS on success or EXIT_FAILURE if S is not a valid
+ * mode. SPEC must be freed with free_mode_spec() in both cases */
+int
+compile_mode_spec(const char *s, struct mode_spec_t *spec)
+{
+	memset(spec, 0, sizeof(struct mode_spec_t));
+	if (!s || !*s)
+		return EXIT_FAILURE;
+
+	if (*s >= '0' && *s <= '7') {
+		char *end = (char *)NULL;
+		long m = strtol(s, &end, 8);
+		if (!end || *end || m < 0 || m > 07777)
+			return EXIT_FAILURE;
+		spec->mode = (mode_t)m;
+		/* As chmod(1), keep the set-user-ID and set-group-ID bits of
+		 * directories, unless either set or cleared explicitly by using
+		 * five or more digits */
+		if (strlen(s) <= 4)
+			spec->dir_keep = (S_ISUID | S_ISGID) & ~spec->mode;
+		return EXIT_SUCCESS;
+	}
+
+	/* Symbolic modes without a class (say, "+x") honor the umask */
+	spec->umask = umask(0);
+	umask(spec->umask);
+
+	if (compile_symbolic_mode(s, spec) != EXIT_SUCCESS || spec->ops_n == 0)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
+
+void
+free_mode_spec(struct mode_spec_t *spec)
+{
+	free(spec->ops);
+	spec->ops = (struct mode_op_t *)NULL;
+	spec->ops_n = 0;
+}
+
+/* Return the permission bits resulting from applying SPEC to a file whose
+ * current mode (including the file type) is MODE. Just as chmod(1) does,
+ * the set-user-ID and set-group-ID bits of directories are left alone
+ * unless they are explicitly named */
+mode_t
+apply_mode_spec(const struct mode_spec_t *spec, const mode_t mode)
+{
+	if (spec->ops_n == 0)
+		return spec->mode | (S_ISDIR(mode) ? (mode & spec->dir_keep) : 0);
+
+	const int dir = S_ISDIR(mode) ? 1 : 0;
+	mode_t newmode = mode & CHMOD_BITS;
+
+	size_t i;
+	for (i = 0; i < spec->ops_n; i++) {
+		const struct mode_op_t *o = &spec->ops[i];
+		const mode_t omit = dir == 1
+			? ((S_ISUID | S_ISGID) & ~o->mentioned) : 0;
+		mode_t value = o->value;
+
+		if (o->flag == MODE_OP_COPY) {
+			value &= newmode;
+			value |= ((value & (S_IRUSR | S_IRGRP | S_IROTH))
+				? (S_IRUSR | S_IRGRP | S_IROTH) : 0)
+				| ((value & (S_IWUSR | S_IWGRP | S_IWOTH))
+				? (S_IWUSR | S_IWGRP | S_IWOTH) : 0)
+				| ((value & (S_IXUSR | S_IXGRP | S_IXOTH))
+				? (S_IXUSR | S_IXGRP | S_IXOTH) : 0);
+		} else if (o->flag == MODE_OP_X) {
+			if (dir == 1 || (newmode & (S_IXUSR | S_IXGRP | S_IXOTH)))
+				value |= S_IXUSR | S_IXGRP | S_IXOTH;
+		}
+
+		value &= (o->who != 0 ? o->who : ~spec->umask) & ~omit;
+
+		switch (o->op) {
+		case '=': {
+			const mode_t keep = (o->who != 0 ? ~o->who : 0) | omit;
+			newmode = (newmode & keep) | value;
+			}
+			break;
+		case '+': newmode |= value; break;
+		case '-': newmode &= ~value; break;
+		default: break;
+		}
+	}
+
+	return newmode & CHMOD_BITS;
+}
+
+/*
+ * Tree walker
+ */
+
+/* Record an error for the file NAME in the directory PATH (NAME is a full
+ * path if PATH is NULL) */
+static void
+add_chtree_error(struct chtree_run_t *r, const char *path, const char *name,
+	const int err)
+{
+	pthread_mutex_lock(&r->mutex);
+
+	struct chtree_stats_t *st = r->st;
+	if (st->errors < CHTREE_ERRORS_MAX) {
+		const char *errstr = strerror(err);
+		const size_t len = (path ? strlen(path) + 1 : 0) + strlen(name)
+			+ strlen(errstr) + 3;
+		char *msg = (char *)xnmalloc(len, sizeof(char));
+		snprintf(msg, len, "%s%s%s: %s", path ? path : "",
+			(path && path[strlen(path) - 1] != '/') ? "/" : "", name, errstr);
+		st->err_msgs[st->errors] = msg;
+	}
+
+	st->errors++;
+	st->last_err = err;
+
+	pthread_mutex_unlock(&r->mutex);
+}
+
+/* Change the mode of the file NAME, relative to the directory FD, to MODE,
+ * failing with ELOOP if NAME is a symbolic link instead of following it.
+ * Returns 0 on success or -1 on error (errno is set) */
+static int
+chmod_nofollow(const int fd, const char *name, const mode_t mode)
+{
+	if (fchmodat(fd, name, mode, AT_SYMLINK_NOFOLLOW) == 0)
+		return 0;
+
+#if defined(__linux__) && defined(O_PATH)
+	/* The C library may not support AT_SYMLINK_NOFOLLOW here (or report
+	 * NAME as a symbolic link this way). Change the file through an O_PATH
+	 * file descriptor, which never follows NAME, and its /proc entry */
+	if (errno != ENOTSUP && errno != EOPNOTSUPP)
+		return -1;
+
+	const int pfd = openat(fd, name, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+	if (pfd == -1)
+		return -1;
+
+	struct stat a;
+	int ret = fstat(pfd, &a);
+	if (ret == 0 && S_ISLNK(a.st_mode)) {
+		errno = ELOOP;
+		ret = -1;
+	} else if (ret == 0) {
+		char p[64];
+		snprintf(p, sizeof(p), "/proc/self/fd/%d", pfd);
+		ret = chmod(p, mode);
+	}
+
+	const int saved_errno = errno;
+	close(pfd);
+	errno = saved_errno;
+	return ret;
+#else
+	return -1;
+#endif /* __linux__ && O_PATH */
+}
+
+/* Apply the operation OP to the file NAME, relative to the directory FD,
+ * whose current attributes are A. FLAGS is passed to fchownat(2): if it
+ * includes AT_SYMLINK_NOFOLLOW, NAME is not followed by mode changes
+ * either.
+ * Returns 1 if the file was changed, 0 if it was left as it was, or -1 on
+ * error (errno is set) */
+static int
+chtree_apply(const int fd, const char *name, const struct stat *a,
+	const struct chtree_op_t *op, const int flags)
+{
+	if (op->type == CHTREE_MODE) {
+		if (S_ISLNK(a->st_mode))
+			return 0;
+
+		const mode_t mode = apply_mode_spec(op->spec, a->st_mode);
+		if (mode == (a->st_mode & CHMOD_BITS))
+			return 0;
+
+		const int ret = (flags & AT_SYMLINK_NOFOLLOW)
+			? chmod_nofollow(fd, name, mode) : fchmodat(fd, name, mode, 0);
+		return ret == -1 ? -1 : 1;
+	}
+
+	if ((op->uid == (uid_t)-1 || op->uid == a->st_uid)
+	&& (op->gid == (gid_t)-1 || op->gid == a->st_gid))
+		return 0;
+
+	return fchownat(fd, name, op->uid, op->gid, flags) == -1 ? -1 : 1;
+}
+
+/* Push the directory PATH, whose file descriptor is FD, onto the stack.
+ * PATH is taken by the stack */
+static void
+push_chtree_dir(struct chtree_run_t *r, char *path, int fd)
+{
+	struct chtree_dir_t *d =
+		(struct chtree_dir_t *)xnmalloc(1, sizeof(struct chtree_dir_t));
+
+	pthread_mutex_lock(&r->mutex);
+
+	if (fd != -1) {
+		if (r->queued_fds >= CHTREE_QUEUED_FDS) {
+			close(fd);
+			fd = -1;
+		} else {
+			r->queued_fds++;
+		}
+	}
+
+	d->path = path;
+	d->fd = fd;
+	d->pad = 0;
+	d->next = r->stack;
+	r->stack = d;
+
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->mutex);
+}
+
+/* Build the path of the entry NAME in the directory PATH */
+static char *
+chtree_path(const char *path, const char *name)
+{
+	const size_t plen = strlen(path);
+	const size_t nlen = strlen(name);
+	const int slash = (plen > 0 && path[plen - 1] == '/');
+
+	char *p = (char *)xnmalloc(plen + nlen + 2, sizeof(char));
+	memcpy(p, path, plen);
+	if (slash == 0)
+		p[plen] = '/';
+	memcpy(p + plen + (slash == 0), name, nlen + 1);
+
+	return p;
+}
+
+/* Change all entries in the directory PATH (opened as FD), pushing
+ * subdirectories onto the stack */
+static void
+walk_chtree_dir(struct chtree_run_t *r, const char *path, const int fd,
+	struct chtree_count_t *c)
+{
+	DIR *dir = fdopendir(fd);
+	if (!dir) {
+		add_chtree_error(r, NULL, path, errno);
+		close(fd);
+		return;
+	}
+
+	const struct chtree_op_t *op = r->op;
+	struct dirent *ent;
+
+	while ((ent = readdir(dir)) != NULL) {
+		const char *n = ent->d_name;
+		if (*n == '.' && (!n[1] || (n[1] == '.' && !n[2])))
+			continue;
+
+		struct stat a;
+		if (fstatat(fd, n, &a, AT_SYMLINK_NOFOLLOW) == -1) {
+			add_chtree_error(r, path, n, errno);
+			continue;
+		}
+
+		const int ret = chtree_apply(fd, n, &a, op, AT_SYMLINK_NOFOLLOW);
+		if (ret == -1)
+			add_chtree_error(r, path, n, errno);
+		else if (ret == 1)
+			c->changed++;
+		else
+			c->unchanged++;
+
+		if (!S_ISDIR(a.st_mode))
+			continue;
+
+		const int dfd = openat(fd, n, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+		if (dfd == -1) {
+			add_chtree_error(r, path, n, errno);
+			continue;
+		}
+
+		push_chtree_dir(r, chtree_path(path, n), dfd);
+	}
+
+	closedir(dir);
+}
+
+/* Pool job: pop and walk directories until the stack is empty and no
+ * other thread could push new ones */
+static void
+chtree_worker(void *arg, const size_t i)
+{
+	UNUSED(i);
+	struct chtree_run_t *r = (struct chtree_run_t *)arg;
+	struct chtree_count_t c = {0, 0};
+
+	pthread_mutex_lock(&r->mutex);
+
+	while (1) {
+		while (!r->stack && r->busy > 0)
+			pthread_cond_wait(&r->cond, &r->mutex);
+
+		if (!r->stack)
+			break;
+
+		struct chtree_dir_t *d = r->stack;
+		r->stack = d->next;
+		if (d->fd != -1)
+			r->queued_fds--;
+		r->busy++;
+		pthread_mutex_unlock(&r->mutex);
+
+		int fd = d->fd;
+		if (fd == -1)
+			fd = open(d->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+
+		if (fd == -1)
+			add_chtree_error(r, NULL, d->path, errno);
+		else
+			walk_chtree_dir(r, d->path, fd, &c);
+
+		free(d->path);
+		free(d);
+
+		pthread_mutex_lock(&r->mutex);
+		r->busy--;
+		if (!r->stack && r->busy == 0)
+			pthread_cond_broadcast(&r->cond);
+	}
+
+	r->st->changed += c.changed;
+	r->st->unchanged += c.unchanged;
+	pthread_mutex_unlock(&r->mutex);
+}
+
+/* Apply OP to all FILES (a NULL terminated list) and, if OP->RECURSIVE is
+ * set, to the contents of those of them that are directories. Results are
+ * stored in ST, whose error messages must be freed by
+ * print_chtree_errors().
+ * Returns EXIT_SUCCESS, or the errno value of the last error */
+int
+chtree(char **files, const struct chtree_op_t *op, struct chtree_stats_t *st)
+{
+	memset(st, 0, sizeof(struct chtree_stats_t));
+
+	struct chtree_run_t r;
+	r.op = op;
+	r.st = st;
+	r.stack = (struct chtree_dir_t *)NULL;
+	r.queued_fds = 0;
+	r.busy = 0;
+	pthread_mutex_init(&r.mutex, NULL);
+	pthread_cond_init(&r.cond, NULL);
+
+	size_t i;
+	for (i = 0; files[i]; i++) {
+		struct stat a;
+		if (stat(files[i], &a) == -1) {
+			add_chtree_error(&r, NULL, files[i], errno);
+			continue;
+		}
+
+		const int ret = chtree_apply(AT_FDCWD, files[i], &a, op, 0);
+		if (ret == -1)
+			add_chtree_error(&r, NULL, files[i], errno);
+		else if (ret == 1)
+			st->changed++;
+		else
+			st->unchanged++;
+
+		if (op->recursive == 0 || !S_ISDIR(a.st_mode))
+			continue;
+
+		const int fd = open(files[i], O_RDONLY | O_DIRECTORY);
+		if (fd == -1) {
+			add_chtree_error(&r, NULL, files[i], errno);
+			continue;
+		}
+
+		push_chtree_dir(&r, savestring(files[i], strlen(files[i])), fd);
+	}
+
+	if (r.stack) {
+		/* One job per thread: each of them walks the shared stack until
+		 * the whole tree is done. Jobs taken once the stack is empty
+		 * return right away */
+		struct pool_t pool;
+		pool_init(&pool, POOL_THREADS, chtree_worker, &r);
+		pool_run(&pool);
+	}
+
+	pthread_cond_destroy(&r.cond);
+	pthread_mutex_destroy(&r.mutex);
+
+	return st->errors > 0 ? st->last_err : EXIT_SUCCESS;
+}
+
+/* Print the errors stored in ST, prefixed by CMD, and free them */
+void
+print_chtree_errors(const char *cmd, struct chtree_stats_t *st)
+{
+	size_t i;
+	for (i = 0; i < st->errors && i < CHTREE_ERRORS_MAX; i++) {
+		fprintf(stderr, "%s: %s\n", cmd, st->err_msgs[i]);
+		free(st->err_msgs[i]);
+		st->err_msgs[i] = (char *)NULL;
+	}
+
+	if (st->errors > CHTREE_ERRORS_MAX) {
+		fprintf(stderr, _("%s: %zu more error(s)\n"), cmd,
+			st->errors - CHTREE_ERRORS_MAX);
+	}
+}
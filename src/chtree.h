@@ -0,0 +1,92 @@
+/* chtree.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef CHTREE_H
+#define CHTREE_H
+
+#include <sys/types.h>
+
+/* Kinds of mode change operations (see struct mode_op_t) */
+#define MODE_OP_ORDINARY 0
+#define MODE_OP_COPY     1 /* Copy the bits of a class (u, g, or o) */
+#define MODE_OP_X        2 /* X: execute only for dirs and executables */
+
+/* Change operations */
+#define CHTREE_MODE  0
+#define CHTREE_OWNER 1
+
+/* Max number of error messages kept for the final summary */
+#define CHTREE_ERRORS_MAX 8
+
+/* A single operation of a symbolic mode, as in chmod(1): "u+x" is one
+ * operation, and so are "+X" and "g=u" */
+struct mode_op_t {
+	mode_t who;       /* Affected bits (zero: all bits not in the umask) */
+	mode_t value;     /* Bits to be added, removed, set, or copied */
+	mode_t mentioned; /* Bits explicitly named by the operation */
+	char op;          /* '+', '-', or '=' */
+	char flag;        /* MODE_OP_ORDINARY, MODE_OP_COPY, or MODE_OP_X */
+	char pad[2];
+};
+
+/* A compiled file mode: either an absolute mode or a list of operations
+ * applied to the current mode of each file */
+struct mode_spec_t {
+	struct mode_op_t *ops;
+	size_t ops_n;  /* Zero for absolute modes */
+	mode_t mode;   /* The absolute mode, if OPS_N is zero */
+	mode_t umask;
+	mode_t dir_keep; /* Bits of directories kept by the absolute mode */
+	int pad;
+};
+
+/* What to do with each file visited by chtree() */
+struct chtree_op_t {
+	const struct mode_spec_t *spec; /* CHTREE_MODE only */
+	uid_t uid; /* CHTREE_OWNER only. -1 to keep the current value */
+	gid_t gid; /* Same as UID */
+	int type;  /* CHTREE_MODE or CHTREE_OWNER */
+	int recursive;
+};
+
+struct chtree_stats_t {
+	size_t changed;
+	size_t unchanged; /* Files already having the requested attributes */
+	size_t errors;
+	char *err_msgs[CHTREE_ERRORS_MAX]; /* The first errors ("FILE: ERROR") */
+	int last_err; /* errno value of the last error, if any */
+	int pad;
+};
+
+__BEGIN_DECLS
+
+mode_t apply_mode_spec(const struct mode_spec_t *, const mode_t);
+int    chtree(char **, const struct chtree_op_t *, struct chtree_stats_t *);
+int    compile_mode_spec(const char *, struct mode_spec_t *);
+void   free_mode_spec(struct mode_spec_t *);
+void   print_chtree_errors(const char *, struct chtree_stats_t *);
+
+__END_DECLS
+
+#endif /* CHTREE_H */
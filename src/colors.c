@@ -41,6 +41,7 @@
 #include "file_operations.h"
 #include "exec.h"
 #include "config.h" /* set_div_line() */
+#include "properties.h" /* clear_props_cache() */
 
 #ifndef CLIFM_SUCKLESS
 /* qsort(3) is used only by get_colorschemes(), which is not included
@@ -1784,6 +1785,8 @@ set_colors(const char *colorscheme, const int check_env)
 
 	date_shades.type = SHADE_TYPE_UNSET;
 	size_shades.type = SHADE_TYPE_UNSET;
+	/* Long view fields are rendered using the current colors */
+	clear_props_cache();
 
 #ifndef _NO_ICONS
 	*dir_ico_c = '\0';
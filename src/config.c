@@ -37,11 +37,14 @@
 #include "colors.h"
 #include "config.h"
 #include "exec.h"
+#include "filter.h"
+#include "history.h"
 #include "init.h"
 #include "listing.h"
 #include "messages.h"
 #include "misc.h"
 #include "navigation.h"
+#include "persist.h"
 #include "file_operations.h"
 #include "autocmds.h"
 
@@ -332,6 +335,9 @@ dump_config(void)
 	print_config_value("PropFields", prop_fields_str, s, DUMP_CONFIG_STR);
 	n = DEF_PURGE_JUMPDB;
 	print_config_value("PurgeJumpDB", &conf.purge_jumpdb, &n, DUMP_CONFIG_BOOL);
+	n = DEF_REFRESH_DELAY;
+	print_config_value("RefreshDelay", &conf.refresh_delay, &n,
+		DUMP_CONFIG_INT);
 	n = DEF_RESTORE_LAST_PATH;
 	print_config_value("RestoreLastPath", &conf.restore_last_path, &n,
 		DUMP_CONFIG_BOOL);
@@ -408,6 +414,9 @@ dump_config(void)
 	print_config_value("WelcomeMessageStr", conf.welcome_message_str,
 		s, DUMP_CONFIG_STR);
 
+	n = DEF_WS_CACHE_SIZE;
+	print_config_value("WorkspaceCacheSize", &conf.ws_cache_size, &n,
+		DUMP_CONFIG_INT);
 	s = "";
 	print_config_value("WorkspaceNames", ws_names, s, DUMP_CONFIG_STR);
 	free(ws_names);
@@ -612,15 +621,14 @@ create_kbinds_file(void)
 		char sys_file[PATH_MAX];
 		snprintf(sys_file, sizeof(sys_file), "%s/%s/keybindings.clifm",
 			data_dir, PNL);
-		if (stat(sys_file, &attr) == EXIT_SUCCESS) {
-			char *cmd[] = {"cp", sys_file, kbinds_file, NULL};
-			if (launch_execve(cmd, FOREGROUND, E_NOFLAG) == EXIT_SUCCESS)
-				return EXIT_SUCCESS;
-		}
+		if (stat(sys_file, &attr) == EXIT_SUCCESS
+		&& persist_copy(sys_file, kbinds_file) == EXIT_SUCCESS)
+			return EXIT_SUCCESS;
 	}
 
 	/* Else, create it */
-	FILE *fp = fopen(kbinds_file, "w");
+	struct persist_t p;
+	FILE *fp = persist_open(&p, kbinds_file, PERSIST_SYNC);
 	if (!fp) {
 		_err('w', PRINT_PROMPT, "%s: '%s': %s\n", PROGRAM_NAME, kbinds_file,
 			strerror(errno));
@@ -768,7 +776,12 @@ quit:\\e[24~\n\
 #plugin4:\n",
 	    PROGRAM_NAME);
 
-	fclose(fp);
+	if (persist_commit(&p) != EXIT_SUCCESS) {
+		_err('w', PRINT_PROMPT, "%s: '%s': %s\n", PROGRAM_NAME, kbinds_file,
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+
 	return EXIT_SUCCESS;
 }
 
@@ -1406,7 +1419,9 @@ create_config(char *file)
 		"# Use a regex expression to filter file names when listing files.\n\
 # Example: \"!.*~$\" to exclude backup files (ending with ~), or \"^\\.\" to list \n\
 # only hidden files. File type filters are also supported. Example: \"=d\" to\n\
-# list directories only, or \"!=l\" to exclude all symlinks.\n\
+# list directories only, or \"!=l\" to exclude all symlinks. Filter expressions\n\
+# are supported as well. Example: \"type:f size:>1M\" to list only regular\n\
+# files bigger than 1MiB.\n\
 # Run 'help file-filters' for more information.\n\
 ;Filter=""\n\n"
 
@@ -1629,7 +1644,12 @@ create_config(char *file)
 # the command line or keyboard shortcuts) are kept private to that workspace\n\
 # and made persistent (for the current session only), even when switching\n\
 # workspaces.\n\
-;PrivateWorkspaceSettings=%s\n\n"
+;PrivateWorkspaceSettings=%s\n\n\
+# Keep the listing of workspaces you leave in memory (up to this amount\n\
+# of MiB for all workspaces), so that switching back to them does not\n\
+# require reading the directory again, unless it was modified in the\n\
+# meantime. Set it to 0 to disable this feature.\n\
+;WorkspaceCacheSize=%d\n\n"
 
 		"# A comma separated list of workspace names in the form NUM=NAME\n\
 # Example: \"1=MAIN,2=EXTRA,3=GIT,4=WORK\" or \"1=α,2=β,3=γ,4=δ\"\n\
@@ -1672,6 +1692,7 @@ create_config(char *file)
 		DEF_SORT,
 		DEF_SORT_REVERSE == 1 ? "true" : "false",
 		DEF_PRIVATE_WS_SETTINGS == 1 ? "true" : "false",
+		DEF_WS_CACHE_SIZE,
 		DEF_TIPS == 1 ? "true" : "false",
 		DEF_LIST_DIRS_FIRST == 1 ? "true" : "false",
 		DEF_CASE_SENS_LIST == 1 ? "true" : "false",
@@ -1701,6 +1722,12 @@ create_config(char *file)
 	    "# If set to true, clear the screen before listing files\n\
 ;ClearScreen=%s\n\n"
 
+	    "# Changes made to the current directory (even while idle at the prompt)\n\
+# are reflected in the files list automatically. Make at least this amount\n\
+# of milliseconds elapse between two automatic refreshes: changes happening\n\
+# in the meantime are handled by a single refresh.\n\
+;RefreshDelay=%d\n\n"
+
 	    "# If not specified, StartingPath defaults to the current working\n\
 # directory. If set, it overrides RestoreLastPath\n\
 ;StartingPath=\n\n"
@@ -1724,6 +1751,7 @@ create_config(char *file)
 		DEF_PRINTSEL == 1 ? "true" : "false",
 		DEF_MAX_PRINTSEL,
 		DEF_CLEAR_SCREEN == 1 ? "true" : "false",
+		DEF_REFRESH_DELAY,
 		DEF_RESTORE_LAST_PATH == 1 ? "true" : "false",
 		DEF_TRASRM == 1 ? "true" : "false",
 		DEF_RL_EDIT_MODE
@@ -2363,7 +2391,7 @@ _set_filter(const char *line)
 		filter.rev = 0;
 	}
 
-	set_filter_type(*q);
+	set_filter_type(q);
 	free(filter.str);
 	filter.str = savestring(q, l);
 
@@ -2843,6 +2871,14 @@ read_config(void)
 			set_config_bool_value(line + 12, &conf.purge_jumpdb);
 		}
 
+		else if (*line == 'R' && strncmp(line, "RefreshDelay=", 13) == 0) {
+			int opt_num = 0;
+			ret = sscanf(line + 13, "%d\n", &opt_num);
+			if (ret == -1 || opt_num < 0)
+				continue;
+			conf.refresh_delay = opt_num;
+		}
+
 		else if (xargs.restore_last_path == UNSET && *line == 'R'
 		&& strncmp(line, "RestoreLastPath=", 16) == 0) {
 			set_config_bool_value(line + 16, &conf.restore_last_path);
@@ -3065,6 +3101,14 @@ read_config(void)
 			conf.welcome_message_str = savestring(tmp, strlen(tmp));
 		}
 
+		else if (*line == 'W' && strncmp(line, "WorkspaceCacheSize=", 19) == 0) {
+			int opt_num = 0;
+			ret = sscanf(line + 19, "%d\n", &opt_num);
+			if (ret == -1 || opt_num < 0)
+				continue;
+			conf.ws_cache_size = opt_num;
+		}
+
 		else {
 			if (*line == 'W' && strncmp(line, "WorkspaceNames=", 15) == 0)
 				set_workspace_names(line + 15);
@@ -3079,15 +3123,16 @@ read_config(void)
 		conf.list_dirs_first = conf.welcome_message = 0;
 	}
 
-	if (filter.str && filter.type == FILTER_FILE_NAME) {
-		regfree(&regex_exp);
-		ret = regcomp(&regex_exp, filter.str, REG_NOSUB | REG_EXTENDED);
+	if (filter.str) {
+		const char *err = (const char *)NULL;
+		ret = compile_filter_prog(filter.str, filter.type, &filter_prog, &err);
 		if (ret != EXIT_SUCCESS) {
-			_err('w', PRINT_PROMPT, _("%s: '%s': Invalid regular "
-				"expression\n"), PROGRAM_NAME, filter.str);
+			_err('w', PRINT_PROMPT, _("%s: '%s': %s\n"), PROGRAM_NAME,
+				filter.str, _(err));
 			free(filter.str);
 			filter.str = (char *)NULL;
-			regfree(&regex_exp);
+			filter.type = FILTER_NONE;
+			free_filter_prog(&filter_prog);
 		}
 	}
 
@@ -3333,7 +3378,7 @@ reset_variables(void)
 	free_remotes(0);
 
 	if (filter.str && filter.env == 0) {
-		regfree(&regex_exp);
+		free_filter_prog(&filter_prog);
 		free(filter.str);
 		filter.str = (char *)NULL;
 		filter.rev = 0;
@@ -3386,7 +3431,6 @@ reset_variables(void)
 	mime_match = 0;
 	no_log = 0;
 	print_msg = 0;
-	recur_perm_error_flag = 0;
 	sel_is_last = 0;
 	shell_is_interactive = 0;
 	shell_terminal = 0;
@@ -3582,12 +3626,14 @@ reload_config(void)
 	check_completion_mode();
 #endif /* !_NO_FZF */
 
+	/* The directory history and the jump database are read again
+	 * from disk: write pending changes first */
+	flush_stores(FLUSH_ALL);
+
 	/* Free the aliases and prompt_cmds arrays to be allocated again */
-	int i = dirhist_total_index;
-	while (--i >= 0)
-		free(old_pwd[i]);
-	free(old_pwd);
-	old_pwd = (char **)NULL;
+	free_dirhist();
+
+	int i;
 
 	if (jump_db) {
 		for (i = 0; jump_db[i].path; i++)
@@ -3611,7 +3657,6 @@ reload_config(void)
 	while (--i >= 0)
 		free(prompt_cmds[i]);
 
-	dirhist_total_index = 0;
 	prompt_cmds_n = 0;
 
 	get_aliases();
@@ -0,0 +1,488 @@
+/* cursor.c -- keep track of the cursor position on the terminal */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* enable_raw_mode, disable_raw_mode, and query_cursor_position functions
+ * are taken from https://github.com/antirez/linenoise/blob/master/linenoise.c,
+ * licensed under BSD-2-Clause.
+ * All changes are licenced under GPL-2.0-or-later. */
+
+/* Querying the cursor position (CPR) means writing a request to the
+ * terminal and blocking until it replies, which is slow over slow ttys
+ * and terminal multiplexers, and keys typed in the meanwhile get lost.
+ * Instead, readline's output stream (rl_outstream) is replaced by a
+ * stream that writes to the same file descriptor, but also feeds every
+ * written byte to a model of the terminal cursor: printable characters
+ * (taking wrapping and wide characters into account), control characters,
+ * and cursor movement escape sequences. The standard streams are left
+ * alone.
+ *
+ * Since the model only sees what readline writes (the prompt, the input
+ * line, and the completions list), it is invalidated whenever something
+ * else might have written to the terminal: a new prompt is about to be
+ * printed (the files list, or a command, was printed before), an external
+ * command was run, or the terminal was resized. Only then is the terminal
+ * queried, and the answer becomes the new starting point of the model.
+ *
+ * If CURSOR_DEBUG_ENV is set, the terminal is always queried, and the
+ * number of checks and mismatches is printed at exit. */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <limits.h> /* INT_MIN */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <wchar.h>
+#include <readline/readline.h>
+
+#include "aux.h"
+#include "cursor.h"
+
+#define CPR     "\x1b[6n" /* Cursor position report */
+#define CPR_LEN (sizeof(CPR) - 1)
+
+#define CSI_MAX_PARAMS 4
+
+/* States of the escape sequences parser */
+#define CUR_GROUND   0
+#define CUR_ESC      1 /* ESC */
+#define CUR_CSI      2 /* ESC [ */
+#define CUR_STR      3 /* OSC, DCS, APC, PM, and SOS: ignored up to ST/BEL */
+#define CUR_STR_ESC  4 /* ESC inside a string: maybe ST (ESC \) */
+#define CUR_CHARSET  5 /* ESC ( and friends: one more byte to skip */
+
+static struct cursor_model_t {
+	int line; /* 1-based, as reported by the terminal */
+	int col;
+	int saved_line;
+	int saved_col;
+	int pending_wrap; /* The last column was written: wrap before the next char */
+	int state;
+	int private_csi;
+	int nparams;
+	int params[CSI_MAX_PARAMS];
+	size_t checks;
+	size_t mismatches;
+	size_t queries;
+	mbstate_t mbs;
+	volatile sig_atomic_t valid;
+	int debug;
+} cur;
+
+/* Set the terminal into raw mode. Return 0 on success and -1 on error */
+static int
+enable_raw_mode(const int fd)
+{
+	struct termios raw;
+
+	if (!isatty(STDIN_FILENO))
+		goto FAIL;
+
+	if (tcgetattr(fd, &orig_termios) == -1)
+		goto FAIL;
+
+	raw = orig_termios;  /* modify the original mode */
+	/* input modes: no break, no CR to NL, no parity check, no strip char,
+	 * no start/stop output control. */
+	raw.c_iflag &= (tcflag_t)~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+	/* output modes - disable post processing */
+	raw.c_oflag &= (tcflag_t)~(OPOST);
+	/* control modes - set 8 bit chars */
+	raw.c_cflag |= (CS8);
+	/* local modes - choing off, canonical off, no extended functions,
+	 * no signal chars (^Z,^C) */
+	raw.c_lflag &= (tcflag_t)~(ECHO | ICANON | IEXTEN | ISIG);
+    /* control chars - set return condition: min number of bytes and timer. */
+    /* We want read to return every single byte, without timeout. */
+	raw.c_cc[VMIN] = 1; raw.c_cc[VTIME] = 0; /* 1 byte, no timer */
+
+	/* Put terminal in raw mode after flushing */
+	if (tcsetattr(fd, TCSAFLUSH, &raw) < 0)
+		goto FAIL;
+
+	return 0;
+
+FAIL:
+	errno = ENOTTY;
+	return -1;
+}
+
+static int
+disable_raw_mode(const int fd)
+{
+	if (tcsetattr(fd, TCSAFLUSH, &orig_termios) != -1)
+		return EXIT_SUCCESS;
+	return EXIT_FAILURE;
+}
+
+/* Use the "ESC [6n" escape sequence to query the cursor position (both
+ * vertical and horizontal) and store both values into C (columns) and L (lines).
+ * Returns 0 on success and 1 on error */
+static int
+query_cursor_position(int *c, int *l)
+{
+	char buf[32];
+	unsigned int i = 0;
+
+	/* Whatever is still buffered must reach the terminal first */
+	fflush(stdout);
+	fflush(stderr);
+
+	if (enable_raw_mode(STDIN_FILENO) == -1) return EXIT_FAILURE;
+
+	cur.queries++;
+
+	/* 1. Ask the terminal about cursor position */
+	if (write(STDOUT_FILENO, CPR, CPR_LEN) != CPR_LEN)
+		{ disable_raw_mode(STDIN_FILENO); return EXIT_FAILURE; }
+
+	/* 2. Read the response: "ESC [ rows ; cols R" */
+	int read_err = 0;
+	while (i < sizeof(buf) - 1) {
+		if (read(STDIN_FILENO, buf + i, 1) != 1) /* flawfinder: ignore */
+			{ read_err = 1; break; }
+		if (buf[i] == 'R')
+			break;
+		i++;
+	}
+	buf[i] = '\0';
+
+	if (disable_raw_mode(STDIN_FILENO) == -1 || read_err == 1)
+		return EXIT_FAILURE;
+
+	/* 3. Parse the response */
+	if (*buf != _ESC || *(buf + 1) != '[' || !*(buf + 2))
+		return EXIT_FAILURE;
+
+	char *p = strchr(buf + 2, ';');
+	if (!p || !*(p + 1)) return EXIT_FAILURE;
+
+	*p = '\0';
+	*l = atoi(buf + 2);	*c = atoi(p + 1);
+	if (*l == INT_MIN || *c == INT_MIN)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
+
+/* The cursor position is unknown from now on: something we cannot see
+ * (an external command) wrote to the terminal, or it was resized.
+ * Async-signal-safe */
+void
+invalidate_cursor_model(void)
+{
+	cur.valid = 0;
+}
+
+/* Get the current cursor position: column into C and line into L.
+ * The terminal is queried only if the cursor model is not valid.
+ * Returns 0 on success and 1 on error */
+int
+get_cursor_position(int *c, int *l)
+{
+#ifdef CURSOR_MODEL
+	fflush(stdout);
+	fflush(stderr);
+
+	if (cur.valid == 1 && cur.debug == 0) {
+		*c = cur.col;
+		*l = cur.line;
+		return EXIT_SUCCESS;
+	}
+#endif /* CURSOR_MODEL */
+
+	if (query_cursor_position(c, l) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+#ifdef CURSOR_MODEL
+	if (cur.valid == 1 && cur.debug == 1) {
+		cur.checks++;
+		if (cur.line != *l || cur.col != *c)
+			cur.mismatches++;
+	}
+
+	cur.line = *l;
+	cur.col = *c;
+	cur.pending_wrap = 0;
+	cur.valid = 1;
+#endif /* CURSOR_MODEL */
+
+	return EXIT_SUCCESS;
+}
+
+void
+print_cursor_model_stats(void)
+{
+	if (cur.debug == 0)
+		return;
+
+	fflush(stdout);
+	fprintf(stderr, "%s: cursor model: %zu checks, %zu mismatches, "
+		"%zu queries\n", PROGRAM_NAME, cur.checks, cur.mismatches,
+		cur.queries);
+}
+
+#ifdef CURSOR_MODEL
+static inline int
+clamp_pos(const int n, const int max)
+{
+	if (n < 1)
+		return 1;
+	return (max > 0 && n > max) ? max : n;
+}
+
+/* Move the cursor one line down, scrolling at the bottom of the screen */
+static inline void
+cursor_line_feed(void)
+{
+	if (term_lines <= 0 || cur.line < term_lines)
+		cur.line++;
+}
+
+/* Advance the cursor over a printable character of width W */
+static void
+cursor_print(const int w)
+{
+	if (w <= 0)
+		return;
+
+	if (cur.pending_wrap == 1 || (term_cols > 0 && cur.col + w - 1 > term_cols)) {
+		cursor_line_feed();
+		cur.col = 1;
+		cur.pending_wrap = 0;
+	}
+
+	cur.col += w;
+	if (term_cols > 0 && cur.col > term_cols) {
+		/* The cursor stays on the last column until the next char */
+		cur.col = term_cols;
+		cur.pending_wrap = 1;
+	}
+}
+
+static void
+run_csi(const int final)
+{
+	const int n = (cur.nparams > 0 && cur.params[0] > 0) ? cur.params[0] : 1;
+	const int m = (cur.nparams > 1 && cur.params[1] > 0) ? cur.params[1] : 1;
+
+	switch (final) {
+	case 'A': cur.line = clamp_pos(cur.line - n, term_lines); break;
+	case 'e': /* fallthrough */
+	case 'B': cur.line = clamp_pos(cur.line + n, term_lines); break;
+	case 'a': /* fallthrough */
+	case 'C': cur.col = clamp_pos(cur.col + n, term_cols); break;
+	case 'D': cur.col = clamp_pos(cur.col - n, term_cols); break;
+	case 'E': cur.line = clamp_pos(cur.line + n, term_lines); cur.col = 1; break;
+	case 'F': cur.line = clamp_pos(cur.line - n, term_lines); cur.col = 1; break;
+	case '`': /* fallthrough */
+	case 'G': cur.col = clamp_pos(n, term_cols); break;
+	case 'd': cur.line = clamp_pos(n, term_lines); break;
+	case 'f': /* fallthrough */
+	case 'H':
+		cur.line = clamp_pos(n, term_lines);
+		cur.col = clamp_pos(m, term_cols);
+		cur.valid = 1; /* Absolute position */
+		break;
+	case 'r': cur.line = cur.col = 1; break; /* DECSTBM homes the cursor */
+	case 's': cur.saved_line = cur.line; cur.saved_col = cur.col; break;
+	case 'u': cur.line = cur.saved_line; cur.col = cur.saved_col; break;
+	default: return; /* SGR, ED, EL, and friends do not move the cursor */
+	}
+
+	cur.pending_wrap = 0;
+}
+
+static void
+run_esc(const unsigned char c)
+{
+	cur.state = CUR_GROUND;
+
+	switch (c) {
+	case '[':
+		cur.state = CUR_CSI;
+		cur.nparams = cur.private_csi = 0;
+		memset(cur.params, 0, sizeof(cur.params));
+		return;
+	case ']': /* fallthrough */
+	case 'P': /* fallthrough */
+	case '_': /* fallthrough */
+	case '^': /* fallthrough */
+	case 'X': cur.state = CUR_STR; return;
+	case '(': /* fallthrough */
+	case ')': /* fallthrough */
+	case '*': /* fallthrough */
+	case '+': /* fallthrough */
+	case '#': /* fallthrough */
+	case '%': cur.state = CUR_CHARSET; return;
+	case '7': cur.saved_line = cur.line; cur.saved_col = cur.col; return;
+	case '8': cur.line = cur.saved_line; cur.col = cur.saved_col; break;
+	case 'c': cur.line = cur.col = 1; cur.valid = 1; break; /* RIS */
+	case 'D': cursor_line_feed(); break; /* IND */
+	case 'E': cursor_line_feed(); cur.col = 1; break; /* NEL */
+	case 'M': if (cur.line > 1) cur.line--; break; /* RI */
+	default: return; /* Keypad modes and the like */
+	}
+
+	cur.pending_wrap = 0;
+}
+
+static void
+feed_csi(const unsigned char c)
+{
+	if (c >= '0' && c <= '9') {
+		if (cur.nparams == 0)
+			cur.nparams = 1;
+		int *p = &cur.params[cur.nparams - 1];
+		if (*p < 10000)
+			*p = (*p * 10) + (c - '0');
+	} else if (c == ';') {
+		if (cur.nparams == 0)
+			cur.nparams = 1;
+		if (cur.nparams < CSI_MAX_PARAMS)
+			cur.nparams++;
+	} else if (c >= '<' && c <= '?') {
+		cur.private_csi = 1;
+	} else if (c >= 0x40 && c <= 0x7e) {
+		if (cur.private_csi == 0)
+			run_csi(c);
+		cur.state = CUR_GROUND;
+	} else if (c < 0x20 || c > 0x7e) {
+		cur.state = CUR_GROUND; /* Malformed sequence */
+	}
+	/* Intermediate bytes (0x20-0x2f) are ignored */
+}
+
+/* Update the cursor model with the byte C, written to the terminal */
+static void
+feed_cursor_model(const unsigned char c)
+{
+	switch (cur.state) {
+	case CUR_ESC: run_esc(c); return;
+	case CUR_CSI: feed_csi(c); return;
+	case CUR_CHARSET: cur.state = CUR_GROUND; return;
+	case CUR_STR:
+		if (c == '\a')
+			cur.state = CUR_GROUND;
+		else if (c == _ESC)
+			cur.state = CUR_STR_ESC;
+		return;
+	case CUR_STR_ESC:
+		cur.state = c == '\\' ? CUR_GROUND : CUR_STR;
+		return;
+	default: break;
+	}
+
+	if (c >= 0x20 && c < 0x7f) { /* Plain ASCII: the usual case */
+		cursor_print(1);
+		return;
+	}
+
+	if (c >= 0x80) {
+		wchar_t wc;
+		const char b = (char)c;
+		const size_t ret = mbrtowc(&wc, &b, 1, &cur.mbs);
+		if (ret == (size_t)-2) /* Incomplete multi-byte sequence */
+			return;
+		if (ret == (size_t)-1) { /* Invalid byte */
+			memset(&cur.mbs, 0, sizeof(mbstate_t));
+			cursor_print(1);
+			return;
+		}
+		cursor_print(wcwidth(wc));
+		return;
+	}
+
+	switch (c) {
+	case _ESC: cur.state = CUR_ESC; break;
+	/* We assume the ONLCR output flag is set (the default) */
+	case '\n': cursor_line_feed(); cur.col = 1; cur.pending_wrap = 0; break;
+	case '\r': cur.col = 1; cur.pending_wrap = 0; break;
+	case '\b': if (cur.col > 1) cur.col--; cur.pending_wrap = 0; break;
+	case '\t':
+		cur.col = clamp_pos(((cur.col - 1) / 8 + 1) * 8 + 1, term_cols);
+		break;
+	default: break; /* BEL and other control chars */
+	}
+}
+
+/* Write function for the stream replacing rl_outstream: write BUF to the
+ * file descriptor pointed to by COOKIE, updating the cursor model */
+static ssize_t
+cursor_stream_write(void *cookie, const char *buf, size_t size)
+{
+	const int fd = *(int *)cookie;
+	size_t done = 0;
+
+	/* Whatever we printed via stdout goes first, as it did when readline
+	 * wrote to stdout itself */
+	fflush(stdout);
+
+	while (done < size) {
+		const ssize_t n = write(fd, buf + done, size - done);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		done += (size_t)n;
+	}
+
+	size_t i;
+	for (i = 0; i < done; i++)
+		feed_cursor_model((unsigned char)buf[i]);
+
+	return done > 0 ? (ssize_t)done : -1;
+}
+
+static int rl_out_fd = STDOUT_FILENO;
+#endif /* CURSOR_MODEL */
+
+/* Start tracking the cursor position. Must be called before readline is
+ * initialized */
+void
+init_cursor_model(void)
+{
+	cur.debug = getenv(CURSOR_DEBUG_ENV) ? 1 : 0;
+	cur.valid = 0;
+	cur.line = cur.col = cur.saved_line = cur.saved_col = 1;
+
+#ifdef CURSOR_MODEL
+	if (!isatty(STDOUT_FILENO))
+		return;
+
+	cookie_io_functions_t io = {NULL, cursor_stream_write, NULL, NULL};
+	FILE *fp = fopencookie(&rl_out_fd, "w", io);
+	if (!fp)
+		return;
+
+	/* Unbuffered: readline output and ours must not be reordered */
+	setvbuf(fp, NULL, _IONBF, 0);
+	rl_outstream = fp;
+#endif /* CURSOR_MODEL */
+}
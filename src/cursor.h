@@ -0,0 +1,47 @@
+/* cursor.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef CURSOR_H
+#define CURSOR_H
+
+/* The cursor model needs glibc's fopencookie(3) to see what readline
+ * writes to the terminal. Elsewhere, the terminal is always queried */
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+# define CURSOR_MODEL
+#endif /* __GLIBC__ && _GNU_SOURCE */
+
+/* If set, always query the terminal, check the cursor model against the
+ * answer, and print the number of mismatches at exit */
+#define CURSOR_DEBUG_ENV "CLIFM_CURSOR_DEBUG"
+
+__BEGIN_DECLS
+
+int  get_cursor_position(int *, int *);
+void init_cursor_model(void);
+void invalidate_cursor_model(void);
+void print_cursor_model_stats(void);
+
+__END_DECLS
+
+#endif /* CURSOR_H */
@@ -31,9 +31,11 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef __OpenBSD__
@@ -54,6 +56,7 @@ typedef char *rl_cpvfunc_t;
 #include "checks.h"
 #include "colors.h"
 #include "config.h"
+#include "cursor.h"
 #include "exec.h"
 #include "file_operations.h"
 #include "history.h"
@@ -85,6 +88,7 @@ typedef char *rl_cpvfunc_t;
 #include "sanitize.h"
 #include "tags.h"
 #include "tabcomp.h"
+#include "watch.h"
 
 static char *
 get_new_filename(char *cur_name)
@@ -118,12 +122,13 @@ get_new_filename(char *cur_name)
 	return n;
 }
 
-/* Run CMD via execve() and refresh the screen in case of success
+/* Run CMD via execve() and refresh the screen in case of success.
+ * RAW tells which words in CMD are raw file names (see is_raw_arg()).
  * skip_force might be true (1) only when coming from cp_mv_file(), that is,
  * for the c and m commands, which take -f,--force as parameter to
  * intruct cp/mv to run non-interactivelly (no -i) */
 int
-run_and_refresh(char **cmd, const int skip_force)
+run_and_refresh(char **cmd, const char *raw, const int skip_force)
 {
 	if (!cmd)
 		return EXIT_FAILURE;
@@ -191,11 +196,15 @@ run_and_refresh(char **cmd, const int skip_force)
 		 * It instructs cp/mv to run non-interactively (no -i param) */
 		if (skip_force == 1 && i == 1 && is_force_param(cmd[i]) == 1)
 			continue;
+		if (is_raw_arg(raw, i) == 1) {
+			tcmd[n] = savestring(cmd[i], strlen(cmd[i]));
+			n++;
+			continue;
+		}
 		p = dequote_str(cmd[i], 0);
 		if (!p)
 			continue;
-		tcmd[n] = savestring(p, strlen(p));
-		free(p);
+		tcmd[n] = p;
 		n++;
 	}
 
@@ -313,6 +322,8 @@ launch_execle(const char *cmd)
 		sanitize_cmd_environ();
 
 	int status = system(cmd);
+	/* The command wrote to the terminal behind our back */
+	invalidate_cursor_model();
 
 	if (xargs.secure_cmds == 1 && xargs.secure_env_full == 0
 	&& xargs.secure_env == 0)
@@ -390,6 +401,7 @@ launch_execve(char **cmd, const int bg, const int xflags)
 
 	/* Get command status (pid > 0) */
 	else {
+		invalidate_cursor_model();
 		if (bg == 1) {
 			status = run_in_background(pid);
 		} else {
@@ -407,6 +419,106 @@ launch_execve(char **cmd, const int bg, const int xflags)
 	return status;
 }
 
+/* Run CMD via the system shell and return its standard output, minus
+ * trailing new line chars, or NULL in case of error. Used for command
+ * substitution. If CMD is still running after CMD_SUBST_TIMEOUT seconds,
+ * it is killed, and whatever it printed so far is returned */
+char *
+get_cmd_output(const char *cmd)
+{
+	if (!cmd || !*cmd)
+		return (char *)NULL;
+
+	int fd[2];
+	if (pipe(fd) == -1) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "%s: pipe: %s\n",
+			PROGRAM_NAME, strerror(errno));
+		return (char *)NULL;
+	}
+
+	/* Reenable SIGCHLD, in case it was disabled. Otherwise, waitpid
+	 * won't be able to reap the child */
+	signal(SIGCHLD, SIG_DFL);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "%s: fork: %s\n",
+			PROGRAM_NAME, strerror(errno));
+		close(fd[0]);
+		close(fd[1]);
+		return (char *)NULL;
+	}
+
+	if (pid == 0) {
+		signal(SIGHUP, SIG_DFL);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGQUIT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+
+		close(fd[0]);
+		dup2(fd[1], STDOUT_FILENO);
+		close(fd[1]);
+
+		/* The command must not compete with us for terminal input */
+		int nullfd = open("/dev/null", O_RDONLY);
+		if (nullfd != -1) {
+			dup2(nullfd, STDIN_FILENO);
+			close(nullfd);
+		}
+
+		execl(FALLBACK_SHELL, FALLBACK_SHELL, "-c", cmd, (char *)NULL);
+		_exit(EXEC_NOTFOUND);
+	}
+
+	/* Error messages still go to the terminal */
+	invalidate_cursor_model();
+	close(fd[1]);
+
+	size_t len = 0, size = NAME_MAX + 1;
+	char *buf = (char *)xnmalloc(size, sizeof(char));
+
+	struct pollfd pfd;
+	pfd.fd = fd[0];
+	pfd.events = POLLIN;
+
+	const time_t deadline = time(NULL) + CMD_SUBST_TIMEOUT;
+	while (1) {
+		const time_t now = time(NULL);
+		if (now >= deadline) {
+			kill(pid, SIGKILL);
+			break;
+		}
+
+		int ret = poll(&pfd, 1, (int)(deadline - now) * 1000);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			continue;
+
+		if (len + NAME_MAX + 1 > size) {
+			size *= 2;
+			buf = (char *)xrealloc(buf, size * sizeof(char));
+		}
+
+		ssize_t n = read(fd[0], buf + len, size - len - 1);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0) /* EOF: the command is done */
+			break;
+		len += (size_t)n;
+	}
+
+	close(fd[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+
+	while (len > 0 && buf[len - 1] == '\n')
+		len--;
+	buf[len] = '\0';
+
+	return buf;
+}
+
 /* Prevent the user from killing the program via the 'kill',
  * 'pkill' or 'killall' commands, from within CliFM itself.
  * Otherwise, the program will be forcefully terminated without
@@ -464,13 +576,7 @@ reload_binaries(void)
 	if (check_paths_timestamps() == EXIT_SUCCESS)
 		return;
 
-	if (bin_commands) {
-		int j = (int)path_progsn;
-		while (--j >= 0)
-			free(bin_commands[j]);
-		free(bin_commands);
-		bin_commands = (char **)NULL;
-	}
+	free_bin_commands();
 
 	if (paths) {
 		int j = (int)path_n;
@@ -481,6 +587,8 @@ reload_binaries(void)
 
 	path_n = (size_t)get_path_env();
 	get_path_programs();
+	/* Cached command paths might be outdated */
+	free_cmd_path_cache();
 }
 #endif /* !__CYGWIN__ */
 
@@ -1776,7 +1884,7 @@ Unstatable files:            %zu\n\
 }
 
 static int
-_trash_function(char **args, int *_cont)
+_trash_function(char **args, const char *raw, int *_cont)
 {
 #ifndef _NO_TRASH
 	if (args[1] && IS_HELP(args[1])) {
@@ -1785,7 +1893,7 @@ _trash_function(char **args, int *_cont)
 		return EXIT_SUCCESS;
 	}
 
-	int exit_status = trash_function(args);
+	int exit_status = trash_function(args, raw);
 
 	if (is_sel) { /* If 'tr sel', deselect everything */
 		int i = (int)sel_n;
@@ -1799,6 +1907,7 @@ _trash_function(char **args, int *_cont)
 	return exit_status;
 #else
 	UNUSED(args);
+	UNUSED(raw);
 	fprintf(stderr, _("%s: trash: %s\n"), PROGRAM_NAME, _(NOT_AVAILABLE));
 	*_cont = 0;
 	return EXIT_FAILURE;
@@ -2215,7 +2324,8 @@ unset_function(const char *var)
 }
 
 /* Take the command entered by the user, already splitted into substrings
- * by parse_input_str(), and call the corresponding function. Return zero
+ * by parse_input_str() (RAW being the raw names array returned along with
+ * COMM), and call the corresponding function. Return zero
  * in case of success and one in case of error
 
  * Exit flag. exit_code is zero (sucess) by default. In case of error
@@ -2224,7 +2334,7 @@ unset_function(const char *var)
  * escape code in the prompt to print the exit status of the last
  * executed command */
 int
-exec_cmd(char **comm)
+exec_cmd(char **comm, const char *raw)
 {
 	if (zombies > 0)
 		check_zombies();
@@ -2352,7 +2462,7 @@ exec_cmd(char **comm)
 	|| strcmp(comm[0], "mkdir") == 0 || strcmp(comm[0], "unlink") == 0
 	|| strcmp(comm[0], "touch") == 0 || strcmp(comm[0], "ln") == 0
 	|| strcmp(comm[0], "chmod") == 0))
-		return (exit_code = run_and_refresh(comm, 0));
+		return (exit_code = run_and_refresh(comm, raw, 0));
 #endif
 
 	/*     ############### COPY AND MOVE ##################     */
@@ -2404,7 +2514,7 @@ exec_cmd(char **comm)
 		}
 
 		kbind_busy = 1;
-		exit_code = cp_mv_file(comm, copy_and_rename, use_force);
+		exit_code = cp_mv_file(comm, raw, copy_and_rename, use_force);
 		kbind_busy = 0;
 	}
 
@@ -2412,7 +2522,7 @@ exec_cmd(char **comm)
 	else if (*comm[0] == 't' && (!comm[0][1] || strcmp(comm[0], "tr") == 0
 	|| strcmp(comm[0], "trash") == 0)) {
 		int _cont = 1;
-		exit_code = _trash_function(comm, &_cont);
+		exit_code = _trash_function(comm, raw, &_cont);
 		if (_cont == 0)
 			return exit_code;
 	}
@@ -2465,7 +2575,7 @@ exec_cmd(char **comm)
 				free(tmp);
 			}
 		} else if (*comm[0] == 'r' && !comm[0][1]) {
-			exit_code = remove_file(comm);
+			exit_code = remove_file(comm, raw);
 			goto CHECK_EVENTS;
 		} else if (*comm[0] == 'm' && comm[0][1] == 'd' && !comm[0][2]) {
 			comm[0] = (char *)xrealloc(comm[0], 9 * sizeof(char));
@@ -2492,7 +2602,7 @@ exec_cmd(char **comm)
 		}
 
 		kbind_busy = 1;
-		exit_code = run_and_refresh(comm, 0);
+		exit_code = run_and_refresh(comm, raw, 0);
 		kbind_busy = 0;
 	}
 
@@ -2556,7 +2666,7 @@ exec_cmd(char **comm)
 	/*    ############### BULK RENAME ##################     */
 	else if (*comm[0] == 'b' && ((comm[0][1] == 'r' && !comm[0][2])
 	|| strcmp(comm[0], "bulk") == 0))
-		exit_code = bulk_rename(comm);
+		exit_code = bulk_rename(comm, raw);
 
 	/*      ################ SORT ##################     */
 	else if (*comm[0] == 's' && ((comm[0][1] == 't' && !comm[0][2])
@@ -2567,7 +2677,7 @@ exec_cmd(char **comm)
 	else if (*comm[0] == 'b' && ((comm[0][1] == 'b' && !comm[0][2])
 	|| strcmp(comm[0], "bleach") == 0)) {
 #ifndef _NO_BLEACH
-		exit_code = bleach_files(comm);
+		exit_code = bleach_files(comm, raw);
 #else
 		fprintf(stderr, "%s: bleach: %s\n", PROGRAM_NAME, NOT_AVAILABLE);
 		return EXIT_FAILURE;
@@ -2602,7 +2712,7 @@ exec_cmd(char **comm)
 
 	else if (*comm[0] == 'f' && ((comm[0][1] == 't' && !comm[0][2])
 	|| strcmp(comm[0], "filter") == 0))
-		return (exit_code = filter_function(comm[1]));
+		return (exit_code = filter_function(comm + 1));
 
 	else if (*comm[0] == 'f' && comm[0][1] == 'z' && !comm[0][2])
 		return (exit_code = toggle_full_dir_size(comm[1]));
@@ -2826,20 +2936,22 @@ CHECK_EVENTS:
 }
 
 static inline void
-run_chained_cmd(char **cmd, size_t *err_code)
+run_chained_cmd(char **cmd, char *raw, size_t *err_code)
 {
 	size_t i;
-	char **alias_cmd = check_for_alias(cmd);
+	char **alias_cmd = check_for_alias(cmd, &raw);
 	if (alias_cmd) {
-		if (exec_cmd(alias_cmd) != 0)
+		if (exec_cmd(alias_cmd, raw) != 0)
 			*err_code = 1;
+		free(raw);
 		for (i = 0; alias_cmd[i]; i++)
 			free(alias_cmd[i]);
 		free(alias_cmd);
 	} else {
-		if ((flags & FAILED_ALIAS) || exec_cmd(cmd) != 0)
+		if ((flags & FAILED_ALIAS) || exec_cmd(cmd, raw) != 0)
 			*err_code = 1;
 		flags &= ~FAILED_ALIAS;
+		free(raw);
 		for (i = 0; i <= args_n; i++)
 			free(cmd[i]);
 		free(cmd);
@@ -2875,12 +2987,13 @@ exec_chained_cmds(char *cmd)
 
 		if (cmd[i] == '&') cond_exec = 1;
 
-		char **tmp_cmd = parse_input_str((*str == ' ') ? str + 1 : str);
+		char *raw = (char *)NULL;
+		char **tmp_cmd = parse_input_str((*str == ' ') ? str + 1 : str, &raw);
 		free(str);
 
 		if (!tmp_cmd) continue;
 
-		run_chained_cmd(tmp_cmd, &error_code);
+		run_chained_cmd(tmp_cmd, raw, &error_code);
 
 		/* Do not continue if the execution was condtional and
 		 * the previous command failed */
@@ -2897,14 +3010,16 @@ run_profile_line(char *cmd)
 		return;
 
 	args_n = 0;
-	char **cmds = parse_input_str(cmd);
+	char *raw = (char *)NULL;
+	char **cmds = parse_input_str(cmd, &raw);
 	if (!cmds)
 		return;
 
 	no_log = 1;
-	exec_cmd(cmds);
+	exec_cmd(cmds, raw);
 	no_log = 0;
 
+	free(raw);
 	int i = (int)args_n + 1;
 	while (--i >= 0)
 		free(cmds[i]);
@@ -40,13 +40,14 @@
 
 __BEGIN_DECLS
 
-int  exec_cmd(char **);
+int  exec_cmd(char **, const char *);
 void exec_chained_cmds(char *);
 void exec_profile(void);
 int  get_exit_code(const int, const int);
+char *get_cmd_output(const char *);
 int  launch_execve(char **, const int, const int);
 int  launch_execle(const char *);
-int  run_and_refresh(char **, const int);
+int  run_and_refresh(char **, const char *, const int);
 
 __END_DECLS
 
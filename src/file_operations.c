@@ -44,6 +44,7 @@
 #include "misc.h"
 #include "navigation.h"
 #include "readline.h"
+#include "rename.h"
 #include "selection.h"
 #include "messages.h"
 
@@ -1329,7 +1330,7 @@ vv_rename_files(char **args)
 	}
 
 	tmp[c] = (char *)NULL;
-	int ret = bulk_rename(tmp);
+	int ret = bulk_rename(tmp, NULL);
 
 	for (i = 0; tmp[i]; i++)
 		free(tmp[i]);
@@ -1366,9 +1367,10 @@ validate_vv_dest_dir(const char *file)
 }
 
 /* Launch the command associated to 'c' (also 'v' and 'vv') or 'm'
- * internal commands */
+ * internal commands. RAW tells which words in ARGS are raw file names */
 int
-cp_mv_file(char **args, const int copy_and_rename, const int force)
+cp_mv_file(char **args, const char *raw, const int copy_and_rename,
+	const int force)
 {
 	log_function(NULL);
 
@@ -1384,7 +1386,7 @@ cp_mv_file(char **args, const int copy_and_rename, const int force)
 	}
 
 	if (is_sel == 0 && copy_and_rename == 0)
-		return run_and_refresh(args, force);
+		return run_and_refresh(args, raw, force);
 
 	size_t n = 0;
 	char **tcmd = (char **)xnmalloc(3 + args_n + 2, sizeof(char *));
@@ -1408,11 +1410,15 @@ cp_mv_file(char **args, const int copy_and_rename, const int force)
 
 	size_t i = force == 1 ? 2 : 1;
 	for (; args[i]; i++) {
+		if (is_raw_arg(raw, i) == 1) {
+			tcmd[n] = savestring(args[i], strlen(args[i]));
+			n++;
+			continue;
+		}
 		p = dequote_str(args[i], 0);
 		if (!p)
 			continue;
-		tcmd[n] = savestring(p, strlen(p));
-		free(p);
+		tcmd[n] = p;
 		n++;
 	}
 
@@ -1487,7 +1493,7 @@ list_removed_files(char **cmd, const size_t start, const int cwd)
 }
 
 int
-remove_file(char **args)
+remove_file(char **args, const char *raw)
 {
 	int cwd = 0, exit_status = EXIT_SUCCESS, errs = 0;
 
@@ -1520,7 +1526,7 @@ remove_file(char **args)
 			cwd = is_file_in_cwd(args[i]);
 
 		char *tmp = (char *)NULL;
-		if (strchr(args[i], '\\')) {
+		if (is_raw_arg(raw, (size_t)i) == 0 && strchr(args[i], '\\')) {
 			tmp = dequote_str(args[i], 0);
 			if (tmp) {
 				/* Start storing file names in 3: 0 is for 'rm', and 1
@@ -1623,15 +1629,28 @@ remove_file(char **args)
  * asked whether to perform the actual bulk renaming or not.
  *
  * This bulk rename method is the same used by the fff filemanager,
- * ranger, and nnn */
+ * ranger, and nnn.
+ * RAW tells which words in ARGS are raw file names (see is_raw_arg()) */
 int
-bulk_rename(char **args)
+bulk_rename(char **args, const char *raw)
 {
 	if (!args || !args[1] || IS_HELP(args[1])) {
 		puts(_(BULK_USAGE));
 		return EXIT_SUCCESS;
 	}
 
+	/* --dry-run: print the rename plan instead of running it */
+	size_t first = 1;
+	int dry_run = 0;
+	if (*args[1] == '-' && strcmp(args[1], "--dry-run") == 0) {
+		dry_run = 1;
+		first = 2;
+		if (!args[2]) {
+			puts(_(BULK_USAGE));
+			return EXIT_SUCCESS;
+		}
+	}
+
 	log_function(NULL);
 
 	int exit_status = EXIT_SUCCESS;
@@ -1670,9 +1689,9 @@ bulk_rename(char **args)
 	struct stat attr;
 	size_t counter = 0;
 	/* Copy all files to be renamed to the bulk file */
-	for (i = 1; args[i]; i++) {
+	for (i = first; args[i]; i++) {
 		/* Dequote file name, if necessary */
-		if (strchr(args[i], '\\')) {
+		if (is_raw_arg(raw, i) == 0 && strchr(args[i], '\\')) {
 			char *deq_file = dequote_str(args[i], 0);
 			if (!deq_file) {
 				_err(ERR_NO_STORE, NOPRINT_PROMPT, _("br: %s: Error "
@@ -1773,7 +1792,7 @@ bulk_rename(char **args)
 
 	/* Make sure there are as many lines in the bulk file as files
 	 * to be renamed */
-	size_t file_total = 1;
+	size_t file_total = first;
 	char tmp_line[256];
 	while (fgets(tmp_line, (int)sizeof(tmp_line), fp)) {
 		if (!*tmp_line || *tmp_line == '\n' || *tmp_line == '#')
@@ -1798,10 +1817,13 @@ bulk_rename(char **args)
 	size_t line_size = 0;
 	char *line = (char *)NULL;
 	ssize_t line_len = 0;
-	int modified = 0;
+	size_t modified = 0;
+	struct rename_t *renames = (struct rename_t *)xnmalloc(arg_total + 1,
+		sizeof(struct rename_t));
+	struct rename_plan_t *plan = (struct rename_plan_t *)NULL;
 
-	i = 1;
-	/* Print what would be done */
+	i = first;
+	/* Collect (and print) what would be done */
 	while ((line_len = getline(&line, &line_size, fp)) > 0) {
 		if (!*line || *line == '\n' || *line == '#')
 			continue;
@@ -1809,7 +1831,10 @@ bulk_rename(char **args)
 			line[line_len - 1] = '\0';
 
 		if (args[i] && strcmp(args[i], line) != 0) {
-			printf("%s %s->%s %s\n", args[i], mi_c, df_c, line);
+			if (dry_run == 0)
+				printf("%s %s->%s %s\n", args[i], mi_c, df_c, line);
+			renames[modified].src = args[i];
+			renames[modified].dst = savestring(line, strlen(line));
 			modified++;
 		}
 
@@ -1817,16 +1842,27 @@ bulk_rename(char **args)
 	}
 
 	/* If no file name was modified */
-	if (!modified) {
+	if (modified == 0) {
 		puts(_("br: Nothing to do"));
-		if (unlinkat(fd, bulk_file, 0) == -1) {
-			_err('e', PRINT_PROMPT, "br: unlinkat: %s: %s\n",
-				bulk_file, strerror(errno));
-			exit_status = errno;
-		}
-		free(line);
-		close_fstream(fp, fd);
-		return exit_status;
+		goto END;
+	}
+
+	/* Check the new names and sort out the order of the renames before
+	 * asking anything: if they cannot be made, nothing will be renamed */
+	plan = plan_renames("br", renames, modified);
+	if (!plan) {
+		exit_status = EXIT_FAILURE;
+		goto END;
+	}
+
+	if (dry_run == 1) {
+		print_rename_plan(plan);
+		goto END;
+	}
+
+	if (plan->tmp_n > 0) {
+		printf(_("br: %zu rename cycle(s) will be broken via temporary "
+			"file names\n"), plan->tmp_n);
 	}
 
 	/* Ask the user for confirmation */
@@ -1839,16 +1875,8 @@ bulk_rename(char **args)
 			continue;
 		}
 
-		if (!answer) {
-			free(line);
-			if (unlinkat(fd, bulk_file, 0) == -1) {
-				_err('e', PRINT_PROMPT, "br: unlinkat: %s: %s\n",
-					bulk_file, strerror(errno));
-				exit_status = errno;
-			}
-			close_fstream(fp, fd);
-			return exit_status;
-		}
+		if (!answer)
+			goto END;
 
 		switch (*answer) {
 		case 'y': /* fallthrough */
@@ -1859,14 +1887,7 @@ bulk_rename(char **args)
 		case 'N': /* fallthrough */
 		case '\0':
 			free(answer);
-			free(line);
-			if (unlinkat(fd, bulk_file, 0) == -1) {
-				_err('e', PRINT_PROMPT, "br: unlinkat: %s: %s\n",
-					bulk_file, strerror(errno));
-				exit_status = errno;
-			}
-			close_fstream(fp, fd);
-			return exit_status;
+			goto END;
 
 		default:
 			free(answer);
@@ -1877,31 +1898,14 @@ bulk_rename(char **args)
 
 	free(answer);
 
-	/* Once again */
-	fseek(fp, 0L, SEEK_SET);
-
-	i = 1;
-
-	/* Rename each file */
-	while ((line_len = getline(&line, &line_size, fp)) > 0) {
-		if (!*line || *line == '\n' || *line == '#')
-			continue;
-
-		if (!args[i]) {
-			i++;
-			continue;
-		}
-
-		if (line[line_len - 1] == '\n')
-			line[line_len - 1] = '\0';
-		if (args[i] && strcmp(args[i], line) != 0) {
-			if (renameat(AT_FDCWD, args[i], AT_FDCWD, line) == -1)
-				exit_status = errno;
-		}
-
-		i++;
-	}
+	size_t renamed = 0;
+	exit_status = run_rename_plan("br", plan, &renamed);
 
+END:
+	free_rename_plan(plan);
+	for (i = 0; i < modified; i++)
+		free(renames[i].dst);
+	free(renames);
 	free(line);
 
 	if (unlinkat(fd, bulk_file, 0) == -1) {
@@ -35,17 +35,17 @@
 __BEGIN_DECLS
 
 int  batch_link(char **);
-int  bulk_rename(char **);
+int  bulk_rename(char **, const char *);
 int  bulk_remove(char *, char *);
 void clear_selbox(void);
-int  cp_mv_file(char **, const int, const int);
+int  cp_mv_file(char **, const char *, const int, const int);
 int  create_file(char **);
 int  dup_file(char **);
 int  edit_link(char *);
 char *export(char **, int);
 int  open_file(char *);
 int  open_function(char **);
-int  remove_file(char **);
+int  remove_file(char **, const char *);
 int  xchmod(const char *, const char *, const int);
 int  toggle_exec(const char *, mode_t);
 
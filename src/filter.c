@@ -0,0 +1,1161 @@
+/* filter.c -- compile and run files filters */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The files filter (the 'ft' command, the Filter option, and the
+ * CLIFM_FILTER variable) is compiled into a small program: a tree of
+ * predicates joined by AND, OR, and NOT nodes. Besides the traditional
+ * forms (a regular expression or a file type character), a filter can be
+ * an expression, for example:
+ *
+ *   name:*.c or name:*.h
+ *   type:f size:>1M not mtime:<1w
+ *   (re:^[0-9]+ || owner:root) && !*~
+ *
+ * Predicates are name:GLOB, re:REGEX, type:CHARS, size:RANGE,
+ * mtime:RANGE, owner:USER, and group:GROUP. A word with no key is a name
+ * glob, and consecutive predicates are joined by AND.
+ *
+ * When compiling, the operands of each AND and OR node are sorted by
+ * cost, so that predicates checking only the file name run before those
+ * needing stat(2), which is then run only if needed. The literal string
+ * every match of a regular expression or glob pattern must contain is
+ * extracted and searched for first: most names are rejected without
+ * running the regex engine, and patterns made only of literals (say,
+ * "^foo" or "\.pdf$") never run it at all. */
+
+#include "helpers.h"
+
+#include <dirent.h>
+#include <fnmatch.h>
+#include <grp.h>
+#include <limits.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "aux.h"
+#include "checks.h"
+#include "filter.h"
+#include "strings.h"
+
+/* Estimated cost of each kind of check */
+#define COST_DTYPE   1  /* File type taken from the directory entry */
+#define COST_LITERAL 2  /* Literal comparison of the file name */
+#define COST_MATCH   4  /* fnmatch(3) or regexec(3) */
+#define COST_STAT    16 /* Needs stat(2) */
+
+/* Returned by the parser on error */
+#define FNODE_ERR ((size_t)-1)
+
+/* Characters having a special meaning in extended regular expressions */
+#define RE_SPECIAL ".[]()*+?{}|^$\\"
+
+/* Tokens of a filter expression */
+#define FTOK_END    0
+#define FTOK_WORD   1
+#define FTOK_LPAREN 2
+#define FTOK_RPAREN 3
+#define FTOK_AND    4
+#define FTOK_OR     5
+#define FTOK_NOT    6
+
+struct fparser_t {
+	struct filter_prog_t *prog;
+	const char *p;   /* Current position in the expression */
+	const char *err; /* Error message, if any */
+};
+
+static const char *const filter_keys[] = {
+	"name", "re", "type", "size", "mtime", "owner", "group", NULL};
+
+static const int filter_key_nodes[] = {
+	FNODE_NAME, FNODE_REGEX, FNODE_TYPE, FNODE_SIZE, FNODE_MTIME,
+	FNODE_OWNER, FNODE_GROUP};
+
+struct filter_prog_t filter_prog = {NULL, 0, 0, 0, 0};
+
+static size_t
+add_filter_node(struct filter_prog_t *prog, const int type)
+{
+	prog->nodes = (struct filter_node_t *)xrealloc(prog->nodes,
+		(prog->n + 1) * sizeof(struct filter_node_t));
+	memset(&prog->nodes[prog->n], 0, sizeof(struct filter_node_t));
+	prog->nodes[prog->n].type = type;
+	return prog->n++;
+}
+
+static void
+add_filter_kid(struct filter_prog_t *prog, const size_t parent,
+	const size_t kid)
+{
+	struct filter_node_t *n = &prog->nodes[parent];
+	n->kids = (size_t *)xrealloc(n->kids, (n->kids_n + 1) * sizeof(size_t));
+	n->kids[n->kids_n] = kid;
+	n->kids_n++;
+}
+
+void
+free_filter_prog(struct filter_prog_t *prog)
+{
+	size_t i;
+	for (i = 0; i < prog->n; i++) {
+		struct filter_node_t *n = &prog->nodes[i];
+		free(n->str);
+		free(n->lit);
+		free(n->kids);
+		if (n->type == FNODE_NAME)
+			free_glob_pat(&n->glob);
+		if (n->re_ok == 1)
+			regfree(&n->re);
+	}
+
+	free(prog->nodes);
+	memset(prog, 0, sizeof(struct filter_prog_t));
+}
+
+/*
+ * Literal extraction
+ */
+
+/* Skip the bracket expression starting at P ('['), returning a pointer to
+ * the character right after it */
+static const char *
+skip_bracket(const char *p)
+{
+	p++;
+	if (*p == '^' || *p == '!')
+		p++;
+	if (*p == ']')
+		p++;
+
+	while (*p && *p != ']') {
+		if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+			const char c = p[1];
+			p += 2;
+			while (*p && !(*p == c && p[1] == ']'))
+				p++;
+			if (*p)
+				p += 2;
+			continue;
+		}
+		p++;
+	}
+
+	return *p ? p + 1 : p;
+}
+
+/* Skip the parenthesized group starting at P ('('), returning a pointer to
+ * the character right after it */
+static const char *
+skip_group(const char *p)
+{
+	int depth = 0;
+
+	while (*p) {
+		if (*p == '\\' && p[1]) {
+			p += 2;
+			continue;
+		}
+		if (*p == '[') {
+			p = skip_bracket(p);
+			continue;
+		}
+		if (*p == '(')
+			depth++;
+		else if (*p == ')' && --depth == 0)
+			return p + 1;
+		p++;
+	}
+
+	return p;
+}
+
+static const char *
+skip_quantifiers(const char *p)
+{
+	while (*p == '*' || *p == '+' || *p == '?' || *p == '{') {
+		if (*p != '{') {
+			p++;
+			continue;
+		}
+		const char *end = strchr(p, '}');
+		p = end ? end + 1 : p + strlen(p);
+	}
+
+	return p;
+}
+
+/* Return 1 if the regular expression RE has an alternation ('|') outside
+ * groups, in which case no literal is required by every match */
+static int
+has_alternation(const char *re)
+{
+	const char *p = re;
+	while (*p) {
+		if (*p == '\\' && p[1])
+			p += 2;
+		else if (*p == '[')
+			p = skip_bracket(p);
+		else if (*p == '(')
+			p = skip_group(p);
+		else if (*p == '|')
+			return 1;
+		else
+			p++;
+	}
+
+	return 0;
+}
+
+/* Remove the last (possibly multi-byte) character of the N bytes long
+ * string BUF */
+static void
+drop_last_char(const char *buf, size_t *n)
+{
+	while (*n > 0 && ((unsigned char)buf[*n - 1] & 0xC0) == 0x80)
+		(*n)--;
+	if (*n > 0)
+		(*n)--;
+}
+
+/* Keep the current run of literals (BUF, N bytes long) if it is the
+ * longest one so far */
+static void
+end_literal_run(const char *buf, size_t *n, char *best, size_t *best_n)
+{
+	if (*n > *best_n) {
+		memcpy(best, buf, *n);
+		*best_n = *n;
+	}
+	*n = 0;
+}
+
+static void
+set_node_literal(struct filter_node_t *node, const char *lit, const size_t n)
+{
+	node->lit = (char *)xnmalloc(n + 1, sizeof(char));
+	memcpy(node->lit, lit, n);
+	node->lit[n] = '\0';
+	node->lit_len = n;
+}
+
+/* If the regular expression RE is made only of literals (optionally
+ * anchored), store them in NODE, which is then matched without the regex
+ * engine. Returns 1 if so, or 0 otherwise */
+static int
+set_pure_literal(struct filter_node_t *node, const char *re)
+{
+	const char *p = re;
+	const int start = (*p == '^');
+	int end = 0;
+	if (start == 1)
+		p++;
+
+	char *buf = (char *)xnmalloc(strlen(p) + 1, sizeof(char));
+	size_t n = 0;
+
+	for (; *p; p++) {
+		if (*p == '$' && !p[1]) {
+			end = 1;
+			break;
+		}
+
+		if (*p == '\\' && p[1] && strchr(RE_SPECIAL, p[1])) {
+			p++;
+		} else if (strchr(RE_SPECIAL, *p)) {
+			free(buf);
+			return 0;
+		}
+
+		buf[n] = *p;
+		n++;
+	}
+
+	set_node_literal(node, buf, n);
+	free(buf);
+
+	node->lit_only = 1;
+	node->lit_pos = (start == 1 && end == 1) ? FLIT_EXACT
+		: (start == 1 ? FLIT_PREFIX : (end == 1 ? FLIT_SUFFIX : FLIT_ANY));
+	return 1;
+}
+
+/* Store in NODE the longest string of literals every match of the regular
+ * expression RE must contain, if any. Characters under a quantifier
+ * allowing zero repetitions, groups, and bracket expressions break
+ * strings of literals */
+static void
+set_regex_literal(struct filter_node_t *node, const char *re)
+{
+	if (set_pure_literal(node, re) == 1 || has_alternation(re) == 1)
+		return;
+
+	const size_t len = strlen(re);
+	char *buf = (char *)xnmalloc(len + 1, sizeof(char));
+	char *best = (char *)xnmalloc(len + 1, sizeof(char));
+	size_t n = 0, best_n = 0;
+
+	const char *p = re;
+	while (*p) {
+		char c;
+		if (*p == '\\') {
+			if (!p[1] || !strchr(RE_SPECIAL, p[1])) {
+				/* Back-references and GNU escapes (\w, \b, ...) */
+				end_literal_run(buf, &n, best, &best_n);
+				p += p[1] ? 2 : 1;
+				continue;
+			}
+			c = p[1];
+			p += 2;
+		} else if (*p == '[' || *p == '(') {
+			end_literal_run(buf, &n, best, &best_n);
+			p = skip_quantifiers(*p == '[' ? skip_bracket(p) : skip_group(p));
+			continue;
+		} else if (strchr(RE_SPECIAL, *p)) {
+			end_literal_run(buf, &n, best, &best_n);
+			p++;
+			continue;
+		} else {
+			c = *p;
+			p++;
+		}
+
+		buf[n] = c;
+		n++;
+
+		/* A quantifier applies to the last character only */
+		if (*p == '*' || *p == '?' || *p == '{') {
+			drop_last_char(buf, &n);
+			end_literal_run(buf, &n, best, &best_n);
+			p = skip_quantifiers(p);
+		} else if (*p == '+') {
+			end_literal_run(buf, &n, best, &best_n);
+			p = skip_quantifiers(p);
+		}
+	}
+
+	end_literal_run(buf, &n, best, &best_n);
+	if (best_n > 0)
+		set_node_literal(node, best, best_n);
+
+	free(buf);
+	free(best);
+}
+
+/* Store in NODE the longest string of literals in the glob pattern GLOB */
+static void
+set_glob_literal(struct filter_node_t *node, const char *glob)
+{
+	const size_t len = strlen(glob);
+	char *buf = (char *)xnmalloc(len + 1, sizeof(char));
+	char *best = (char *)xnmalloc(len + 1, sizeof(char));
+	size_t n = 0, best_n = 0;
+
+	const char *p = glob;
+	while (*p) {
+		if (*p == '*' || *p == '?') {
+			end_literal_run(buf, &n, best, &best_n);
+			p++;
+		} else if (*p == '[') {
+			end_literal_run(buf, &n, best, &best_n);
+			p = skip_bracket(p);
+		} else {
+			if (*p == '\\' && p[1])
+				p++;
+			buf[n] = *p;
+			n++;
+			p++;
+		}
+	}
+
+	end_literal_run(buf, &n, best, &best_n);
+	if (best_n > 0)
+		set_node_literal(node, best, best_n);
+
+	free(buf);
+	free(best);
+}
+
+/*
+ * Predicates
+ */
+
+static int
+compile_name_node(struct fparser_t *ps, const size_t i, const char *glob)
+{
+	struct filter_node_t *n = &ps->prog->nodes[i];
+	n->str = savestring(glob, strlen(glob));
+	compile_glob(glob, &n->glob);
+
+	if (n->glob.simple == 1) {
+		n->cost = COST_LITERAL;
+	} else {
+		set_glob_literal(n, glob);
+		n->cost = COST_MATCH;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static int
+compile_regex_node(struct fparser_t *ps, const size_t i, const char *re)
+{
+	struct filter_node_t *n = &ps->prog->nodes[i];
+	if (regcomp(&n->re, re, REG_NOSUB | REG_EXTENDED) != 0) {
+		regfree(&n->re);
+		ps->err = "Invalid regular expression";
+		return EXIT_FAILURE;
+	}
+
+	n->re_ok = 1;
+	set_regex_literal(n, re);
+	n->cost = n->lit_only == 1 ? COST_LITERAL : COST_MATCH;
+	return EXIT_SUCCESS;
+}
+
+static int
+compile_type_node(struct fparser_t *ps, const size_t i, const char *types)
+{
+	struct filter_node_t *n = &ps->prog->nodes[i];
+	if (!*types || strspn(types, "bcdflpsghotux") != strlen(types)) {
+		ps->err = "Invalid file type";
+		return EXIT_FAILURE;
+	}
+
+	n->str = savestring(types, strlen(types));
+	ps->prog->needs_stat = 1;
+	/* Basic file types are taken from the directory entry, if possible */
+	n->cost = strspn(types, "bcdflps") == strlen(types) ? COST_DTYPE : COST_STAT;
+	return EXIT_SUCCESS;
+}
+
+/* Parse the size at S (e.g. "100", "10k", or "2G") into *N. *UNIT is set to
+ * the size of the unit used. Returns a pointer to the first character
+ * after the size, or NULL on error */
+static const char *
+parse_size(const char *s, long long *n, long long *unit)
+{
+	if (!IS_DIGIT(*s))
+		return (const char *)NULL;
+
+	char *end = (char *)NULL;
+	const long long v = strtoll(s, &end, 10);
+	if (!end || v < 0)
+		return (const char *)NULL;
+
+	*unit = 1;
+	switch (*end) {
+	case 'k': /* fallthrough */
+	case 'K': *unit = 1LL << 10; end++; break;
+	case 'M': *unit = 1LL << 20; end++; break;
+	case 'G': *unit = 1LL << 30; end++; break;
+	case 'T': *unit = 1LL << 40; end++; break;
+	default: break;
+	}
+
+	if (*end == 'B')
+		end++;
+
+	if (v > LLONG_MAX / *unit)
+		return (const char *)NULL;
+
+	*n = v * *unit;
+	return end;
+}
+
+/* Parse the time span at S (e.g. "30m", "2d", or "1y") into *N (in seconds).
+ * Days are assumed if no unit is given. *UNIT is set to the size of the unit
+ * used. Returns a pointer to the first character after the span, or NULL on
+ * error */
+static const char *
+parse_age(const char *s, long long *n, long long *unit)
+{
+	if (!IS_DIGIT(*s))
+		return (const char *)NULL;
+
+	char *end = (char *)NULL;
+	const long long v = strtoll(s, &end, 10);
+	if (!end || v < 0)
+		return (const char *)NULL;
+
+	*unit = 86400;
+	switch (*end) {
+	case 's': *unit = 1; end++; break;
+	case 'm': *unit = 60; end++; break;
+	case 'h': *unit = 3600; end++; break;
+	case 'd': end++; break;
+	case 'w': *unit = 86400 * 7; end++; break;
+	case 'y': *unit = 86400 * 365; end++; break;
+	default: break;
+	}
+
+	if (v > LLONG_MAX / *unit)
+		return (const char *)NULL;
+
+	*n = v * *unit;
+	return end;
+}
+
+/* Parse the range S into N->LO and N->HI (inclusive). S is either "V",
+ * ">V", ">=V", "<V", "<=V", or "V..V", and each V is read by PARSE.
+ * A single value V covers the whole unit in which it is expressed if SPAN
+ * is set (for example, "2d" is anything from 2 to 3 days) */
+static int
+compile_range_node(struct fparser_t *ps, const size_t i, const char *s,
+	const char *(*parse)(const char *, long long *, long long *),
+	const int span)
+{
+	struct filter_node_t *n = &ps->prog->nodes[i];
+	long long a = 0, b = 0, unit = 1;
+	const char *p;
+
+	ps->err = "Invalid range";
+
+	if (*s == '>' || *s == '<') {
+		const int gt = (*s == '>');
+		const int eq = (s[1] == '=');
+		if (!(p = parse(s + 1 + eq, &a, &unit)) || *p)
+			return EXIT_FAILURE;
+
+		if (gt == 1) {
+			n->lo = eq == 1 ? a : a + 1;
+			n->hi = LLONG_MAX;
+		} else {
+			n->lo = LLONG_MIN;
+			n->hi = eq == 1 ? a : a - 1;
+		}
+	} else {
+		if (!(p = parse(s, &a, &unit)))
+			return EXIT_FAILURE;
+
+		if (!*p) {
+			n->lo = a;
+			n->hi = span == 1 ? a + unit - 1 : a;
+		} else if (*p == '.' && p[1] == '.') {
+			const char *q = parse(p + 2, &b, &unit);
+			if (!q || *q || b < a)
+				return EXIT_FAILURE;
+			n->lo = a;
+			n->hi = b;
+		} else {
+			return EXIT_FAILURE;
+		}
+	}
+
+	ps->err = (const char *)NULL;
+	ps->prog->needs_stat = 1;
+	n->cost = COST_STAT;
+	return EXIT_SUCCESS;
+}
+
+static int
+compile_id_node(struct fparser_t *ps, const size_t i, const char *s)
+{
+	struct filter_node_t *n = &ps->prog->nodes[i];
+
+	if (is_number(s)) {
+		n->id = (unsigned long)strtoul(s, NULL, 10);
+	} else if (n->type == FNODE_OWNER) {
+		struct passwd *pw = getpwnam(s);
+		if (!pw) {
+			ps->err = "No such user";
+			return EXIT_FAILURE;
+		}
+		n->id = (unsigned long)pw->pw_uid;
+	} else {
+		struct group *gr = getgrnam(s);
+		if (!gr) {
+			ps->err = "No such group";
+			return EXIT_FAILURE;
+		}
+		n->id = (unsigned long)gr->gr_gid;
+	}
+
+	ps->prog->needs_stat = 1;
+	n->cost = COST_STAT;
+	return EXIT_SUCCESS;
+}
+
+/* Return the node type for the key at S (e.g. "size:"), or -1 if S does
+ * not start with a key. *LEN is set to the length of the key */
+static int
+get_filter_key(const char *s, size_t *len)
+{
+	size_t i;
+	for (i = 0; filter_keys[i]; i++) {
+		const size_t l = strlen(filter_keys[i]);
+		if (strncmp(s, filter_keys[i], l) == 0 && s[l] == ':') {
+			*len = l;
+			return filter_key_nodes[i];
+		}
+	}
+
+	return (-1);
+}
+
+static int
+compile_pred_node(struct fparser_t *ps, const size_t i, const char *val)
+{
+	switch (ps->prog->nodes[i].type) {
+	case FNODE_NAME: return compile_name_node(ps, i, val);
+	case FNODE_REGEX: return compile_regex_node(ps, i, val);
+	case FNODE_TYPE: return compile_type_node(ps, i, val);
+	case FNODE_SIZE: return compile_range_node(ps, i, val, parse_size, 0);
+	case FNODE_MTIME:
+		ps->prog->needs_time = 1;
+		return compile_range_node(ps, i, val, parse_age, 1);
+	case FNODE_OWNER: /* fallthrough */
+	case FNODE_GROUP: return compile_id_node(ps, i, val);
+	default: return EXIT_FAILURE;
+	}
+}
+
+/*
+ * Expression parser
+ */
+
+static int
+is_word_end(const char c)
+{
+	return (c == '\0' || c == ' ' || c == '\t' || c == '(' || c == ')');
+}
+
+/* Return the type of the next token, without consuming it. *LEN is set to
+ * its length (zero for words, which are read by read_word()) */
+static int
+peek_token(struct fparser_t *ps, size_t *len)
+{
+	while (*ps->p == ' ' || *ps->p == '\t')
+		ps->p++;
+
+	const char *p = ps->p;
+	*len = 1;
+
+	switch (*p) {
+	case '\0': *len = 0; return FTOK_END;
+	case '(': return FTOK_LPAREN;
+	case ')': return FTOK_RPAREN;
+	case '!': return FTOK_NOT;
+	default: break;
+	}
+
+	*len = 2;
+	if ((*p == '&' && p[1] == '&')
+	|| (*p == 'o' && p[1] == 'r' && is_word_end(p[2])))
+		return *p == '&' ? FTOK_AND : FTOK_OR;
+	if (*p == '|' && p[1] == '|')
+		return FTOK_OR;
+
+	*len = 3;
+	if (strncmp(p, "and", 3) == 0 && is_word_end(p[3]))
+		return FTOK_AND;
+	if (strncmp(p, "not", 3) == 0 && is_word_end(p[3]))
+		return FTOK_NOT;
+
+	*len = 0;
+	return FTOK_WORD;
+}
+
+/* Read the word at the current position. Quotes are removed, and
+ * parentheses are part of the word as long as they are balanced, so that
+ * "re:(a|b)" is a single word */
+static char *
+read_word(struct fparser_t *ps)
+{
+	const char *p = ps->p;
+	char *w = (char *)xnmalloc(strlen(p) + 1, sizeof(char));
+	size_t n = 0;
+	int depth = 0;
+	char quote = 0;
+
+	for (; *p; p++) {
+		if (quote != 0) {
+			if (*p == quote)
+				quote = 0;
+			else
+				w[n++] = *p;
+			continue;
+		}
+
+		if (*p == '\'' || *p == '"') {
+			quote = *p;
+			continue;
+		}
+
+		if (*p == '\\' && p[1]) {
+			w[n++] = *p++;
+			w[n++] = *p;
+			continue;
+		}
+
+		if ((*p == ' ' || *p == '\t') && depth == 0)
+			break;
+		if (*p == '(') {
+			depth++;
+		} else if (*p == ')') {
+			if (depth == 0)
+				break;
+			depth--;
+		}
+
+		w[n++] = *p;
+	}
+
+	w[n] = '\0';
+	ps->p = p;
+
+	if (quote != 0) {
+		ps->err = "Unterminated quote";
+		free(w);
+		return (char *)NULL;
+	}
+
+	return w;
+}
+
+/* Parse a predicate: either KEY:VALUE or a name glob */
+static size_t
+parse_pred(struct fparser_t *ps)
+{
+	char *w = read_word(ps);
+	if (!w)
+		return FNODE_ERR;
+
+	size_t klen = 0;
+	int type = get_filter_key(w, &klen);
+	const char *val = w;
+	if (type == -1)
+		type = FNODE_NAME;
+	else
+		val = w + klen + 1;
+
+	const size_t i = add_filter_node(ps->prog, type);
+	int ret = EXIT_FAILURE;
+	if (!*val)
+		ps->err = "Missing value";
+	else
+		ret = compile_pred_node(ps, i, val);
+
+	free(w);
+	return ret == EXIT_SUCCESS ? i : FNODE_ERR;
+}
+
+static size_t parse_or(struct fparser_t *ps);
+
+static size_t
+parse_unary(struct fparser_t *ps)
+{
+	size_t len;
+	const int t = peek_token(ps, &len);
+
+	if (t == FTOK_NOT) {
+		ps->p += len;
+		const size_t kid = parse_unary(ps);
+		if (kid == FNODE_ERR)
+			return FNODE_ERR;
+		const size_t i = add_filter_node(ps->prog, FNODE_NOT);
+		add_filter_kid(ps->prog, i, kid);
+		return i;
+	}
+
+	if (t == FTOK_LPAREN) {
+		ps->p += len;
+		const size_t i = parse_or(ps);
+		if (i == FNODE_ERR)
+			return FNODE_ERR;
+		if (peek_token(ps, &len) != FTOK_RPAREN) {
+			ps->err = "Missing closing parenthesis";
+			return FNODE_ERR;
+		}
+		ps->p += len;
+		return i;
+	}
+
+	if (t != FTOK_WORD) {
+		ps->err = t == FTOK_END ? "Missing operand" : "Syntax error";
+		return FNODE_ERR;
+	}
+
+	return parse_pred(ps);
+}
+
+/* Parse operands joined by the operator OP (FTOK_AND or FTOK_OR) into a
+ * node of type TYPE. Juxtaposed operands are joined by AND */
+static size_t
+parse_list(struct fparser_t *ps, const int op, const int type,
+	size_t (*parse_operand)(struct fparser_t *))
+{
+	const size_t first = parse_operand(ps);
+	if (first == FNODE_ERR)
+		return FNODE_ERR;
+
+	size_t node = FNODE_ERR;
+	while (1) {
+		size_t len;
+		const int t = peek_token(ps, &len);
+		if (t == op) {
+			ps->p += len;
+		} else if (op != FTOK_AND || (t != FTOK_WORD && t != FTOK_LPAREN
+		&& t != FTOK_NOT)) {
+			break;
+		}
+
+		const size_t kid = parse_operand(ps);
+		if (kid == FNODE_ERR)
+			return FNODE_ERR;
+
+		if (node == FNODE_ERR) {
+			node = add_filter_node(ps->prog, type);
+			add_filter_kid(ps->prog, node, first);
+		}
+		add_filter_kid(ps->prog, node, kid);
+	}
+
+	return node == FNODE_ERR ? first : node;
+}
+
+static size_t
+parse_and(struct fparser_t *ps)
+{
+	return parse_list(ps, FTOK_AND, FNODE_AND, parse_unary);
+}
+
+static size_t
+parse_or(struct fparser_t *ps)
+{
+	return parse_list(ps, FTOK_OR, FNODE_OR, parse_and);
+}
+
+/* Return 1 if the filter STR is an expression, that is, if some word in it
+ * starts with a key (say, "size:"), or 0 otherwise (a regular expression) */
+int
+is_filter_expr(const char *str)
+{
+	if (!str)
+		return 0;
+
+	const char *p;
+	for (p = str; *p; p++) {
+		if (p != str && p[-1] != ' ' && p[-1] != '\t' && p[-1] != '('
+		&& p[-1] != '!')
+			continue;
+
+		size_t len;
+		if (get_filter_key(p, &len) != -1)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Compute the cost of the node I and sort the operands of AND and OR
+ * nodes, cheapest first */
+static int
+finalize_filter_node(struct filter_prog_t *prog, const size_t i)
+{
+	struct filter_node_t *n = &prog->nodes[i];
+	if (n->type != FNODE_AND && n->type != FNODE_OR && n->type != FNODE_NOT)
+		return n->cost;
+
+	n->cost = 0;
+	size_t k;
+	for (k = 0; k < n->kids_n; k++) {
+		const int c = finalize_filter_node(prog, n->kids[k]);
+		n->cost = n->cost > INT_MAX - c ? INT_MAX : n->cost + c;
+	}
+
+	/* Operands have no side effects: sort them (insertion sort, stable) */
+	for (k = 1; k < n->kids_n; k++) {
+		const size_t kid = n->kids[k];
+		const int c = prog->nodes[kid].cost;
+		size_t j = k;
+		while (j > 0 && prog->nodes[n->kids[j - 1]].cost > c) {
+			n->kids[j] = n->kids[j - 1];
+			j--;
+		}
+		n->kids[j] = kid;
+	}
+
+	return n->cost;
+}
+
+/* Compile the filter STR, whose type (see set_filter_type()) is TYPE, into
+ * PROG, whose previous contents are freed.
+ * Returns EXIT_SUCCESS on success, or EXIT_FAILURE on error, in which case
+ * PROG is left untouched and ERR points to an error message */
+int
+compile_filter_prog(const char *str, const int type,
+	struct filter_prog_t *prog, const char **err)
+{
+	struct filter_prog_t p = {NULL, 0, 0, 0, 0};
+	struct fparser_t ps;
+	ps.prog = &p;
+	ps.p = str;
+	ps.err = "Invalid filter";
+
+	size_t root = FNODE_ERR;
+	if (!str || !*str) {
+		root = FNODE_ERR;
+	} else if (type == FILTER_FILE_NAME) {
+		root = add_filter_node(&p, FNODE_REGEX);
+		if (compile_regex_node(&ps, root, str) != EXIT_SUCCESS)
+			root = FNODE_ERR;
+	} else if (type == FILTER_FILE_TYPE && *str == '=' && str[1]) {
+		root = add_filter_node(&p, FNODE_TYPE);
+		if (compile_type_node(&ps, root, str + 1) != EXIT_SUCCESS)
+			root = FNODE_ERR;
+	} else if (type == FILTER_EXPR) {
+		root = parse_or(&ps);
+		size_t len;
+		if (root != FNODE_ERR && peek_token(&ps, &len) != FTOK_END) {
+			ps.err = "Syntax error";
+			root = FNODE_ERR;
+		}
+	}
+
+	if (root == FNODE_ERR) {
+		free_filter_prog(&p);
+		if (err)
+			*err = ps.err;
+		return EXIT_FAILURE;
+	}
+
+	p.root = root;
+	finalize_filter_node(&p, root);
+
+	free_filter_prog(prog);
+	*prog = p;
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Evaluation
+ */
+
+static const char *
+find_literal(const char *s, const size_t len, const char *lit,
+	const size_t lit_len)
+{
+#ifdef _GNU_SOURCE
+	return memmem(s, len, lit, lit_len);
+#else
+	const char *end = s + (len - lit_len);
+	const char *p = s;
+	while (p <= end && (p = memchr(p, *lit, (size_t)(end - p) + 1))) {
+		if (memcmp(p, lit, lit_len) == 0)
+			return p;
+		p++;
+	}
+	return (const char *)NULL;
+#endif /* _GNU_SOURCE */
+}
+
+static int
+match_literal(const struct filter_node_t *n, const struct filter_file_t *f)
+{
+	const size_t len = f->name_len, l = n->lit_len;
+	if (l == 0)
+		return n->lit_pos == FLIT_EXACT ? (len == 0) : 1;
+	if (l > len)
+		return 0;
+
+	switch (n->lit_pos) {
+	case FLIT_EXACT: return (l == len && memcmp(f->name, n->lit, l) == 0);
+	case FLIT_PREFIX: return (memcmp(f->name, n->lit, l) == 0);
+	case FLIT_SUFFIX: return (memcmp(f->name + len - l, n->lit, l) == 0);
+	default: return (find_literal(f->name, len, n->lit, l) != NULL);
+	}
+}
+
+/* Make sure F->ATTR holds the stat(2) information of the file F.
+ * Returns 1 on success or 0 if not available */
+static int
+filter_stat(struct filter_file_t *f)
+{
+	if (f->stat_state == FILTER_STAT_NONE) {
+		f->stat_state = (f->dirfd != -1 && f->attr
+			&& fstatat(f->dirfd, f->name, f->attr, f->stat_flags) == 0)
+			? FILTER_STAT_OK : FILTER_STAT_ERR;
+	}
+
+	return (f->stat_state == FILTER_STAT_OK);
+}
+
+#ifdef _DIRENT_HAVE_D_TYPE
+static unsigned char
+type_char_to_dt(const char c)
+{
+	switch (c) {
+	case 'b': return DT_BLK;
+	case 'c': return DT_CHR;
+	case 'd': return DT_DIR;
+	case 'f': return DT_REG;
+	case 'l': return DT_LNK;
+	case 'p': return DT_FIFO;
+	case 's': return DT_SOCK;
+	default: return DT_UNKNOWN;
+	}
+}
+#endif /* _DIRENT_HAVE_D_TYPE */
+
+/* Return 1 if the file F is of any of the types in TYPES, or 0 otherwise */
+static int
+match_file_type(const char *types, struct filter_file_t *f)
+{
+	const char *t;
+	for (t = types; *t; t++) {
+#ifdef _DIRENT_HAVE_D_TYPE
+		const unsigned char dt = type_char_to_dt(*t);
+		if (dt != DT_UNKNOWN && f->d_type != DT_UNKNOWN) {
+			if (dt == f->d_type)
+				return 1;
+			continue;
+		}
+#endif /* _DIRENT_HAVE_D_TYPE */
+
+		if (filter_stat(f) == 0)
+			return 0;
+
+		const mode_t m = f->attr->st_mode;
+		switch (*t) {
+		case 'b': if (S_ISBLK(m)) return 1; break;
+		case 'c': if (S_ISCHR(m)) return 1; break;
+		case 'd': if (S_ISDIR(m)) return 1; break;
+		case 'f': if (S_ISREG(m)) return 1; break;
+		case 'l': if (S_ISLNK(m)) return 1; break;
+		case 'p': if (S_ISFIFO(m)) return 1; break;
+		case 's': if (S_ISSOCK(m)) return 1; break;
+		case 'g': if (m & S_ISGID) return 1; break;
+		case 'h':
+			if (f->attr->st_nlink > 1 && !S_ISDIR(m)) return 1;
+			break;
+		case 'o': if (m & S_IWOTH) return 1; break;
+		case 't': if (m & S_ISVTX) return 1; break;
+		case 'u': if (m & S_ISUID) return 1; break;
+		case 'x':
+			if (S_ISREG(m) && (m & (S_IXUSR | S_IXGRP | S_IXOTH)))
+				return 1;
+			break;
+		default: break;
+		}
+	}
+
+	return 0;
+}
+
+static int
+eval_filter_node(const struct filter_prog_t *prog, const size_t i,
+	struct filter_file_t *f)
+{
+	const struct filter_node_t *n = &prog->nodes[i];
+	size_t k;
+
+	switch (n->type) {
+	case FNODE_AND:
+		for (k = 0; k < n->kids_n; k++) {
+			if (eval_filter_node(prog, n->kids[k], f) == 0)
+				return 0;
+		}
+		return 1;
+
+	case FNODE_OR:
+		for (k = 0; k < n->kids_n; k++) {
+			if (eval_filter_node(prog, n->kids[k], f) == 1)
+				return 1;
+		}
+		return 0;
+
+	case FNODE_NOT:
+		return !eval_filter_node(prog, n->kids[0], f);
+
+	case FNODE_NAME:
+		if (n->glob.simple == 1)
+			return match_simple_glob(&n->glob, f->name);
+		if (match_literal(n, f) == 0)
+			return 0;
+		return (fnmatch(n->str, f->name, 0) == 0);
+
+	case FNODE_REGEX:
+		if (match_literal(n, f) == 0)
+			return 0;
+		if (n->lit_only == 1)
+			return 1;
+		return (regexec(&n->re, f->name, 0, NULL, 0) == 0);
+
+	case FNODE_TYPE:
+		return match_file_type(n->str, f);
+
+	case FNODE_SIZE:
+		return (filter_stat(f) == 1 && (long long)f->attr->st_size >= n->lo
+			&& (long long)f->attr->st_size <= n->hi);
+
+	case FNODE_MTIME: {
+		if (filter_stat(f) == 0)
+			return 0;
+		if (f->now == 0)
+			f->now = time(NULL);
+		const long long age = (long long)f->now
+			- (long long)f->attr->st_mtime;
+		return (age >= n->lo && age <= n->hi);
+		}
+
+	case FNODE_OWNER:
+		return (filter_stat(f) == 1 && (unsigned long)f->attr->st_uid == n->id);
+
+	case FNODE_GROUP:
+		return (filter_stat(f) == 1 && (unsigned long)f->attr->st_gid == n->id);
+
+	default: return 0;
+	}
+}
+
+/* Return 1 if the file F matches the filter program PROG, or 0 otherwise.
+ * If some predicate needs it, the stat(2) information of F is stored in
+ * F->ATTR, and F->STAT_STATE updated accordingly */
+int
+eval_filter_prog(const struct filter_prog_t *prog, struct filter_file_t *f)
+{
+	if (!prog->nodes)
+		return 1;
+
+	f->name_len = strlen(f->name);
+	return eval_filter_node(prog, prog->root, f);
+}
+
+/* Return 1 if NAME matches the current filter, or 0 otherwise. Only filters
+ * depending on file names alone are checked: 0 is returned for any other
+ * filter */
+int
+filter_match_name(const char *name)
+{
+	if (!filter.str || !filter_prog.nodes || filter_prog.needs_stat == 1)
+		return 0;
+
+	struct filter_file_t f;
+	memset(&f, 0, sizeof(struct filter_file_t));
+	f.name = name;
+	f.dirfd = -1;
+
+	return eval_filter_prog(&filter_prog, &f);
+}
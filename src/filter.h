@@ -0,0 +1,112 @@
+/* filter.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <regex.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "strings.h" /* struct glob_pat_t */
+
+/* Node types of a filter program */
+#define FNODE_AND   0
+#define FNODE_OR    1
+#define FNODE_NOT   2
+#define FNODE_NAME  3 /* name:GLOB */
+#define FNODE_REGEX 4 /* re:REGEX */
+#define FNODE_TYPE  5 /* type:CHARS */
+#define FNODE_SIZE  6 /* size:RANGE */
+#define FNODE_MTIME 7 /* mtime:RANGE */
+#define FNODE_OWNER 8 /* owner:USER */
+#define FNODE_GROUP 9 /* group:GROUP */
+
+/* Where the literal string required by a name predicate must be found */
+#define FLIT_ANY    0
+#define FLIT_PREFIX 1
+#define FLIT_SUFFIX 2
+#define FLIT_EXACT  3
+
+/* State of the stat(2) information of a file being filtered */
+#define FILTER_STAT_NONE 0
+#define FILTER_STAT_OK   1
+#define FILTER_STAT_ERR  2
+
+struct filter_node_t {
+	char *str;         /* NAME: glob pattern. TYPE: file type characters */
+	char *lit;         /* NAME and REGEX: literal substring every match has */
+	size_t lit_len;
+	size_t *kids;      /* AND, OR, and NOT: operands (indices into the program) */
+	size_t kids_n;
+	long long lo;      /* SIZE and MTIME: accepted range (inclusive) */
+	long long hi;
+	unsigned long id;  /* OWNER and GROUP: UID or GID */
+	struct glob_pat_t glob;
+	regex_t re;
+	int type;          /* One of the FNODE_* macros */
+	int cost;          /* Estimated evaluation cost */
+	int lit_pos;       /* One of the FLIT_* macros */
+	int lit_only;      /* The literal alone decides whether the name matches */
+	int re_ok;
+	int pad;
+};
+
+/* A compiled filter: a tree of predicates joined by AND, OR, and NOT nodes,
+ * whose operands are sorted cheapest first */
+struct filter_prog_t {
+	struct filter_node_t *nodes;
+	size_t n;
+	size_t root;
+	int needs_stat; /* Some predicate needs stat(2) information */
+	int needs_time; /* Some predicate depends on the current time */
+};
+
+/* A file to be checked against a filter program */
+struct filter_file_t {
+	const char *name;
+	struct stat *attr; /* Filled in only if some predicate needs it */
+	size_t name_len;   /* Set by eval_filter_prog() */
+	time_t now;        /* Current time. Set on first use if zero */
+	int dirfd;         /* Directory containing NAME, or -1 (no stat info) */
+	int stat_flags;    /* Flags passed to fstatat(2) */
+	int stat_state;    /* One of the FILTER_STAT_* macros */
+	unsigned char d_type; /* DT_UNKNOWN (zero) if not known */
+	char pad[3];
+};
+
+extern struct filter_prog_t filter_prog;
+
+__BEGIN_DECLS
+
+int  compile_filter_prog(const char *, const int, struct filter_prog_t *,
+	const char **);
+int  eval_filter_prog(const struct filter_prog_t *, struct filter_file_t *);
+int  filter_match_name(const char *);
+void free_filter_prog(struct filter_prog_t *);
+int  is_filter_expr(const char *);
+
+__END_DECLS
+
+#endif /* FILTER_H */
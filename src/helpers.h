@@ -257,6 +257,8 @@ extern int watch;
 #define KITTY_TERM          (1 << 12)
 #define NO_FIX_RL_POINT     (1 << 13)
 #define FAILED_ALIAS        (1 << 14)
+/* Waiting for input in the main prompt (refresh on filesystem events) */
+#define IN_MAIN_PROMPT      (1 << 15)
 
 /* Flags for third party binaries */
 #define FZF_BIN_OK     (1 << 0)
@@ -518,6 +520,7 @@ extern int watch;
 #define FILTER_FILE_NAME 1 /* Regex */
 #define FILTER_FILE_TYPE 2 /* =x */
 #define FILTER_MIME_TYPE 3 /* @query */
+#define FILTER_EXPR      4 /* Filter expression (see filter.c) */
 
 /* Macros for properties string fields in long view */
 #if defined(_LINUX_XATTR)
@@ -526,6 +529,10 @@ extern int watch;
 # define PROP_FIELDS_SIZE 6 /* Six available fields */
 #endif /* _LINUX_XATTR */
 
+/* Security attributes probed by the listing function */
+#define SECATTR_CAP   (1 << 0)
+#define SECATTR_XATTR (1 << 1)
+
 #define PERM_SYMBOLIC 1
 #define PERM_NUMERIC  2
 
@@ -725,6 +732,7 @@ struct config_t {
 	int purge_jumpdb;
 	int print_selfiles;
 	int private_ws_settings;
+	int refresh_delay;
 	int relative_time;
 	int restore_last_path;
 	int rm_force;
@@ -748,6 +756,7 @@ struct config_t {
 	int unicode;
 	int warning_prompt;
 	int welcome_message;
+	int ws_cache_size;
 
 	char *opener;
 	char *encoded_prompt;
@@ -873,10 +882,14 @@ struct fileinfo {
 	int symlink;
 	int sel;
 	int xattr;
+	int sec_probe; /* Security attributes not yet probed (SECATTR flags) */
+	int pad;
 	size_t len;
 	mode_t mode; /* Store st_mode (for long view mode) */
 	mode_t type; /* Store d_type value */
 	ino_t inode;
+	dev_t dev;
+	time_t ctime; /* Used to validate cached security attributes */
 	off_t size;
 	uid_t uid;
 	gid_t gid;
@@ -1320,7 +1333,6 @@ extern int
 	print_removed_files,
 	prompt_offset,
 	prompt_notif,
-	recur_perm_error_flag,
 	rl_nohist,
 	rl_notab,
 	sel_is_last,
@@ -1443,7 +1455,6 @@ extern char
 	**prompt_cmds,
 	**tags;
 
-extern regex_t regex_exp;
 extern char **environ;
 
 /* To store all the 39 color variables we use, with 46 bytes each, we need
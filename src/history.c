@@ -25,6 +25,7 @@
 #include "helpers.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -37,6 +38,7 @@
 #include "history.h"
 #include "init.h"
 #include "misc.h"
+#include "persist.h"
 #include "messages.h"
 #include "file_operations.h"
 
@@ -321,25 +323,243 @@ log_msg(char *_msg, const int print_prompt, const int logme,
 	write_msg_into_logfile(_msg);
 }
 
+/* Directory history (old_pwd) bookkeeping.
+ * old_pwd is indexed directly all over the place, so it is kept as a
+ * contiguous array: once it holds twice MaxDirhist entries, the oldest ones
+ * are dropped at once (see trim_dirhist()), which keeps memory bounded at
+ * an amortized cost of O(1) per new entry.
+ * The dirhist file is append-only: only entries added since it was last
+ * loaded or saved are written at exit. It is rewritten (compacted) only if
+ * it grew twice as large as needed (other instances append to it as well,
+ * so this is checked against the file itself), or if the history was
+ * cleared */
+static struct dirhist_state_t {
+	size_t *slots; /* Hash index: path -> position of its most recent
+	entry in old_pwd, plus one (zero if empty) */
+	size_t size;   /* Slots in the index (a power of two) */
+	size_t used;   /* Used slots */
+	int saved;     /* Entries in old_pwd already in the dirhist file */
+	int rewrite;   /* The dirhist file must be rewritten */
+} dh = {NULL, 0, 0, 0, 0};
+
+/* Make the entry I in old_pwd the most recent one for its path */
+static void
+add_to_dirhist_index(const int i)
+{
+	if (!old_pwd[i] || !dh.slots)
+		return;
+
+	const size_t mask = dh.size - 1;
+	size_t j = hashme32(old_pwd[i], HASH_SEED) & mask;
+
+	while (dh.slots[j] != 0) {
+		const char *p = old_pwd[dh.slots[j] - 1];
+		if (p && *p == *old_pwd[i] && strcmp(p, old_pwd[i]) == 0)
+			break;
+		j = (j + 1) & mask;
+	}
+
+	if (dh.slots[j] == 0)
+		dh.used++;
+	dh.slots[j] = (size_t)i + 1;
+}
+
+static void
+rebuild_dirhist_index(void)
+{
+	free(dh.slots);
+	dh.slots = (size_t *)NULL;
+	dh.used = 0;
+
+	size_t size = 16;
+	while (size < (size_t)dirhist_total_index * 2 + 2)
+		size <<= 1;
+
+	dh.size = size;
+	dh.slots = (size_t *)xcalloc(size, sizeof(size_t));
+
+	int i;
+	for (i = 0; i < dirhist_total_index; i++)
+		add_to_dirhist_index(i);
+}
+
+/* Return 1 if the entry I in old_pwd is the most recent one for its
+ * path, or 0 otherwise */
+int
+dirhist_is_latest(const int i)
+{
+	if (i < 0 || i >= dirhist_total_index || !old_pwd[i])
+		return 0;
+
+	if (!dh.slots)
+		return 1;
+
+	const size_t mask = dh.size - 1;
+	size_t j = hashme32(old_pwd[i], HASH_SEED) & mask;
+
+	while (dh.slots[j] != 0) {
+		const char *p = old_pwd[dh.slots[j] - 1];
+		if (p && *p == *old_pwd[i] && strcmp(p, old_pwd[i]) == 0)
+			return (dh.slots[j] - 1 == (size_t)i);
+		j = (j + 1) & mask;
+	}
+
+	return 1;
+}
+
+/* Set up the directory history index once old_pwd was loaded from the
+ * dirhist file */
+void
+index_dirhist(void)
+{
+	dh.saved = dirhist_total_index;
+	dh.rewrite = 0;
+	rebuild_dirhist_index();
+}
+
+void
+free_dirhist(void)
+{
+	int i = dirhist_total_index;
+	while (--i >= 0)
+		free(old_pwd[i]);
+	free(old_pwd);
+	old_pwd = (char **)NULL;
+	dirhist_cur_index = dirhist_total_index = 0;
+
+	free(dh.slots);
+	dh.slots = (size_t *)NULL;
+	dh.size = dh.used = 0;
+	dh.saved = dh.rewrite = 0;
+}
+
+/* Clear the directory history. The dirhist file will be rewritten by the
+ * next flush_stores() */
+void
+reset_dirhist(void)
+{
+	free_dirhist();
+	dh.rewrite = 1;
+	mark_store_dirty(STORE_DIRHIST);
+}
+
+/* Keep only the last MaxDirhist entries once old_pwd holds twice as many */
+static void
+trim_dirhist(void)
+{
+	if (conf.max_dirhist <= 0 || dirhist_total_index < conf.max_dirhist * 2)
+		return;
+
+	const int drop = dirhist_total_index - conf.max_dirhist;
+	int i;
+	for (i = 0; i < drop; i++)
+		free(old_pwd[i]);
+
+	/* Move the remaining entries, plus the terminating NULL */
+	memmove(old_pwd, old_pwd + drop,
+		(size_t)(dirhist_total_index - drop + 1) * sizeof(char *));
+
+	dirhist_total_index -= drop;
+	dirhist_cur_index = dirhist_cur_index >= drop
+		? dirhist_cur_index - drop : 0;
+	dh.saved = dh.saved >= drop ? dh.saved - drop : 0;
+
+	rebuild_dirhist_index();
+}
+
+/* Return the number of lines in the file opened as FD, or -1 on error */
+static int
+count_dirhist_lines(const int fd)
+{
+	struct stat a;
+	if (fstat(fd, &a) == -1)
+		return (-1);
+	if (a.st_size == 0)
+		return 0;
+
+	char buf[8192];
+	ssize_t r;
+	int n = 0;
+	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+		const char *p = buf, *end = buf + r;
+		while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+			n++;
+			p++;
+		}
+	}
+
+	return r == -1 ? -1 : n;
+}
+
+static void
+dirhist_save_error(void)
+{
+	_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: Error saving directory "
+		"history: %s\n"), PROGRAM_NAME, strerror(errno));
+}
+
 int
 save_dirhist(void)
 {
 	if (!dirhist_file)
 		return EXIT_FAILURE;
 
-	if (!old_pwd || !old_pwd[0])
+	if (!old_pwd || !old_pwd[0]) {
+		if (dh.rewrite == 0)
+			return EXIT_SUCCESS;
+		/* The history was cleared: truncate the file */
+		struct persist_t p;
+		if (persist_open(&p, dirhist_file, PERSIST_SYNC)
+		&& persist_commit(&p) != EXIT_SUCCESS) {
+			dirhist_save_error();
+			return EXIT_FAILURE;
+		}
+		dh.rewrite = 0;
+		return EXIT_SUCCESS;
+	}
+
+	const int unsaved = dirhist_total_index - dh.saved;
+	if (unsaved <= 0 && dh.rewrite == 0)
 		return EXIT_SUCCESS;
 
-	FILE *fp = fopen(dirhist_file, "w");
+	/* Rewrite the file only if needed. Otherwise, just append new entries */
+	int compact = (dh.rewrite == 1 || conf.max_dirhist <= 0);
+	int fd = -1;
+
+	if (compact == 0) {
+		fd = open(dirhist_file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+			S_IRUSR | S_IWUSR);
+		const int lines = fd == -1 ? -1 : count_dirhist_lines(fd);
+		if (lines == -1) {
+			dirhist_save_error();
+			if (fd != -1)
+				close(fd);
+			return EXIT_FAILURE;
+		}
+
+		if (lines + unsaved > conf.max_dirhist * 2) {
+			close(fd);
+			compact = 1;
+		}
+	}
+
+	/* Appending cannot damage entries already in the file, but a rewrite
+	 * is done on a copy of it */
+	struct persist_t p;
+	FILE *fp = compact == 1 ? persist_open(&p, dirhist_file, PERSIST_SYNC)
+		: fdopen(fd, "a");
 	if (!fp) {
-		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: Error saving "
-			"directory history: %s\n"), PROGRAM_NAME, strerror(errno));
+		dirhist_save_error();
+		if (compact == 0)
+			close(fd);
 		return EXIT_FAILURE;
 	}
 
 	/* Let's keep only the last MaxDirhist entries */
-	int i, n = dirhist_total_index <= conf.max_dirhist ? 0
-		: dirhist_total_index - conf.max_dirhist;
+	int i, n = dh.saved;
+	if (compact == 1)
+		n = dirhist_total_index <= conf.max_dirhist ? 0
+			: dirhist_total_index - conf.max_dirhist;
 
 	for (i = n; i < dirhist_total_index; i++) {
 		/* Exclude invalid/consecutive equal entries */
@@ -350,7 +570,25 @@ save_dirhist(void)
 		fprintf(fp, "%s\n", old_pwd[i]);
 	}
 
-	fclose(fp);
+	if (compact == 1) {
+		if (persist_commit(&p) != EXIT_SUCCESS) {
+			dirhist_save_error();
+			return EXIT_FAILURE;
+		}
+	} else {
+		/* Entries count as saved only once they reached the file */
+		const int werr = ferror(fp);
+		if (fclose(fp) == EOF || werr != 0) {
+			if (werr != 0 && errno == 0)
+				errno = EIO;
+			dirhist_save_error();
+			return EXIT_FAILURE;
+		}
+	}
+
+	dh.saved = dirhist_total_index;
+	dh.rewrite = 0;
+
 	return EXIT_SUCCESS;
 }
 
@@ -385,6 +623,7 @@ add_to_dirhist(const char *dir_path)
 		    old_pwd[dirhist_cur_index],
 		    strlen(old_pwd[dirhist_cur_index]));
 		dirhist_total_index++;
+		add_to_dirhist_index(dirhist_total_index - 1);
 
 		dirhist_cur_index = dirhist_total_index;
 		old_pwd[dirhist_total_index] = savestring(dir_path, strlen(dir_path));
@@ -392,6 +631,14 @@ add_to_dirhist(const char *dir_path)
 
 		old_pwd[dirhist_total_index] = (char *)NULL;
 	}
+
+	if (!dh.slots || (dh.used + 1) * 2 > dh.size)
+		rebuild_dirhist_index();
+	else
+		add_to_dirhist_index(dirhist_total_index - 1);
+
+	trim_dirhist();
+	mark_store_dirty(STORE_DIRHIST);
 }
 
 static int
@@ -454,7 +701,8 @@ static int
 _clear_history(char **args)
 {
 	/* Let's overwrite whatever was there */
-	FILE *hist_fp = fopen(hist_file, "w+");
+	struct persist_t p;
+	FILE *hist_fp = persist_open(&p, hist_file, PERSIST_SYNC);
 	if (!hist_fp) {
 		_err(0, NOPRINT_PROMPT, "history: %s: %s\n", hist_file, strerror(errno));
 		return EXIT_FAILURE;
@@ -462,7 +710,10 @@ _clear_history(char **args)
 
 	/* Do not create an empty file */
 	fprintf(hist_fp, "%s %s\n", args[0], args[1]);
-	fclose(hist_fp);
+	if (persist_commit(&p) != EXIT_SUCCESS) {
+		_err(0, NOPRINT_PROMPT, "history: %s: %s\n", hist_file, strerror(errno));
+		return EXIT_FAILURE;
+	}
 
 	/* Reset readline history */
 	return reload_history(args);
@@ -572,26 +823,28 @@ history_function(char **args)
 }
 
 static int
-exec_hist_cmd(char **cmd)
+exec_hist_cmd(char **cmd, char *raw)
 {
 	int i, exit_status = EXIT_SUCCESS;
 
-	char **alias_cmd = check_for_alias(cmd);
+	char **alias_cmd = check_for_alias(cmd, &raw);
 	if (alias_cmd) {
 		/* If an alias is found, check_for_alias frees CMD and returns
 		 * alias_cmd in its place to be executed by exec_cmd() */
-		if (exec_cmd(alias_cmd) != 0)
+		if (exec_cmd(alias_cmd, raw) != 0)
 			exit_status = EXIT_FAILURE;
 
+		free(raw);
 		for (i = 0; alias_cmd[i]; i++)
 			free(alias_cmd[i]);
 		free(alias_cmd);
 		alias_cmd = (char **)NULL;
 	} else {
-		if ((flags & FAILED_ALIAS) || exec_cmd(cmd) != 0)
+		if ((flags & FAILED_ALIAS) || exec_cmd(cmd, raw) != 0)
 			exit_status = EXIT_FAILURE;
 
 		flags &= ~FAILED_ALIAS;
+		free(raw);
 		for (i = 0; cmd[i]; i++)
 			free(cmd[i]);
 		free(cmd);
@@ -615,14 +868,15 @@ run_hist_num(const char *cmd)
 	if (record_cmd(history[num - 1].cmd))
 		add_to_cmdhist(history[num - 1].cmd);
 
-	char **cmd_hist = parse_input_str(history[num - 1].cmd);
+	char *raw = (char *)NULL;
+	char **cmd_hist = parse_input_str(history[num - 1].cmd, &raw);
 	if (!cmd_hist) {
 		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("history: Error parsing "
 			"history command\n"));
 		return EXIT_FAILURE;
 	}
 
-	int exit_status = exec_hist_cmd(cmd_hist);
+	int exit_status = exec_hist_cmd(cmd_hist, raw);
 	args_n = old_args;
 	return exit_status;
 }
@@ -635,14 +889,15 @@ run_last_hist_cmd(void)
 	if (record_cmd(history[current_hist_n - 1].cmd))
 		add_to_cmdhist(history[current_hist_n - 1].cmd);
 
-	char **cmd_hist = parse_input_str(history[current_hist_n - 1].cmd);
+	char *raw = (char *)NULL;
+	char **cmd_hist = parse_input_str(history[current_hist_n - 1].cmd, &raw);
 	if (!cmd_hist) {
 		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("history: Error parsing "
 			"history command\n"));
 		return EXIT_FAILURE;
 	}
 
-	int exit_status = exec_hist_cmd(cmd_hist);
+	int exit_status = exec_hist_cmd(cmd_hist, raw);
 	args_n = old_args;
 	return exit_status;
 }
@@ -664,9 +919,10 @@ run_last_lessn_hist_cmd(const char *cmd)
 	if (record_cmd(history[n].cmd))
 		add_to_cmdhist(history[n].cmd);
 
-	char **cmd_hist = parse_input_str(history[n].cmd);
+	char *raw = (char *)NULL;
+	char **cmd_hist = parse_input_str(history[n].cmd, &raw);
 	if (cmd_hist) {
-		int exit_status = exec_hist_cmd(cmd_hist);
+		int exit_status = exec_hist_cmd(cmd_hist, raw);
 		args_n = old_args;
 		return exit_status;
 	}
@@ -686,11 +942,12 @@ run_hist_string(const char *cmd)
 		if (*cmd != *history[i].cmd || strncmp(cmd, history[i].cmd, len) != 0)
 			continue;
 
-		char **cmd_hist = parse_input_str(history[i].cmd);
+		char *raw = (char *)NULL;
+		char **cmd_hist = parse_input_str(history[i].cmd, &raw);
 		if (!cmd_hist)
 			continue;
 
-		int exit_status = exec_hist_cmd(cmd_hist);
+		int exit_status = exec_hist_cmd(cmd_hist, raw);
 		args_n = old_args;
 		return exit_status;
 	}
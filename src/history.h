@@ -33,11 +33,15 @@ __BEGIN_DECLS
 
 void add_to_cmdhist(char *);
 void add_to_dirhist(const char *);
+int  dirhist_is_latest(const int);
+void free_dirhist(void);
 int  get_history(void);
 int  history_function(char **);
+void index_dirhist(void);
 int  log_function(char **);
 void log_msg(char *, const int, const int, const int);
 int  record_cmd(char *);
+void reset_dirhist(void);
 int  run_history_cmd(const char *);
 int  save_dirhist(void);
 
@@ -55,9 +55,11 @@
 #include <paths.h>
 
 #include "aux.h"
+#include "bookmarks.h"
 #include "checks.h"
 #include "config.h"
 #include "exec.h"
+#include "history.h"
 #include "init.h"
 #if defined(_NO_PROFILES) || defined(_NO_FZF) || defined(_NO_ICONS) \
 || defined(_NO_TRASH)
@@ -66,11 +68,13 @@
 #include "mime.h"
 #include "misc.h"
 #include "navigation.h"
+#include "properties.h"
 #include "sort.h"
 #include "file_operations.h"
 #include "autocmds.h"
 #include "sanitize.h"
 #include "selection.h"
+#include "snapshot.h"
 
 /* Macros to be able to consult the value of a macro string */
 #define STRINGIZE_(x) #x
@@ -194,7 +198,9 @@ init_conf_struct(void)
 	conf.only_dirs = UNSET;
 	conf.pager = UNSET;
 	conf.private_ws_settings = UNSET;
+	conf.ws_cache_size = UNSET;
 	conf.purge_jumpdb = UNSET;
+	conf.refresh_delay = UNSET;
 	conf.relative_time = UNSET;
 	conf.restore_last_path = UNSET;
 	conf.rm_force = UNSET;
@@ -714,7 +720,7 @@ check_env_filter(void)
 	}
 
 	filter.env = 1;
-	set_filter_type(*p);
+	set_filter_type(p);
 	filter.str = savestring(p, strlen(p));
 }
 
@@ -1162,6 +1168,7 @@ load_bookmarks(void)
 
 	if (bm_total == 0) {
 		close_fstream(fp, fd);
+		index_bookmarks();
 		return EXIT_SUCCESS;
 	}
 
@@ -1263,6 +1270,7 @@ load_bookmarks(void)
 	if (bm_n == 0) {
 		free(bookmarks);
 		bookmarks = (struct bookmarks_t *)NULL;
+		index_bookmarks();
 		return EXIT_SUCCESS;
 	}
 
@@ -1270,6 +1278,7 @@ load_bookmarks(void)
 	bookmarks[bm_n].path = (char *)NULL;
 	bookmarks[bm_n].shortcut = (char *)NULL;
 
+	index_bookmarks();
 	return EXIT_SUCCESS;
 }
 
@@ -3025,6 +3034,49 @@ cygwin_exclude_file(char *name)
 }
 #endif /* __CYGWIN__ */
 
+/* The snapshot holding the names of the commands in PATH listed in
+ * BIN_COMMANDS, if any. It stays mapped as long as BIN_COMMANDS is
+ * in use */
+static struct snapshot_t path_snap = {0};
+
+/* Free the list of commands built by get_path_programs() */
+void
+free_bin_commands(void)
+{
+	if (bin_commands) {
+		size_t i;
+		for (i = 0; bin_commands[i]; i++) {
+			/* Names taken from the snapshot are used in place */
+			if (in_snapshot(&path_snap, bin_commands[i]) == 0)
+				free(bin_commands[i]);
+		}
+		free(bin_commands);
+		bin_commands = (char **)NULL;
+	}
+
+	close_snapshot(&path_snap);
+	path_progsn = 0;
+}
+
+#if !defined(__CYGWIN__)
+/* Index, in the paths array, of the directory being scanned by
+ * get_path_programs() */
+static size_t scan_path_idx = 0;
+
+/* Same as skip_nonexec(), but files left out are recorded for the
+ * snapshot, which cannot tell otherwise when one of them becomes
+ * executable */
+static int
+skip_nonexec_snap(const struct dirent *ent)
+{
+	if (skip_nonexec(ent) == 1)
+		return 1;
+
+	add_snapshot_reject(scan_path_idx, ent->d_name);
+	return 0;
+}
+#endif /* !__CYGWIN__ */
+
 /* Get the list of files in PATH, plus CliFM internal commands, and send
  * them into an array to be read by my readline custom auto-complete
  * function (my_rl_completion) */
@@ -3034,8 +3086,20 @@ get_path_programs(void)
 	int i, l = 0, total_cmd = 0;
 	int *cmd_n = (int *)0;
 	struct dirent ***commands_bin = (struct dirent ***)NULL;
+	struct snap_stamp_t *stamps = (struct snap_stamp_t *)NULL;
+	struct snapshot_t *snap = &path_snap;
+
+	free_bin_commands();
 
 	if (conf.ext_cmd_ok == 1) {
+		/* If PATH did not change since the last scan, use the snapshot
+		 * taken back then instead of scanning it again */
+		stamps = get_path_stamps();
+		if (open_snapshot(snap, stamps) == EXIT_SUCCESS)
+			total_cmd = (int)snap->cmds_n;
+	}
+
+	if (conf.ext_cmd_ok == 1 && !snap->map) {
 		char cwd[PATH_MAX];
 		if (getcwd(cwd, sizeof(cwd)) == NULL) {/* Avoid compiler warning */}
 
@@ -3050,11 +3114,14 @@ get_path_programs(void)
 				continue;
 			}
 
+#if !defined(__CYGWIN__)
+			scan_path_idx = (size_t)i;
+#endif /* !__CYGWIN__ */
 			cmd_n[i] = scandir(paths[i].path, &commands_bin[i],
 #if defined(__CYGWIN__)
 					NULL, xalphasort);
 #else
-					conf.light_mode ? NULL : skip_nonexec, xalphasort);
+					conf.light_mode ? NULL : skip_nonexec_snap, xalphasort);
 #endif /* __CYGWIN__ */
 			/* If paths[i] directory does not exist, scandir returns -1.
 			 * Fedora, for example, adds $HOME/bin and $HOME/.local/bin to
@@ -3096,7 +3163,17 @@ get_path_programs(void)
 		}
 	}
 
-	if (conf.ext_cmd_ok == 1 && total_cmd > 0) {
+	const int path_first = l;
+
+	if (snap->map) {
+		/* And finally, add commands in PATH, as stored in the snapshot.
+		 * Names are not copied: they are used right from the mapped file */
+		size_t n;
+		for (n = 0; n < snap->cmds_n; n++) {
+			bin_commands[l] = (char *)snap->strtab + snap->offsets[n];
+			l++;
+		}
+	} else if (conf.ext_cmd_ok == 1 && total_cmd > 0) {
 		/* And finally, add commands in PATH */
 		i = (int)path_n;
 		while (--i >= 0) {
@@ -3123,8 +3200,13 @@ get_path_programs(void)
 
 			free(commands_bin[i]);
 		}
+
+		save_snapshot(stamps, bin_commands + path_first,
+			(size_t)(l - path_first));
 	}
 
+	free_snapshot_rejects();
+	free(stamps);
 	free(commands_bin);
 	free(cmd_n);
 	path_progsn = (size_t)l;
@@ -3262,10 +3344,15 @@ load_dirhist(void)
 
 	if (!dirs) {
 		close_fstream(fp, fd);
+		index_dirhist();
 		return EXIT_SUCCESS;
 	}
 
-	old_pwd = (char **)xnmalloc(dirs + 2, sizeof(char *));
+	/* The file is append-only: load only the last MaxDirhist entries */
+	size_t skip = (conf.max_dirhist > 0 && dirs > (size_t)conf.max_dirhist)
+		? dirs - (size_t)conf.max_dirhist : 0;
+
+	old_pwd = (char **)xnmalloc(dirs - skip + 2, sizeof(char *));
 
 	fseek(fp, 0L, SEEK_SET);
 
@@ -3274,13 +3361,19 @@ load_dirhist(void)
 	ssize_t line_len = 0;
 	dirhist_total_index = 0;
 
-	while ((line_len = getline(&line, &line_size, fp)) > 0)
+	while ((line_len = getline(&line, &line_size, fp)) > 0) {
+		if (skip > 0) {
+			skip--;
+			continue;
+		}
 		write_dirhist(line, line_len);
+	}
 
 	close_fstream(fp, fd);
 	old_pwd[dirhist_total_index] = (char *)NULL;
 	free(line);
 	dirhist_cur_index = dirhist_total_index - 1;
+	index_dirhist();
 	return EXIT_SUCCESS;
 }
 
@@ -3347,6 +3440,9 @@ get_prompt_cmds(void)
 static void
 check_time_str(void)
 {
+	/* Formatted dates are cached by print_entry_props() */
+	clear_props_cache();
+
 	if (prop_fields.time == 0)
 		return;
 
@@ -3396,6 +3492,8 @@ check_options(void)
 	if (conf.trim_names == 0)
 		conf.max_name_len = UNSET;
 
+	if (conf.refresh_delay == UNSET)
+		conf.refresh_delay = DEF_REFRESH_DELAY;
 	if (conf.relative_time == UNSET)
 		conf.relative_time = DEF_RELATIVE_TIME;
 
@@ -3417,6 +3515,8 @@ check_options(void)
 
 	if (conf.private_ws_settings == UNSET)
 		conf.private_ws_settings = DEF_PRIVATE_WS_SETTINGS;
+	if (conf.ws_cache_size == UNSET)
+		conf.ws_cache_size = DEF_WS_CACHE_SIZE;
 
 	if (conf.rm_force == UNSET)
 		conf.rm_force = DEF_RM_FORCE;
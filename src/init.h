@@ -38,6 +38,7 @@ char *get_date(void);
 int  get_home(void);
 int  get_last_path(void);
 size_t get_path_env(void);
+void free_bin_commands(void);
 void get_path_programs(void);
 void get_prompt_cmds(void);
 int  get_sel_files(void);
@@ -35,6 +35,7 @@
 #endif
 
 #include "aux.h"
+#include "bookmarks.h"
 #include "checks.h"
 #include "colors.h" /* get_dir_color() */
 #include "exec.h"
@@ -43,6 +44,7 @@
 #include "navigation.h"
 #include "messages.h"
 #include "misc.h"
+#include "persist.h"
 
 /* Macros to calculate directories rank extra points */
 #define BASENAME_BONUS 	300
@@ -92,14 +94,9 @@ rank_entry(const int i, const time_t now, int *days_since_first,
 		rank = JOLDER(tmp_rank);
 	}
 
-	int j = (int)bm_n;//, bpw = 0; /* Bookmarked, pinned or workspace */
-	while (--j >= 0) {
-		if (bookmarks[j].path && bookmarks[j].path[1] == jump_db[i].path[1]
-		&& strcmp(bookmarks[j].path, jump_db[i].path) == 0) {
-			rank += BOOKMARK_BONUS;
-			jump_db[i].keep = 1;
-			break;
-		}
+	if (find_bookmark(BM_PATH, jump_db[i].path) != -1) {
+		rank += BOOKMARK_BONUS;
+		jump_db[i].keep = 1;
 	}
 
 	if (pinned_dir && pinned_dir[1] == jump_db[i].path[1]
@@ -108,7 +105,7 @@ rank_entry(const int i, const time_t now, int *days_since_first,
 		jump_db[i].keep = 1;
 	}
 
-	j = MAX_WS;
+	int j = MAX_WS;
 	while (--j >= 0) {
 		if (workspaces[j].path && workspaces[j].path[1] == jump_db[i].path[1]
 		&& strcmp(jump_db[i].path, workspaces[j].path) == 0) {
@@ -172,6 +169,8 @@ add_to_jumpdb(const char *dir)
 		jump_n = 0;
 	}
 
+	mark_store_dirty(STORE_JUMPDB);
+
 	int i = (int)jump_n, new_entry = 1;
 	while (--i >= 0) {
 		if (!IS_VALID_JUMP_ENTRY(i))
@@ -204,8 +203,11 @@ save_jumpdb(void)
 	char *jump_file = (char *)xnmalloc(config_dir_len + 12, sizeof(char));
 	sprintf(jump_file, "%s/jump.clifm", config_dir);
 
-	FILE *fp = fopen(jump_file, "w+");
+	struct persist_t p;
+	FILE *fp = persist_open(&p, jump_file, PERSIST_SYNC);
 	if (!fp) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "jump: %s: %s\n", jump_file,
+			strerror(errno));
 		free(jump_file);
 		return;
 	}
@@ -254,7 +256,9 @@ save_jumpdb(void)
 	}
 
 	fprintf(fp, "@%d\n", total_rank);
-	fclose(fp);
+	if (persist_commit(&p) != EXIT_SUCCESS)
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "jump: %s: %s\n", jump_file,
+			strerror(errno));
 	free(jump_file);
 }
 
@@ -495,6 +499,7 @@ purge_invalid_entries(void)
 		if (stat(jump_db[i].path, &a) == -1) {
 			printf("%s->%s %s%s%s\n", mi_c, df_c, uf_c, jump_db[i].path, df_c);
 			jump_db[i].rank = JUMP_ENTRY_PURGED;
+			mark_store_dirty(STORE_JUMPDB);
 			c++;
 		}
 	}
@@ -530,6 +535,7 @@ purge_low_ranked_entries(const int limit)
 			jump_db[i].keep = 0;
 			printf("%s->%s %s (%d)\n", mi_c, df_c, jump_db[i].path, rank);
 			jump_db[i].rank = JUMP_ENTRY_PURGED;
+			mark_store_dirty(STORE_JUMPDB);
 			c++;
 		}
 	}
@@ -835,14 +841,8 @@ dirjump(char **args, int mode)
 		}
 
 		/* Bookmarked directories have extra credit */
-		k = (int)bm_n;
-		while (--k >= 0) {
-			if (bookmarks[k].path && bookmarks[k].path[1] == matches[j][1]
-			&& strcmp(bookmarks[k].path, matches[j]) == 0) {
-				rank += BOOKMARK_BONUS;
-				break;
-			}
-		}
+		if (find_bookmark(BM_PATH, matches[j]) != -1)
+			rank += BOOKMARK_BONUS;
 
 		if (pinned_dir && pinned_dir[1] == matches[j][1]
 		&& strcmp(pinned_dir, matches[j]) == 0)
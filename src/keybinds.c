@@ -272,11 +272,12 @@ keybind_exec_cmd(char *str)
 #endif
 
 	int exit_status = EXIT_FAILURE;
-	char **cmd = parse_input_str(str);
+	char *raw = (char *)NULL;
+	char **cmd = parse_input_str(str, &raw);
 	putchar('\n');
 
 	if (cmd) {
-		exit_status = exec_cmd(cmd);
+		exit_status = exec_cmd(cmd, raw);
 
 		/* While in the bookmarks or mountpoints screen, the kbind_busy
 		 * flag will be set to 1 and no keybinding will work. Once the
@@ -285,6 +286,7 @@ keybind_exec_cmd(char *str)
 		if (kbind_busy)
 			kbind_busy = 0;
 
+		free(raw);
 		int i = (int)args_n + 1;
 		while (--i >= 0)
 			free(cmd[i]);
@@ -26,9 +26,9 @@
 
 #include <stdio.h>
 #include <sys/statvfs.h>
-#if defined(BSD_KQUEUE)
-# include <unistd.h> /* open(2) */
-#endif
+#include <unistd.h> /* open(2), read(2) */
+#include <poll.h>
+#include <termios.h>
 #if defined(__linux__)
 # include <sys/capability.h>
 #endif
@@ -68,7 +68,9 @@
 #include "sort.h"
 #include "checks.h"
 #include "exec.h"
+#include "filter.h"
 #include "autocmds.h"
+#include "watch.h"
 
 #ifndef _NO_ICONS
 # include "icons.h"
@@ -89,9 +91,13 @@
 #define DIR_IN_NAME  ".cfm.in"
 #define DIR_OUT_NAME ".cfm.out"
 
+/* Set if autocommands for the current directory were already run */
+static int chdir_autocmds_done = 0;
+/* Amount of files excluded by a filter in the last listing */
+static int excluded_files_n = 0;
+
 /* Amount of digits of the files counter of the longest directory */
 static size_t longest_fc = 0;
-static int pager_bk = 0;
 
 /* Struct to store information about trimmed file names. Used only when
  * Unicode is disabled */
@@ -337,7 +343,7 @@ get_ext_icon(const char *restrict ext, int n)
 #endif /* _NO_ICONS */
 
 static int
-post_listing(DIR *dir, const int close_dir, const int reset_pager)
+post_listing(DIR *dir, const int close_dir)
 {
 	if (close_dir && closedir(dir) == -1)
 		return EXIT_FAILURE;
@@ -351,9 +357,6 @@ post_listing(DIR *dir, const int close_dir, const int reset_pager)
 	if (xargs.list_and_quit == 1)
 		exit(exit_code);
 
-	if (reset_pager == 1 && (conf.pager < 2 || (int)files < conf.pager))
-		conf.pager = pager_bk;
-
 	if (max_files != UNSET && (int)files > max_files)
 		printf("... (%d/%zu)\n", max_files, files);
 
@@ -381,79 +384,11 @@ post_listing(DIR *dir, const int close_dir, const int reset_pager)
 	return EXIT_SUCCESS;
 }
 
-/* A basic pager for directories containing large amount of files.
- * What's missing? It only goes downwards. To go backwards, use the
- * terminal scrollback function */
-static int
-run_pager(const int columns_n, int *reset_pager, int *i, size_t *counter)
-{
-	fputs(PAGER_LABEL, stdout);
-
-	switch (xgetchar()) {
-
-	/* Advance one line at a time */
-	case 66: /* fallthrough */ /* Down arrow */
-	case 10: /* fallthrough */ /* Enter */
-	case 32: /* Space */
-		break;
-
-	/* Advance one page at a time */
-	case 126: /* Page Down */
-		*counter = 0;
-		break;
-
-	/* h: Print pager help */
-	case 63: /* fallthrough */ /* ? */
-	case 104: {
-		CLEAR;
-
-		fputs(_(PAGER_HELP), stdout);
-		int l = (int)term_lines - 5;
-		MOVE_CURSOR_DOWN(l);
-		fputs(PAGER_LABEL, stdout);
-
-		xgetchar();
-		CLEAR;
-
-		if (columns_n == -1) { /* Long view */
-			*i = 0;
-		} else { /* Normal view */
-			if (conf.listing_mode == HORLIST)
-				*i = 0;
-			else
-				return (-2);
-		}
-
-		*counter = 0;
-		if (*i < 0)
-			*i = 0;
-	} break;
-
-	/* Stop paging (and set a flag to reenable the pager later) */
-	case 99:  /* 'c' */
-	case 112: /* 'p' */
-	case 113: /* 'q' */
-		pager_bk = conf.pager; conf.pager = 0; *reset_pager = 1;
-		break;
-
-	/* If another key is pressed, go back one position.
-	 * Otherwise, some file names won't be listed.*/
-	default:
-		putchar('\r');
-		ERASE_TO_RIGHT;
-		return (-1);
-	}
-
-	putchar('\r');
-	ERASE_TO_RIGHT;
-	return 0;
-}
-
 static void
 set_events_checker(void)
 {
 #if defined(LINUX_INOTIFY)
-	reset_inotify();
+	watch_cwd();
 #elif defined(BSD_KQUEUE)
 	if (event_fd >= 0) {
 		close(event_fd);
@@ -635,58 +570,6 @@ get_max_size(void)
 	return size_max;
 }
 
-static void
-print_long_mode(size_t *counter, int *reset_pager, const int pad,
-	const size_t ug_max, const size_t ino_max, const uint8_t have_xattr)
-{
-	struct stat lattr;
-
-	size_t fc_max = conf.files_counter == 1 ? get_max_files_counter() : 0;
-	size_t size_max = prop_fields.size == PROP_SIZE_BYTES ? get_max_size() : 0;
-
-	/* Available space (term cols) to print the file name */
-	int space_left = (int)term_cols - (prop_fields.len + have_xattr
-		+ (int)fc_max + (int)size_max + (int)ug_max + (int)ino_max);
-
-	if (space_left < conf.min_name_trim)
-		space_left = conf.min_name_trim;
-
-	if (conf.min_name_trim != UNSET && longest > (size_t)space_left)
-		longest = (size_t)space_left;
-
-	if (longest < (size_t)space_left)
-		space_left = (int)longest;
-
-	int i, k = (int)files;
-	for (i = 0; i < k; i++) {
-		if (max_files != UNSET && i == max_files)
-			break;
-		if (lstat(file_info[i].name, &lattr) == -1)
-			continue;
-
-		if (conf.pager == 1 || (*reset_pager == 0 && conf.pager > 1
-		&& (int)files >= conf.pager)) {
-			int ret = 0;
-			if (*counter > (size_t)(term_lines - 2))
-				ret = run_pager(-1, reset_pager, &i, counter);
-			if (ret == -1 || ret == -2) {
-				--i;
-				if (ret == -2)
-					*counter = 0;
-				continue;
-			}
-			(*counter)++;
-		}
-
-		if (conf.no_eln == 0) /* Print ELN */
-			printf("%s%*d%s%s%c%s", el_c, pad, i + 1, df_c,
-				li_cb, file_info[i].sel ? SELFILE_CHR : ' ', df_c);
-		/* Print the remaining part of the entry */
-		print_entry_props(&file_info[i], (size_t)space_left, ug_max,
-			ino_max, fc_max, size_max, have_xattr);
-	}
-}
-
 static size_t
 get_columns(void)
 {
@@ -1254,406 +1137,913 @@ pad_filename_light(int *ind_char, const int i, const int pad,
 	}
 }
 
-/* List files horizontally:
- * 1 AAA	2 AAB	3 AAC
- * 4 AAD	5 AAE	6 AAF */
+#if defined(_LINUX_CAP) || defined(_LINUX_XATTR)
+/* Cache of security attributes (capabilities and extended attributes),
+ * keyed by device and inode number. Since modifying these attributes
+ * updates the file's ctime, an entry is valid as long as the ctime of the
+ * file does not change. This way, unchanged files are never probed twice */
+#define SECATTR_CACHE_MIN 1024
+#define SECATTR_CACHE_MAX (1 << 18) /* Must be a power of two */
+
+struct secattr_t {
+	dev_t dev;
+	ino_t ino;
+	time_t ctime;
+	int probed; /* Attributes already probed (SECATTR flags) */
+	int found;  /* Attributes found (SECATTR flags) */
+};
+
+static struct secattr_t *secattr_cache = (struct secattr_t *)NULL;
+static size_t secattr_size = 0, secattr_n = 0;
+
+static size_t
+secattr_slot(const dev_t dev, const ino_t ino)
+{
+	uint64_t h = ((uint64_t)ino * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)dev;
+	h ^= h >> 29;
+	return (size_t)h & (secattr_size - 1);
+}
+
+/* Grow the cache table (or flush it, if it already reached its maximum
+ * size) */
 static void
-list_files_horizontal(size_t *counter, int *reset_pager, const int pad,
-		const size_t columns_n)
+grow_secattr_cache(void)
 {
-	int nn = (max_files != UNSET && max_files < (int)files)
-		? max_files : (int)files;
+	struct secattr_t *old = secattr_cache;
+	size_t old_size = secattr_size, i;
 
-	void (*print_entry_function)(int *, const int, const int, const int);
-	if (conf.colorize == 1)
-		print_entry_function = conf.light_mode == 1
-			? print_entry_color_light : print_entry_color;
-	else
-		print_entry_function = conf.light_mode == 1
-			? print_entry_nocolor_light : print_entry_nocolor;
+	if (secattr_size >= SECATTR_CACHE_MAX) {
+		free(old);
+		old = (struct secattr_t *)NULL;
+	} else {
+		secattr_size = secattr_size == 0 ? SECATTR_CACHE_MIN
+			: secattr_size * 2;
+	}
 
-	void (*pad_filename_function)(int *, const int, const int, const int);
-	pad_filename_function = conf.light_mode == 1
-		? pad_filename_light : pad_filename;
+	secattr_cache = (struct secattr_t *)xcalloc(secattr_size,
+		sizeof(struct secattr_t));
+	secattr_n = 0;
 
-	int termcap_move_right = (xargs.list_and_quit == 1
-		|| term_caps.suggestions == 0) ? 0 : 1;
+	for (i = 0; old && i < old_size; i++) {
+		if (old[i].ino == 0)
+			continue;
+		size_t j = secattr_slot(old[i].dev, old[i].ino);
+		while (secattr_cache[j].ino != 0)
+			j = (j + 1) & (secattr_size - 1);
+		secattr_cache[j] = old[i];
+		secattr_n++;
+	}
 
-	size_t cur_cols = 0;
-	int i, last_column = 0;
-	int blc = last_column;
-	for (i = 0; i < nn; i++) {
-		/* If current entry is in the last column, we need to print a new line char */
-		size_t bcur_cols = cur_cols;
-		if (++cur_cols == columns_n) {
-			cur_cols = 0;
-			last_column = 1;
-		} else {
-			last_column = 0;
-		}
+	free(old);
+}
 
-		int ind_char = 1;
-		if (!conf.classify)
-			ind_char = 0;
-
-				/* ##########################
-				 * #  MAS: A SIMPLE PAGER   #
-				 * ########################## */
-
-		if (conf.pager == 1 || (*reset_pager == 0 && conf.pager > 1
-		&& (int)files >= conf.pager)) {
-			/* Run the pager only once all columns and rows fitting in
-			 * the screen are filled with the corresponding file names */
-			int ret = 0, bi = i;
-			if (blc && *counter > columns_n * ((size_t)term_lines - 2))
-				ret = run_pager((int)columns_n, reset_pager, &i, counter);
-
-			if (ret == -1) {
-				i = bi ? bi - 1 : bi;
-				cur_cols = bcur_cols;
-				last_column = blc;
-				continue;
-			}
-			(*counter)++;
-		}
+/* Return the cache entry for DEV/INO, creating it if it does not exist */
+static struct secattr_t *
+get_secattr_entry(const dev_t dev, const ino_t ino)
+{
+	if (secattr_n + 1 > (secattr_size / 4) * 3)
+		grow_secattr_cache();
+
+	size_t i = secattr_slot(dev, ino);
+	while (secattr_cache[i].ino != 0) {
+		if (secattr_cache[i].ino == ino && secattr_cache[i].dev == dev)
+			return &secattr_cache[i];
+		i = (i + 1) & (secattr_size - 1);
+	}
+
+	secattr_cache[i].dev = dev;
+	secattr_cache[i].ino = ino;
+	secattr_cache[i].ctime = 0;
+	secattr_cache[i].probed = secattr_cache[i].found = 0;
+	secattr_n++;
+	return &secattr_cache[i];
+}
 
-		blc = last_column;
+/* Return the security attributes (among those specified by WHICH) set for
+ * the file NAME, whose stat data are DEV, INO, and CTIME */
+static int
+get_secattrs(const char *name, const dev_t dev, const ino_t ino,
+	const time_t ctime, const int which)
+{
+	struct secattr_t *e = ino != 0 ? get_secattr_entry(dev, ino)
+		: (struct secattr_t *)NULL;
 
-			/* #################################
-			 * #    PRINT THE CURRENT ENTRY    #
-			 * ################################# */
+	if (e && e->ctime != ctime) {
+		e->ctime = ctime;
+		e->probed = e->found = 0;
+	}
 
-		/* Trim file name to MAX_NAME_LEN */
-		int fc = file_info[i].dir != 1 ? (int)longest_fc : 0;
-		int _max = conf.max_name_len + fc;
+	int missing = e ? (which & ~e->probed) : which;
+	int found = 0;
 
-		file_info[i].eln_n = conf.no_eln ? -1 : DIGINUM(i + 1);
+#ifdef _LINUX_CAP
+	if (missing & SECATTR_CAP) {
+		cap_t cap = cap_get_file(name);
+		if (cap) {
+			found |= SECATTR_CAP;
+			cap_free(cap);
+		}
+	}
+#endif /* _LINUX_CAP */
 
-		print_entry_function(&ind_char, i, pad, _max);
+#ifdef _LINUX_XATTR
+	if ((missing & SECATTR_XATTR) && listxattr(name, NULL, 0) > 0)
+		found |= SECATTR_XATTR;
+#endif /* _LINUX_XATTR */
 
-		if (!last_column)
-			pad_filename_function(&ind_char, i, pad, termcap_move_right);
-		else
-			putchar('\n');
-	}
+	if (!e)
+		return found;
 
-	if (!last_column)
-		putchar('\n');
+	e->probed |= missing;
+	e->found |= found;
+	return e->found & which;
 }
 
-/* List files vertically, like ls(1) would
- * 1 AAA	3 AAC	5 AAE
- * 2 AAB	4 AAD	6 AAF */
+/* Probe the pending security attributes of the entry I in the files list.
+ * This is done only for files that are actually printed (see
+ * print_listing_row()): with the pager, only for the pages displayed */
 static void
-list_files_vertical(size_t *counter, int *reset_pager, const int pad,
-		const size_t columns_n)
+probe_entry_secattrs(const int i)
 {
-	int nn = (max_files != UNSET && max_files < (int)files)
-		? max_files : (int)files;
-
-	int rows = nn / (int)columns_n;
-	if (nn % (int)columns_n > 0)
-		rows++;
-
-	int last_column = 0;
-	/* The previous value of LAST_COLUMN. We need this value to run the pager */
-	int blc = last_column;
-
-	void (*print_entry_function)(int *, const int, const int, const int);
-	if (conf.colorize == 1)
-		print_entry_function = conf.light_mode == 1
-			? print_entry_color_light : print_entry_color;
-	else
-		print_entry_function = conf.light_mode == 1
-			? print_entry_nocolor_light : print_entry_nocolor;
+	if (file_info[i].sec_probe == 0)
+		return;
 
-	void (*pad_filename_function)(int *, const int, const int, const int);
-	pad_filename_function = conf.light_mode == 1
-		? pad_filename_light : pad_filename;
+	int ret = get_secattrs(file_info[i].name, file_info[i].dev,
+		file_info[i].inode, file_info[i].ctime, file_info[i].sec_probe);
+	file_info[i].sec_probe = 0;
 
-	int termcap_move_right = (xargs.list_and_quit == 1
-		|| term_caps.suggestions == 0) ? 0 : 1;
+	if (ret & SECATTR_XATTR)
+		file_info[i].xattr = 1;
 
-	size_t cur_cols = 0, cc = columns_n;
-	int x = 0, xx = 0, i = 0;
-	for ( ; ; i++) {
-		/* Copy current values to restore them if necessary: done to
-		 * skip the first two chars of arrow keys : \x1b [ */
-		int bxx = xx, bx = x;
-		size_t bcc = cc;
-		if (cc == columns_n) {
-			x = xx;
-			xx++;
-			cc = 0;
-		} else {
-			x += rows;
-		}
-		cc++;
+	if (ret & SECATTR_CAP) {
+		file_info[i].color = ca_c;
+		file_info[i].exec = 0;
+		if (stats.exec > 0)
+			stats.exec--;
+		stats.caps++;
+#ifndef _NO_ICONS
+		if (xargs.icons_use_file_color == 1 && conf.icons == 1)
+			file_info[i].icon_color = file_info[i].color;
+#endif /* !_NO_ICONS */
+	}
+}
 
-		if (xx > rows)
-			break;
+/* Probe pending security attributes for the first N (sorted) entries in
+ * the files list. Returns 1 if at least one of these files has extended
+ * attributes or 0 otherwise */
+static uint8_t
+probe_listed_secattrs(const size_t n)
+{
+	uint8_t have_xattr = 0;
+	size_t i;
 
-		size_t bcur_cols = cur_cols;
-		/* If current entry is in the last column, print a new line char */
-		if (++cur_cols == columns_n) {
-			cur_cols = 0;
-			last_column = 1;
-		} else {
-			last_column = 0;
-		}
+	for (i = 0; i < n; i++) {
+		probe_entry_secattrs((int)i);
+		if (file_info[i].xattr == 1)
+			have_xattr = 1;
+	}
 
-		int ind_char = 1;
-		if (!conf.classify)
-			ind_char = 0;
-
-		if (x >= nn || !file_info[x].name) {
-			if (last_column)
-				/* Last column is empty. Ex:
-				 * 1 file  3 file3  5 file5
-				 * 2 file2 4 file4  HERE
-				 * ... */
-				putchar('\n');
-			continue;
-		}
+	return have_xattr;
+}
+#endif /* _LINUX_CAP || _LINUX_XATTR */
+
+/* Keys understood by the pager, besides plain ASCII characters */
+#define PAGER_KEY_UP   256
+#define PAGER_KEY_DOWN 257
+#define PAGER_KEY_PGUP 258
+#define PAGER_KEY_PGDN 259
+#define PAGER_KEY_HOME 260
+#define PAGER_KEY_END  261
+#define PAGER_KEY_ESC  262
+
+#define PAGER_INPUT_MAX 256
+
+#define LAYOUT_LONG 0
+#define LAYOUT_HOR  1
+#define LAYOUT_VER  2
+
+/* Geometry of the current listing. It is computed once per listing and
+ * then used to print any screen row in isolation (print_listing_row()),
+ * so that the pager only formats the rows it actually displays */
+struct list_layout_t {
+	void (*print_entry)(int *, const int, const int, const int);
+	void (*pad_filename)(int *, const int, const int, const int);
+	size_t space_left; /* Long view only: space available for file names */
+	size_t ug_max;
+	size_t ino_max;
+	size_t fc_max;
+	size_t size_max;
+	int mode;    /* One of the LAYOUT_* values */
+	int nn;      /* Amount of entries to be listed */
+	int columns;
+	int rows;    /* Amount of screen rows taken by the whole listing */
+	int pad;
+	int move_right;
+	uint8_t have_xattr;
+};
 
-				/* ##########################
-				 * #  MAS: A SIMPLE PAGER   #
-				 * ########################## */
-
-		if (conf.pager == 1 || (*reset_pager == 0 && conf.pager > 1
-		&& (int)files >= conf.pager)) {
-			int ret = 0, bi = i;
-			/* Run the pager only once all columns and rows fitting in
-			 * the screen are filled with the corresponding file names */
-			if (blc && *counter > columns_n * ((size_t)term_lines - 2))
-				ret = run_pager((int)columns_n, reset_pager, &x, counter);
-
-			if (ret == -1) {
-				/* Restore previous values */
-				i = bi ? bi - 1: bi;
-				x = bx;
-				xx = bxx;
-				cc = bcc;
-				cur_cols = bcur_cols;
-				continue;
-			} else {
-				if (ret == -2) {
-					i = x = xx = last_column = blc = 0;
-					*counter = cur_cols = 0;
-					cc = columns_n;
-					continue;
-				}
-			}
-			(*counter)++;
-		}
+/* Screen rows currently displayed by the pager: [top, bottom) */
+struct pager_pos_t {
+	int top;
+	int bottom;
+	int page;
+};
 
-		blc = last_column;
+/* Last pattern searched for in the pager, and index of its last match */
+static char pager_pattern[PAGER_INPUT_MAX];
+static int pager_match = -1;
 
-			/* #################################
-			 * #    PRINT THE CURRENT ENTRY    #
-			 * ################################# */
+/* Print the entry at index I of the listing described by L (normal view),
+ * followed by either padding or, if LAST_COLUMN is set, a new line */
+static void
+print_grid_entry(const struct list_layout_t *l, const int i,
+	const int last_column)
+{
+	int ind_char = 1;
+	if (!conf.classify)
+		ind_char = 0;
 
-		/* Trim file name to MAX_NAME_LEN (+ LONGEST_FC) */
-		int fc = file_info[x].dir != 1 ? (int)longest_fc : 0;
-		int _max = conf.max_name_len + fc;
+	/* Trim file name to MAX_NAME_LEN (+ LONGEST_FC) */
+	int fc = file_info[i].dir != 1 ? (int)longest_fc : 0;
+	int _max = conf.max_name_len + fc;
 
-		file_info[x].eln_n = conf.no_eln ? -1 : DIGINUM(x + 1);
+	file_info[i].eln_n = conf.no_eln ? -1 : DIGINUM(i + 1);
 
-		print_entry_function(&ind_char, x, pad, _max);
+#if defined(_LINUX_CAP) || defined(_LINUX_XATTR)
+	probe_entry_secattrs(i);
+#endif /* _LINUX_CAP || _LINUX_XATTR */
 
-		if (!last_column)
-			pad_filename_function(&ind_char, x, pad, termcap_move_right);
-		else
-			/* Last column is populated. Ex:
-			 * 1 file  3 file3  5 file5HERE
-			 * 2 file2 4 file4  6 file6HERE
-			 * ... */
-			putchar('\n');
-	}
+	l->print_entry(&ind_char, i, l->pad, _max);
 
 	if (!last_column)
+		l->pad_filename(&ind_char, i, l->pad, l->move_right);
+	else
 		putchar('\n');
 }
 
-/* Execute commands in either DIR_IN_NAME or DIR_OUT_NAME files.
- * MODE (either DIR_IN or DIR_OUT) tells the function whether to check
- * for DIR_IN_NAME or DIR_OUT_NAME files.
- * Used by the autocommands function */
+/* Print the screen row ROW of the listing described by L */
 static void
-run_dir_cmd(const int mode)
+print_listing_row(const struct list_layout_t *l, const int row)
 {
-	FILE *fp = (FILE *)NULL;
-	char path[PATH_MAX];
-
-	if (mode == DIR_IN) {
-		snprintf(path, PATH_MAX - 1, "%s/%s",
-			workspaces[cur_ws].path, DIR_IN_NAME);
-	} else {
-		if (mode == DIR_OUT) {
-			if (dirhist_cur_index <= 0 || !old_pwd[dirhist_cur_index - 1])
-				return;
-			snprintf(path, PATH_MAX - 1, "%s/%s",
-				old_pwd[dirhist_cur_index - 1], DIR_OUT_NAME);
-		}
-	}
+	if (l->mode == LAYOUT_LONG) {
+		struct stat a;
+		if (lstat(file_info[row].name, &a) == -1)
+			return;
 
-	fp = fopen(path, "r");
-	if (!fp)
-		return;
+#if defined(_LINUX_CAP) || defined(_LINUX_XATTR)
+		probe_entry_secattrs(row);
+#endif /* _LINUX_CAP || _LINUX_XATTR */
 
-	char buf[PATH_MAX];
-	*buf = '\0';
-	char *ret = fgets(buf, sizeof(buf), fp);
-	if (!ret) {
-		fclose(fp);
+		if (conf.no_eln == 0) /* Print ELN */
+			printf("%s%*d%s%s%c%s", el_c, l->pad, row + 1, df_c,
+				li_cb, file_info[row].sel ? SELFILE_CHR : ' ', df_c);
+		/* Print the remaining part of the entry */
+		print_entry_props(&file_info[row], l->space_left, l->ug_max,
+			l->ino_max, l->fc_max, l->size_max, l->have_xattr);
 		return;
 	}
 
-	fclose(fp);
+	/* Vertical listing (like ls(1)):   Horizontal listing:
+	 * 1 AAA	3 AAC	5 AAE           1 AAA	2 AAB	3 AAC
+	 * 2 AAB	4 AAD	6 AAF           4 AAD	5 AAE	6 AAF */
+	int c, last_column = 0;
+	for (c = 0; c < l->columns; c++) {
+		int i = l->mode == LAYOUT_VER ? row + (c * l->rows)
+			: (row * l->columns) + c;
+		if (i >= l->nn)
+			break;
 
-	if (!*buf)
-		return;
+		last_column = (c + 1 == l->columns);
+		print_grid_entry(l, i, last_column);
+	}
 
-	if (xargs.secure_cmds == 0
-	|| sanitize_cmd(buf, SNT_AUTOCMD) == EXIT_SUCCESS)
-		launch_execle(buf);
+	if (!last_column)
+		putchar('\n');
 }
 
-/* Check if S is either .cfm.in or .cfm.out */
 static void
-check_autocmd_file(const char *s)
+print_listing_rows(const struct list_layout_t *l, const int from, const int to)
 {
-	if (*s == '.' && s[1] == 'c' && s[2] == 'f' && s[3] == 'm'
-	&& s[4] == '.') {
-		if (s[5] == 'o' && s[6] == 'u' && s[7] == 't' && !s[8]) {
-			dir_out = 1;
-		} else {
-			if (s[5] == 'i' && s[6] == 'n' && !s[7])
-				run_dir_cmd(DIR_IN);
-		}
-	}
+	int r;
+	for (r = from; r < to && r < l->rows; r++)
+		print_listing_row(l, r);
 }
 
-static void
-get_largest(size_t i, off_t *size, char **name, char **color, off_t *total)
+/* Return the screen row of the listing L in which the entry at index I
+ * is displayed */
+static int
+get_entry_row(const struct list_layout_t *l, const int i)
 {
-	/* Only directories and regular files should be counted */
-	if (file_info[i].type != DT_DIR && file_info[i].type != DT_REG)
-		return;
-
-	int d = (file_info[i].type == DT_DIR ? 1024 : 1);
-	if (file_info[i].size * d > *size) {
-		*size = file_info[i].size * d;
-		*name = file_info[i].name;
-		*color = file_info[i].color;
-	}
-
-	/* Do not recount hardlinks */
-	if (file_info[i].linkn > 1) {
-		int j = (int)i - 1;
-		while (--j >= 0)
-			if (file_info[i].inode == file_info[j].inode)
-				return;
-	}
+	if (l->mode == LAYOUT_LONG)
+		return i;
 
-	*total += file_info[i].size * d;
+	return l->mode == LAYOUT_VER ? i % l->rows : i / l->columns;
 }
 
-/* Return the lenght of the longest UID:GID string for files listed in
- * long view mode */
-static size_t
-get_max_ug_str(void)
+/* Return the index of the first entry (in ELN order) displayed in the
+ * screen row ROW of the listing L */
+static int
+get_row_entry(const struct list_layout_t *l, const int row)
 {
-	size_t ug_max = 0;
-	int i = (int)files;
-
-	while (--i >= 0) {
-		size_t t = (size_t)DIGINUM(file_info[i].uid) + DIGINUM(file_info[i].gid);
-		if (t > ug_max)
-			ug_max = t;
-	}
-
-	return ug_max;
+	return l->mode == LAYOUT_HOR ? row * l->columns : row;
 }
 
-static size_t
-get_longest_inode(void)
+/* Return the amount of screen rows making up a pager page (the last line
+ * of the screen is taken by the pager label) */
+static int
+get_pager_page_rows(void)
 {
-	size_t l = 0;
-
-	int i = (int)files;
-	while (--i >= 0) {
-		size_t n = DIGINUM(file_info[i].inode);
-		if (n > l)
-			l = n;
-	}
-
-	return l;
+	return term_lines > 2 ? (int)term_lines - 1 : 1;
 }
 
 static int
-exclude_file_type_light(const unsigned char type)
+pager_is_needed(const struct list_layout_t *l)
 {
-	if (!*(filter.str + 1))
-		return EXIT_FAILURE;
-
-	int match = 0;
-
-	switch(*(filter.str + 1)) {
-	case 'd': if (type == DT_DIR) match = 1; break;
-	case 'f': if (type == DT_REG) match = 1; break;
-	case 'l': if (type == DT_LNK) match = 1; break;
-	case 's': if (type == DT_SOCK) match = 1; break;
-	case 'c': if (type == DT_CHR) match = 1; break;
-	case 'b': if (type == DT_BLK) match = 1; break;
-	case 'p': if (type == DT_FIFO) match = 1; break;
-	default: return EXIT_FAILURE;
-	}
+	if (conf.pager == 0 || (conf.pager > 1 && (int)files < conf.pager))
+		return 0;
 
-	if (match == 1)
-		return filter.rev == 1 ? EXIT_SUCCESS : EXIT_FAILURE;
-	else
-		return filter.rev == 1 ? EXIT_FAILURE : EXIT_SUCCESS;
+	return (l->rows > get_pager_page_rows());
 }
 
-/* Returns EXIT_SUCCESS if the file with mode MODE and LINKS number
- * of links must be excluded from the files list, or EXIT_FAILURE */
+/* Read a key from the terminal (already in non-canonical mode), translating
+ * the escape sequences the pager cares about into PAGER_KEY_* values.
+ * Returns -1 on error and 0 for unsupported escape sequences */
 static int
-exclude_file_type(const mode_t mode, const nlink_t links)
+pager_getkey(void)
 {
-/* ADD: C = Files with capabilities */
+	unsigned char c = 0;
 
-	if (!*(filter.str + 1))
-		return EXIT_FAILURE;
+	fflush(stdout);
+	if (read(STDIN_FILENO, &c, 1) != 1)
+		return (-1);
 
-	int match = 0;
-
-	switch(*(filter.str + 1)) {
-	case 'b': if (S_ISBLK(mode)) match = 1; break;
-	case 'd': if (S_ISDIR(mode)) match = 1; break;
-	case 'c': if (S_ISCHR(mode)) match = 1; break;
-	case 'f': if (S_ISREG(mode)) match = 1; break;
-	case 'l': if (S_ISLNK(mode)) match = 1; break;
-	case 'p': if (S_ISFIFO(mode)) match = 1; break;
-	case 's': if (S_ISSOCK(mode)) match = 1; break;
-
-	case 'g': if (mode & 02000) match = 1; break; // SGID
-	case 'h': if (links > 1 && !S_ISDIR(mode)) match = 1; break;
-	case 'o': if (mode & 00002) match = 1; break; // Other writable
-	case 't': if (mode & 01000) match = 1; break; // Sticky
-	case 'u': if (mode & 04000) match = 1; break; // SUID
-	case 'x': // Executable
-//		if (S_ISREG(mode) && ((mode & S_IXUSR) || (mode & S_IXGRP) || (mode & S_IXOTH))) {
-		if (S_ISREG(mode) && ((mode & 00100) || (mode & 00010) || (mode & 00001)))
-			match = 1;
-		break;
-	default: return EXIT_FAILURE;
+	if (c != 27)
+		return (int)c;
+
+	/* A lone Esc is not followed by anything else */
+	struct pollfd pfd;
+	pfd.fd = STDIN_FILENO;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	unsigned char seq[3] = {0};
+	if (poll(&pfd, 1, 50) <= 0 || read(STDIN_FILENO, &seq[0], 1) != 1)
+		return PAGER_KEY_ESC;
+
+	if ((*seq != '[' && *seq != 'O') || read(STDIN_FILENO, &seq[1], 1) != 1)
+		return 0;
+
+	if (seq[1] >= '0' && seq[1] <= '9') {
+		/* "\x1b[N~" sequences */
+		if (read(STDIN_FILENO, &seq[2], 1) != 1 || seq[2] != '~')
+			return 0;
+
+		switch (seq[1]) {
+		case '1': /* fallthrough */
+		case '7': return PAGER_KEY_HOME;
+		case '4': /* fallthrough */
+		case '8': return PAGER_KEY_END;
+		case '5': return PAGER_KEY_PGUP;
+		case '6': return PAGER_KEY_PGDN;
+		default: return 0;
+		}
+	}
+
+	switch (seq[1]) {
+	case 'A': return PAGER_KEY_UP;
+	case 'B': return PAGER_KEY_DOWN;
+	case 'H': return PAGER_KEY_HOME;
+	case 'F': return PAGER_KEY_END;
+	default: return 0;
+	}
+}
+
+/* Update the input buffer BUF (holding LEN bytes) of a pager prompt
+ * according to KEY. Returns 1 if the input was accepted, -1 if it was
+ * canceled, and 0 otherwise */
+static int
+pager_edit_input(char *buf, size_t *len, const int key)
+{
+	switch (key) {
+	case '\n': return 1;
+
+	case -1: /* fallthrough */
+	case PAGER_KEY_ESC: return (-1);
+
+	case 8: /* fallthrough */ /* Ctrl-h */
+	case 127: /* Backspace */
+		/* Remove UTF-8 continuation bytes first, if any */
+		while (*len > 0 && (buf[*len - 1] & 0xC0) == 0x80)
+			(*len)--;
+		if (*len > 0)
+			(*len)--;
+		buf[*len] = '\0';
+		return 0;
+
+	default:
+		if (key >= ' ' && key < 256 && key != 127
+		&& *len + 1 < PAGER_INPUT_MAX) {
+			buf[*len] = (char)key;
+			(*len)++;
+			buf[*len] = '\0';
+		}
+		return 0;
+	}
+}
+
+/* Return the index of the first entry in the listing L, starting at START
+ * and wrapping around, whose name contains PATTERN, or -1 if none */
+static int
+pager_find_entry(const struct list_layout_t *l, const char *pattern,
+	const int start)
+{
+	if (!pattern || !*pattern || l->nn <= 0)
+		return (-1);
+
+	int i;
+	for (i = 0; i < l->nn; i++) {
+		int n = (start + i) % l->nn;
+		if ((conf.case_sens_search == 1 ? strstr(file_info[n].name, pattern)
+		: strcasestr(file_info[n].name, pattern)) != NULL)
+			return n;
+	}
+
+	return (-1);
+}
+
+/* Clear the screen and display the page of the listing L starting at the
+ * screen row TOP. Nothing is done if that page is already displayed,
+ * unless FORCE is set */
+static void
+pager_draw(const struct list_layout_t *l, struct pager_pos_t *p, int top,
+	const int force)
+{
+	if (top > l->rows - p->page)
+		top = l->rows - p->page;
+	if (top < 0)
+		top = 0;
+
+	if (top == p->top && force == 0)
+		return;
+
+	CLEAR;
+	p->top = top;
+	p->bottom = top + p->page < l->rows ? top + p->page : l->rows;
+	print_listing_rows(l, p->top, p->bottom);
+}
+
+/* Incremental search: each key press moves the pager to the first entry,
+ * starting at the current page, matching the input so far. Esc goes back
+ * to where the search started */
+static void
+pager_search(const struct list_layout_t *l, struct pager_pos_t *p)
+{
+	const int orig_top = p->top;
+	const int start = get_row_entry(l, p->top);
+	size_t len = 0;
+	int ret = 0;
+
+	*pager_pattern = '\0';
+	pager_match = -1;
+
+	while (ret == 0) {
+		printf("/%s%s", pager_pattern, (*pager_pattern && pager_match == -1)
+			? _(" (not found)") : "");
+		ERASE_TO_RIGHT;
+
+		ret = pager_edit_input(pager_pattern, &len, pager_getkey());
+		putchar('\r');
+		ERASE_TO_RIGHT;
+		if (ret != 0)
+			break;
+
+		pager_match = pager_find_entry(l, pager_pattern, start);
+		pager_draw(l, p, pager_match == -1 ? orig_top
+			: get_entry_row(l, pager_match), 0);
+	}
+
+	if (ret == -1) {
+		pager_match = -1;
+		pager_draw(l, p, orig_top, 0);
+	}
+}
+
+/* Read an ELN at the pager prompt, whose first digit is FIRST (if any),
+ * and move the pager to the corresponding entry */
+static void
+pager_jump_to_eln(const struct list_layout_t *l, struct pager_pos_t *p,
+	const int first)
+{
+	char buf[PAGER_INPUT_MAX] = "";
+	size_t len = 0;
+	int ret = first ? pager_edit_input(buf, &len, first) : 0;
+
+	while (ret == 0) {
+		printf(":%s", buf);
+		ERASE_TO_RIGHT;
+		ret = pager_edit_input(buf, &len, pager_getkey());
+		putchar('\r');
+		ERASE_TO_RIGHT;
+	}
+
+	if (ret == -1 || !is_number(buf))
+		return;
+
+	int n = xatoi(buf);
+	if (n > 0 && n <= l->nn)
+		pager_draw(l, p, get_entry_row(l, n - 1), 0);
+}
+
+/* Mas, the files list pager.
+ * Only the rows actually displayed are formatted: moving forward prints
+ * just the next rows, while moving backwards or jumping (to the top, the
+ * bottom, an ELN, or a search match) redraws a single page. Displaying
+ * any page thus costs the same no matter the size of the listing or the
+ * position in it. The pager ends once the last row is on the screen */
+static void
+run_pager(const struct list_layout_t *l)
+{
+	struct pager_pos_t p;
+	p.page = get_pager_page_rows();
+	p.top = 0;
+	p.bottom = p.page;
+
+	print_listing_rows(l, 0, p.bottom);
+
+	struct termios oldt, newt;
+	if (tcgetattr(STDIN_FILENO, &oldt) == -1) {
+		print_listing_rows(l, p.bottom, l->rows);
+		return;
+	}
+
+	newt = oldt;
+	newt.c_lflag &= (tcflag_t)~(ICANON | ECHO);
+	newt.c_cc[VMIN] = 1;
+	newt.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+
+	while (p.bottom < l->rows) {
+		fputs(PAGER_LABEL, stdout);
+		int key = pager_getkey();
+		putchar('\r');
+		ERASE_TO_RIGHT;
+
+		switch (key) {
+		/* Advance one line at a time */
+		case PAGER_KEY_DOWN: /* fallthrough */
+		case '\n': /* fallthrough */
+		case ' ': /* fallthrough */
+		case 'j':
+			print_listing_row(l, p.bottom);
+			p.bottom++;
+			p.top++;
+			break;
+
+		/* Advance one page at a time */
+		case PAGER_KEY_PGDN: /* fallthrough */
+		case 'f': {
+			int n = p.bottom + p.page < l->rows ? p.bottom + p.page : l->rows;
+			print_listing_rows(l, p.bottom, n);
+			p.top += n - p.bottom;
+			p.bottom = n;
+			}
+			break;
+
+		case PAGER_KEY_UP: /* fallthrough */
+		case 'k': pager_draw(l, &p, p.top - 1, 0); break;
+
+		case PAGER_KEY_PGUP: /* fallthrough */
+		case 'b': pager_draw(l, &p, p.top - p.page, 0); break;
+
+		case PAGER_KEY_HOME: /* fallthrough */
+		case 'g': pager_draw(l, &p, 0, 0); break;
+
+		case PAGER_KEY_END: /* fallthrough */
+		case 'G': pager_draw(l, &p, l->rows, 0); break;
+
+		case '/': pager_search(l, &p); break;
+
+		/* Next match of the last search pattern */
+		case 'n':
+			if (*pager_pattern) {
+				pager_match = pager_find_entry(l, pager_pattern,
+					pager_match + 1);
+				if (pager_match != -1)
+					pager_draw(l, &p, get_entry_row(l, pager_match), 0);
+			}
+			break;
+
+		/* Jump to ELN */
+		case ':': pager_jump_to_eln(l, &p, 0); break;
+
+		/* h: Print pager help */
+		case '?': /* fallthrough */
+		case 'h':
+			CLEAR;
+			fputs(_(PAGER_HELP), stdout);
+			fputs(PAGER_LABEL, stdout);
+			pager_getkey();
+			pager_draw(l, &p, p.top, 1);
+			break;
+
+		/* Stop paging: print the remaining rows */
+		case -1: /* fallthrough */
+		case 'c': /* fallthrough */
+		case 'p': /* fallthrough */
+		case 'q':
+			print_listing_rows(l, p.bottom, l->rows);
+			p.bottom = l->rows;
+			break;
+
+		default:
+			if (key >= '1' && key <= '9')
+				pager_jump_to_eln(l, &p, key);
+			break;
+		}
+	}
+
+	tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+}
+
+/* Print the listing described by L, either at once or through the pager */
+static void
+print_listing(const struct list_layout_t *l)
+{
+	if (pager_is_needed(l) == 1)
+		run_pager(l);
+	else
+		print_listing_rows(l, 0, l->rows);
+}
+
+/* Set the entry printing functions used in normal view */
+static void
+set_grid_printers(struct list_layout_t *l)
+{
+	if (conf.colorize == 1)
+		l->print_entry = conf.light_mode == 1
+			? print_entry_color_light : print_entry_color;
+	else
+		l->print_entry = conf.light_mode == 1
+			? print_entry_nocolor_light : print_entry_nocolor;
+
+	l->pad_filename = conf.light_mode == 1
+		? pad_filename_light : pad_filename;
+
+	l->move_right = (xargs.list_and_quit == 1
+		|| term_caps.suggestions == 0) ? 0 : 1;
+}
+
+/* List files horizontally:
+ * 1 AAA	2 AAB	3 AAC
+ * 4 AAD	5 AAE	6 AAF */
+static void
+list_files_horizontal(const int pad, const size_t columns_n)
+{
+	struct list_layout_t l;
+	memset(&l, 0, sizeof(struct list_layout_t));
+
+	l.mode = LAYOUT_HOR;
+	l.nn = (max_files != UNSET && max_files < (int)files)
+		? max_files : (int)files;
+	l.pad = pad;
+	l.columns = (int)columns_n;
+	l.rows = (l.nn / l.columns) + (l.nn % l.columns > 0);
+	set_grid_printers(&l);
+
+	print_listing(&l);
+}
+
+/* List files vertically, like ls(1) would
+ * 1 AAA	3 AAC	5 AAE
+ * 2 AAB	4 AAD	6 AAF */
+static void
+list_files_vertical(const int pad, const size_t columns_n)
+{
+	struct list_layout_t l;
+	memset(&l, 0, sizeof(struct list_layout_t));
+
+	l.mode = LAYOUT_VER;
+	l.nn = (max_files != UNSET && max_files < (int)files)
+		? max_files : (int)files;
+	l.pad = pad;
+	l.columns = (int)columns_n;
+	l.rows = (l.nn / l.columns) + (l.nn % l.columns > 0);
+	set_grid_printers(&l);
+
+	print_listing(&l);
+}
+
+static void
+print_long_mode(const int pad, const size_t ug_max, const size_t ino_max,
+	const uint8_t have_xattr)
+{
+	struct list_layout_t l;
+	memset(&l, 0, sizeof(struct list_layout_t));
+
+	l.fc_max = conf.files_counter == 1 ? get_max_files_counter() : 0;
+	l.size_max = prop_fields.size == PROP_SIZE_BYTES ? get_max_size() : 0;
+
+	/* Available space (term cols) to print the file name */
+	int space_left = (int)term_cols - (prop_fields.len + have_xattr
+		+ (int)l.fc_max + (int)l.size_max + (int)ug_max + (int)ino_max);
+
+	if (space_left < conf.min_name_trim)
+		space_left = conf.min_name_trim;
+
+	if (conf.min_name_trim != UNSET && longest > (size_t)space_left)
+		longest = (size_t)space_left;
+
+	if (longest < (size_t)space_left)
+		space_left = (int)longest;
+
+	l.mode = LAYOUT_LONG;
+	l.nn = (max_files != UNSET && max_files < (int)files)
+		? max_files : (int)files;
+	l.rows = l.nn;
+	l.columns = 1;
+	l.pad = pad;
+	l.space_left = (size_t)space_left;
+	l.ug_max = ug_max;
+	l.ino_max = ino_max;
+	l.have_xattr = have_xattr;
+
+	print_listing(&l);
+}
+
+/* Execute commands in either DIR_IN_NAME or DIR_OUT_NAME files.
+ * MODE (either DIR_IN or DIR_OUT) tells the function whether to check
+ * for DIR_IN_NAME or DIR_OUT_NAME files.
+ * Used by the autocommands function */
+static void
+run_dir_cmd(const int mode)
+{
+	FILE *fp = (FILE *)NULL;
+	char path[PATH_MAX];
+
+	if (mode == DIR_IN) {
+		snprintf(path, PATH_MAX - 1, "%s/%s",
+			workspaces[cur_ws].path, DIR_IN_NAME);
+	} else {
+		if (mode == DIR_OUT) {
+			if (dirhist_cur_index <= 0 || !old_pwd[dirhist_cur_index - 1])
+				return;
+			snprintf(path, PATH_MAX - 1, "%s/%s",
+				old_pwd[dirhist_cur_index - 1], DIR_OUT_NAME);
+		}
+	}
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return;
+
+	char buf[PATH_MAX];
+	*buf = '\0';
+	char *ret = fgets(buf, sizeof(buf), fp);
+	if (!ret) {
+		fclose(fp);
+		return;
+	}
+
+	fclose(fp);
+
+	if (!*buf)
+		return;
+
+	if (xargs.secure_cmds == 0
+	|| sanitize_cmd(buf, SNT_AUTOCMD) == EXIT_SUCCESS)
+		launch_execle(buf);
+}
+
+/* Check if S is either .cfm.in or .cfm.out */
+static void
+check_autocmd_file(const char *s)
+{
+	if (*s == '.' && s[1] == 'c' && s[2] == 'f' && s[3] == 'm'
+	&& s[4] == '.') {
+		if (s[5] == 'o' && s[6] == 'u' && s[7] == 't' && !s[8]) {
+			dir_out = 1;
+		} else {
+			if (s[5] == 'i' && s[6] == 'n' && !s[7])
+				run_dir_cmd(DIR_IN);
+		}
+	}
+}
+
+static void
+get_largest(size_t i, off_t *size, char **name, char **color, off_t *total)
+{
+	/* Only directories and regular files should be counted */
+	if (file_info[i].type != DT_DIR && file_info[i].type != DT_REG)
+		return;
+
+	int d = (file_info[i].type == DT_DIR ? 1024 : 1);
+	if (file_info[i].size * d > *size) {
+		*size = file_info[i].size * d;
+		*name = file_info[i].name;
+		*color = file_info[i].color;
+	}
+
+	/* Do not recount hardlinks */
+	if (file_info[i].linkn > 1) {
+		int j = (int)i - 1;
+		while (--j >= 0)
+			if (file_info[i].inode == file_info[j].inode)
+				return;
+	}
+
+	*total += file_info[i].size * d;
+}
+
+/* Return the lenght of the longest UID:GID string for files listed in
+ * long view mode */
+static size_t
+get_max_ug_str(void)
+{
+	size_t ug_max = 0;
+	int i = (int)files;
+
+	while (--i >= 0) {
+		size_t t = (size_t)DIGINUM(file_info[i].uid) + DIGINUM(file_info[i].gid);
+		if (t > ug_max)
+			ug_max = t;
+	}
+
+	return ug_max;
+}
+
+static size_t
+get_longest_inode(void)
+{
+	size_t l = 0;
+
+	int i = (int)files;
+	while (--i >= 0) {
+		size_t n = DIGINUM(file_info[i].inode);
+		if (n > l)
+			l = n;
+	}
+
+	return l;
+}
+
+/* Run autocommands for the new directory and the .cfm.out file of the
+ * previous one, if we just changed directory */
+static void
+run_chdir_autocmds(void)
+{
+	if (dir_changed && autocmds_n) {
+		if (autocmd_set)
+			revert_autocmd_opts();
+		check_autocmds();
+	}
+
+	if (dir_changed && dir_out) {
+		run_dir_cmd(DIR_OUT);
+		dir_out = 0;
+	}
+}
+
+/* Print the list of files in CWD (file_info), already sorted */
+static void
+print_dirlist(const uint8_t have_xattr)
+{
+	int pad = (max_files != UNSET && (int)files > max_files)
+		? DIGINUM(max_files) : DIGINUM(files);
+
+		/* ##########################################
+		 * #    GET INFO TO PRINT COLUMNED OUTPUT   #
+		 * ########################################## */
+
+	size_t columns_n = 1;
+
+	/* Get the longest file name */
+	if (conf.columned || conf.long_view) {
+		int nn = (int)files;
+		get_longest_filename(nn, pad);
 	}
 
-	if (match == 1)
-		return filter.rev == 1 ? EXIT_SUCCESS : EXIT_FAILURE;
+				/* ########################
+				 * #    LONG VIEW MODE    #
+				 * ######################## */
+
+	if (conf.long_view == 1) {
+		print_long_mode(pad,
+			prop_fields.ids == 1 ? get_max_ug_str() : 0,
+			prop_fields.inode == 1 ? get_longest_inode() : 0, have_xattr);
+		return;
+	}
+
+				/* ########################
+				 * #   NORMAL VIEW MODE   #
+				 * ######################## */
+
+	/* Get amount of columns needed to print files in CWD  */
+	columns_n = conf.columned == 0 ? 1 : get_columns();
+
+	if (conf.listing_mode == VERTLIST) /* ls(1) like listing */
+		list_files_vertical(pad, columns_n);
 	else
-		return filter.rev == 1 ? EXIT_FAILURE : EXIT_SUCCESS;
+		list_files_horizontal(pad, columns_n);
 }
 
 /* List files in the current working directory (global variable 'path').
@@ -1673,7 +2063,6 @@ list_dir_light(void)
 
 	DIR *dir;
 	struct dirent *ent;
-	int reset_pager = 0;
 	int close_dir = 1;
 	int excluded_files = 0;
 	uint8_t have_xattr = 0;
@@ -1691,6 +2080,13 @@ list_dir_light(void)
 
 	set_events_checker();
 
+	struct stat fattr;
+	struct filter_file_t ff;
+	memset(&ff, 0, sizeof(struct filter_file_t));
+	ff.attr = &fattr;
+	ff.dirfd = dirfd(dir);
+	ff.stat_flags = AT_SYMLINK_NOFOLLOW;
+
 	errno = 0;
 	longest = 0;
 	unsigned int n = 0;
@@ -1708,14 +2104,14 @@ list_dir_light(void)
 		if (dir_changed)
 			check_autocmd_file(ename);
 
-		/* Skip files according to a regex filter */
-		if (filter.str && filter.type == FILTER_FILE_NAME) {
-			if (regexec(&regex_exp, ename, 0, NULL, 0) == EXIT_SUCCESS) {
-				if (filter.rev == 1) {
-					excluded_files++;
-					continue;
-				}
-			} else if (filter.rev == 0) {
+		/* Skip files according to the current filter */
+		if (filter.str) {
+			ff.name = ename;
+			ff.stat_state = FILTER_STAT_NONE;
+#ifdef _DIRENT_HAVE_D_TYPE
+			ff.d_type = ent->d_type;
+#endif /* _DIRENT_HAVE_D_TYPE */
+			if (eval_filter_prog(&filter_prog, &ff) == filter.rev) {
 				excluded_files++;
 				continue;
 			}
@@ -1733,17 +2129,6 @@ list_dir_light(void)
 #endif /* !_DIRENT_HAVE_D_TYPE */
 			continue;
 
-		/* Filter files according to file type */
-		if (filter.str && filter.type == FILTER_FILE_TYPE
-#ifndef _DIRENT_HAVE_D_TYPE
-		&& exclude_file_type_light((unsigned char)get_dt(attr.st_mode)) == EXIT_SUCCESS) {
-#else
-		&& exclude_file_type_light(ent->d_type) == EXIT_SUCCESS) {
-#endif
-			excluded_files++;
-			continue;
-		}
-
 		if (count > ENTRY_N) {
 			count = 0;
 			total_dents = n + ENTRY_N;
@@ -1882,46 +2267,14 @@ list_dir_light(void)
 		goto END;
 	}
 
-	int pad = (max_files != UNSET && (int)files > max_files)
-		? DIGINUM(max_files) : DIGINUM(files);
-
 	if (conf.sort)
 		ENTSORT(file_info, n, entrycmp);
 
-	size_t counter = 0;
-	size_t columns_n = 1;
-
-	/* Get the longest file name */
-	if (conf.columned || conf.long_view) {
-		int nn = (int)n;
-		get_longest_filename(nn, pad);
-	}
-
-				/* ########################
-				 * #    LONG VIEW MODE    #
-				 * ######################## */
-
-	if (conf.long_view == 1) {
-		print_long_mode(&counter, &reset_pager, pad,
-			prop_fields.ids == 1 ? get_max_ug_str() : 0,
-			prop_fields.inode == 1 ? get_longest_inode() : 0, have_xattr);
-		goto END;
-	}
-
-				/* ########################
-				 * #   NORMAL VIEW MODE   #
-				 * ######################## */
-
-	/* Get possible amount of columns for the dirlist screen */
-	columns_n = conf.columned == 0 ? 1 : get_columns();
-
-	if (conf.listing_mode == VERTLIST) /* ls(1) like listing */
-		list_files_vertical(&counter, &reset_pager, pad, columns_n);
-	else
-		list_files_horizontal(&counter, &reset_pager, pad, columns_n);
+	print_dirlist(have_xattr);
 
 END:
-	exit_code = post_listing(dir, close_dir, reset_pager);
+	excluded_files_n = excluded_files;
+	exit_code = post_listing(dir, close_dir);
 	if (virtual_dir == 1)
 		print_reload_msg(_("Virtual directory\n"));
 	if (excluded_files > 0)
@@ -1939,6 +2292,25 @@ END:
 	return exit_code;
 }
 
+/* Device and inode numbers of the selected files, loaded by
+ * load_sel_inodes() while a list is being marked */
+static struct inode_set_t sel_inodes = {NULL, NULL, NULL, 0, 0, 0};
+
+/* Load the device and inode numbers of all selected files into SEL_INODES,
+ * so that check_seltag() takes constant time per file. Undone by
+ * inode_set_free(&sel_inodes) */
+static void
+load_sel_inodes(void)
+{
+	inode_set_free(&sel_inodes);
+	if (sel_n == 0 || !sel_devino)
+		return;
+
+	size_t i;
+	for (i = 0; i < sel_n; i++)
+		inode_set_add(&sel_inodes, sel_devino[i].dev, sel_devino[i].ino);
+}
+
 /* Check whether the file in the device DEV with inode INO is selected.
  * Used to mark selected files in the files list */
 static inline int
@@ -1948,6 +2320,14 @@ check_seltag(const dev_t dev, const ino_t ino, const nlink_t links,
 	if (sel_n == 0 || !sel_devino)
 		return 0;
 
+	if (sel_inodes.size > 0) {
+		if (inode_set_has(&sel_inodes, dev, ino) == 0)
+			return 0;
+		/* Hardlinks to a selected file must be told apart by name */
+		if (file_info[index].type == DT_DIR || links <= 1)
+			return 1;
+	}
+
 	int j = (int)sel_n;
 	while (--j >= 0) {
 		if (sel_devino[j].dev != dev || sel_devino[j].ino != ino)
@@ -1968,6 +2348,30 @@ check_seltag(const dev_t dev, const ino_t ino, const nlink_t links,
 	return 0;
 }
 
+/* Return 1 if the xattr column must be displayed in long view for the
+ * first NN entries in the files list, or 0 otherwise.
+ * Security attributes are probed as entries are printed, but the width of
+ * this column must be known beforehand: if every entry is going to be
+ * printed anyway, probe them all now. Otherwise (the pager might hide
+ * some of them), just reserve the column */
+static uint8_t
+get_xattr_column(const size_t nn)
+{
+#if defined(_LINUX_CAP) || defined(_LINUX_XATTR)
+	if (conf.long_view == 0 || prop_fields.xattr == 0)
+		return 0;
+
+	if (conf.pager == 0 || (conf.pager > 1 && (int)files < conf.pager)
+	|| (int)nn <= get_pager_page_rows())
+		return probe_listed_secattrs(nn);
+
+	return 1;
+#else
+	UNUSED(nn);
+	return 0;
+#endif /* _LINUX_CAP || _LINUX_XATTR */
+}
+
 /* Initialize the file_info struct, mostly in case stat fails */
 static inline void
 init_fileinfo(const size_t n)
@@ -1998,8 +2402,9 @@ init_fileinfo(const size_t n)
 	file_info[n].ltime = 0; /* For long view mode */
 	file_info[n].time = 0;
 	file_info[n].xattr = 0;
-/*	file_info[n].dev = 0;
-	file_info[n].ino = 0; */
+	file_info[n].sec_probe = 0;
+	file_info[n].dev = 0;
+	file_info[n].ctime = 0;
 }
 
 /* Initialize the stats struct */
@@ -2045,16 +2450,10 @@ list_dir(void)
 	if (xargs.list_and_quit != 1)
 		HIDE_CURSOR;
 
-	if (dir_changed && autocmds_n) {
-		if (autocmd_set)
-			revert_autocmd_opts();
-		check_autocmds();
-	}
-
-	if (dir_changed && dir_out) {
-		run_dir_cmd(DIR_OUT);
-		dir_out = 0;
-	}
+	/* Already done if coming from restore_workspace_listing() */
+	if (chdir_autocmds_done == 0)
+		run_chdir_autocmds();
+	chdir_autocmds_done = 0;
 
 	if (conf.clear_screen == 1) {
 		// For some reason we need to clear the screen twice to prevent
@@ -2092,7 +2491,6 @@ list_dir(void)
 	DIR *dir;
 	struct dirent *ent;
 	struct stat attr;
-	int reset_pager = 0;
 	int close_dir = 1;
 	int excluded_files = 0;
 	uint8_t have_xattr = 0;
@@ -2112,6 +2510,12 @@ list_dir(void)
 
 	int fd = dirfd(dir);
 
+	struct filter_file_t ff;
+	memset(&ff, 0, sizeof(struct filter_file_t));
+	ff.attr = &attr;
+	ff.dirfd = fd;
+	ff.stat_flags = virtual_dir == 1 ? 0 : AT_SYMLINK_NOFOLLOW;
+
 		/* ##########################################
 		 * #    GATHER AND STORE FILE INFORMATION   #
 		 * ########################################## */
@@ -2122,6 +2526,7 @@ list_dir(void)
 	unsigned int total_dents = 0, count = 0;
 
 	file_info = (struct fileinfo *)xnmalloc(ENTRY_N + 2, sizeof(struct fileinfo));
+	load_sel_inodes();
 
 	while ((ent = readdir(dir))) {
 		char *ename = ent->d_name;
@@ -2133,14 +2538,14 @@ list_dir(void)
 		if (dir_changed)
 			check_autocmd_file(ename);
 
-		/* Filter files according to a regex filter */
-		if (filter.str && filter.type == FILTER_FILE_NAME) {
-			if (regexec(&regex_exp, ename, 0, NULL, 0) == EXIT_SUCCESS) {
-				if (filter.rev == 1) {
-					excluded_files++;
-					continue;
-				}
-			} else if (filter.rev == 0) {
+		/* Filter files according to the current filter */
+		if (filter.str) {
+			ff.name = ename;
+			ff.stat_state = FILTER_STAT_NONE;
+#ifdef _DIRENT_HAVE_D_TYPE
+			ff.d_type = virtual_dir == 1 ? DT_UNKNOWN : ent->d_type;
+#endif /* _DIRENT_HAVE_D_TYPE */
+			if (eval_filter_prog(&filter_prog, &ff) == filter.rev) {
 				excluded_files++;
 				continue;
 			}
@@ -2154,24 +2559,14 @@ list_dir(void)
 
 		init_fileinfo(n);
 
+		/* The filter may have already stat'ed the file */
 		int stat_ok = 1;
-		if (fstatat(fd, ename, &attr, virtual_dir == 1 ? 0 : AT_SYMLINK_NOFOLLOW) == -1) {
+		if (ff.stat_state == FILTER_STAT_ERR || (ff.stat_state == FILTER_STAT_NONE
+		&& fstatat(fd, ename, &attr, ff.stat_flags) == -1)) {
 			stat_ok = 0;
 			stats.unstat++;
 		}
 
-		/* Filter files according to file type */
-		if (stat_ok == 1 && filter.str && filter.type == FILTER_FILE_TYPE
-		&& exclude_file_type(attr.st_mode, attr.st_nlink) == EXIT_SUCCESS) {
-			/* Decrease counters: the file won't be displayed */
-			if (*ename == '.' && stats.hidden > 0)
-				stats.hidden--;
-			if (stat_ok == 0 && stats.unstat > 0)
-				stats.unstat--;
-			excluded_files++;
-			continue;
-		}
-
 #if defined(_DIRENT_HAVE_D_TYPE)
 		if (conf.only_dirs == 1 && ent->d_type != DT_DIR
 		&& (ent->d_type != DT_LNK || get_link_ref(ename) != S_IFDIR))
@@ -2214,13 +2609,14 @@ list_dir(void)
 			file_info[n].uid = attr.st_uid;
 			file_info[n].gid = attr.st_gid;
 			file_info[n].mode = attr.st_mode;
+			file_info[n].dev = attr.st_dev;
+			file_info[n].ctime = (time_t)attr.st_ctime;
 
 			if (conf.long_view == 1) {
 #if defined(_LINUX_XATTR)
-				if (prop_fields.xattr == 1 && listxattr(ename, NULL, 0)) {
-					file_info[n].xattr = 1;
-					have_xattr = 1;
-				}
+				/* Probed only for listed files: see probe_entry_secattrs() */
+				if (prop_fields.xattr == 1)
+					file_info[n].sec_probe |= SECATTR_XATTR;
 #endif /* _LINUX_XATTR */
 				switch(prop_fields.time) {
 				case PROP_TIME_ACCESS: file_info[n].ltime = (time_t)attr.st_atime; break;
@@ -2327,7 +2723,7 @@ list_dir(void)
 			struct stat attrl;
 			if (fstatat(fd, ename, &attrl, 0) == -1) {
 				file_info[n].color = or_c;
-				file_info[n].xattr = 0;
+				file_info[n].sec_probe &= ~SECATTR_XATTR;
 				stats.broken_link++;
 			} else {
 				if (S_ISDIR(attrl.st_mode)) {
@@ -2342,9 +2738,6 @@ list_dir(void)
 			break;
 
 		case DT_REG: {
-#ifdef _LINUX_CAP
-			cap_t cap;
-#endif
 			/* Do not perform the access check if the user is root */
 			if (user.uid != 0 && stat_ok
 			&& check_file_access(attr.st_mode, attr.st_uid, attr.st_gid) == 0) {
@@ -2369,14 +2762,6 @@ list_dir(void)
 #endif
 			}
 
-#ifdef _LINUX_CAP
-			else if (check_cap && (cap = cap_get_file(ename))) {
-				file_info[n].color = ca_c;
-				stats.caps++;
-				cap_free(cap);
-			}
-#endif
-
 			else if (stat_ok && ((attr.st_mode & 00100) /* Exec */
 			|| (attr.st_mode & 00010) || (attr.st_mode & 00001))) {
 				file_info[n].exec = 1;
@@ -2388,6 +2773,12 @@ list_dir(void)
 					file_info[n].color = ee_c;
 				else
 					file_info[n].color = ex_c;
+#ifdef _LINUX_CAP
+				/* Only executable files are checked for capabilities, and
+				 * only if listed: see probe_entry_secattrs() */
+				if (check_cap)
+					file_info[n].sec_probe |= SECATTR_CAP;
+#endif /* _LINUX_CAP */
 			} else if (file_info[n].size == 0) {
 				file_info[n].color = ef_c;
 			} else if (file_info[n].linkn > 1) { /* Multi-hardlink */
@@ -2480,9 +2871,6 @@ list_dir(void)
 		goto END;
 	}
 
-	int pad = (max_files != UNSET && (int)files > max_files)
-		? DIGINUM(max_files) : DIGINUM(files);
-
 		/* #############################################
 		 * #    SORT FILES ACCORDING TO SORT METHOD    #
 		 * ############################################# */
@@ -2490,48 +2878,19 @@ list_dir(void)
 	if (conf.sort)
 		ENTSORT(file_info, n, entrycmp);
 
-		/* ##########################################
-		 * #    GET INFO TO PRINT COLUMNED OUTPUT   #
-		 * ########################################## */
-
-	size_t counter = 0;
-	size_t columns_n = 1;
-
-	/* Get the longest file name */
-	if (conf.columned || conf.long_view) {
-		int nn = (int)n;
-		get_longest_filename(nn, pad);
-	}
-
-				/* ########################
-				 * #    LONG VIEW MODE    #
-				 * ######################## */
-
-	if (conf.long_view == 1) {
-		print_long_mode(&counter, &reset_pager, pad,
-			prop_fields.ids == 1 ? get_max_ug_str() : 0,
-			prop_fields.inode == 1 ? get_longest_inode() : 0, have_xattr);
-		goto END;
-	}
-
-				/* ########################
-				 * #   NORMAL VIEW MODE   #
-				 * ######################## */
-
-	/* Get amount of columns needed to print files in CWD  */
-	columns_n = conf.columned == 0 ? 1 : get_columns();
+	have_xattr = get_xattr_column((max_files != UNSET && max_files < (int)n)
+		? (size_t)max_files : (size_t)n);
 
-	if (conf.listing_mode == VERTLIST) /* ls(1) like listing */
-		list_files_vertical(&counter, &reset_pager, pad, columns_n);
-	else
-		list_files_horizontal(&counter, &reset_pager, pad, columns_n);
+	print_dirlist(have_xattr);
 
 				/* #########################
 				 * #   POST LISTING STUFF  #
 				 * ######################### */
 
 END:
-	exit_code = post_listing(dir, close_dir, reset_pager);
+	inode_set_free(&sel_inodes);
+	excluded_files_n = excluded_files;
+	exit_code = post_listing(dir, close_dir);
 	if (virtual_dir == 1)
 		print_reload_msg(_("Virtual directory\n"));
 	if (excluded_files > 0)
@@ -2548,22 +2907,335 @@ END:
 	return exit_code;
 }
 
+static void
+free_fileinfo_list(struct fileinfo *list, const size_t n)
+{
+	int i = (int)n;
+	while (--i >= 0) {
+		free(list[i].name);
+		if (list[i].ext_color)
+			free(list[i].ext_color);
+	}
+
+	free(list);
+}
+
 void
 free_dirlist(void)
 {
 	if (!file_info || !files)
 		return;
 
-	int i = (int)files;
-	while (--i >= 0) {
-		free(file_info[i].name);
-		if (file_info[i].ext_color)
-			free(file_info[i].ext_color);
+	free_fileinfo_list(file_info, files);
+	file_info = (struct fileinfo *)NULL;
+}
+
+#ifdef LINUX_INOTIFY
+/* Resident workspace listings
+ * When leaving a workspace, its listing (file_info) is kept in memory (up
+ * to WorkspaceCacheSize MiB for all workspaces), together with the options
+ * it was built with, and its directory is watched via the watch manager
+ * (watch.c). Switching back to that workspace is then a mere redraw, unless
+ * listing options changed or the directory was modified in the meantime,
+ * in which case only that directory is read again. */
+
+/* Options affecting the contents or the order of file_info */
+struct ws_listing_opts_t {
+	char *cscheme;
+	int case_sens_list;
+	int check_cap;
+	int check_ext;
+	int colorize;
+	int files_counter;
+	int filter_rev;
+	int filter_type;
+	int follow_symlinks;
+	int full_dir_size;
+	int icons;
+	int light_mode;
+	int list_dirs_first;
+	int long_view;
+	int only_dirs;
+	int prop_time;
+	int show_hidden;
+	int sort;
+	int sort_reverse;
+	int unicode;
+};
+
+struct ws_listing_t {
+	struct fileinfo *list;
+	char *path;
+	char *filter_str;
+	struct ws_listing_opts_t opts;
+	struct stats_t stats;
+	size_t files;
+	size_t mem;       /* Approximate memory taken by LIST */
+	size_t last_used; /* Used to evict the least recently used listing */
+	size_t changes;   /* Changes to PATH when the listing was stored */
+	int excluded;
+	int wd;           /* Inotify watch descriptor for PATH */
+};
+
+static struct ws_listing_t ws_listings[MAX_WS];
+static size_t ws_listings_mem = 0;
+static size_t ws_listings_clock = 0;
+
+static void
+get_listing_opts(struct ws_listing_opts_t *o)
+{
+	memset(o, 0, sizeof(struct ws_listing_opts_t));
+
+	o->cscheme = cur_cscheme;
+	o->case_sens_list = conf.case_sens_list;
+	o->check_cap = check_cap;
+	o->check_ext = check_ext;
+	o->colorize = conf.colorize;
+	o->files_counter = conf.files_counter;
+	o->filter_rev = filter.rev;
+	o->filter_type = filter.type;
+	o->follow_symlinks = follow_symlinks;
+	o->full_dir_size = conf.full_dir_size;
+#ifndef _NO_ICONS
+	o->icons = conf.icons;
+#endif /* !_NO_ICONS */
+	o->light_mode = conf.light_mode;
+	o->list_dirs_first = conf.list_dirs_first;
+	o->long_view = conf.long_view;
+	o->only_dirs = conf.only_dirs;
+	o->prop_time = prop_fields.time;
+	o->show_hidden = conf.show_hidden;
+	o->sort = conf.sort;
+	o->sort_reverse = conf.sort_reverse;
+	o->unicode = conf.unicode;
+}
+
+static void
+free_ws_listing(const int ws)
+{
+	struct ws_listing_t *w = &ws_listings[ws];
+
+	if (w->wd >= 0)
+		del_watch(w->wd, WATCH_WS);
+
+	if (w->list) {
+		free_fileinfo_list(w->list, w->files);
+		ws_listings_mem -= w->mem;
+	}
+
+	free(w->path);
+	free(w->filter_str);
+	memset(w, 0, sizeof(struct ws_listing_t));
+	w->wd = -1;
+}
+
+void
+free_workspace_listings(void)
+{
+	int i;
+	for (i = 0; i < MAX_WS; i++) {
+		if (ws_listings[i].list)
+			free_ws_listing(i);
+	}
+}
+
+/* Evict the least recently used listings until MEM more bytes fit into
+ * the cache. Returns 1 if they do or 0 otherwise */
+static int
+make_room_for_listing(const size_t mem)
+{
+	const size_t cap = (size_t)conf.ws_cache_size * 1024 * 1024;
+	if (mem > cap)
+		return 0;
+
+	while (ws_listings_mem + mem > cap) {
+		int i, lru = -1;
+		for (i = 0; i < MAX_WS; i++) {
+			if (ws_listings[i].list && (lru == -1
+			|| ws_listings[i].last_used < ws_listings[lru].last_used))
+				lru = i;
+		}
+
+		if (lru == -1)
+			return 0;
+		free_ws_listing(lru);
 	}
 
-	free(file_info);
+	return 1;
+}
+
+/* Keep the current listing (file_info) in memory as the listing of the
+ * workspace WS, which we are about to leave */
+void
+stash_workspace_listing(const int ws)
+{
+	if (ws < 0 || ws >= MAX_WS)
+		return;
+
+	free_ws_listing(ws);
+
+	if (conf.ws_cache_size <= 0 || conf.autols == 0 || !file_info
+	|| files == 0 || !workspaces[ws].path
+	|| (stdin_tmp_dir && strcmp(stdin_tmp_dir, workspaces[ws].path) == 0))
+		return;
+
+	const size_t mem = files * (sizeof(struct fileinfo) + NAME_MAX + 1);
+	if (make_room_for_listing(mem) == 0)
+		return;
+
+	const int wd = add_watch(workspaces[ws].path, WATCH_WS);
+	if (wd < 0)
+		return;
+
+	struct ws_listing_t *w = &ws_listings[ws];
+	w->list = file_info;
+	w->files = files;
+	w->path = savestring(workspaces[ws].path, strlen(workspaces[ws].path));
+	w->filter_str = filter.str ? savestring(filter.str, strlen(filter.str))
+		: (char *)NULL;
+	get_listing_opts(&w->opts);
+	w->stats = stats;
+	w->excluded = excluded_files_n;
+	w->mem = mem;
+	w->last_used = ++ws_listings_clock;
+	w->wd = wd;
+	w->changes = watch_changes(wd);
+
+	ws_listings_mem += mem;
+
 	file_info = (struct fileinfo *)NULL;
+	files = 0;
+}
+
+/* Return 1 if the stored listing W is still valid for the current
+ * directory and listing options, or 0 otherwise */
+static int
+is_valid_ws_listing(const struct ws_listing_t *w)
+{
+	if (watch_changes(w->wd) != w->changes || !w->path
+	|| !workspaces[cur_ws].path
+	|| strcmp(w->path, workspaces[cur_ws].path) != 0)
+		return 0;
+
+	if ((w->filter_str == NULL) != (filter.str == NULL)
+	|| (w->filter_str && strcmp(w->filter_str, filter.str) != 0))
+		return 0;
+
+	/* The files matched by a filter on modification times change with
+	 * time */
+	if (filter.str && filter_prog.needs_time == 1)
+		return 0;
+
+	/* Files counters and full directory sizes depend on the contents of
+	 * subdirectories, which are not watched */
+	if (w->stats.dir > 0 && (conf.files_counter == 1
+	|| (conf.long_view == 1 && conf.full_dir_size == 1)))
+		return 0;
+
+	struct ws_listing_opts_t o;
+	get_listing_opts(&o);
+	return (memcmp(&o, &w->opts, sizeof(struct ws_listing_opts_t)) == 0);
+}
+
+/* Redraw the stored listing of the workspace WS, which has just become
+ * the current workspace. Returns EXIT_FAILURE if there is no valid
+ * stored listing, in which case the directory must be read again */
+int
+restore_workspace_listing(const int ws)
+{
+	if (ws < 0 || ws >= MAX_WS || !ws_listings[ws].list)
+		return EXIT_FAILURE;
+
+	if (conf.ws_cache_size <= 0) {
+		free_ws_listing(ws);
+		return EXIT_FAILURE;
+	}
+
+	if (conf.clear_screen == 1) {
+		CLEAR; fflush(stdout);
+	}
+
+	if (xargs.list_and_quit != 1)
+		HIDE_CURSOR;
+
+	/* Autocommands may change listing options */
+	run_chdir_autocmds();
+
+	struct ws_listing_t *w = &ws_listings[ws];
+	if (is_valid_ws_listing(w) == 0) {
+		free_ws_listing(ws);
+		chdir_autocmds_done = 1;
+		return EXIT_FAILURE;
+	}
+
+	free_dirlist();
+
+	file_info = w->list;
+	files = w->files;
+	stats = w->stats;
+	excluded_files_n = w->excluded;
+	w->list = (struct fileinfo *)NULL;
+	w->files = 0;
+	free_ws_listing(ws);
+
+	if (conf.unicode == 0) {
+		trim.state = trim.a = trim.b = 0;
+		trim.len = 0;
+	}
+
+	get_term_size();
+
+	if (conf.long_view == 1)
+		props_now = time(NULL);
+
+	set_events_checker();
+
+	if (dir_changed == 1) {
+		/* Check .cfm.in and .cfm.out files for the autocommands function */
+		if (access(DIR_OUT_NAME, F_OK) == 0)
+			check_autocmd_file(DIR_OUT_NAME);
+		if (access(DIR_IN_NAME, F_OK) == 0)
+			check_autocmd_file(DIR_IN_NAME);
+	}
+
+	/* The selection may have changed in the meantime */
+	const size_t nn = (max_files != UNSET && max_files < (int)files)
+		? (size_t)max_files : files;
+	size_t i;
+	load_sel_inodes();
+	for (i = 0; i < files; i++)
+		file_info[i].sel = check_seltag(file_info[i].dev, file_info[i].inode,
+			file_info[i].linkn, i);
+	inode_set_free(&sel_inodes);
+
+	print_dirlist(get_xattr_column(nn));
+
+	post_listing(NULL, 0);
+	if (excluded_files_n > 0)
+		printf(_("Excluded files: %d\n"), excluded_files_n);
+
+	return EXIT_SUCCESS;
+}
+#else
+void
+stash_workspace_listing(const int ws)
+{
+	UNUSED(ws);
+}
+
+int
+restore_workspace_listing(const int ws)
+{
+	UNUSED(ws);
+	return EXIT_FAILURE;
+}
+
+void
+free_workspace_listings(void)
+{
+	return;
 }
+#endif /* LINUX_INOTIFY */
 
 void
 reload_dirlist(void)
@@ -28,9 +28,12 @@
 __BEGIN_DECLS
 
 void free_dirlist(void);
+void free_workspace_listings(void);
 int  list_dir(void);
 void reload_dirlist(void);
 void refresh_screen(void);
+int  restore_workspace_listing(const int);
+void stash_workspace_listing(const int);
 
 __END_DECLS
 
@@ -40,6 +40,7 @@
 #include "aux.h"
 #include "checks.h"
 #include "config.h"
+#include "cursor.h"
 #include "exec.h"
 #include "history.h"
 #include "init.h"
@@ -47,12 +48,14 @@
 #include "keybinds.h"
 #include "listing.h"
 #include "misc.h"
+#include "persist.h"
 #ifndef _NO_PROFILES
 # include "profiles.h"
 #endif
 #include "prompt.h"
 #include "readline.h"
 #include "remotes.h"
+#include "watch.h"
 
 /* Globals */
 
@@ -128,8 +131,6 @@ unsigned short
 	term_cols = 0,
 	term_lines = 0;
 
-regex_t regex_exp;
-
 /* Internal status flags */
 int
 	argc_bk = 0,
@@ -173,7 +174,6 @@ int
 	print_removed_files = UNSET,
 	prompt_offset = UNSET,
 	prompt_notif = UNSET,
-	recur_perm_error_flag = 0,
 	rl_nohist = 0,
 	rl_notab = 0,
 	sel_is_last = 0,
@@ -791,13 +791,18 @@ run_main_loop(void)
 	int i;
 	/* 1) Infinite loop to keep the program running */
 	while (1) {
+		/* Write state files modified a while ago, if any. While idle at the
+		 * prompt, wait_for_input() takes care of it */
+		flush_stores(FLUSH_IDLE);
+
 		/* 2) Grab input string from the prompt */
 		char *input = prompt();
 		if (!input)
 			continue;
 
 		/* 3) Parse input string */
-		char **cmd = parse_input_str(input);
+		char *raw = (char *)NULL;
+		char **cmd = parse_input_str(input, &raw);
 		free(input);
 		input = (char *)NULL;
 
@@ -805,12 +810,13 @@ run_main_loop(void)
 			continue;
 
 		/* 4) Execute input string */
-		char **alias_cmd = check_for_alias(cmd);
+		char **alias_cmd = check_for_alias(cmd, &raw);
 		if (alias_cmd) {
 			/* If an alias is found, check_for_alias() frees CMD and returns
 			 * ALIAS_CMD in its place to be executed by exec_cmd() */
-			exec_cmd(alias_cmd);
+			exec_cmd(alias_cmd, raw);
 
+			free(raw);
 			for (i = 0; alias_cmd[i]; i++)
 				free(alias_cmd[i]);
 			free(alias_cmd);
@@ -818,9 +824,10 @@ run_main_loop(void)
 		}
 
 		if (!(flags & FAILED_ALIAS))
-			exec_cmd(cmd);
+			exec_cmd(cmd, raw);
 		flags &= ~FAILED_ALIAS;
 
+		free(raw);
 		i = (int)args_n + 1;
 		while (--i >= 0)
 			free(cmd[i]);
@@ -844,7 +851,7 @@ _list(void)
 	if (conf.autols == 1 && isatty(STDIN_FILENO)) {
 #ifdef LINUX_INOTIFY
 		/* Initialize inotify */
-		inotify_fd = inotify_init1(IN_NONBLOCK);
+		inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
 		if (inotify_fd < 0) {
 			_err('w', PRINT_PROMPT, "%s: inotify: %s\n",
 				PROGRAM_NAME, strerror(errno));
@@ -919,6 +926,9 @@ init_trash(void)
 		trash_n = (size_t)count_dir(trash_files_dir, NO_CPOP);
 		if (trash_n <= 2)
 			trash_n = 0;
+#ifdef LINUX_INOTIFY
+		watch_trash();
+#endif /* LINUX_INOTIFY */
 	}
 }
 #endif /* _NO_TRASH */
@@ -1015,6 +1025,8 @@ main(int argc, char *argv[])
 /*	init_file_flags(); */
 
 	set_locale();
+	/* Before readline is initialized */
+	init_cursor_model();
 
 	/* Store external arguments to be able to rerun external_arguments()
 	 * in case the user edits the config file, in which case the program
@@ -148,10 +148,13 @@ change this suffix)"
 
 #define BLEACH_USAGE "Clean up file names from non-ASCII characters\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
-  bb, bleach ELN/FILE...\n\n\
-\x1b[1mEXAMPLE\x1b[0m\n\
+  bb, bleach [-r] ELN/FILE...\n\n\
+Use -r to bleach the contents of directories as well, recursively\n\n\
+\x1b[1mEXAMPLES\x1b[0m\n\
 - Bleach file names in your Downloads directory\n\
-    bb ~/Downloads/*"
+    bb ~/Downloads/*\n\
+- Bleach the Music directory and everything under it\n\
+    bb -r ~/Music"
 
 #define BOOKMARKS_USAGE "Manage bookmarks\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
@@ -180,13 +183,15 @@ Note: When using TAB completion only bookmark names are listed"
 
 #define BULK_USAGE "Bulk rename files\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
-  br, bulk ELN/FILE...\n\n\
+  br, bulk [--dry-run] ELN/FILE...\n\n\
 \x1b[1mEXAMPLES\x1b[0m\n\
 - Bulk rename all files ending with .pdf in the current directory\n\
     br *.pdf (or 'br <TAB> to choose from a list - mutli-selection is\n\
   allowed')\n\
 - Bulk rename all selected files\n\
-    br sel"
+    br sel\n\
+- Print what would be done (as a shell script), without renaming anything\n\
+    br --dry-run sel"
 
 #define CD_USAGE "Change the current working directory\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
@@ -388,7 +393,7 @@ that there is no need to set this variable."
 
 #define FILTER_USAGE "Set a filter for the files list\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
-  ft, filter [unset] [[!]REGEX,=FILE-TYPE-CHAR]\n\n\
+  ft, filter [unset] [[!]REGEX,=FILE-TYPE-CHAR,EXPRESSION]\n\n\
 \x1b[1mEXAMPLES\x1b[0m\n\
 - Print the current filter, if any\n\
     ft\n\
@@ -401,6 +406,12 @@ that there is no need to set this variable."
 - Do not list socket files\n\
     ft !=s\n\
   Note: See below for the list of available file type characters\n\
+- List only C files bigger than 1MiB\n\
+    ft name:*.c size:>1M\n\
+- List directories and files modified in the last two days\n\
+    ft type:d or mtime:<2d\n\
+- Do not list backup files owned by root\n\
+    ft not (owner:root and name:*~)\n\
 - Unset the current filter\n\
     ft unset\n\n\
 You can also filter files in the current directory using TAB\n\
@@ -425,7 +436,20 @@ Available file type characters:\n\
   g: SGID files (2)\n\
   x: Executable files (2)\n\n\
 (1) Only via TAB completion\n\
-(2) Not available in light mode\n\n\
+(2) Not available in light mode (except in filter expressions)\n\n\
+Filter expressions combine the following predicates by means of 'and'\n\
+(or '&&', or just a space), 'or' (or '||'), 'not' (or '!'), and parentheses:\n\
+  name:GLOB     File name matches the wildcards pattern GLOB\n\
+  re:REGEX      File name matches the regular expression REGEX\n\
+  type:CHARS    File type is any of the file type characters CHARS\n\
+  size:RANGE    File size (k, M, G, or T suffix) is in RANGE\n\
+  mtime:RANGE   Time since last modification (s, m, h, d, w, or y suffix,\n\
+                defaulting to days) is in RANGE\n\
+  owner:USER    File is owned by USER (name or UID)\n\
+  group:GROUP   File belongs to GROUP (name or GID)\n\
+RANGE is either N, >N, >=N, <N, <=N, or N..M. A word without a predicate\n\
+name is taken as a wildcards pattern. Use quotes for values containing\n\
+spaces. A leading exclamation mark reverses the whole filter.\n\n\
 Type '=<TAB>' to get the list of available file type filters\n\n\
 Other ways of filtering files in the current directory:\n\n\
 * @<TAB>       List all MIME-types found\n\
@@ -676,12 +700,14 @@ both 'dir' and 'subdir' directories will be created if they do not exist"
 
 #define OC_USAGE "Interactively change files ownership\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
-  oc FILE...\n\n\
+  oc [-R] FILE...\n\n\
 \x1b[1mEXAMPLES\x1b[0m\n\
 - Change ownership of selected files\n\
   oc sel\n\
 - Change ownership of all .iso files\n\
-  oc *.iso\n\n\
+  oc *.iso\n\
+- Change ownership of the directory src and all its contents\n\
+  oc -R src\n\n\
 \x1b[1mNOTES\x1b[0m\n\
 A template is presented to the user to be edited.\n\n\
 Only user and primary group common to all files passed as\n\
@@ -742,17 +768,22 @@ Note: You can also try the 'pager' plugin running 'gg'"
 
 #define PC_USAGE "Interactively edit file permissions\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
-  pc FILE...\n\n\
+  pc [-R] FILE...\n\n\
 \x1b[1mEXAMPLES\x1b[0m\n\
 - Change permissions of file named file.txt\n\
     pc file.txt\n\
 - Change permissions of all selected files at once\n\
-    pc sel\n\n\
+    pc sel\n\
+- Change permissions of the directory src and all its contents\n\
+    pc -R src\n\n\
 When editing multiple files with different permissions at once,\n\
 only shared permission bits will be set in the permissions template.\n\
 Bear in mind that the new permissions set will be applied to all files\n\
 passed as arguments\n\n\
 Both symbolic and octal notation for the new permissions set are allowed\n\n\
+Relative modes, as in chmod(1), are allowed as well: for example,\n\
+\"u+rwX,go-w\" is applied to each file based on its current permissions\n\
+(X sets the executable bit only for directories and executable files)\n\n\
 Note: Use the 'oc' command to edit files ownership"
 
 #define PIN_USAGE "Pin a file or directory\n\n\
@@ -985,7 +1016,7 @@ Mark the files you need via TAB and then press Enter or Right"
 
 #define TRASH_USAGE "Send one or multiple files to the trash can\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
-  t, tr, trash [ELN/FILE]... [ls, list] [clear, empty] [del]\n\n\
+  t, tr, trash [ELN/FILE]... [ls, list [date, dir]] [clear, empty] [del]\n\n\
 \x1b[1mEXAMPLES\x1b[0m\n\
 - Trash the file whose ELN is 12\n\
     t 12 (or 't <TAB>' to choose from a list - multi-selection is allowed)\n\
@@ -993,6 +1024,10 @@ Mark the files you need via TAB and then press Enter or Right"
     t *.sh\n\
 - List currently trashed files\n\
     t (or 't ls', 't list', or 't <TAB>')\n\
+- List trashed files by deletion date (newest first)\n\
+    t ls date\n\
+- List trashed files grouped by original directory\n\
+    t ls dir\n\
 - Remove/delete trashed files using a menu (permanent removal)\n\
     t del\n\
 - Remove/delete all files from the trash can (permanent removal)\n\
@@ -1008,12 +1043,14 @@ Mark the files you need via TAB and then press Enter or Right"
 
 #define UNTRASH_USAGE "Restore files from the trash can\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
-  u, undel, untrash [FILE]... [*, a, all]\n\n\
+  u, undel, untrash [FILE]... [*, a, all] [--dir DIR]\n\n\
 \x1b[1mEXAMPLES\x1b[0m\n\
 - Untrash all trashed files (restore them to their original location)\n\
     u *\n\
 - Untrash files selectively using a menu\n\
-    u (or 'u <TAB>' to choose from a list - multi-selection is allowed)\n\n\
+    u (or 'u <TAB>' to choose from a list - multi-selection is allowed)\n\
+- Untrash all files trashed from the directory 'mydir' (or any of its subdirectories)\n\
+    u --dir mydir\n\n\
 Note: Use the 'trash' command to trash files. Try 'trash --help'"
 
 #define VV_USAGE "Copy files into a directory and bulk rename them at once\n\n\
@@ -1132,8 +1169,17 @@ Note: By default xterm(1) is used. Set your preferred terminal\n\
 emulator using the TerminalCmd option in the configuration file"
 
 /* Misc messages */
-#define PAGER_HELP "?, h: help\nDown arrow, Enter, Space: Advance one line\n\
-Page Down: Advance one page\nq: Stop pagging\n"
+#define PAGER_HELP "?, h: help\n\
+Down arrow, Enter, Space, j: Advance one line\n\
+Up arrow, k: Go back one line\n\
+Page Down, f: Advance one page\n\
+Page Up, b: Go back one page\n\
+Home, g: Go to the first page\n\
+End, G: Go to the last page\n\
+:N, N: Go to the file whose ELN is N\n\
+/PATTERN: Go to the next file name containing PATTERN\n\
+n: Go to the next match of the last PATTERN\n\
+q: Stop pagging\n"
 #define PAGER_LABEL "\x1b[7;97m--Mas--\x1b[0;49m"
 #define NOT_AVAILABLE "This feature has been disabled at compile time"
 #define STEALTH_DISABLED "Access to configuration files is not allowed in stealth mode"
@@ -104,83 +104,301 @@ expand_env(char *s)
 	return ret;
 }
 
-/* Move the pointer in LINE immediately after prefix (X or !X)
- * Returns NULL if there's nothing after prefix, if prefix is "!X" and we
- * are in a graphical environment, or if prefix is "X" and we're not in
- * a graphical environment. Otherwise, it returns the corresponding pointer */
-static char *
-skip_line_prefix(char *line)
+/* The mimelist file is parsed only once into a table of compiled rules,
+ * which is reloaded only if the file changes (see load_mime_rules()) */
+#define MRULE_MIME 0 /* Pattern is matched against the MIME type */
+#define MRULE_NAME 1 /* Pattern is matched against the file name (N: or E:) */
+
+#define MRULE_ANY    0 /* No prefix */
+#define MRULE_GUI    1 /* X: prefix */
+#define MRULE_NO_GUI 2 /* !X: prefix */
+
+struct mime_rule_t {
+	char *cmds;   /* List of opening applications (everything after '=') */
+	char *app;    /* Cached value returned by retrieve_app() for CMDS */
+	char **exts;  /* Literal extensions, if the pattern could be reduced to them */
+	uint32_t *ext_hashes;
+	size_t exts_n;
+	regex_t regex;
+	uint32_t app_stamp; /* PATH stamp at the time APP was resolved */
+	int type;     /* Either MRULE_MIME or MRULE_NAME */
+	int env;      /* Either MRULE_ANY, MRULE_GUI, or MRULE_NO_GUI */
+	int regex_ok; /* REGEX was successfully compiled */
+	int app_state; /* UNSET: not cached, 0: no app found, 1: cached in APP */
+	int cacheable; /* CMDS contains no env variable nor tilde */
+	int pad;
+};
+
+static struct mime_rules_t {
+	struct mime_rule_t *r;
+	char *file;  /* Mimelist file the rules were loaded from */
+	size_t n;
+	time_t mtime;
+	off_t size;
+	ino_t ino;
+} mime_rules = {NULL, NULL, 0, 0, 0, 0};
+
+static void
+free_mime_rules(void)
 {
-	if (!line || !*line)
-		return (char *)NULL;
+	size_t i, j;
+	for (i = 0; i < mime_rules.n; i++) {
+		struct mime_rule_t *r = &mime_rules.r[i];
+		free(r->cmds);
+		free(r->app);
+		for (j = 0; j < r->exts_n; j++)
+			free(r->exts[j]);
+		free(r->exts);
+		free(r->ext_hashes);
+		if (r->regex_ok == 1)
+			regfree(&r->regex);
+	}
+
+	free(mime_rules.r);
+	free(mime_rules.file);
+	mime_rules.r = (struct mime_rule_t *)NULL;
+	mime_rules.file = (char *)NULL;
+	mime_rules.n = 0;
+}
+
+static int
+is_ext_char(const char c)
+{
+	return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+		|| IS_DIGIT(c) || c == '_' || c == '-');
+}
 
-	char *p = line;
+/* Append the extension STR, of length LEN, to the list of literal
+ * extensions of the rule R */
+static void
+add_rule_ext(struct mime_rule_t *r, const char *str, const size_t len)
+{
+	r->exts = (char **)xrealloc(r->exts, (r->exts_n + 1) * sizeof(char *));
+	r->ext_hashes = (uint32_t *)xrealloc(r->ext_hashes,
+		(r->exts_n + 1) * sizeof(uint32_t));
+
+	r->exts[r->exts_n] = (char *)xnmalloc(len + 1, sizeof(char));
+	memcpy(r->exts[r->exts_n], str, len);
+	r->exts[r->exts_n][len] = '\0';
+	r->ext_hashes[r->exts_n] = hashme32(r->exts[r->exts_n], HASH_SEED);
+	r->exts_n++;
+}
 
-	if (!(flags & GUI)) {
-		if (*p == 'X' && *(p + 1) == ':')
-			return (char *)NULL;
-		if (*p == '!' && *(p + 1) == 'X' && *(p + 2) == ':')
-			p += 3;
-	} else {
-		if (*p == '!' && *(p + 1) == 'X')
-			return (char *)NULL;
-		if (*p == 'X' && *(p + 1) == ':')
-			p += 2;
+/* Most file name patterns are just a list of extensions: ".*\.EXT$" or
+ * ".*\.(EXT|EXT...)$". If PAT is one of these, store each extension
+ * in R, so that we can match file names via a hash lookup instead of
+ * running regexec(3). Returns 1 if PAT is literal or 0 otherwise */
+static int
+get_literal_exts(struct mime_rule_t *r, const char *pat)
+{
+	if (*pat == '^')
+		pat++;
+
+	if (strncmp(pat, ".*\\.", 4) != 0)
+		return 0;
+	pat += 4;
+
+	const int group = (*pat == '(');
+	if (group == 1)
+		pat++;
+
+	const char *p = pat;
+	while (1) {
+		while (is_ext_char(*p))
+			p++;
+
+		if (p == pat)
+			break;
+
+		const char c = *p;
+		if (group == 1 && c != '|' && !(c == ')' && p[1] == '$' && !p[2]))
+			break;
+		if (group == 0 && !(c == '$' && !p[1]))
+			break;
+
+		add_rule_ext(r, pat, (size_t)(p - pat));
+
+		if (c != '|') /* We're done */
+			return 1;
+
+		pat = ++p;
 	}
 
-	return p;
+	/* Not a literal pattern */
+	size_t i;
+	for (i = 0; i < r->exts_n; i++)
+		free(r->exts[i]);
+	free(r->exts);
+	free(r->ext_hashes);
+	r->exts = (char **)NULL;
+	r->ext_hashes = (uint32_t *)NULL;
+	r->exts_n = 0;
+
+	return 0;
 }
 
-/* Should we skip the line LINE?
- * Returns 1 if true and 0 otherwise
- * If true, the pointer PATTERN will point to the beginning of the
- * null terminated pattern, and the pointer CMDS will point to the
- * beginnning of the list of opening applications */
+/* Parse the line LINE of the mimelist file into the rule R.
+ * Returns 1 if LINE holds a valid rule or 0 otherwise */
 static int
-skip_line(char *line, char **pattern, char **cmds)
+parse_mime_rule(char *line, struct mime_rule_t *r)
 {
 	if (*line == '#' || *line == '[' || *line == '\n')
-		return 1;
+		return 0;
 
-	*pattern = skip_line_prefix(line);
-	if (!*pattern)
-		return 1;
-	/* PATTERN points now to the beginning of the pattern */
+	char *pattern = line;
+	r->env = MRULE_ANY;
+	if (*pattern == 'X' && pattern[1] == ':') {
+		r->env = MRULE_GUI;
+		pattern += 2;
+	} else if (*pattern == '!' && pattern[1] == 'X' && pattern[2] == ':') {
+		r->env = MRULE_NO_GUI;
+		pattern += 3;
+	}
+
+	char *cmds = strchr(pattern, '=');
+	if (!cmds || !*(cmds + 1))
+		return 0;
+
+	*cmds = '\0';
+	cmds++;
+
+	size_t len = strlen(cmds);
+	if (len > 0 && cmds[len - 1] == '\n')
+		cmds[--len] = '\0';
+	if (len == 0)
+		return 0;
+
+	r->type = MRULE_MIME;
+	if ((*pattern == 'N' || *pattern == 'E') && pattern[1] == ':') {
+		r->type = MRULE_NAME;
+		pattern += 2;
+	}
+
+	r->exts = (char **)NULL;
+	r->ext_hashes = (uint32_t *)NULL;
+	r->exts_n = 0;
+	r->regex_ok = 0;
+
+	if (r->type != MRULE_NAME || get_literal_exts(r, pattern) == 0)
+		r->regex_ok = regcomp(&r->regex, pattern,
+			REG_NOSUB | REG_EXTENDED) == 0 ? 1 : 0;
+
+	r->cmds = savestring(cmds, len);
+	r->app = (char *)NULL;
+	r->app_state = UNSET;
+	r->app_stamp = 0;
+	r->cacheable = (!strchr(cmds, '$') && !strchr(cmds, '~'));
+	r->pad = 0;
+
+	return 1;
+}
+
+/* Load rules from the mimelist file, unless they are already loaded and
+ * the file did not change since then.
+ * Returns the number of loaded rules */
+static size_t
+load_mime_rules(void)
+{
+	struct stat a;
+	if (stat(mime_file, &a) == -1) {
+		free_mime_rules();
+		return 0;
+	}
+
+	if (mime_rules.file && strcmp(mime_rules.file, mime_file) == 0
+	&& a.st_mtime == mime_rules.mtime && a.st_size == mime_rules.size
+	&& a.st_ino == mime_rules.ino)
+		return mime_rules.n;
+
+	free_mime_rules();
+
+	FILE *fp = fopen(mime_file, "r");
+	if (!fp) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "%s: %s: %s\n",
+			err_name, mime_file, strerror(errno));
+		return 0;
+	}
+
+	size_t line_size = 0, n = 0;
+	char *line = (char *)NULL;
+
+	while (getline(&line, &line_size, fp) > 0) {
+		mime_rules.r = (struct mime_rule_t *)xrealloc(mime_rules.r,
+			(n + 1) * sizeof(struct mime_rule_t));
+		if (parse_mime_rule(line, &mime_rules.r[n]) == 1)
+			n++;
+	}
+
+	free(line);
+	fclose(fp);
 
-	*cmds = strchr(*pattern, '=');
-	if (!*cmds || !*(*cmds + 1))
+	mime_rules.n = n;
+	mime_rules.file = savestring(mime_file, strlen(mime_file));
+	mime_rules.mtime = a.st_mtime;
+	mime_rules.size = a.st_size;
+	mime_rules.ino = a.st_ino;
+
+	return n;
+}
+
+/* Return 1 if the rule R applies to the current environment (graphical
+ * or not), or 0 otherwise */
+static int
+check_rule_env(const struct mime_rule_t *r)
+{
+	if (r->env == MRULE_ANY)
 		return 1;
 
-	/* Truncate line in '=' to get only the name/mimetype pattern */
-	*(*cmds) = '\0';
-	(*cmds)++;
-	/* CMDS points now to the beginning of the list of opening cmds */
-	return 0;
+	return (flags & GUI) ? (r->env == MRULE_GUI) : (r->env == MRULE_NO_GUI);
 }
 
-/* Test PATTERN against either FILENAME or the mime-type MIME
+/* Test the rule R against either the file name FILENAME, whose extension
+ * (if any) is EXT and has hash EXT_HASH, or the MIME type MIME.
  * Returns zero in case of a match, and 1 otherwise */
 static int
-test_pattern(const char *pattern, const char *filename, const char *mime)
+test_rule(const struct mime_rule_t *r, const char *filename,
+	const char *ext, const uint32_t ext_hash, const char *mime)
 {
-	int ret = EXIT_FAILURE;
-	regex_t regex;
+	if (r->type == MRULE_NAME) {
+		if (!filename)
+			return EXIT_FAILURE;
 
-	if (filename && (*pattern == 'N' || *pattern == 'E')
-	&& *(pattern + 1) == ':') {
-		if (regcomp(&regex, pattern + 2, REG_NOSUB | REG_EXTENDED) == 0
-		&& regexec(&regex, filename, 0, NULL, 0) == 0)
-			ret = EXIT_SUCCESS;
-	} else {
-		if (regcomp(&regex, pattern, REG_NOSUB | REG_EXTENDED) == 0
-		&& regexec(&regex, mime, 0, NULL, 0) == 0) {
-			mime_match = 1;
-			ret = EXIT_SUCCESS;
+		if (r->exts_n > 0) {
+			if (!ext)
+				return EXIT_FAILURE;
+			size_t i;
+			for (i = 0; i < r->exts_n; i++) {
+				if (r->ext_hashes[i] == ext_hash && *ext == *r->exts[i]
+				&& strcmp(ext, r->exts[i]) == 0)
+					return EXIT_SUCCESS;
+			}
+			return EXIT_FAILURE;
 		}
+
+		return (r->regex_ok == 1
+			&& regexec(&r->regex, filename, 0, NULL, 0) == 0)
+			? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
-	regfree(&regex);
-	return ret;
+	if (!mime || r->regex_ok == 0
+	|| regexec(&r->regex, mime, 0, NULL, 0) != 0)
+		return EXIT_FAILURE;
+
+	mime_match = 1;
+	return EXIT_SUCCESS;
+}
+
+/* Return the extension of FILENAME (if any), storing its hash in HASH */
+static const char *
+get_name_ext(const char *filename, uint32_t *hash)
+{
+	*hash = 0;
+	const char *ext = filename ? strrchr(filename, '.') : (char *)NULL;
+	if (!ext || !*(++ext))
+		return (char *)NULL;
+
+	*hash = hashme32(ext, HASH_SEED);
+	return ext;
 }
 
 /* Return 1 if APP is a valid and existent application. Zero otherwise */
@@ -289,8 +507,30 @@ retrieve_app(char *line)
 	return (char *)NULL; /* No app was found */
 }
 
+/* Return the first valid and existent opening application for the rule R
+ * or NULL. The result is cached and reused as long as the command path
+ * cache (see get_cmd_path()) is not invalidated */
+static char *
+get_rule_app(struct mime_rule_t *r, uint32_t *path_stamp)
+{
+	if (r->cacheable == 0)
+		return retrieve_app(r->cmds);
+
+	if (*path_stamp == 0)
+		*path_stamp = get_cmd_path_stamp();
+
+	if (r->app_state == UNSET || r->app_stamp != *path_stamp) {
+		free(r->app);
+		r->app = retrieve_app(r->cmds);
+		r->app_state = r->app ? 1 : 0;
+		r->app_stamp = *path_stamp;
+	}
+
+	return r->app ? savestring(r->app, strlen(r->app)) : (char *)NULL;
+}
+
 /* Get application associated to a given MIME type or file name.
- * Returns the first matching line in the MIME file or NULL if none is
+ * Returns the first matching rule in the MIME file or NULL if none is
  * found */
 static char *
 get_app(const char *mime, const char *filename)
@@ -298,35 +538,29 @@ get_app(const char *mime, const char *filename)
 	if (!mime || !mime_file || !*mime_file)
 		return (char *)NULL;
 
-	FILE *defs_fp = fopen(mime_file, "r");
-	if (!defs_fp) {
-		_err(ERR_NO_STORE, NOPRINT_PROMPT, "%s: %s: %s\n",
-			err_name, mime_file, strerror(errno));
+	size_t n = load_mime_rules();
+	if (n == 0)
 		return (char *)NULL;
-	}
 
-	size_t line_size = 0;
-	char *line = (char *)NULL, *app = (char *)NULL;
+	uint32_t ext_hash = 0, path_stamp = 0;
+	const char *ext = get_name_ext(filename, &ext_hash);
+	char *app = (char *)NULL;
+	size_t i;
 
-	/* Each line has this form: prefix:pattern=cmd;cmd;cmd... */
-	while (getline(&line, &line_size, defs_fp) > 0) {
-		char *pattern = (char *)NULL, *cmds = (char *)NULL;
-		if (skip_line(line, &pattern, &cmds) == 1)
+	for (i = 0; i < n; i++) {
+		struct mime_rule_t *r = &mime_rules.r[i];
+		if (check_rule_env(r) == 0)
 			continue;
-		/* PATTERN points now to the beginning of the null terminated pattern,
-		 * while CMDS points to the beginning of the list of opening cmds */
 
 		mime_match = 0;
-		/* Global. Are we matching a MIME type? It will be set by test_pattern */
-		if (test_pattern(pattern, filename, mime) == EXIT_FAILURE)
+		/* Global. Are we matching a MIME type? It will be set by test_rule */
+		if (test_rule(r, filename, ext, ext_hash, mime) == EXIT_FAILURE)
 			continue;
 
-		if ((app = retrieve_app(cmds)))
+		if ((app = get_rule_app(r, &path_stamp)))
 			break;
 	}
 
-	free(line);
-	fclose(defs_fp);
 	return app;
 }
 
@@ -966,8 +1200,8 @@ mime_open_with_tab(char *filename, const char *prefix)
 
 	file_name = get_filename(name);
 
-	FILE *defs_fp = fopen(mime_file, "r");
-	if (!defs_fp)
+	size_t rules_n = load_mime_rules();
+	if (rules_n == 0)
 		goto FAIL;
 
 	size_t appsn = 1;
@@ -986,41 +1220,18 @@ mime_open_with_tab(char *filename, const char *prefix)
 	if (prefix)
 		prefix_len = strlen(prefix);
 
-	size_t line_size = 0;
-	char *line = (char *)NULL, *app = (char *)NULL;
-
-	while (getline(&line, &line_size, defs_fp) > 0) {
-		if (*line == '#' || *line == '[' || *line == '\n')
-			continue;
-
-		char *p = skip_line_prefix(line);
-		if (!p)
-			continue;
-
-		char *tmp = strchr(p, '=');
-		if (!tmp || !*(tmp + 1))
-			continue;
-
-		/* Truncate line in '=' to get only the ext/mimetype pattern/string */
-		*tmp = '\0';
-		regex_t regex;
-
-		int found = 0;
-		if (file_name && (*p == 'N' || *p == 'E') && *(p + 1) == ':') {
-			if (regcomp(&regex, p + 2, REG_NOSUB | REG_EXTENDED) == 0
-			&& regexec(&regex, file_name, 0, NULL, 0) == 0)
-				found = 1;
-		} else if (regcomp(&regex, p, REG_NOSUB | REG_EXTENDED) == 0
-		&& regexec(&regex, mime, 0, NULL, 0) == 0) {
-			found = 1;
-		}
-
-		regfree(&regex);
+	uint32_t ext_hash = 0;
+	const char *ext = get_name_ext(file_name, &ext_hash);
+	char *app = (char *)NULL;
+	size_t n;
 
-		if (!found)
+	for (n = 0; n < rules_n; n++) {
+		struct mime_rule_t *r = &mime_rules.r[n];
+		if (check_rule_env(r) == 0
+		|| test_rule(r, file_name, ext, ext_hash, mime) == EXIT_FAILURE)
 			continue;
 
-		tmp++; /* We don't want the '=' char */
+		char *tmp = r->cmds;
 
 		size_t tmp_len = strlen(tmp);
 		app = (char *)xrealloc(app, (tmp_len + 1) * sizeof(char));
@@ -1132,7 +1343,8 @@ mime_open_with_tab(char *filename, const char *prefix)
 				appsn++;
 			}
 
-			tmp++;
+			if (*tmp)
+				tmp++;
 		}
 	}
 
@@ -1146,9 +1358,6 @@ mime_open_with_tab(char *filename, const char *prefix)
 		apps[1] = (char *)NULL;
 	}
 
-	free(line);
-	fclose(defs_fp);
-
 	free(app);
 	free(mime);
 	free(name);
@@ -1343,46 +1552,22 @@ mime_open_with(char *filename, char **args)
 
 	file_name = get_filename(name);
 
-	FILE *defs_fp = fopen(mime_file, "r");
-	if (!defs_fp)
+	size_t rules_n = load_mime_rules();
+	if (rules_n == 0)
 		goto FAIL;
 
-	size_t line_size = 0;
-	char *line = (char *)NULL, *app = (char *)NULL;
-
-	while (getline(&line, &line_size, defs_fp) > 0) {
-		if (*line == '#' || *line == '[' || *line == '\n')
-			continue;
-
-		char *p = skip_line_prefix(line);
-		if (!p)
-			continue;
+	uint32_t ext_hash = 0;
+	const char *ext = get_name_ext(file_name, &ext_hash);
+	char *app = (char *)NULL;
+	size_t n;
 
-		char *tmp = strchr(p, '=');
-		if (!tmp || !*(tmp + 1))
+	for (n = 0; n < rules_n; n++) {
+		struct mime_rule_t *r = &mime_rules.r[n];
+		if (check_rule_env(r) == 0
+		|| test_rule(r, file_name, ext, ext_hash, mime) == EXIT_FAILURE)
 			continue;
 
-		/* Truncate line in '=' to get only the ext/mimetype pattern/string */
-		*tmp = '\0';
-		regex_t regex;
-
-		int found = 0;
-		if (file_name && (*p == 'N' || *p == 'E') && *(p + 1) == ':') {
-			if (regcomp(&regex, p + 2, REG_NOSUB | REG_EXTENDED) == 0
-			&& regexec(&regex, file_name, 0, NULL, 0) == 0)
-				found = 1;
-		} else {
-			if (regcomp(&regex, p, REG_NOSUB | REG_EXTENDED) == 0
-			&& regexec(&regex, mime, 0, NULL, 0) == 0)
-				found = 1;
-		}
-
-		regfree(&regex);
-
-		if (!found)
-			continue;
-
-		tmp++; /* We don't want the '=' char */
+		char *tmp = r->cmds;
 
 		size_t tmp_len = strlen(tmp);
 		app = (char *)xrealloc(app, (tmp_len + 1) * sizeof(char));
@@ -1474,13 +1659,11 @@ mime_open_with(char *filename, char **args)
 			}
 
 			appsn++;
-			tmp++;
+			if (*tmp)
+				tmp++;
 		}
 	}
 
-	free(line);
-	fclose(defs_fp);
-
 	free(app);
 	free(mime);
 
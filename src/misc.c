@@ -50,23 +50,27 @@ typedef char *rl_cpvfunc_t;
 
 #include <time.h>
 #include <unistd.h>
-#ifdef LINUX_INOTIFY
-# include <sys/inotify.h>
-#endif
 
 #include "aux.h"
+#include "autocmds.h"
 #include "bookmarks.h"
 #include "checks.h"
+#include "cursor.h"
 #include "exec.h"
+#include "filter.h"
 #include "history.h"
 #include "init.h"
 #include "jump.h"
 #include "listing.h"
 #include "navigation.h"
+#include "persist.h"
 #include "readline.h"
 #include "remotes.h"
 #include "messages.h"
 #include "file_operations.h"
+#include "trash.h"
+#include "properties.h"
+#include "watch.h"
 
 int
 is_blank_name(const char *s)
@@ -227,150 +231,7 @@ print_reload_msg(const char *msg, ...)
 	return EXIT_SUCCESS;
 }
 
-#ifdef LINUX_INOTIFY
-void
-reset_inotify(void)
-{
-	watch = 0;
-
-	if (inotify_wd >= 0) {
-		inotify_rm_watch(inotify_fd, inotify_wd);
-		inotify_wd = -1;
-	}
-
-	if (inotify_fd != UNSET)
-		close(inotify_fd);
-	inotify_fd = inotify_init1(IN_NONBLOCK);
-	if (inotify_fd < 0) {
-		_err('w', PRINT_PROMPT, "%s: inotify: %s\n",
-			PROGRAM_NAME, strerror(errno));
-		return;
-	}
-
-	/* If CWD is a symlink to a directory and it does not end with a slash,
-	 * inotify_add_watch(3) fails with ENOTDIR */
-	char rpath[PATH_MAX];
-	snprintf(rpath, sizeof(rpath), "%s/", workspaces[cur_ws].path);
-
-//	inotify_wd = inotify_add_watch(inotify_fd, workspaces[cur_ws].path, INOTIFY_MASK);
-	inotify_wd = inotify_add_watch(inotify_fd, rpath, INOTIFY_MASK);
-	if (inotify_wd > 0)
-		watch = 1;
-	else
-		_err('w', PRINT_PROMPT, "%s: inotify: %s: %s\n",
-			PROGRAM_NAME, rpath, strerror(errno));
-}
-
-void
-read_inotify(void)
-{
-	if (inotify_fd == UNSET)
-		return;
-
-	int i;
-	struct inotify_event *event;
-	char inotify_buf[EVENT_BUF_LEN];
-
-	memset((void *)inotify_buf, '\0', EVENT_BUF_LEN);
-	i = (int)read(inotify_fd, inotify_buf, EVENT_BUF_LEN);
-
-	if (i <= 0) {
-#ifdef INOTIFY_DEBUG
-		puts("INOTIFY_RETURN");
-#endif /* INOTIFY_DEBUG */
-		return;
-	}
-
-	int ignore_event = 0, refresh = 0;
-	for (char *ptr = inotify_buf;
-	ptr + ((struct inotify_event *)ptr)->len < inotify_buf + i;
-	ptr += sizeof(struct inotify_event) + event->len) {
-		event = (struct inotify_event *)ptr;
-
-#ifdef INOTIFY_DEBUG
-		printf("%s (%u:%d): ", *event->name
-			? event->name : NULL, event->len, event->wd);
-#endif /* INOTIFY_DEBUG */
-
-		if (!event->wd) {
-#ifdef INOTIFY_DEBUG
-			puts("INOTIFY_BREAK");
-#endif /* INOTIFY_DEBUG */
-			break;
-		}
-
-		if (event->mask & IN_CREATE) {
-#ifdef INOTIFY_DEBUG
-			puts("IN_CREATE");
-#endif /* INOTIFY_DEBUG */
-			struct stat a;
-			if (event->len && lstat(event->name, &a) != 0) {
-				/* The file was created, but doesn't exist anymore */
-				ignore_event = 1;
-			}
-		}
-
-		/* A file was renamed */
-		if (event->mask & IN_MOVED_TO) {
-			int j = (int)files;
-			while (--j >= 0) {
-				if (*file_info[j].name == *event->name
-				&& strcmp(file_info[j].name, event->name) == 0)
-					break;
-			}
-
-			if (j < 0) {
-				ignore_event = 0;
-			} else {
-				/* If destiny file name is already in the files list,
-				 * ignore this event */
-				ignore_event = 1;
-			}
-		}
-
-		if (event->mask & IN_DELETE) {
-#ifdef INOTIFY_DEBUG
-			puts("IN_DELETE");
-#endif /* INOTIFY_DEBUG */
-			struct stat a;
-			if (event->len && lstat(event->name, &a) == 0)
-				/* The file was removed, but is still there (recreated) */
-				ignore_event = 1;
-		}
-
-#ifdef INOTIFY_DEBUG
-		if (event->mask & IN_DELETE_SELF)
-			puts("IN_DELETE_SELF");
-		if (event->mask & IN_MOVE_SELF)
-			puts("IN_MOVE_SELF");
-		if (event->mask & IN_MOVED_FROM)
-			puts("IN_MOVED_FROM");
-		if (event->mask & IN_MOVED_TO)
-			puts("IN_MOVED_TO");
-		if (event->mask & IN_IGNORED)
-			puts("IN_IGNORED");
-#endif /* INOTIFY_DEBUG */
-
-		if (!ignore_event && (event->mask & INOTIFY_MASK))
-			refresh = 1;
-	}
-
-	if (refresh == 1 && exit_code == EXIT_SUCCESS) {
-#ifdef INOTIFY_DEBUG
-		puts("INOTIFY_REFRESH");
-#endif /* INOTIFY_DEBUG */
-		reload_dirlist();
-	} else {
-#ifdef INOTIFY_DEBUG
-		puts("INOTIFY_RESET");
-#endif /* INOTIFY_DEBUG */
-		/* Reset the inotify watch list */
-		reset_inotify();
-	}
-
-	return;
-}
-#elif defined(BSD_KQUEUE)
+#if defined(BSD_KQUEUE)
 /* Insert the following lines in the for loop to debug kqueue:
 if (event_data[i].fflags & NOTE_DELETE)
 	puts("NOTE_DELETE");
@@ -413,7 +274,7 @@ read_kqueue(void)
 		watch = 0;
 	} */
 }
-#endif /* LINUX_INOTIFY */
+#endif /* BSD_KQUEUE */
 
 void
 set_term_title(char *str)
@@ -430,12 +291,14 @@ set_term_title(char *str)
 }
 
 void
-set_filter_type(const char c)
+set_filter_type(const char *str)
 {
-	if (c == '=')
+	if (*str == '=')
 		filter.type = FILTER_FILE_TYPE;
-	else if (c == '@')
+	else if (*str == '@')
 		filter.type = FILTER_MIME_TYPE; /* UNIMPLEMENTED */
+	else if (is_filter_expr(str) == 1)
+		filter.type = FILTER_EXPR;
 	else
 		filter.type = FILTER_FILE_NAME;
 }
@@ -452,7 +315,7 @@ unset_filter(void)
 	filter.str = (char *)NULL;
 	filter.rev = 0;
 	filter.type = FILTER_NONE;
-	regfree(&regex_exp);
+	free_filter_prog(&filter_prog);
 
 	if (conf.autols == 1)
 		reload_dirlist();
@@ -486,19 +349,16 @@ validate_file_type_filter(void)
 static int
 compile_filter(void)
 {
-	if (filter.type == FILTER_FILE_NAME) {
-		if (regcomp(&regex_exp, filter.str, REG_NOSUB | REG_EXTENDED) != EXIT_SUCCESS) {
-			fputs(_("ft: Invalid regular expression\n"), stderr);
-			regfree(&regex_exp);
-			goto ERR;
-		}
-	} else if (filter.type == FILTER_FILE_TYPE) {
-		if (validate_file_type_filter() != EXIT_SUCCESS) {
-			fputs(_("ft: Invalid file type filter\n"), stderr);
-			goto ERR;
-		}
-	} else {
-		fputs(_("ft: Invalid filter\n"), stderr);
+	if (filter.type == FILTER_FILE_TYPE
+	&& validate_file_type_filter() != EXIT_SUCCESS) {
+		fputs(_("ft: Invalid file type filter\n"), stderr);
+		goto ERR;
+	}
+
+	const char *err = (const char *)NULL;
+	if (compile_filter_prog(filter.str, filter.type, &filter_prog,
+	&err) != EXIT_SUCCESS) {
+		fprintf(stderr, "ft: %s\n", _(err));
 		goto ERR;
 	}
 
@@ -514,12 +374,51 @@ ERR:
 	free(filter.str);
 	filter.str = (char *)NULL;
 	filter.type = FILTER_NONE;
+	free_filter_prog(&filter_prog);
 	return EXIT_FAILURE;
 }
 
+/* Append the word W to the buffer pointed to by P, quoting it if it has
+ * spaces */
+static void
+append_filter_word(char **p, const char *w)
+{
+	const char q = strchr(w, ' ') ? (strchr(w, '"') ? '\'' : '"') : 0;
+	const size_t l = strlen(w);
+
+	if (q)
+		*(*p)++ = q;
+	memcpy(*p, w, l);
+	*p += l;
+	if (q)
+		*(*p)++ = q;
+}
+
+/* Join FIRST and the remaining words (ARGS) of a filter expression split
+ * by the command line parser */
+static char *
+join_filter_args(const char *first, char **args)
+{
+	size_t i, len = strlen(first) + 2;
+	for (i = 0; args[i]; i++)
+		len += strlen(args[i]) + 3;
+
+	char *str = (char *)xnmalloc(len + 1, sizeof(char));
+	char *p = str;
+	append_filter_word(&p, first);
+	for (i = 0; args[i]; i++) {
+		*p++ = ' ';
+		append_filter_word(&p, args[i]);
+	}
+	*p = '\0';
+
+	return str;
+}
+
 int
-filter_function(char *arg)
+filter_function(char **args)
 {
+	char *arg = args[0];
 	if (!arg) {
 		printf(_("Current filter: %c%s\n"), filter.rev == 1 ? '!' : 0,
 				filter.str ? filter.str : "none");
@@ -535,7 +434,7 @@ filter_function(char *arg)
 		return unset_filter();
 
 	free(filter.str);
-	regfree(&regex_exp);
+	free_filter_prog(&filter_prog);
 
 	if (*arg == '!') {
 		filter.rev = 1;
@@ -548,8 +447,9 @@ filter_function(char *arg)
 	if (*arg == '\'' || *arg == '"')
 		p = remove_quotes(arg);
 
-	set_filter_type(*p);
-	filter.str = savestring(p, strlen(p));
+	filter.str = args[1] ? join_filter_args(p, args + 1)
+		: savestring(p, strlen(p));
+	set_filter_type(filter.str);
 
 	return compile_filter();
 }
@@ -1087,12 +987,7 @@ alias_import(char *file)
 	get_aliases();
 
 	/* Add new aliases to the commands list for TAB completion */
-	if (bin_commands) {
-		for (i = 0; bin_commands[i]; i++)
-			free(bin_commands[i]);
-		free(bin_commands);
-		bin_commands = (char **)NULL;
-	}
+	free_bin_commands();
 
 	get_path_programs();
 	return EXIT_SUCCESS;
@@ -1109,7 +1004,8 @@ save_last_path(void)
 	char *last_dir = (char *)xnmalloc(config_dir_len + 7, sizeof(char));
 	sprintf(last_dir, "%s/.last", config_dir);
 
-	FILE *last_fp = fopen(last_dir, "w");
+	struct persist_t p;
+	FILE *last_fp = persist_open(&p, last_dir, PERSIST_SYNC);
 	if (!last_fp) {
 		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: Error saving last "
 			"visited directory: %s\n"), PROGRAM_NAME, strerror(errno));
@@ -1126,17 +1022,25 @@ save_last_path(void)
 		}
 	}
 
-	fclose(last_fp);
+	if (persist_commit(&p) != EXIT_SUCCESS) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: Error saving last "
+			"visited directory: %s\n"), PROGRAM_NAME, strerror(errno));
+		free(last_dir);
+		return;
+	}
 
 	char *last_dir_tmp = xnmalloc(strlen(config_dir_gral) + 7, sizeof(char *));
 	sprintf(last_dir_tmp, "%s/.last", config_dir_gral);
 
+	/* The copy in the general config dir is read by the cd on quit
+	 * shell function. If not cd on quit, remove the file */
 	if (conf.cd_on_quit == 1) {
-		char *cmd[] = {"cp", "-p", last_dir, last_dir_tmp, NULL};
-		launch_execve(cmd, FOREGROUND, E_NOFLAG);
-	} else { /* If not cd on quit, remove the file */
-		char *cmd[] = {"rm", "-f", "--", last_dir_tmp, NULL};
-		launch_execve(cmd, FOREGROUND, E_NOFLAG);
+		if (persist_copy(last_dir, last_dir_tmp) != EXIT_SUCCESS)
+			_err(ERR_NO_STORE, NOPRINT_PROMPT, "%s: %s: %s\n", PROGRAM_NAME,
+				last_dir_tmp, strerror(errno));
+	} else if (unlink(last_dir_tmp) == -1 && errno != ENOENT) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "%s: %s: %s\n", PROGRAM_NAME,
+			last_dir_tmp, strerror(errno));
 	}
 
 	free(last_dir_tmp);
@@ -1223,6 +1127,7 @@ free_autocmds(void)
 		autocmds[i].color_scheme = (char *)NULL;
 	}
 	free(autocmds);
+	free_autocmd_patterns();
 	autocmds = (struct autocmds_t *)NULL;
 	autocmds_n = 0;
 	autocmd_set = 0;
@@ -1378,10 +1283,7 @@ free_stuff(void)
 
 #ifdef LINUX_INOTIFY
 	/* Shutdown inotify */
-	if (inotify_wd >= 0)
-		inotify_rm_watch(inotify_fd, inotify_wd);
-	if (inotify_fd != UNSET)
-		close(inotify_fd);
+	free_watches();
 #elif defined(BSD_KQUEUE)
 	if (event_fd >= 0)
 		close(event_fd);
@@ -1392,13 +1294,14 @@ free_stuff(void)
 	free_prompts();
 	free(prompts_file);
 	free_autocmds();
+	free_cmd_path_cache();
 	free_tags();
 	free_remotes(1);
 
-	if (xargs.stealth_mode != 1)
-		save_jumpdb();
+	/* Write the jump database and the directory history */
+	flush_stores(FLUSH_ALL);
 
-	save_dirhist();
+	print_cursor_model_stats();
 
 	if (conf.restore_last_path || conf.cd_on_quit)
 		save_last_path();
@@ -1433,11 +1336,8 @@ free_stuff(void)
 	if (pinned_dir)
 		free(pinned_dir);
 
-//	ADD FILTER TYPE CHECK!
-	if (filter.str) {
-		regfree(&regex_exp);
-		free(filter.str);
-	}
+	free(filter.str);
+	free_filter_prog(&filter_prog);
 
 	free_workspaces_filters();
 
@@ -1455,12 +1355,7 @@ free_stuff(void)
 	}
 	free(sel_devino);
 
-	if (bin_commands) {
-		i = (int)path_progsn;
-		while (--i >= 0)
-			free(bin_commands[i]);
-		free(bin_commands);
-	}
+	free_bin_commands();
 
 	if (paths) {
 		i = (int)path_n;
@@ -1490,12 +1385,7 @@ free_stuff(void)
 		free(argv_bk);
 	}
 
-	if (dirhist_total_index) {
-		i = (int)dirhist_total_index;
-		while (--i >= 0)
-			free(old_pwd[i]);
-		free(old_pwd);
-	}
+	free_dirhist();
 
 	i = (int)aliases_n;
 	while (--i >= 0) {
@@ -1584,7 +1474,11 @@ free_stuff(void)
 
 	free(user.groups);
 
+	free_workspace_listings();
+	clear_props_cache();
+
 #ifndef _NO_TRASH
+	free_trash_catalog();
 	free(trash_dir);
 	free(trash_files_dir);
 	free(trash_info_dir);
@@ -1631,6 +1525,7 @@ static void
 sigwinch_handler(int sig)
 {
 	UNUSED(sig);
+	invalidate_cursor_model();
 	if (xargs.refresh_on_resize == 0 || conf.pager == 1 || kbind_busy == 1)
 		return;
 
@@ -1905,13 +1800,17 @@ save_pinned_dir(void)
 	char *pin_file = (char *)xnmalloc(config_dir_len + 7, sizeof(char));
 	sprintf(pin_file, "%s/.pin", config_dir);
 
-	FILE *fp = fopen(pin_file, "w");
+	struct persist_t p;
+	FILE *fp = persist_open(&p, pin_file, PERSIST_SYNC);
+	if (fp) {
+		fprintf(fp, "%s", pinned_dir);
+		if (persist_commit(&p) != EXIT_SUCCESS)
+			fp = (FILE *)NULL;
+	}
+
 	if (!fp) {
 		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: Error storing pinned "
 			"directory: %s\n"), PROGRAM_NAME, strerror(errno));
-	} else {
-		fprintf(fp, "%s", pinned_dir);
-		fclose(fp);
 	}
 
 	free(pin_file);
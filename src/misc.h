@@ -32,7 +32,7 @@ int  alias_import(char *);
 void bonus_function(void);
 int  create_usr_var(char *);
 int  expand_prompt_name(char *);
-int  filter_function(char *);
+int  filter_function(char **);
 void free_autocmds(void);
 void free_prompts(void);
 void free_software(void);
@@ -62,13 +62,10 @@ void set_term_title(char *);
 void splash(void);
 int  unpin_dir(void);
 void version_function(void);
-#ifdef LINUX_INOTIFY
-void read_inotify(void);
-void reset_inotify(void);
-#elif defined(BSD_KQUEUE)
+#if defined(BSD_KQUEUE)
 void read_kqueue(void);
 #endif
-void set_filter_type(const char);
+void set_filter_type(const char *);
 int  sanitize_cmd(char *, int);
 /*void refresh_files_list(void); */
 
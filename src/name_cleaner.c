@@ -37,6 +37,11 @@
 #include <time.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <dirent.h>
+#if defined(__SSE2__) && defined(__GNUC__)
+# include <emmintrin.h>
+# define BLEACH_SSE2
+#endif
 
 #include "aux.h"
 #include "file_operations.h"
@@ -48,6 +53,7 @@
 #include "misc.h"
 #include "cleaner_table.h"
 #include "readline.h"
+#include "rename.h"
 #include "selection.h"
 
 #define FUNC_NAME "bleach"
@@ -57,6 +63,14 @@
 #define UNMOD_NAMES 0
 #define MOD_NAMES   1
 
+/* Number of Unicode code point pages (256 code points each) */
+#define UNI_PAGES 0x1100
+
+/* Names are cleaned by a worker pool, BLEACH_CHUNK at a time, but only if
+ * there are at least BLEACH_PARALLEL_MIN of them */
+#define BLEACH_PARALLEL_MIN 1024
+#define BLEACH_CHUNK        64
+
 #define UTF_8_ENCODED_MASK  0xC0
 #define UTF_8_ENCODED_START 0xC0
 #define UTF_8_ENCODED_CONT  0x80
@@ -127,6 +141,64 @@ translate_unsafe_char(unsigned char c)
 	return t;
 }
 
+/* Characters copied verbatim by clean_file_name(): [a-zA-Z0-9.]
+ * Underscores and dashes are not included, since consecutive ones are
+ * collapsed into a single one */
+static const unsigned char safe_chars[256] = {
+	['.'] = 1,
+	['0'] = 1, ['1'] = 1, ['2'] = 1, ['3'] = 1, ['4'] = 1,
+	['5'] = 1, ['6'] = 1, ['7'] = 1, ['8'] = 1, ['9'] = 1,
+	['A'] = 1, ['B'] = 1, ['C'] = 1, ['D'] = 1, ['E'] = 1, ['F'] = 1,
+	['G'] = 1, ['H'] = 1, ['I'] = 1, ['J'] = 1, ['K'] = 1, ['L'] = 1,
+	['M'] = 1, ['N'] = 1, ['O'] = 1, ['P'] = 1, ['Q'] = 1, ['R'] = 1,
+	['S'] = 1, ['T'] = 1, ['U'] = 1, ['V'] = 1, ['W'] = 1, ['X'] = 1,
+	['Y'] = 1, ['Z'] = 1,
+	['a'] = 1, ['b'] = 1, ['c'] = 1, ['d'] = 1, ['e'] = 1, ['f'] = 1,
+	['g'] = 1, ['h'] = 1, ['i'] = 1, ['j'] = 1, ['k'] = 1, ['l'] = 1,
+	['m'] = 1, ['n'] = 1, ['o'] = 1, ['p'] = 1, ['q'] = 1, ['r'] = 1,
+	['s'] = 1, ['t'] = 1, ['u'] = 1, ['v'] = 1, ['w'] = 1, ['x'] = 1,
+	['y'] = 1, ['z'] = 1,
+};
+
+#ifdef BLEACH_SSE2
+/* Return a mask with one bit set for each byte in X in the range
+ * [FROM, FROM + LEN). SSE2 has no unsigned byte comparison: flipping the
+ * sign bit of both operands makes the signed one do the job */
+static inline int
+sse2_range_mask(const __m128i x, const char from, const char len)
+{
+	const __m128i bias = _mm_set1_epi8((char)0x80);
+	const __m128i d = _mm_xor_si128(_mm_sub_epi8(x, _mm_set1_epi8(from)), bias);
+	const __m128i m = _mm_cmplt_epi8(d, _mm_xor_si128(_mm_set1_epi8(len), bias));
+	return _mm_movemask_epi8(m);
+}
+#endif /* BLEACH_SSE2 */
+
+/* Return the length of the initial run of safe characters (see safe_chars)
+ * in the first LEN bytes of S. Sixteen bytes are checked at once if SSE2
+ * is available */
+static size_t
+safe_run_len(const unsigned char *s, const size_t len)
+{
+	size_t i = 0;
+
+#ifdef BLEACH_SSE2
+	for (; i + 16 <= len; i += 16) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+		const int mask = sse2_range_mask(x, 'a', 26)
+			| sse2_range_mask(x, 'A', 26) | sse2_range_mask(x, '0', 10)
+			| _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('.')));
+
+		if (mask != 0xffff)
+			return i + (size_t)__builtin_ctz(~(unsigned)mask);
+	}
+#endif /* BLEACH_SSE2 */
+
+	while (i < len && safe_chars[s[i]] == 1)
+		i++;
+
+	return i;
+}
 
 static int
 get_uft8_dec_value(size_t *i, char *str)
@@ -175,6 +247,46 @@ get_uft8_dec_value(size_t *i, char *str)
 	return new_value;
 }
 
+/* Direct-indexed transliteration table, built out of unitable (in
+ * cleaner_table.h) by init_unipages(): the replacement for the code point
+ * C is unipages[C >> 8][C & 0xff]. Only pages holding at least one
+ * replacement are allocated */
+static char **unipages[UNI_PAGES];
+static int unipages_ok = 0;
+
+/* Build the transliteration table. It must be called before spawning
+ * the threads running clean_file_name() */
+static void
+init_unipages(void)
+{
+	if (unipages_ok == 1)
+		return;
+
+	/* Go backwards, so that the first entry for a code point wins */
+	size_t i = sizeof(unitable) / sizeof(struct utable_t);
+	while (i-- > 0) {
+		const int key = unitable[i].key;
+		if (!unitable[i].data || key < 0 || key >= UNI_PAGES << 8)
+			continue;
+
+		if (!unipages[key >> 8])
+			unipages[key >> 8] = (char **)xcalloc(256, sizeof(char *));
+		unipages[key >> 8][key & 0xff] = unitable[i].data;
+	}
+
+	unipages_ok = 1;
+}
+
+/* Return the ASCII replacement for the code point C, or NULL if none */
+static char *
+translate_code_point(const int c)
+{
+	if (c < 0 || c >= UNI_PAGES << 8 || !unipages[c >> 8])
+		return (char *)NULL;
+
+	return unipages[c >> 8][c & 0xff];
+}
+
 /* Clean up NAME either by removing those (extended-ASCII/Unicode) characters
  * without an ASCII alternative/similar character, or by translating (based
  * on the unitable table (in cleaner_table.h)) extended-ASCII/Unicode characters
@@ -196,13 +308,16 @@ clean_file_name(char *restrict name)
 	if (!name || !*name)
 		return (char *)NULL;
 
-	char *p = xcalloc(NAME_MAX + 1, sizeof(char));
+	/* Translations are appended as long as the name is not longer than
+	 * NAME_MAX, so that the last one may go a few bytes beyond it */
+	char *p = xcalloc(NAME_MAX + 16, sizeof(char));
 	char *q = p;
 
 	size_t i = 0, cur_len = 0, too_long = 0;
 
 	char *s = strrchr(name, '/');
 	i = s ? (size_t)(s - name) + 1 : 0;
+	const size_t len = i + strlen(name + i);
 
 	unsigned char n = 0;
 	for (; (n = (unsigned char)name[i]); i++) {
@@ -211,6 +326,18 @@ clean_file_name(char *restrict name)
 			break;
 		}
 
+		/* Copy runs of safe characters at once */
+		size_t run = safe_run_len((unsigned char *)name + i, len - i);
+		if (run > 0) {
+			if (run > NAME_MAX + 1 - cur_len)
+				run = NAME_MAX + 1 - cur_len;
+			memcpy(q, name + i, run);
+			q += run;
+			cur_len += run;
+			i += run - 1;
+			continue;
+		}
+
 		/* ASCII chars */
 		if (n == 38) { /* & */
 			if (q == p || *(q - 1) != DEFAULT_TRANSLATION) {
@@ -276,13 +403,7 @@ clean_file_name(char *restrict name)
 			continue;
 		}
 
-		int j = (int)(sizeof(unitable) / sizeof(struct utable_t));
-		char *t = (char *)NULL;
-		while (--j >= 0) {
-			if (dec_value == unitable[j].key && unitable[j].data)
-				t = unitable[j].data;
-		}
-
+		char *t = translate_code_point(dec_value);
 		if (!t)
 			continue;
 
@@ -519,58 +640,185 @@ edit_replacements(struct bleach_t *bfiles, size_t *n, int *edited_names)
 	return bfiles;
 }
 
+/* A list of file names to be bleached */
+struct bleach_list_t {
+	char **names;
+	size_t n;
+	size_t size;
+};
+
+static void
+add_bleach_name(struct bleach_list_t *list, char *name)
+{
+	if (list->n == list->size) {
+		list->size = list->size == 0 ? 32 : list->size * 2;
+		list->names = (char **)xrealloc(list->names,
+			list->size * sizeof(char *));
+	}
+
+	list->names[list->n] = name;
+	list->n++;
+}
+
+/* Append all files under DIR to LIST, in post-order (the contents of a
+ * directory before the directory itself), so that files can be renamed
+ * before their parent directories. Symbolic links are not followed */
+static void
+collect_bleach_tree(const char *dir, struct bleach_list_t *list)
+{
+	DIR *d = opendir(dir);
+	if (!d) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "%s: %s: %s\n", FUNC_NAME,
+			dir, strerror(errno));
+		return;
+	}
+
+	const size_t dlen = strlen(dir);
+	struct dirent *ent;
+
+	while ((ent = readdir(d))) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		const size_t len = dlen + strlen(ent->d_name) + 2;
+		char *path = (char *)xnmalloc(len, sizeof(char));
+		snprintf(path, len, "%s/%s", dir, ent->d_name);
+
+		int is_dir = 0;
+#if !defined(_DIRENT_HAVE_D_TYPE)
+		struct stat a;
+		is_dir = (lstat(path, &a) == 0 && S_ISDIR(a.st_mode));
+#else
+		if (ent->d_type == DT_UNKNOWN) {
+			struct stat a;
+			is_dir = (lstat(path, &a) == 0 && S_ISDIR(a.st_mode));
+		} else {
+			is_dir = (ent->d_type == DT_DIR);
+		}
+#endif /* !_DIRENT_HAVE_D_TYPE */
+
+		if (is_dir == 1)
+			collect_bleach_tree(path, list);
+
+		add_bleach_name(list, path);
+	}
+
+	closedir(d);
+}
+
+struct bleach_job_t {
+	char **names;
+	char **clean;
+};
+
+static void
+bleach_name(void *arg, const size_t i)
+{
+	struct bleach_job_t *job = (struct bleach_job_t *)arg;
+	job->clean[i] = clean_file_name(job->names[i]);
+}
+
+/* Return an array with the cleaned up version of each of the N file names
+ * in NAMES (NULL for those that could not be cleaned). Large lists are
+ * split among the threads of a worker pool */
+static char **
+clean_file_names(char **names, const size_t n)
+{
+	init_unipages();
+
+	struct bleach_job_t job;
+	job.names = names;
+	job.clean = (char **)xnmalloc(n + 1, sizeof(char *));
+
+	struct pool_t pool;
+	pool_init(&pool, n, bleach_name, &job);
+	pool.chunk = BLEACH_CHUNK;
+	if (n < BLEACH_PARALLEL_MIN)
+		pool.max_threads = 1;
+	pool_run(&pool);
+
+	return job.clean;
+}
+
 /* Clean up the list of file names (NAMES), print the list of the cleaned
  * file names (allowing the user to edit this list), and finally
- * rename the original file names into the clean ones */
+ * rename the original file names into the clean ones.
+ * If the first name is "-r", the contents of directories are bleached
+ * as well, recursively */
 int
-bleach_files(char **names)
+bleach_files(char **names, const char *raw)
 {
 	if (!names || !names[1] || IS_HELP(names[1])) {
 		puts(_(BLEACH_USAGE));
 		return EXIT_SUCCESS;
 	}
 
-	struct bleach_t *bfiles = (struct bleach_t *)NULL;
-
 	size_t f = 0, i = 1;
+	int recursive = 0;
+	if (*names[1] == '-' && strcmp(names[1], "-r") == 0
+	&& is_raw_arg(raw, 1) == 0) {
+		if (!names[2]) {
+			puts(_(BLEACH_USAGE));
+			return EXIT_SUCCESS;
+		}
+		recursive = 1;
+		i = 2;
+	}
+
+	struct bleach_list_t list = {0};
+
 	for (; names[i]; i++) {
-		char *dstr = dequote_str(names[i], 0);
-		if (!dstr) {
-			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("bleach: %s: Error "
-				"dequoting file name\n"), names[i]);
-			continue;
+		if (is_raw_arg(raw, i) == 0) {
+			char *dstr = dequote_str(names[i], 0);
+			if (!dstr) {
+				_err(ERR_NO_STORE, NOPRINT_PROMPT, _("bleach: %s: Error "
+					"dequoting file name\n"), names[i]);
+				continue;
+			}
+			strcpy(names[i], dstr);
+			free(dstr);
 		}
-		strcpy(names[i], dstr);
-		free(dstr);
 		size_t nlen = strlen(names[i]);
-		if (names[i][nlen - 1] == '/')
+		if (nlen > 1 && names[i][nlen - 1] == '/')
 			names[i][--nlen] = '\0';
 
-		char *sl = strrchr(names[i], '/');
-		char *p = clean_file_name((sl && *(sl + 1)) ? sl + 1 : names[i]);
-		if (!p)
+		struct stat a;
+		if (recursive == 1 && lstat(names[i], &a) == 0 && S_ISDIR(a.st_mode))
+			collect_bleach_tree(names[i], &list);
+
+		add_bleach_name(&list, savestring(names[i], nlen));
+	}
+
+	char **clean = list.n > 0 ? clean_file_names(list.names, list.n)
+		: (char **)NULL;
+	struct bleach_t *bfiles = list.n > 0 ? (struct bleach_t *)xnmalloc(
+		list.n, sizeof(struct bleach_t)) : (struct bleach_t *)NULL;
+
+	for (i = 0; i < list.n; i++) {
+		char *name = list.names[i];
+		char *p = clean[i];
+		if (!p) {
+			free(name);
 			continue;
+		}
 
 		/* Nothing to clean. Skip this one */
-		char *n = (sl && *(sl + 1)) ? sl + 1 : names[i];
+		char *sl = strrchr(name, '/');
+		char *n = (sl && *(sl + 1)) ? sl + 1 : name;
 		if (*n == *p && strcmp(n, p) == 0) {
 			free(p);
+			free(name);
 			continue;
 		}
 
-		bfiles = (struct bleach_t *)xrealloc(bfiles, (f + 1) * sizeof(struct bleach_t));
-		bfiles[f].original = savestring(names[i], nlen);
+		bfiles[f].original = name;
 		if (sl) {
+			size_t rlen = (size_t)(sl - name) + strlen(p) + 2;
+			bfiles[f].replacement = (char *)xnmalloc(rlen, sizeof(char));
 			*sl = '\0';
-			bfiles[f].replacement = (char *)xnmalloc(nlen + strlen(p) + 2, sizeof(char));
-//			Fix comp warning with -O3 and -Wformat -Werror=format-security
-//			Why? p comes from clean_file_name(), which returns at most NAME_MAX
-//			bfiles[f].replacement = (char *)xnmalloc(nlen + strnlen(p, NAME_MAX) + 2, sizeof(char));
-			sprintf(bfiles[f].replacement, "%s/%s", names[i], p);
+			snprintf(bfiles[f].replacement, rlen, "%s/%s", name, p);
 			*sl = '/';
 		} else {
-//			Fix comp warning with -O3 and -Wformat -Werror=format-security
-//			bfiles[f].replacement = savestring(p, strnlen(p, NAME_MAX));
 			bfiles[f].replacement = savestring(p, strlen(p));
 		}
 		printf("%s %s->%s %s\n",
@@ -579,7 +827,11 @@ bleach_files(char **names)
 		free(p);
 	}
 
+	free(clean);
+	free(list.names);
+
 	if (f == 0 || !bfiles) {
+		free(bfiles);
 		printf(_("%s: Nothing to do\n"), FUNC_NAME);
 		return EXIT_SUCCESS;
 	}
@@ -654,36 +906,59 @@ CONFIRM:
 	if (rename == 1 && is_sel)
 		deselect_all();
 
-	int total_rename = rename == 1 ? (int)f : 0;
 	size_t rep_suffix = 1;
 	int exit_status = EXIT_SUCCESS;
+	struct rename_t *renames = (struct rename_t *)xnmalloc(f + 1,
+		sizeof(struct rename_t));
+	size_t n = 0;
+
+	/* Replacement names already taken by some other file in the list */
+	struct strset_t taken;
+	strset_init(&taken, f);
+
 	for (i = 0; i < f; i++) {
-		char *o = bfiles[i].original ? bfiles[i].original : (char *)NULL;
-		char *r = bfiles[i].replacement ? bfiles[i].replacement : (char *)NULL;
-		if (o && *o && r && *r && rename) {
-			/* Make sure the replacement file name does not exist. If
-			 * it does, append REP_SUFFIX and try again */
-			struct stat a;
-			while (lstat(r, &a) == 0) {
-				char tmp[PATH_MAX];
-				xstrsncpy(tmp, r, PATH_MAX - 1);
-				r = (char *)xrealloc(r,	PATH_MAX * sizeof(char));
-				sprintf(r, "%s-%zu", tmp, rep_suffix);
-				rep_suffix++;
-			}
+		char *o = bfiles[i].original;
+		char *r = bfiles[i].replacement;
+		if (!o || !*o || !r || !*r || rename == 0)
+			continue;
 
-			if (renameat(AT_FDCWD, o, AT_FDCWD, r) == -1) {
-				_err(ERR_NO_STORE, NOPRINT_PROMPT, "bleach: renameat: %s: %s\n",
-					o, strerror(errno));
-				total_rename--;
-				exit_status = EXIT_FAILURE;
-			}
+		/* Make sure the replacement file name does not exist and is not
+		 * used by another file. If it is, append REP_SUFFIX and try again */
+		struct stat a;
+		while (lstat(r, &a) == 0 || strset_has(&taken, r) == 1) {
+			char tmp[PATH_MAX];
+			xstrsncpy(tmp, r, PATH_MAX - 1);
+			r = (char *)xrealloc(r,	PATH_MAX * sizeof(char));
+			sprintf(r, "%s-%zu", tmp, rep_suffix);
+			rep_suffix++;
 		}
-		free(o);
-		free(r);
+		bfiles[i].replacement = r;
+		strset_add(&taken, r);
+
+		renames[n].src = o;
+		renames[n].dst = r;
+		n++;
+	}
+
+	size_t renamed = 0;
+	if (n > 0) {
+		struct rename_plan_t *plan = plan_renames("bleach", renames, n);
+		if (plan)
+			exit_status = run_rename_plan("bleach", plan, &renamed);
+		else
+			exit_status = EXIT_FAILURE;
+		free_rename_plan(plan);
+	}
+
+	strset_free(&taken);
+	for (i = 0; i < f; i++) {
+		free(bfiles[i].original);
+		free(bfiles[i].replacement);
 	}
 	free(bfiles);
+	free(renames);
 
+	int total_rename = (int)renamed;
 	if (exit_status == EXIT_FAILURE || total_rename == 0) {
 		printf(_("%s: %d file(s) bleached\n"), FUNC_NAME, total_rename);
 	} else {
@@ -34,6 +34,7 @@
 #include "aux.h"
 #include "checks.h"
 #include "colors.h" /* Used to get workspace path color */
+#include "filter.h"
 #include "fuzzy_match.h"
 #include "history.h"
 #include "jump.h"
@@ -211,7 +212,7 @@ unset_ws_filter(void)
 	filter.str = (char *)NULL;
 	filter.rev = 0;
 	filter.type = FILTER_NONE;
-	regfree(&regex_exp);
+	free_filter_prog(&filter_prog);
 }
 
 static void
@@ -222,14 +223,11 @@ set_ws_filter(const int n)
 	filter.env = workspace_opts[n].filter.env;
 
 	free(filter.str);
-	regfree(&regex_exp);
 	char *p = workspace_opts[n].filter.str;
 	filter.str = savestring(p, strlen(p));
 
-	if (filter.type != FILTER_FILE_NAME)
-		return;
-
-	if (regcomp(&regex_exp, filter.str, REG_NOSUB | REG_EXTENDED) != EXIT_SUCCESS)
+	if (compile_filter_prog(filter.str, filter.type, &filter_prog,
+	NULL) != EXIT_SUCCESS)
 		unset_ws_filter();
 }
 
@@ -286,6 +284,9 @@ switch_workspace(int tmp_ws)
 	if (conf.private_ws_settings == 1)
 		save_workspace_opts(cur_ws);
 
+	if (conf.autols == 1)
+		stash_workspace_listing(cur_ws);
+
 	prev_ws = cur_ws;
 	cur_ws = tmp_ws;
 	dir_changed = 1;
@@ -298,7 +299,8 @@ switch_workspace(int tmp_ws)
 
 	set_oldpwd(old_pwd[dirhist_cur_index], workspaces[cur_ws].path);
 
-	if (conf.autols == 1)
+	if (conf.autols == 1
+	&& restore_workspace_listing(cur_ws) == EXIT_FAILURE)
 		reload_dirlist();
 
 	add_to_dirhist(workspaces[cur_ws].path);
@@ -931,11 +933,7 @@ print_dirhist(char *query)
 static int
 clear_dirhist(void)
 {
-	int i = dirhist_total_index;
-
-	while (--i >= 0)
-		free(old_pwd[i]);
-	dirhist_cur_index = dirhist_total_index = 0;
+	reset_dirhist();
 	add_to_dirhist(workspaces[cur_ws].path);
 
 	printf("%s: Directory history cleared\n", PROGRAM_NAME);
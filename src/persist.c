@@ -0,0 +1,284 @@
+/* persist.c -- crash-safe replacement of state files */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* Rewriting a file in place (fopen(file, "w")) truncates it first: if we
+ * crash, or the disk gets full, in the middle of the write, the file is
+ * left truncated. Instead, new contents are written into a temporary file
+ * in the same directory, which is then renamed over the original file.
+ * Since rename(2) is atomic, the file is always either the old or the new
+ * one.
+ *
+ * This module also keeps track of state files modified in memory (the
+ * jump database and the directory history), so that they are written
+ * all at once, either at exit or, at most every STORES_FLUSH_INTERVAL
+ * seconds, while waiting for input at the prompt (see wait_for_input()).
+ *
+ * misc/tools/crashtest kills clifm at every write, rename, and fsync
+ * call in turn to check that state files are never left half written. */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aux.h"
+#include "history.h"
+#include "jump.h"
+#include "persist.h"
+
+static int dirty_stores = 0;
+static time_t dirty_since = 0;
+
+/* Flush the directory containing FILE to disk, so that a rename in it
+ * survives a system crash */
+static void
+sync_parent_dir(const char *file)
+{
+	char *p = strrchr(file, '/');
+	if (!p)
+		return;
+
+	const size_t len = p == file ? 1 : (size_t)(p - file);
+	char *dir = (char *)xnmalloc(len + 1, sizeof(char));
+	memcpy(dir, file, len);
+	dir[len] = '\0';
+
+	const int fd = open(dir, O_RDONLY | O_DIRECTORY);
+	free(dir);
+
+	if (fd == -1)
+		return;
+
+	fsync(fd);
+	close(fd);
+}
+
+static void
+free_persist(struct persist_t *p)
+{
+	free(p->file);
+	free(p->tmp);
+	p->file = p->tmp = (char *)NULL;
+	p->fp = (FILE *)NULL;
+}
+
+/* Start replacing FILE: return a stream to write the new contents of FILE
+ * into, or NULL on error (errno is set). Once done, call either
+ * persist_commit() or persist_cancel().
+ * If FILE is a symbolic link, the file it points to is replaced. The
+ * permissions of the original file, if any, are preserved */
+FILE *
+persist_open(struct persist_t *p, const char *file, const int flags)
+{
+	memset(p, 0, sizeof(struct persist_t));
+	p->flags = flags;
+
+	struct stat a;
+	if (lstat(file, &a) == 0 && S_ISLNK(a.st_mode))
+		p->file = realpath(file, NULL);
+	if (!p->file)
+		p->file = savestring(file, strlen(file));
+
+	mode_t mode;
+	if (stat(p->file, &a) == 0) {
+		mode = a.st_mode & 07777;
+	} else { /* New file: use the same mode fopen(3) would use */
+		const mode_t old_umask = umask(0);
+		umask(old_umask);
+		mode = 0666 & ~old_umask;
+	}
+
+	const size_t len = strlen(p->file) + 8;
+	p->tmp = (char *)xnmalloc(len, sizeof(char));
+	snprintf(p->tmp, len, "%s.XXXXXX", p->file);
+
+	const int fd = mkstemp(p->tmp);
+	if (fd == -1)
+		goto ERROR;
+
+	if (fchmod(fd, mode) == -1 || !(p->fp = fdopen(fd, "w"))) {
+		const int saved_errno = errno;
+		close(fd);
+		unlink(p->tmp);
+		errno = saved_errno;
+		goto ERROR;
+	}
+
+	return p->fp;
+
+ERROR:
+	free_persist(p);
+	return (FILE *)NULL;
+}
+
+/* Discard the new contents written via the stream returned by
+ * persist_open(). The original file is left untouched */
+void
+persist_cancel(struct persist_t *p)
+{
+	if (p->fp) {
+		fclose(p->fp);
+		unlink(p->tmp);
+	}
+
+	free_persist(p);
+}
+
+/* Replace the original file by the new contents written via the stream
+ * returned by persist_open(). If anything fails (say, the disk is full),
+ * the original file is left untouched.
+ * Returns EXIT_SUCCESS or EXIT_FAILURE (errno is set) */
+int
+persist_commit(struct persist_t *p)
+{
+	if (!p->fp)
+		return EXIT_FAILURE;
+
+	int err = 0;
+	if (fflush(p->fp) == EOF || ((p->flags & PERSIST_SYNC)
+	&& fsync(fileno(p->fp)) == -1))
+		err = errno;
+	else if (ferror(p->fp))
+		err = EIO;
+
+	if (fclose(p->fp) == EOF && err == 0)
+		err = errno;
+	p->fp = (FILE *)NULL;
+
+	if (err == 0 && rename(p->tmp, p->file) == -1)
+		err = errno;
+
+	if (err != 0) {
+		unlink(p->tmp);
+		free_persist(p);
+		errno = err;
+		return EXIT_FAILURE;
+	}
+
+	if (p->flags & PERSIST_SYNC)
+		sync_parent_dir(p->file);
+
+	free_persist(p);
+	return EXIT_SUCCESS;
+}
+
+/* Atomically replace DST by a copy of SRC, preserving permissions and
+ * access/modification times (like 'cp -p').
+ * Returns EXIT_SUCCESS or EXIT_FAILURE (errno is set) */
+int
+persist_copy(const char *src, const char *dst)
+{
+	const int fd = open(src, O_RDONLY);
+	if (fd == -1)
+		return EXIT_FAILURE;
+
+	struct stat a;
+	struct persist_t p;
+	FILE *fp = (FILE *)NULL;
+	if (fstat(fd, &a) == -1 || !(fp = persist_open(&p, dst, PERSIST_SYNC))) {
+		const int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return EXIT_FAILURE;
+	}
+
+	char buf[8192];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		if (fwrite(buf, 1, (size_t)n, fp) != (size_t)n)
+			break;
+	}
+
+	const int saved_errno = errno;
+	close(fd);
+
+	if (n != 0 || fflush(fp) == EOF) {
+		persist_cancel(&p);
+		errno = saved_errno;
+		return EXIT_FAILURE;
+	}
+
+	struct timespec ts[2];
+	ts[0].tv_sec = a.st_atime;
+	ts[1].tv_sec = a.st_mtime;
+#if defined(__linux__)
+	ts[0].tv_nsec = a.st_atim.tv_nsec;
+	ts[1].tv_nsec = a.st_mtim.tv_nsec;
+#else
+	ts[0].tv_nsec = ts[1].tv_nsec = 0;
+#endif /* __linux__ */
+
+	fchmod(fileno(fp), a.st_mode & 07777);
+	futimens(fileno(fp), ts);
+
+	return persist_commit(&p);
+}
+
+/* Mark the state file STORE (a STORE macro) as modified, to be written
+ * by the next call to flush_stores() */
+void
+mark_store_dirty(const int store)
+{
+	if (dirty_stores == 0)
+		dirty_since = time(NULL);
+
+	dirty_stores |= store;
+}
+
+/* Return the number of milliseconds left before flush_stores(FLUSH_IDLE)
+ * has something to write, or -1 if no state file is dirty */
+int
+stores_flush_wait(void)
+{
+	if (dirty_stores == 0)
+		return (-1);
+
+	const time_t elapsed = time(NULL) - dirty_since;
+	return elapsed >= STORES_FLUSH_INTERVAL ? 0
+		: (int)(STORES_FLUSH_INTERVAL - elapsed) * 1000;
+}
+
+/* Write all dirty state files. If MODE is FLUSH_IDLE, do nothing unless
+ * the oldest modification is STORES_FLUSH_INTERVAL seconds old */
+void
+flush_stores(const int mode)
+{
+	if (dirty_stores == 0 || (mode == FLUSH_IDLE
+	&& time(NULL) - dirty_since < STORES_FLUSH_INTERVAL))
+		return;
+
+	const int stores = dirty_stores;
+	dirty_stores = 0;
+
+	if ((stores & STORE_JUMPDB) && xargs.stealth_mode != 1)
+		save_jumpdb();
+	if (stores & STORE_DIRHIST)
+		save_dirhist();
+}
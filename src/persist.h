@@ -0,0 +1,67 @@
+/* persist.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef PERSIST_H
+#define PERSIST_H
+
+/* Flags for persist_open() */
+#define PERSIST_NOFLAG 0
+/* Flush the new file and its directory to disk before returning from
+ * persist_commit(): the file survives a system crash as well */
+#define PERSIST_SYNC   (1 << 0)
+
+/* State files saved by flush_stores() */
+#define STORE_JUMPDB  (1 << 0)
+#define STORE_DIRHIST (1 << 1)
+
+/* Modes for flush_stores() */
+#define FLUSH_IDLE 0 /* Flush only stores dirty for STORES_FLUSH_INTERVAL secs */
+#define FLUSH_ALL  1
+
+/* Dirty stores are written at most once every STORES_FLUSH_INTERVAL secs */
+#define STORES_FLUSH_INTERVAL 30
+
+/* A file being replaced: new contents are written into a temporary file
+ * in the same directory, which is then renamed over the original one */
+struct persist_t {
+	char *file;
+	char *tmp;
+	FILE *fp;
+	int flags;
+	int pad;
+};
+
+__BEGIN_DECLS
+
+void flush_stores(const int);
+void mark_store_dirty(const int);
+void persist_cancel(struct persist_t *);
+int  persist_commit(struct persist_t *);
+int  persist_copy(const char *, const char *);
+FILE *persist_open(struct persist_t *, const char *, const int);
+int  stores_flush_wait(void);
+
+__END_DECLS
+
+#endif /* PERSIST_H */
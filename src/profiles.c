@@ -42,6 +42,7 @@
 #include "listing.h"
 #include "misc.h"
 #include "navigation.h"
+#include "persist.h"
 #include "profiles.h"
 #include "sort.h"
 #include "messages.h"
@@ -147,6 +148,7 @@ profile_set(char *prof)
 
 	if (conf.restore_last_path)
 		save_last_path();
+	flush_stores(FLUSH_ALL);
 
 	if (alt_profile) {
 		free(alt_profile);
@@ -228,12 +230,7 @@ profile_set(char *prof)
 	load_actions();
 
 	/* Reload PATH commands (actions are profile specific) */
-	if (bin_commands) {
-		for (i = 0; bin_commands[i]; i++)
-			free(bin_commands[i]);
-		free(bin_commands);
-		bin_commands = (char **)NULL;
-	}
+	free_bin_commands();
 
 	if (paths) {
 		i = (int)path_n;
@@ -29,13 +29,11 @@
 
 #include <stdio.h>
 #include <string.h>
-#if !defined(__HAIKU__) && !defined(__OpenBSD__) && !defined(__ANDROID__)
-# include <wordexp.h>
-#endif
 #include <readline/readline.h>
 #include <errno.h>
 
 #include "aux.h"
+#include "cursor.h"
 #include "exec.h"
 #include "file_operations.h"
 #include "history.h"
@@ -46,6 +44,7 @@
 #include "navigation.h"
 #include "prompt.h"
 #include "sanitize.h"
+#include "watch.h"
 
 #ifndef _NO_SUGGESTIONS
 # include "suggestions.h"
@@ -419,57 +418,32 @@ add_string(char **tmp, const int c, char **line, char **res, size_t *len)
 	free(*tmp);
 }
 
-#if !defined(__HAIKU__) && !defined(__OpenBSD__) && !defined(__ANDROID__)
-static inline void
-reset_ifs(const char *value)
-{
-	if (value)
-		setenv("IFS", value, 1);
-	else
-		unsetenv("IFS");
-}
-
 static inline void
 substitute_cmd(char **line, char **res, size_t *len)
 {
 	int tmp = strcntchr(*line, ')');
 	if (tmp == -1) return; /* No ending bracket */
 
-	char *tmp_str = (char *)xnmalloc(strlen(*line) + 2, sizeof(char));
-	sprintf(tmp_str, "$%s", *line);
-
-	tmp_str[tmp + 2] = '\0';
+	/* *LINE points to the opening bracket */
+	char *cmd = (char *)xnmalloc((size_t)tmp + 1, sizeof(char));
+	xstrsncpy(cmd, *line + 1, (size_t)tmp - 1);
 	*line += tmp + 1;
 
-	const char *old_value = getenv("IFS");
-	setenv("IFS", "", 1);
-
-	wordexp_t wordbuf;
-	if (wordexp(tmp_str, &wordbuf, 0) != EXIT_SUCCESS) {
-		free(tmp_str);
-		reset_ifs(old_value);
+	char *out = get_cmd_output(cmd);
+	free(cmd);
+	if (!out)
 		return;
-	}
-	reset_ifs(old_value);
-	free(tmp_str);
-
-	if (wordbuf.we_wordc) {
-		for (size_t j = 0; j < wordbuf.we_wordc; j++) {
-			*len += strlen(wordbuf.we_wordv[j]);
-			if (!*res) {
-				*res = (char *)xnmalloc(*len + 2, sizeof(char));
-				*(*res) = '\0';
-			} else {
-				*res = (char *)xrealloc(*res, (*len + 2) * sizeof(char));
-			}
-			strcat(*res, wordbuf.we_wordv[j]);
-		}
-	}
 
-	wordfree(&wordbuf);
-	return;
+	*len += strlen(out);
+	if (!*res) {
+		*res = (char *)xnmalloc(*len + 2, sizeof(char));
+		*(*res) = '\0';
+	} else {
+		*res = (char *)xrealloc(*res, (*len + 2) * sizeof(char));
+	}
+	strcat(*res, out);
+	free(out);
 }
-#endif /* !__HAIKU__ && !__OpenBSD__ && !__ANDROID__ */
 
 static inline char *
 gen_emergency_prompt(void)
@@ -695,13 +669,11 @@ ADD_STRING:
 			if (c == '\'' || c == '"')
 				continue;
 
-#if !defined(__HAIKU__) && !defined(__OpenBSD__) && !defined(__ANDROID__)
 			/* Command substitution */
 			if (c == '$' && *line == '(') {
 				substitute_cmd(&line, &result, &result_len);
 				continue;
 			}
-#endif /* !__HAIKU__ && !__OpenBSD__ && !__ANDROID__ */
 
 			size_t new_len = result_len + 2
 							+ (wrong_cmd ? (MAX_COLOR + 6) : 0);
@@ -932,6 +904,9 @@ initialize_prompt_data(void)
 	update_trash_indicator();
 #endif
 	get_sel_files();
+#ifdef LINUX_INOTIFY
+	watch_sel_parents();
+#endif /* LINUX_INOTIFY */
 	setenv_prompt();
 
 	args_n = 0;
@@ -978,6 +953,41 @@ print_right_prompt(void)
 	free(p);
 } */
 
+/* Update the selected and trashed files counters shown by the prompt.
+ * Returns 1 if any of them changed, or 0 otherwise */
+int
+update_prompt_counters(void)
+{
+	const size_t sel_bk = sel_n, trash_bk = trash_n;
+
+#ifndef _NO_TRASH
+	update_trash_indicator();
+#endif
+	get_sel_files();
+
+	return (sel_n != sel_bk || trash_n != trash_bk);
+}
+
+/* Generate the prompt again and redisplay it, together with the current
+ * input line. Used when the files list is refreshed while waiting for
+ * input */
+void
+redisplay_prompt(void)
+{
+	setenv_prompt();
+
+	char *decoded_prompt = decode_prompt(conf.encoded_prompt);
+	char *the_prompt = construct_prompt(decoded_prompt ? decoded_prompt : EMERGENCY_PROMPT);
+	free(decoded_prompt);
+
+	rl_set_prompt(the_prompt);
+	free(the_prompt);
+	prompt_offset = UNSET;
+
+	UNHIDE_CURSOR;
+	rl_forced_update_display();
+}
+
 /* Print the prompt and return the string entered by the user, to be
  * parsed later by parse_input_str() */
 char *
@@ -1001,10 +1011,19 @@ prompt(void)
 		print_right_prompt(); */
 
 	UNHIDE_CURSOR;
+	/* The cursor model did not see what was printed since the last prompt */
+	invalidate_cursor_model();
 
 	/* Print the prompt and get user input */
 	char *input = (char *)NULL;
+	/* Let my_rl_getc() refresh the files list while waiting for input.
+	 * Keybindings may run a prompt of their own, so restore the flag
+	 * to its previous state when done */
+	const int main_prompt = flags & IN_MAIN_PROMPT;
+	flags |= IN_MAIN_PROMPT;
 	input = readline(the_prompt);
+	if (main_prompt == 0)
+		flags &= ~IN_MAIN_PROMPT;
 	free(the_prompt);
 
 	if (!input || !*input || rl_end == 0) {
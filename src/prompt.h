@@ -30,6 +30,8 @@ __BEGIN_DECLS
 char *prompt(void);
 char *decode_prompt(char *);
 int  prompt_function(char *, char *);
+void redisplay_prompt(void);
+int  update_prompt_counters(void);
 
 __END_DECLS
 
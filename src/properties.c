@@ -22,8 +22,8 @@
  * MA 02110-1301, USA.
 */
 
-/* These four functions: get_color_size, get_color_size256, get_color_age,
- * and get_color_age256 are based on https://github.com/leahneukirchen/lr
+/* The functions used to get gradient colors for the size and date fields
+ * (get_size_shade, get_age_shade, and render_shade) are based on https://github.com/leahneukirchen/lr
  * (licenced MIT) and modified to fit our needs.
  * All changes are licensed under GPL-2.0-or-later. */
 
@@ -39,6 +39,7 @@
 #endif
 #include <fcntl.h>
 #include <grp.h>
+#include <signal.h>
 #include <pwd.h>
 
 #if defined(__OpenBSD__) || defined(__NetBSD__) \
@@ -58,6 +59,7 @@
 
 #include "aux.h"
 #include "checks.h"
+#include "chtree.h"
 #include "colors.h"
 #include "messages.h"
 #include "misc.h"
@@ -198,10 +200,67 @@ get_link_color(char *name, int *link_dir, const int dsize)
 	return color;
 }
 
+/* Total sizes of the directories given to 'pp' are computed in the
+ * background by a worker pool, while properties are printed in the
+ * original order */
+struct size_job_t {
+	char *path;
+	struct tree_size_t ts;
+	int ret; /* Value returned by tree_size() */
+	int pad;
+};
+
+static struct size_pool_t {
+	struct size_job_t *jobs;
+	size_t n;
+	struct pool_t pool;
+} size_pool;
+
+/* Set by SIGINT (Ctrl-c) while 'pp' is computing sizes: no more sizes
+ * are computed, and ongoing computations are stopped */
+static volatile sig_atomic_t size_canceled = 0;
+
+static void
+size_sigint_handler(int sig)
+{
+	UNUSED(sig);
+	size_canceled = 1;
+}
+
+/* Totals for all files given to 'pp' */
+struct props_total_t {
+	off_t size;
+	off_t largest_size;
+	char *largest;
+	size_t files;
+	size_t dirs;
+};
+
+static void
+run_size_job(void *arg, const size_t i)
+{
+	UNUSED(arg);
+	struct size_job_t *job = &size_pool.jobs[i];
+	job->ret = tree_size(job->path, &job->ts, &size_canceled);
+}
+
+/* Wait for JOB to be done. If no thread took it yet, run it here. Jobs
+ * never run (canceled) keep their initial ECANCELED value */
+static void
+wait_size_job(struct size_job_t *job)
+{
+	pool_wait_job(&size_pool.pool, (size_t)(job - size_pool.jobs));
+}
+
+/* Compute the total size of FILENAME, in bytes, or take it from JOB, if
+ * it is being computed in the background. On error, -1 is returned and
+ * ERR is set to the corresponding errno value */
 static off_t
-get_total_size(const int link_to_dir, char *filename)
+get_total_size(const int link_to_dir, char *filename, struct size_job_t *job,
+	int *err)
 {
-	off_t total_size = 0;
+	struct tree_size_t ts;
+	int ret = 0;
 
 	char _path[PATH_MAX]; *_path = '\0';
 	if (link_to_dir == 1)
@@ -210,24 +269,40 @@ get_total_size(const int link_to_dir, char *filename)
 	if (term_caps.suggestions == 0) {
 		fputs("Retrieving file size... ", stdout);
 		fflush(stdout);
-		total_size = dir_size(*_path ? _path : filename,
-			(bin_flags & (GNU_DU_BIN_DU | GNU_DU_BIN_GDU)) ? 1 : 0);
-		fputs("\r                       \r", stdout);
-		fputs(_("Total size: \t"), stdout);
 	} else {
 		fputs(_("Total size: \t"), stdout);
 		HIDE_CURSOR;
 		fputs("Calculating... ", stdout);
 		fflush(stdout);
-		total_size = dir_size(*_path ? _path : filename,
-			(bin_flags & (GNU_DU_BIN_DU | GNU_DU_BIN_GDU)) ? 1 : 0);
+	}
+
+	if (job) {
+		wait_size_job(job);
+		ts = job->ts;
+		ret = job->ret;
+	} else {
+		ret = tree_size(*_path ? _path : filename, &ts, &size_canceled);
+	}
+
+	if (term_caps.suggestions == 0) {
+		fputs("\r                       \r", stdout);
+		fputs(_("Total size: \t"), stdout);
+	} else if (ret == ECANCELED) {
+		/* The terminal echoed ^C: the cursor is no longer where we left it */
+		putchar('\r');
+		ERASE_TO_RIGHT;
+		fputs(_("Total size: \t"), stdout);
+		UNHIDE_CURSOR;
+		fflush(stdout);
+	} else {
 		MOVE_CURSOR_LEFT(15);
 		ERASE_TO_RIGHT;
 		UNHIDE_CURSOR;
 		fflush(stdout);
 	}
 
-	return total_size;
+	*err = ret;
+	return ret == 0 ? ts.size : (-1);
 }
 
 /* Returns a struct perms_t with the symbolic value and color for each
@@ -412,9 +487,10 @@ perm2octal(char *s)
 /* Ask the user to edit permissions given by STR and return the edited string
  * If DIFF is set to 0, we are editing a single file or multiple files with the
  * same set of permissions. Otherwise, we have multiple files with different
- * sets of permissions */
+ * sets of permissions. In RECURSIVE mode, the template is always applied,
+ * even if left unchanged */
 static char *
-get_new_perms(char *str, const int diff)
+get_new_perms(char *str, const int diff, const int recursive)
 {
 	int poffset_bk = prompt_offset;
 	prompt_offset = 3;
@@ -425,7 +501,8 @@ get_new_perms(char *str, const int diff)
 			"Only shared permission bits are set in the template"));
 	}
 	puts("Edit file permissions (Ctrl-d to quit)\n"
-		"Both symbolic and numeric notation are supported");
+		"Both symbolic and numeric notation are supported, just as\n"
+		"relative modes (e.g. u+rwX,go-w), applied to each file");
 	char m[(MAX_COLOR * 2) + 7];
 	snprintf(m, sizeof(m), "\001%s\002>\001%s\002 ", mi_c, tx_c);
 
@@ -442,7 +519,7 @@ get_new_perms(char *str, const int diff)
 	xrename = 0;
 	prompt_offset = poffset_bk;
 
-	if (diff == 0 && new_perms && *str == *new_perms
+	if (diff == 0 && recursive == 0 && new_perms && *str == *new_perms
 	&& strcmp(str, new_perms) == 0) {
 		fprintf(stderr, _("pc: Nothing to do\n"));
 		free(new_perms);
@@ -543,7 +620,55 @@ get_perm_str(char **s, int *diff)
 	return ptr;
 }
 
-/* Change permissions of files passed via ARGS */
+/* Return 1 if the mode string S is a relative mode in chmod(1) notation
+ * (e.g. "u+x,go-w" or "-w"), or 0 if it is either an octal mode or a
+ * permissions template ("rwxr-xr-x", "-w-r--r--") */
+static int
+is_relative_mode(const char *s)
+{
+	if (*s == 'u' || *s == 'g' || *s == 'o' || *s == 'a')
+		return 1;
+
+	/* A removal without a class ("-w", "-x") is relative, unless S is
+	 * a whole template */
+	if (*s == '-' && s[1] && strchr("rwxXst", s[1]))
+		return (strlen(s) != 9 || strspn(s, "-rwxsStT") != 9) ? 1 : 0;
+
+	return (strchr(s, '+') || strchr(s, '=') || strchr(s, ',')) ? 1 : 0;
+}
+
+/* Compile the new permissions NEW_PERMS, as entered by the user, into SPEC.
+ * Returns EXIT_SUCCESS on success or EXIT_FAILURE on error */
+static int
+get_mode_spec(char *new_perms, struct mode_spec_t *spec)
+{
+	if (is_relative_mode(new_perms) == 1) {
+		if (compile_mode_spec(new_perms, spec) == EXIT_SUCCESS)
+			return EXIT_SUCCESS;
+		free_mode_spec(spec);
+		fprintf(stderr, _("pc: %s: Invalid mode\n"), new_perms);
+		return EXIT_FAILURE;
+	}
+
+	if (validate_new_perms(new_perms) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	if (IS_DIGIT(*new_perms))
+		return compile_mode_spec(new_perms, spec);
+
+	/* A template sets all bits: prefix the octal mode with a zero, so that
+	 * set-user-ID and set-group-ID bits of directories are cleared if
+	 * not in the template */
+	char *octal_str = perm2octal(new_perms);
+	char buf[sizeof("0") + 32];
+	snprintf(buf, sizeof(buf), "0%s", octal_str);
+	free(octal_str);
+
+	return compile_mode_spec(buf, spec);
+}
+
+/* Change permissions of files passed via ARGS. If the first argument is
+ * "-R", directories are changed recursively */
 int
 set_file_perms(char **args)
 {
@@ -552,57 +677,68 @@ set_file_perms(char **args)
 		return EXIT_SUCCESS;
 	}
 
+	const int recursive = strcmp(args[1], "-R") == 0 ? 1 : 0;
+	char **files = args + 1 + recursive;
+	if (!*files) {
+		puts(PC_USAGE);
+		return EXIT_SUCCESS;
+	}
+
 	int j;
-	for (j = 1; args[j]; j++) {
-		if (!strchr(args[j], '\\'))
+	for (j = 0; files[j]; j++) {
+		if (!strchr(files[j], '\\'))
 			continue;
-		char *t = dequote_str(args[j], 0);
+		char *t = dequote_str(files[j], 0);
 		if (t) {
-			free(args[j]);
-			args[j] = t;
+			free(files[j]);
+			files[j] = t;
 		}
 	}
 
 	int diff = 0; /* Either a single file o multiple files with same perms */
-	char *pstr = get_perm_str(args + 1, &diff);
+	char *pstr = get_perm_str(files, &diff);
 	if (!pstr) return errno;
 
-	char *new_perms = get_new_perms(pstr, diff);
+	char *new_perms = get_new_perms(pstr, diff, recursive);
 	free(pstr);
 
 	if (!new_perms) return EXIT_SUCCESS;
 
-	if (validate_new_perms(new_perms) != EXIT_SUCCESS) {
+	struct mode_spec_t spec;
+	if (get_mode_spec(new_perms, &spec) != EXIT_SUCCESS) {
 		free(new_perms);
 		return EXIT_FAILURE;
 	}
 
-	char *octal_str = IS_DIGIT(*new_perms) ? new_perms : perm2octal(new_perms);
+	free(new_perms);
 
-	int ret = EXIT_SUCCESS;
-	size_t i, n = 0;
-	mode_t mode = (mode_t)strtol(octal_str, 0, 8);
-	for (i = 1; args[i]; i++) {
-		if (fchmodat(AT_FDCWD, args[i], mode, 0) == EXIT_SUCCESS) {
-			n++;
-		} else {
-			fprintf(stderr, "pc: %s: %s\n", args[i], strerror(errno));
-			ret = errno;
-		}
-		fflush(stdout);
-	}
+	struct chtree_op_t op;
+	op.spec = &spec;
+	op.uid = (uid_t)-1;
+	op.gid = (gid_t)-1;
+	op.type = CHTREE_MODE;
+	op.recursive = recursive;
 
-	if (n > 0)
-		printf(_("pc: Applied new permissions to %zu file(s)\n"), n);
+	struct chtree_stats_t st;
+	const int ret = chtree(files, &op, &st);
+	free_mode_spec(&spec);
+
+	print_chtree_errors("pc", &st);
+
+	if (st.changed > 0) {
+		printf(_("pc: Applied new permissions to %zu file(s)"), st.changed);
+		if (st.unchanged > 0)
+			printf(_(" (%zu already had them)"), st.unchanged);
+		putchar('\n');
+	} else if (st.errors == 0) {
+		puts(_("pc: Nothing to do"));
+	}
 
-	free(new_perms);
-	if (octal_str != new_perms)
-		free(octal_str);
 	return ret;
 }
 
 static char *
-get_new_ownership(char *str, const int diff)
+get_new_ownership(char *str, const int diff, const int recursive)
 {
 	int poffset_bk = prompt_offset;
 	prompt_offset = 3;
@@ -630,7 +766,8 @@ get_new_ownership(char *str, const int diff)
 	xrename = 0;
 	prompt_offset = poffset_bk;
 
-	if (diff == 0 && new_own && *str == *new_own && strcmp(str, new_own) == 0) {
+	if (diff == 0 && recursive == 0 && new_own && *str == *new_own
+	&& strcmp(str, new_own) == 0) {
 		fprintf(stderr, _("oc: Nothing to do\n"));
 		free(new_own);
 		new_own = (char *)NULL;
@@ -694,6 +831,34 @@ get_common_ownership(char **args, int *exit_status, int *diff)
 	return p;
 }
 
+/* Recursively set the owner of FILES to OWNER and their primary group to
+ * GROUP (either of them may be NULL, meaning unchanged) */
+static int
+set_tree_owner(char **files, const struct passwd *owner,
+	const struct group *group)
+{
+	struct chtree_op_t op;
+	op.spec = (struct mode_spec_t *)NULL;
+	op.uid = owner ? owner->pw_uid : (uid_t)-1;
+	op.gid = group ? group->gr_gid : (gid_t)-1;
+	op.type = CHTREE_OWNER;
+	op.recursive = 1;
+
+	struct chtree_stats_t st;
+	const int ret = chtree(files, &op, &st);
+
+	print_chtree_errors("oc", &st);
+
+	if (st.changed > 0)
+		printf(_("New ownership set for %zu file(s)\n"), st.changed);
+	else if (st.errors == 0)
+		puts(_("oc: Nothing to do"));
+
+	return ret;
+}
+
+/* Change ownership of files passed via ARGS. If the first argument is
+ * "-R", directories are changed recursively */
 int
 set_file_owner(char **args)
 {
@@ -702,6 +867,15 @@ set_file_owner(char **args)
 		return EXIT_SUCCESS;
 	}
 
+	const int recursive = strcmp(args[1], "-R") == 0 ? 1 : 0;
+	if (recursive == 1) {
+		if (!args[2]) {
+			puts(OC_USAGE);
+			return EXIT_SUCCESS;
+		}
+		args++;
+	}
+
 	int exit_status = EXIT_SUCCESS, diff = 0;
 	char *own = get_common_ownership(args + 1, &exit_status, &diff);
 	if (!own)
@@ -711,7 +885,7 @@ set_file_owner(char **args)
 	if (*own == ':' && !*(own + 1))
 		*own = '\0';
 
-	char *new_own = get_new_ownership(own, diff);
+	char *new_own = get_new_ownership(own, diff, recursive);
 	free(own);
 
 	if (!new_own || !*new_own) {
@@ -756,6 +930,14 @@ set_file_owner(char **args)
 		}
 	}
 
+	if (recursive == 1) {
+		exit_status = set_tree_owner(args + 1,
+			*new_own ? owner : (struct passwd *)NULL,
+			new_group ? group : (struct group *)NULL);
+		free(new_own);
+		return exit_status;
+	}
+
 	/* Change ownership */
 	struct stat a;
 	size_t new_o = 0, new_g = 0, i;
@@ -767,6 +949,10 @@ set_file_owner(char **args)
 			return errno;
 		}
 
+		if ((!*new_own || owner->pw_uid == a.st_uid)
+		&& (!new_group || group->gr_gid == a.st_gid))
+			continue;
+
 		if (fchownat(AT_FDCWD, args[i],
 		*new_own ? owner->pw_uid : a.st_uid,
 		new_group ? group->gr_gid : a.st_gid,
@@ -800,53 +986,17 @@ set_file_owner(char **args)
 	return exit_status;
 }
 
-/* Get gradient color based on file size (true colors version) */
-static void
-get_color_size_truecolor(const off_t s, char *str, const size_t len)
+/* Get the shade index (for size_shades) corresponding to the file size S */
+static uint8_t
+get_size_shade(const off_t s)
 {
 	long long base = xargs.si == 1 ? 1000 : 1024;
-	uint8_t n = 0;
-
-	if      (s <                base) n = 1; // Bytes
-	else if (s <           base*base) n = 2; // Kb
-	else if (s <      base*base*base) n = 3; // Mb
-	else if (s < base*base*base*base) n = 4; // Gb
-	else				              n = 5; // Larger
-
-	snprintf(str, len, "\x1b[0;%d;38;2;%d;%d;%dm",
-		size_shades.shades[n].attr,
-		size_shades.shades[n].R,
-		size_shades.shades[n].G,
-		size_shades.shades[n].B);
-}
-
-/* Get gradient color based on file time (true colors version) */
-static void
-get_color_age_truecolor(const time_t t, char *str, const size_t len)
-{
-	time_t age = props_now - t;
-	uint8_t n;
-
-	if      (age <             0LL) n = 0;
-	else if (age <=        60*60LL) n = 1; /* One hour or less */
-	else if (age <=     24*60*60LL) n = 2; /* One day or less */
-	else if (age <=   7*24*60*60LL) n = 3; /* One weak or less */
-	else if (age <= 4*7*24*60*60LL) n = 4; /* One month or less */
-	else                            n = 5; /* Older */
-
-	snprintf(str, len, "\x1b[0;%d;38;2;%d;%d;%dm",
-		date_shades.shades[n].attr,
-		date_shades.shades[n].R,
-		date_shades.shades[n].G,
-		date_shades.shades[n].B);
-}
 
-/* Get gradient color based on file size (256 colors version) */
-static void
-get_color_size256(const off_t s, char *str, const size_t len)
-{
-	long long base = xargs.si == 1 ? 1000 : 1024;
-	uint8_t n = 0;
+	if (size_shades.type == SHADE_TYPE_8COLORS) {
+		if (s <      base*base) return 1; // Byte and Kb
+		if (s < base*base*base) return 2; // Mb
+		return 3; // Larger
+	}
 
 /* LSD uses this criteria and colors:
  * Bytes and Kb = small (229)
@@ -860,72 +1010,70 @@ get_color_size256(const off_t s, char *str, const size_t len)
  * Gb (220)
  * Larger (214) */
 
-	if      (s <                base) n = 1; // Bytes
-	else if (s <           base*base) n = 2; // Kb
-	else if (s <      base*base*base) n = 3; // Mb
-	else if (s < base*base*base*base) n = 4; // Gb
-	else				              n = 5; // Larger
-
-	snprintf(str, len, "\x1b[0;%d;38;5;%dm",
-		size_shades.shades[n].attr,
-		size_shades.shades[n].R);
+	if      (s <                base) return 1; // Bytes
+	else if (s <           base*base) return 2; // Kb
+	else if (s <      base*base*base) return 3; // Mb
+	else if (s < base*base*base*base) return 4; // Gb
+	return 5; // Larger
 }
 
-/* Get gradient color based on file time (256 colors version) */
-static void
-get_color_age256(const time_t t, char *str, const size_t len)
+/* Get the shade index (for date_shades) corresponding to the file time T */
+static uint8_t
+get_age_shade(const time_t t)
 {
 	/* PROPS_NOW is global. Calculated before by list_dir() and when
 	 * running the 'p' command */
 	time_t age = props_now - t;
-	uint8_t n;
+
+	if (date_shades.type == SHADE_TYPE_8COLORS) {
+		if (age <         0LL) return 0;
+		if (age <=    60*60LL) return 1; // One hour or less
+		if (age <= 24*60*60LL) return 2; // One day or less
+		return 3; // Older
+	}
 
 /* LSD uses this criteria and colors:
  * HourOld (40)
  * DayOld (42)
  * Older (36) */
 
-	if      (age <             0LL) n = 0;
-	else if (age <=        60*60LL) n = 1; // One hour or less
-	else if (age <=     24*60*60LL) n = 2; // One day or less
-	else if (age <=   7*24*60*60LL) n = 3; // One weak or less
-	else if (age <= 4*7*24*60*60LL) n = 4; // One month or less
-	else                            n = 5; // Older
-
-	snprintf(str, len, "\x1b[0;%d;38;5;%dm",
-		date_shades.shades[n].attr,
-		date_shades.shades[n].R);
+	if      (age <             0LL) return 0;
+	else if (age <=        60*60LL) return 1; /* One hour or less */
+	else if (age <=     24*60*60LL) return 2; /* One day or less */
+	else if (age <=   7*24*60*60LL) return 3; /* One weak or less */
+	else if (age <= 4*7*24*60*60LL) return 4; /* One month or less */
+	return 5; /* Older */
 }
 
+/* Write the escape sequence for the shade N of SHADES into STR,
+ * whose len is LEN */
 static void
-get_color_size8(const off_t s, char *str, const size_t len)
+render_shade(const struct shades_t *shades, const uint8_t n, char *str,
+	const size_t len)
 {
-	long long base = xargs.si == 1 ? 1000 : 1024;
-	uint8_t n;
-
-	if      (s <      base*base) n = 1; // Byte and Kb
-	else if (s < base*base*base) n = 2; // Mb
-	else		                 n = 3; // Larger
-
-	snprintf(str, len, "\x1b[0;%d;%dm",
-		size_shades.shades[n].attr,
-		size_shades.shades[n].R);
-}
+	switch (shades->type) {
+	case SHADE_TYPE_8COLORS:
+		snprintf(str, len, "\x1b[0;%d;%dm",
+			shades->shades[n].attr,
+			shades->shades[n].R);
+		break;
 
-static void
-get_color_age8(const time_t t, char *str, const size_t len)
-{
-	time_t age = props_now - t;
-	uint8_t n;
+	case SHADE_TYPE_256COLORS:
+		snprintf(str, len, "\x1b[0;%d;38;5;%dm",
+			shades->shades[n].attr,
+			shades->shades[n].R);
+		break;
 
-	if      (age <         0LL) n = 0;
-	else if (age <=    60*60LL) n = 1; // One hour or less
-	else if (age <= 24*60*60LL) n = 2; // One day or less
-	else                        n = 3; // Older
+	case SHADE_TYPE_TRUECOLOR:
+		snprintf(str, len, "\x1b[0;%d;38;2;%d;%d;%dm",
+			shades->shades[n].attr,
+			shades->shades[n].R,
+			shades->shades[n].G,
+			shades->shades[n].B);
+		break;
 
-	snprintf(str, len, "\x1b[0;%d;%dm",
-		date_shades.shades[n].attr,
-		date_shades.shades[n].R);
+	default: *str = '\0'; break;
+	}
 }
 
 /* Get gradient color (based on size) for the file whose size is S.
@@ -933,12 +1081,7 @@ get_color_age8(const time_t t, char *str, const size_t len)
 static void
 get_color_size(const off_t s, char *str, const size_t len)
 {
-	switch(size_shades.type) {
-	case SHADE_TYPE_8COLORS: get_color_size8(s, str, len); break;
-	case SHADE_TYPE_256COLORS: get_color_size256(s, str, len); break;
-	case SHADE_TYPE_TRUECOLOR: get_color_size_truecolor(s, str, len); break;
-	default: break;
-	}
+	render_shade(&size_shades, get_size_shade(s), str, len);
 }
 
 /* Get gradient color (based on time) for the file whose time is T.
@@ -946,12 +1089,7 @@ get_color_size(const off_t s, char *str, const size_t len)
 static void
 get_color_age(const time_t t, char *str, const size_t len)
 {
-	switch(date_shades.type) {
-	case SHADE_TYPE_8COLORS: get_color_age8(t, str, len); break;
-	case SHADE_TYPE_256COLORS: get_color_age256(t, str, len); break;
-	case SHADE_TYPE_TRUECOLOR: get_color_age_truecolor(t, str, len); break;
-	default: break;
-	}
+	render_shade(&date_shades, get_age_shade(t), str, len);
 }
 
 /* Print final stats for the disk usage analyzer mode: total and largest file */
@@ -1079,7 +1217,7 @@ print_extended_attributes(char *s)
 #endif /* _LINUX_XATTR */
 
 static int
-get_properties(char *filename, const int dsize)
+get_properties(char *filename, const int dsize, struct size_job_t *job)
 {
 	if (!filename || !*filename)
 		return EXIT_FAILURE;
@@ -1371,49 +1509,38 @@ get_properties(char *filename, const int dsize)
 	if (dsize == 0) /* We're running 'p', not 'pp' */
 		goto END;
 
+	int size_err = 0;
 	off_t total_size = file_perm == 1
-		? get_total_size(link_to_dir, filename) : (-2);
+		? get_total_size(link_to_dir, filename, job, &size_err) : (-2);
 
 	if (total_size < 0) {
 		if (total_size == -2) /* No access */
 			printf(_("Total size: \t%s-%s\n"), dn_c, cend);
 		else /* get_total_size returned error (-1) */
-			puts("?");
+			printf("? (%s)\n", strerror(size_err));
 		goto END;
 	}
 
 	int size_mult_factor = xargs.si == 1 ? 1000 : 1024;
 
-	off_t total_size_kb = 0;
-	if (bin_flags & (GNU_DU_BIN_DU | GNU_DU_BIN_GDU)) {
-		total_size_kb = total_size > size_mult_factor
-			? (total_size / size_mult_factor) : total_size;
-	} else {
-		total_size_kb = total_size;
-	}
-
 	if (!*dz_c) {
-		get_color_size(total_size_kb * size_mult_factor, sf, sizeof(sf));
+		get_color_size(total_size, sf, sizeof(sf));
 		csize = sf;
 	}
 
-	char *human_size = get_size_unit(total_size_kb * size_mult_factor);
+	char *human_size = get_size_unit(total_size);
 	if (!human_size) {
 		puts("?");
 		goto END;
 	}
 
-	if (bin_flags & (GNU_DU_BIN_DU | GNU_DU_BIN_GDU)) {
-		printf("%s%s%s ", csize, human_size, cend);
+	printf("%s%s%s ", csize, human_size, cend);
 
-		if (total_size > size_mult_factor)
-			printf("/ %s%juB%s ", csize, (uintmax_t)total_size, cend);
+	if (total_size > size_mult_factor)
+		printf("/ %s%juB%s ", csize, (uintmax_t)total_size, cend);
 
-		printf("(%s%s)\n", conf.apparent_size == 1 ? "apparent" : "real",
-			xargs.si == 1 ? " / si" : "");
-	} else {
-		printf("%s%s%s\n", csize, human_size, cend);
-	}
+	printf("(%s%s)\n", conf.apparent_size == 1 ? "apparent" : "real",
+		xargs.si == 1 ? " / si" : "");
 	free(human_size);
 
 END:
@@ -1482,6 +1609,205 @@ calc_relative_time(const time_t age, char *s)
 	}
 }
 
+/* Caches used by print_entry_props() to render long view fields.
+ * They depend on the current color scheme and time format, so that
+ * clear_props_cache() must be called whenever any of these changes */
+
+/* File types, as indexed by the permissions cache */
+#define PTYPE_REG   0
+#define PTYPE_DIR   1
+#define PTYPE_LNK   2
+#define PTYPE_SOCK  3
+#define PTYPE_BLK   4
+#define PTYPE_CHR   5
+#define PTYPE_FIFO  6
+#define PTYPE_UNKN  7
+#define PTYPE_NUM   8
+
+/* Number of distinct permission bits combinations (07777 + 1) */
+#define PERM_MODES 4096
+
+#define DATE_CACHE_SIZE    1024 /* Must be a power of two */
+#define DATE_CACHE_STR_LEN 64
+
+/* Time formats, as cached by the date cache */
+#define TFMT_RECENT 0
+#define TFMT_OLDER  1
+#define TFMT_USER   2
+#define TFMT_NUM    3
+
+struct date_cache_t {
+	time_t key;
+	int fmt;
+	int ok;
+	char str[DATE_CACHE_STR_LEN];
+};
+
+static struct props_cache_t {
+	/* Symbolic permission strings (including the file type indicator),
+	 * allocated on demand per file type and indexed by permission bits */
+	char **perms[PTYPE_NUM];
+	struct date_cache_t *dates;
+	/* Time granularity (in seconds) of each time format */
+	int tfmt_step[TFMT_NUM];
+	int colorize;
+	int shades_ok;
+	int dates_ok;
+	char size_shades[NUM_SHADES][MAX_SHADE_LEN];
+	char date_shades[NUM_SHADES][MAX_SHADE_LEN];
+} pcache = { .colorize = -1 };
+
+void
+clear_props_cache(void)
+{
+	size_t i, j;
+	for (i = 0; i < PTYPE_NUM; i++) {
+		if (!pcache.perms[i])
+			continue;
+		for (j = 0; j < PERM_MODES; j++)
+			free(pcache.perms[i][j]);
+		free(pcache.perms[i]);
+		pcache.perms[i] = (char **)NULL;
+	}
+
+	free(pcache.dates);
+	pcache.dates = (struct date_cache_t *)NULL;
+	pcache.colorize = -1;
+	pcache.shades_ok = pcache.dates_ok = 0;
+}
+
+/* Return the symbolic permissions string (file type included) for a file
+ * of type TYPE (TYPE_CHR is the file type indicator and TYPE_COLOR its
+ * color) and mode MODE */
+static char *
+get_perm_str_cached(const int type, const char type_chr,
+	const char *type_color, const mode_t mode)
+{
+	if (pcache.colorize != conf.colorize) {
+		clear_props_cache();
+		pcache.colorize = conf.colorize;
+	}
+
+	if (!pcache.perms[type])
+		pcache.perms[type] = (char **)xcalloc(PERM_MODES, sizeof(char *));
+
+	size_t m = (size_t)(mode & 07777);
+	if (pcache.perms[type][m])
+		return pcache.perms[type][m];
+
+	char *t_ctype = savestring(type_color, strnlen(type_color, MAX_COLOR));
+	remove_bold_attr(&t_ctype);
+
+	char *cend = df_c;
+	/* 14 colors + 15 single chars + NUL byte */
+	char attr_s[(MAX_COLOR * 14) + 16];
+	struct perms_t perms = get_file_perms(mode);
+	int len = snprintf(attr_s, sizeof(attr_s),
+		"%s%c%s/%s%c%s%c%s%c%s/%s%c%s%c%s%c%s/%s%c%s%c%s%c%s",
+		t_ctype, type_chr, cend,
+		perms.cur, perms.ur, perms.cuw, perms.uw, perms.cux, perms.ux, cend,
+		perms.cgr, perms.gr, perms.cgw, perms.gw, perms.cgx, perms.gx, cend,
+		perms.cor, perms.or, perms.cow, perms.ow, perms.cox, perms.ox, cend);
+
+	free(t_ctype);
+
+	if (len < 0)
+		len = 0;
+	if ((size_t)len >= sizeof(attr_s))
+		len = (int)sizeof(attr_s) - 1;
+
+	pcache.perms[type][m] = savestring(attr_s, (size_t)len);
+	return pcache.perms[type][m];
+}
+
+/* Return the shade color for the file size S (SIZE is true), or for the
+ * file time S (SIZE is false) */
+static char *
+get_shade_cached(const time_t s, const int size)
+{
+	if (pcache.shades_ok == 0) {
+		uint8_t i;
+		for (i = 0; i < NUM_SHADES; i++) {
+			render_shade(&size_shades, i, pcache.size_shades[i], MAX_SHADE_LEN);
+			render_shade(&date_shades, i, pcache.date_shades[i], MAX_SHADE_LEN);
+		}
+		pcache.shades_ok = 1;
+	}
+
+	return size == 1 ? pcache.size_shades[get_size_shade((off_t)s)]
+		: pcache.date_shades[get_age_shade(s)];
+}
+
+/* Return 60 if the strftime(3) format FMT prints nothing finer than minutes
+ * (so that dates can be cached per minute), or 1 otherwise */
+static int
+get_time_fmt_step(const char *fmt)
+{
+	const char *p;
+	for (p = fmt; *p; p++) {
+		if (*p != '%')
+			continue;
+		p++;
+		/* Alternative representations: %Ey, %Od, and so on */
+		if (*p == 'E' || *p == 'O')
+			p++;
+		if (!*p)
+			break;
+		if (!strchr("aAbBCdDeFgGhHIjklmMnpPRtuUVwWyYzZ%", *p))
+			return 1;
+	}
+
+	return 60;
+}
+
+/* Write the formatted time T (FMT being one of TFMT_RECENT, TFMT_OLDER, or
+ * TFMT_USER, and TFMT_STR the corresponding format) into BUF, whose size
+ * is SIZE. Formatted dates are cached: since time zone offsets are whole
+ * minutes, all times within the same minute produce the same string
+ * if the format does not print seconds */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+static void
+format_time_cached(const time_t t, const int fmt, const char *tfmt_str,
+	char *buf, const size_t size)
+{
+	if (pcache.dates_ok == 0) {
+		if (!pcache.dates)
+			pcache.dates = (struct date_cache_t *)xcalloc(DATE_CACHE_SIZE,
+				sizeof(struct date_cache_t));
+		else
+			memset(pcache.dates, 0, DATE_CACHE_SIZE
+				* sizeof(struct date_cache_t));
+
+		pcache.tfmt_step[TFMT_RECENT] = get_time_fmt_step(DEF_TIME_STYLE_RECENT);
+		pcache.tfmt_step[TFMT_OLDER] = get_time_fmt_step(DEF_TIME_STYLE_OLDER);
+		pcache.tfmt_step[TFMT_USER] = conf.time_str
+			? get_time_fmt_step(conf.time_str) : 1;
+		pcache.dates_ok = 1;
+	}
+
+	time_t key = t / pcache.tfmt_step[fmt];
+	size_t slot = ((size_t)key * 31 + (size_t)fmt) & (DATE_CACHE_SIZE - 1);
+	struct date_cache_t *d = &pcache.dates[slot];
+
+	if (d->ok == 1 && d->key == key && d->fmt == fmt) {
+		xstrsncpy(buf, d->str, size - 1);
+		return;
+	}
+
+	struct tm tm;
+	localtime_r(&t, &tm);
+	size_t len = strftime(buf, size, tfmt_str, &tm);
+
+	if (len > 0 && len < DATE_CACHE_STR_LEN) {
+		memcpy(d->str, buf, len + 1);
+		d->key = key;
+		d->fmt = fmt;
+		d->ok = 1;
+	}
+}
+#pragma GCC diagnostic pop
+
 /* Compose the properties line for the current file name
  * This function is called by list_dir(), in listing.c, for each file name
  * in the current directory when running in long view mode, and after
@@ -1494,29 +1820,24 @@ print_entry_props(const struct fileinfo *props, size_t max, const size_t ug_max,
 	/* Let's get file properties and the corresponding colors */
 
 	char file_type = 0; /* File type indicator */
+	int ptype = PTYPE_UNKN;
 	char *ctype = dn_c, /* Color for file type */
 		 *cdate = dd_c, /* Color for dates */
 		 *cid = df_c,   /* Color for UID and GID */
 		 *csize = props->dir ? dz_c : df_c, /* Directories size */
 		 *cend = df_c;  /* Ending Color */
 
-	/* Let's construct color shades for file size and time fields */
-	char sf[MAX_SHADE_LEN], df[MAX_SHADE_LEN];
-
+	/* Let's get color shades for file size and time fields */
 	if (conf.colorize == 1) {
 		off_t s = props->size;
 		if (props->dir == 1 && conf.full_dir_size == 1)
 			s = props->size * (xargs.si == 1 ? 1000 : 1024);
 
-		if (!*dz_c) {
-			get_color_size(s, sf, sizeof(sf));
-			csize = sf;
-		}
+		if (!*dz_c)
+			csize = get_shade_cached((time_t)s, 1);
 
-		if (!*dd_c) {
-			get_color_age(props->ltime, df, sizeof(df));
-			cdate = df;
-		}
+		if (!*dd_c)
+			cdate = get_shade_cached(props->ltime, 0);
 	}
 
 	int file_perm = check_file_access(props->mode, props->uid, props->gid);
@@ -1524,13 +1845,13 @@ print_entry_props(const struct fileinfo *props, size_t max, const size_t ug_max,
 		cid = dg_c;
 
 	switch (props->mode & S_IFMT) {
-	case S_IFREG:  file_type = '.'; break;
-	case S_IFDIR:  file_type = 'd'; ctype = di_c; break;
-	case S_IFLNK:  file_type = 'l'; ctype = ln_c; break;
-	case S_IFSOCK: file_type = 's'; ctype = so_c; break;
-	case S_IFBLK:  file_type = 'b'; ctype = bd_c; break;
-	case S_IFCHR:  file_type = 'c'; ctype = cd_c; break;
-	case S_IFIFO:  file_type = 'p'; ctype = pi_c; break;
+	case S_IFREG:  file_type = '.'; ptype = PTYPE_REG; break;
+	case S_IFDIR:  file_type = 'd'; ptype = PTYPE_DIR; ctype = di_c; break;
+	case S_IFLNK:  file_type = 'l'; ptype = PTYPE_LNK; ctype = ln_c; break;
+	case S_IFSOCK: file_type = 's'; ptype = PTYPE_SOCK; ctype = so_c; break;
+	case S_IFBLK:  file_type = 'b'; ptype = PTYPE_BLK; ctype = bd_c; break;
+	case S_IFCHR:  file_type = 'c'; ptype = PTYPE_CHR; ctype = cd_c; break;
+	case S_IFIFO:  file_type = 'p'; ptype = PTYPE_FIFO; ctype = pi_c; break;
 	default:       file_type = '?'; break;
 	}
 
@@ -1542,9 +1863,6 @@ print_entry_props(const struct fileinfo *props, size_t max, const size_t ug_max,
 		cend = df_c;
 	}
 
-	char *t_ctype = savestring(ctype, strnlen(ctype, MAX_COLOR));
-	remove_bold_attr(&t_ctype);
-
 	/* Let's compose each properties field individually to be able to
 	 * print only the desired ones. This is specified via the PropFields
 	 * option in the config file */
@@ -1616,21 +1934,17 @@ print_entry_props(const struct fileinfo *props, size_t max, const size_t ug_max,
 				 * #     2. PERMISSIONS      #
 				 * ########################### */
 
-		/* 14 colors + 15 single chars + NUL byte */
-	char attr_s[(MAX_COLOR * 14) + 16];
+	/* Symbolic permission strings are rendered only once per file type
+	 * and mode (see get_perm_str_cached()) */
+	char attr_n[(MAX_COLOR * 2) + 5]; /* 2 colors + 4 digits + NUL byte */
+	char *attr_s = attr_n;
 	if (prop_fields.perm == PERM_SYMBOLIC) {
-		struct perms_t perms = get_file_perms(props->mode);
-		snprintf(attr_s, sizeof(attr_s),
-			"%s%c%s/%s%c%s%c%s%c%s/%s%c%s%c%s%c%s/%s%c%s%c%s%c%s",
-			t_ctype, file_type, cend,
-			perms.cur, perms.ur, perms.cuw, perms.uw, perms.cux, perms.ux, cend,
-			perms.cgr, perms.gr, perms.cgw, perms.gw, perms.cgx, perms.gx, cend,
-			perms.cor, perms.or, perms.cow, perms.ow, perms.cox, perms.ox, cend);
+		attr_s = get_perm_str_cached(ptype, file_type, ctype, props->mode);
 	} else if (prop_fields.perm == PERM_NUMERIC) {
-		snprintf(attr_s, sizeof(attr_s), "%s%04o%s", do_c,
+		snprintf(attr_n, sizeof(attr_n), "%s%04o%s", do_c,
 			props->mode & 07777, cend);
 	} else {
-		*attr_s = '\0';
+		*attr_n = '\0';
 	}
 
 				/* ###########################
@@ -1665,9 +1979,6 @@ print_entry_props(const struct fileinfo *props, size_t max, const size_t ug_max,
 	char time_s[MAX_TIME_STR + (MAX_COLOR * 2) + 2];
 	if (prop_fields.time != 0) {
 		if (props->ltime >= 0) {
-			struct tm t;
-			localtime_r(&props->ltime, &t);
-
 			time_t age = props_now - props->ltime;
 			/* AGE is negative if file time is in the future */
 
@@ -1679,15 +1990,12 @@ print_entry_props(const struct fileinfo *props, size_t max, const size_t ug_max,
 				uint8_t recent = age >= 0 && age < 14515200LL;
 				/* 14515200 == 6*4*7*24*60*60 == six months */
 				/* If not user defined, let's mimic ls(1) behavior */
+				int fmt = conf.time_str ? TFMT_USER
+					: (recent ? TFMT_RECENT : TFMT_OLDER);
 				char *tfmt = conf.time_str ? conf.time_str :
 					(recent ? DEF_TIME_STYLE_RECENT : DEF_TIME_STYLE_OLDER);
-				/* GCC (not clang) complains about tfmt being not a string
-				 * literal. Let's silence this warning until we find a better
-				 * approach. */
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wformat-nonliteral"
-				strftime(file_time, sizeof(file_time), tfmt, &t);
-#pragma GCC diagnostic pop
+				format_time_cached(props->ltime, fmt, tfmt, file_time,
+					sizeof(file_time));
 			}
 		} else {
 			/* INVALID_TIME_STR is generated by check_time_str() in init.c */
@@ -1706,9 +2014,9 @@ print_entry_props(const struct fileinfo *props, size_t max, const size_t ug_max,
 
 	/* size_s is either file size or "major,minor" IDs in case of special
 	 * files (char and block devs) */
-	char *size_type = (char *)NULL;
-	/* get_size_unit() returns a string of at most MAX_UNIT_SIZE chars
+	/* construct_human_size() writes at most MAX_UNIT_SIZE chars
 	 * (see aux.h) */
+	char size_type[MAX_UNIT_SIZE];
 	char size_s[MAX_UNIT_SIZE + (MAX_COLOR * 2) + 1];
 	if (prop_fields.size >= 1) {
 		if (!(S_ISCHR(props->mode) || S_ISBLK(props->mode))
@@ -1718,14 +2026,14 @@ print_entry_props(const struct fileinfo *props, size_t max, const size_t ug_max,
 			} else {
 				if (prop_fields.size == PROP_SIZE_HUMAN) {
 					if (props->dir == 1 && conf.full_dir_size == 1) {
-						size_type = get_size_unit(props->size *
-							(xargs.si == 1 ? 1000 : 1024));
+						construct_human_size(props->size *
+							(xargs.si == 1 ? 1000 : 1024), size_type);
 					} else {
-						size_type = get_size_unit(props->size);
+						construct_human_size(props->size, size_type);
 					}
 
 					snprintf(size_s, sizeof(size_s), "%s%s%s", csize,
-						size_type ? size_type : "?", cend);
+						size_type, cend);
 				} else {
 					snprintf(size_s, sizeof(size_s), "%s%*ju%s", csize,
 						(int)size_max, (uintmax_t)props->size, cend);
@@ -1816,12 +2124,101 @@ print_entry_props(const struct fileinfo *props, size_t max, const size_t ug_max,
 		prop_fields.time != 0 ? time_s : "",
 		prop_fields.size != 0 ? size_s : "");
 
-	free(t_ctype);
-	free(size_type);
-
 	return EXIT_SUCCESS;
 }
 
+/* Queue a background size job for each directory (or symbolic link to
+ * a directory) in ARGS, and start the threads running them */
+static void
+start_size_jobs(char **args, const char *skip, struct size_job_t **job_of)
+{
+	size_pool.jobs = (struct size_job_t *)xnmalloc(args_n + 1,
+		sizeof(struct size_job_t));
+	size_pool.n = 0;
+
+	size_t i;
+	for (i = 1; i <= args_n; i++) {
+		job_of[i] = (struct size_job_t *)NULL;
+		if (skip[i] == 1)
+			continue;
+
+		struct stat a;
+		if (lstat(args[i], &a) == -1)
+			continue;
+
+		char *path = (char *)NULL;
+		if (S_ISDIR(a.st_mode)) {
+			path = savestring(args[i], strlen(args[i]));
+		} else if (S_ISLNK(a.st_mode) && stat(args[i], &a) != -1
+		&& S_ISDIR(a.st_mode)) {
+			/* As du(1), follow the link if the path ends with a slash */
+			const size_t len = strlen(args[i]);
+			path = (char *)xnmalloc(len + 2, sizeof(char));
+			snprintf(path, len + 2, "%s/", args[i]);
+		} else {
+			continue;
+		}
+
+		struct size_job_t *job = &size_pool.jobs[size_pool.n];
+		job->path = path;
+		job->ret = ECANCELED;
+		job_of[i] = job;
+		size_pool.n++;
+	}
+
+	if (size_pool.n == 0)
+		return;
+
+	pool_init(&size_pool.pool, size_pool.n, run_size_job, NULL);
+	size_pool.pool.cancel = &size_canceled;
+	pool_start(&size_pool.pool, 0);
+}
+
+static void
+add_props_total(struct props_total_t *t, char *name, struct size_job_t *job)
+{
+	struct tree_size_t ts;
+	if (job) {
+		wait_size_job(job);
+		if (job->ret != 0)
+			return;
+		ts = job->ts;
+	} else if (tree_size(name, &ts, &size_canceled) != 0) {
+		return;
+	}
+
+	t->size += ts.size;
+	t->files += ts.files;
+	t->dirs += ts.dirs;
+
+	if (!t->largest || ts.size > t->largest_size) {
+		t->largest = name;
+		t->largest_size = ts.size;
+	}
+}
+
+static void
+print_props_total(const struct props_total_t *t)
+{
+	char *size = get_size_unit(t->size);
+	char *largest = get_size_unit(t->largest_size);
+	char *cb = conf.colorize == 1 ? BOLD : df_c;
+
+	printf(_("\n%sTotal%s: %s%s%s (%s%s) in %s%zu%s %s and %s%zu%s %s\n"),
+		cb, df_c, cb, size ? size : "?", df_c,
+		conf.apparent_size == 1 ? _("apparent") : _("real"),
+		xargs.si == 1 ? " / si" : "",
+		cb, t->files, df_c, t->files == 1 ? _("file") : _("files"),
+		cb, t->dirs, df_c, t->dirs == 1 ? _("directory") : _("directories"));
+
+	if (t->largest)
+		printf(_("%sLargest%s: %s (%s%s%s)\n"), cb, df_c, t->largest,
+			cb, largest ? largest : "?", df_c);
+
+	free(size);
+	free(largest);
+}
+
 int
 properties_function(char **args)
 {
@@ -1835,6 +2232,9 @@ properties_function(char **args)
 	if (*args[0] == 'p' && args[0][1] == 'p' && !args[0][2])
 		_dir_size = 1;
 
+	/* Files that could not be dequoted */
+	char *skip = (char *)xcalloc(args_n + 1, sizeof(char));
+
 	/* If "pr file..." */
 	for (i = 1; i <= args_n; i++) {
 		if (strchr(args[i], '\\')) {
@@ -1843,16 +2243,59 @@ properties_function(char **args)
 				_err(ERR_NO_STORE, NOPRINT_PROMPT, _("pr: %s: Error dequoting "
 					"file name\n"), args[i]);
 				exit_status = EXIT_FAILURE;
+				skip[i] = 1;
 				continue;
 			}
 
 			free(args[i]);
 			args[i] = deq_file;
 		}
+	}
+
+	struct size_job_t **job_of = (struct size_job_t **)xcalloc(args_n + 1,
+		sizeof(struct size_job_t *));
+	if (_dir_size == 1) {
+		/* Let Ctrl-c interrupt long size computations */
+		size_canceled = 0;
+		signal(SIGINT, size_sigint_handler);
+		start_size_jobs(args, skip, job_of);
+	}
+
+	struct props_total_t total = {0};
+
+	for (i = 1; i <= args_n && size_canceled == 0; i++) {
+		if (skip[i] == 1)
+			continue;
+
+		if (get_properties(args[i], _dir_size, job_of[i]) != 0) {
+			exit_status = EXIT_FAILURE;
+			continue;
+		}
+
+		if (_dir_size == 1 && args_n > 1)
+			add_props_total(&total, args[i], job_of[i]);
+	}
+
+	if (_dir_size == 1 && args_n > 1 && total.largest && size_canceled == 0)
+		print_props_total(&total);
+
+	if (_dir_size == 1 && size_pool.n > 0) {
+		/* Jobs not waited for (files that could not be accessed) */
+		pool_finish(&size_pool.pool);
+		for (i = 0; i < size_pool.n; i++)
+			free(size_pool.jobs[i].path);
+	}
 
-		if (get_properties(args[i], _dir_size) != 0)
+	if (_dir_size == 1) {
+		free(size_pool.jobs);
+		size_pool.jobs = (struct size_job_t *)NULL;
+		size_pool.n = 0;
+		signal(SIGINT, SIG_IGN);
+		if (size_canceled == 1)
 			exit_status = EXIT_FAILURE;
 	}
 
+	free(job_of);
+	free(skip);
 	return exit_status;
 }
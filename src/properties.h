@@ -55,6 +55,7 @@
 
 __BEGIN_DECLS
 
+void clear_props_cache(void);
 int  properties_function(char **);
 void print_analysis_stats(off_t, off_t, char *, char *);
 int  print_entry_props(const struct fileinfo *, size_t, const size_t,
@@ -55,6 +55,8 @@ typedef char *rl_cpvfunc_t;
 
 #include "misc.h"
 #include "aux.h"
+#include "history.h"
+#include "bookmarks.h"
 #include "checks.h"
 #include "exec.h"
 #include "fuzzy_match.h"
@@ -64,6 +66,7 @@ typedef char *rl_cpvfunc_t;
 #include "tabcomp.h"
 #include "mime.h"
 #include "tags.h"
+#include "watch.h"
 
 #ifndef _NO_SUGGESTIONS
 # include "suggestions.h"
@@ -785,6 +788,10 @@ my_rl_getc(FILE *stream)
 	}
 
 	while (1) {
+#ifdef LINUX_INOTIFY
+		/* Refresh the files list if modified while waiting for input */
+		wait_for_input(fileno(stream));
+#endif /* LINUX_INOTIFY */
 		result = (int)read(fileno(stream), &c, sizeof(unsigned char)); /* flawfinder: ignore */
 		if (result > 0 && result == sizeof(unsigned char)) {
 			/* Ctrl-d (empty command line only). Let's check the previous
@@ -1594,9 +1601,10 @@ bookmarks_generator(const char *text, int state)
 	if (!bookmarks || bm_n == 0)
 		return (char *)NULL;
 
-	static int i;
+	static size_t i, n;
 	static size_t len;
 	static int prefix;
+	static size_t *ids;
 	char *name;
 
 	if (!state) {
@@ -1606,16 +1614,14 @@ bookmarks_generator(const char *text, int state)
 		i = 0;
 		prefix = (*text == 'b' && *(text + 1) == ':') ? 2 : 0;
 		len = strlen(text + prefix);
+		/* Named bookmarks matching TEXT, case insensitively */
+		n = get_bm_name_range(text + prefix, len, &ids);
 	}
 
-	/* Look for bookmarks in bookmark names for a match */
-	while ((size_t)i < bm_n) {
-		name = bookmarks[i++].name;
-		if (!name || !*name)
-			continue;
+	while (i < n) {
+		name = bookmarks[ids[i++]].name;
 
-		if ((conf.case_sens_list == 1 ? strncmp(name, text + prefix, len)
-		: strncasecmp(name, text + prefix, len)) != 0)
+		if (conf.case_sens_list == 1 && strncmp(name, text + prefix, len) != 0)
 			continue;
 
 		if (prefix == 2) {
@@ -1679,30 +1685,38 @@ bm_paths_generator(const char *text, int state)
 	if (!bookmarks || bm_n == 0)
 		return (char *)NULL;
 
-	static int i;
+	static size_t i, n, len;
+	static size_t *ids;
 	char *name, *_path;
 
-	if (!state)
+	if (!state) {
 		i = 0;
+		len = strlen(text);
+		n = get_bm_name_range(text, len, &ids);
+	}
 
-	while (i < (int)bm_n) {
-		name = bookmarks[i].name;
-		_path = bookmarks[i].path;
+	while (i < n) {
+		name = bookmarks[ids[i]].name;
+		_path = bookmarks[ids[i]].path;
 		i++;
 
-		if (!name || !_path || (conf.case_sens_list == 1 ? strcmp(name, text)
-		: strcasecmp(name, text)) != 0)
+		if (!_path || name[len] != '\0'
+		|| (conf.case_sens_list == 1 && strcmp(name, text) != 0))
 			continue;
 
-		size_t plen = strlen(_path);
+		/* Do not modify the bookmark path: it is a key in the bookmarks
+		 * index */
+		char tmp[PATH_MAX + 1];
+		xstrsncpy(tmp, _path, sizeof(tmp) - 1);
+		size_t plen = strlen(tmp);
 
-		if (plen > 1 && _path[plen - 1] == '/')
-			_path[plen - 1] = '\0';
+		if (plen > 1 && tmp[plen - 1] == '/')
+			tmp[plen - 1] = '\0';
 
-		char *p = abbreviate_file_name(_path);
-		char *ret = strdup(p ? p : _path);
+		char *p = abbreviate_file_name(tmp);
+		char *ret = strdup(p ? p : tmp);
 
-		if (p != _path)
+		if (p != tmp)
 			free(p);
 
 		return ret;
@@ -1972,7 +1986,8 @@ dirhist_generator(const char *text, int state)
 	}
 
 	while ((name = old_pwd[i++]) != NULL) {
-		if (*name == _ESC)
+		/* Skip invalid entries and older duplicates */
+		if (*name == _ESC || dirhist_is_latest(i - 1) == 0)
 			continue;
 
 		if (!text || !*text)
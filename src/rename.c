@@ -0,0 +1,445 @@
+/* rename.c -- plan and run renames of several files at once */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The rename planner, used by both bulk_rename() and bleach_files()
+ * Renaming files one after the other, in the order given by the user,
+ * breaks as soon as the target of a rename is the source of another one
+ * (a->b, b->c), and cannot work at all for swaps (a->b, b->a). So,
+ * before renaming anything, the whole list is validated (no missing
+ * sources, no duplicate or already existing targets) and turned into
+ * a graph: each rename depends on the rename whose source is its own
+ * target. Since sources and targets are unique, this graph is made of
+ * disjoint paths and cycles. Each path is run backwards (the rename
+ * whose target is free goes first), and each cycle is broken by moving
+ * one of its files to a temporary name first.
+ *
+ * Paths and cycles (chains) are independent of each other, so that
+ * large plans are run by a worker pool (see pool_run()). Files are never
+ * overwritten (renameat2(RENAME_NOREPLACE), where available), and, if
+ * some rename fails, everything done so far is undone. */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aux.h"
+#include "misc.h"
+#include "rename.h"
+#include "strings.h"
+
+/* Plans with fewer chains than this are run by the current thread only */
+#define RENAME_PARALLEL_MIN 64
+
+/* Rename FROM into TO, failing with EEXIST instead of replacing TO if
+ * it exists. Returns zero on success or errno on error */
+static int
+rename_noreplace(const char *from, const char *to)
+{
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+	if (renameat2(AT_FDCWD, from, AT_FDCWD, to, RENAME_NOREPLACE) == 0)
+		return 0;
+	/* EINVAL: RENAME_NOREPLACE not supported by the file system */
+	if (errno != EINVAL && errno != ENOSYS && errno != EEXIST)
+		return errno;
+#endif /* __linux__ && RENAME_NOREPLACE */
+
+	struct stat a, b;
+	if (lstat(to, &b) == 0) {
+		/* Only allowed if FROM and TO are the same file, for example,
+		 * when changing case on a case insensitive file system */
+		if (lstat(from, &a) == -1 || a.st_dev != b.st_dev
+		|| a.st_ino != b.st_ino)
+			return EEXIST;
+	}
+
+	return renameat(AT_FDCWD, from, AT_FDCWD, to) == -1 ? errno : 0;
+}
+
+void
+free_rename_plan(struct rename_plan_t *plan)
+{
+	if (!plan)
+		return;
+
+	size_t i;
+	for (i = 0; i < plan->tmp_n; i++)
+		free(plan->tmp_names[i]);
+	free(plan->tmp_names);
+	free(plan->steps);
+	free(plan->chains);
+	free(plan);
+}
+
+static int
+compare_src(const void *a, const void *b)
+{
+	const struct rename_t *x = *(struct rename_t *const *)a;
+	const struct rename_t *y = *(struct rename_t *const *)b;
+	return strcmp(x->src, y->src);
+}
+
+/* Return the index in R of the entry whose source is NAME, or -1 */
+static ssize_t
+find_src(struct rename_t **by_src, const size_t n, struct rename_t *r,
+	char *name)
+{
+	struct rename_t key = { name, NULL };
+	struct rename_t *k = &key;
+	struct rename_t **p = (struct rename_t **)bsearch(&k, by_src, n,
+		sizeof(struct rename_t *), compare_src);
+
+	return p ? (ssize_t)(*p - r) : -1;
+}
+
+/* Return a temporary name, next to the file SRC, for the cycle number N */
+static char *
+gen_tmp_name(const char *src, const size_t n)
+{
+	const char *s = strrchr(src, '/');
+	const int dir_len = s ? (int)(s - src + 1) : 0;
+	const size_t len = (size_t)dir_len + 64;
+
+	char *p = (char *)xnmalloc(len, sizeof(char));
+	snprintf(p, len, "%.*s.%s-rename.%d.%zu", dir_len, src, PROGRAM_NAME,
+		(int)getpid(), n);
+
+	return p;
+}
+
+static int
+check_renames(const char *cmd, struct rename_t *r, const size_t n,
+	struct rename_t **by_src, int *dirs)
+{
+	size_t i;
+	struct stat a;
+
+	for (i = 0; i < n; i++) {
+		if (lstat(r[i].src, &a) == -1) {
+			_err(ERR_NO_STORE, NOPRINT_PROMPT, "%s: %s: %s\n", cmd,
+				r[i].src, strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		if (S_ISDIR(a.st_mode))
+			*dirs = 1;
+
+		if (i > 0 && strcmp(by_src[i]->src, by_src[i - 1]->src) == 0) {
+			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: %s: Duplicate "
+				"source file\n"), cmd, by_src[i]->src);
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct strset_t targets;
+	strset_init(&targets, n);
+	int ret = EXIT_SUCCESS;
+
+	for (i = 0; i < n; i++) {
+		if (strset_add(&targets, r[i].dst) == 1)
+			continue;
+
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: %s: Duplicate target "
+			"file name\n"), cmd, r[i].dst);
+		ret = EXIT_FAILURE;
+		break;
+	}
+
+	strset_free(&targets);
+	return ret;
+}
+
+/* Append the step FROM->TO to PLAN */
+static void
+add_step(struct rename_plan_t *plan, char *from, char *to)
+{
+	plan->steps[plan->steps_n].from = from;
+	plan->steps[plan->steps_n].to = to;
+	plan->steps_n++;
+}
+
+static void
+add_chain(struct rename_plan_t *plan, const size_t first)
+{
+	struct rename_chain_t *c = &plan->chains[plan->chains_n];
+	c->first = first;
+	c->n = plan->steps_n - first;
+	c->done = 0;
+	c->err = 0;
+	plan->chains_n++;
+}
+
+/* Build a plan to rename the N files in R (R[I].SRC into R[I].DST).
+ * Entries whose source and target are the same are ignored.
+ * Returns NULL (after printing the reason, prefixed by CMD) if the
+ * renames cannot be made: a missing source file, duplicate sources or
+ * targets, or a target that exists and is not going to be renamed.
+ * Nothing is renamed here */
+struct rename_plan_t *
+plan_renames(const char *cmd, struct rename_t *rr, const size_t nn)
+{
+	/* Drop unchanged entries */
+	struct rename_t *r = (struct rename_t *)xnmalloc(nn + 1,
+		sizeof(struct rename_t));
+	size_t i, n = 0;
+	for (i = 0; i < nn; i++) {
+		if (!rr[i].src || !*rr[i].src || !rr[i].dst || !*rr[i].dst) {
+			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: Empty file name\n"),
+				cmd);
+			free(r);
+			return (struct rename_plan_t *)NULL;
+		}
+		if (strcmp(rr[i].src, rr[i].dst) == 0)
+			continue;
+		r[n] = rr[i];
+		n++;
+	}
+
+	struct rename_t **by_src = (struct rename_t **)xnmalloc(n + 1,
+		sizeof(struct rename_t *));
+	for (i = 0; i < n; i++)
+		by_src[i] = &r[i];
+	qsort(by_src, n, sizeof(struct rename_t *), compare_src);
+
+	int dirs = 0;
+	if (check_renames(cmd, r, n, by_src, &dirs) == EXIT_FAILURE) {
+		free(by_src);
+		free(r);
+		return (struct rename_plan_t *)NULL;
+	}
+
+	/* NEXT[I] is the rename that must be run before I: the one whose
+	 * source is the target of I. PREV is the other way around */
+	ssize_t *next = (ssize_t *)xnmalloc(n + 1, sizeof(ssize_t));
+	ssize_t *prev = (ssize_t *)xnmalloc(n + 1, sizeof(ssize_t));
+	for (i = 0; i < n; i++)
+		prev[i] = -1;
+
+	int ret = EXIT_SUCCESS;
+	for (i = 0; i < n; i++) {
+		next[i] = find_src(by_src, n, r, r[i].dst);
+		if (next[i] != -1) {
+			prev[next[i]] = (ssize_t)i;
+			continue;
+		}
+
+		/* The target is not going to be renamed: it must not exist */
+		struct stat a, b;
+		if (lstat(r[i].dst, &b) == -1 || (lstat(r[i].src, &a) == 0
+		&& a.st_dev == b.st_dev && a.st_ino == b.st_ino))
+			continue;
+
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "%s: %s: %s\n", cmd,
+			r[i].dst, strerror(EEXIST));
+		ret = EXIT_FAILURE;
+		break;
+	}
+
+	free(by_src);
+
+	if (ret == EXIT_FAILURE) {
+		free(next);
+		free(prev);
+		free(r);
+		return (struct rename_plan_t *)NULL;
+	}
+
+	struct rename_plan_t *plan = (struct rename_plan_t *)xcalloc(1,
+		sizeof(struct rename_plan_t));
+	/* A cycle of N renames takes N + 1 steps */
+	plan->steps = (struct rename_step_t *)xnmalloc(n * 2 + 1,
+		sizeof(struct rename_step_t));
+	plan->chains = (struct rename_chain_t *)xnmalloc(n + 1,
+		sizeof(struct rename_chain_t));
+	plan->renames = n;
+
+	char *visited = (char *)xcalloc(n + 1, sizeof(char));
+	size_t *path = (size_t *)xnmalloc(n + 1, sizeof(size_t));
+
+	/* 1. Paths: start at each rename nobody depends on, and run them
+	 * from the end (whose target is free) */
+	for (i = 0; i < n; i++) {
+		if (prev[i] != -1)
+			continue;
+
+		size_t len = 0;
+		ssize_t j;
+		for (j = (ssize_t)i; j != -1; j = next[j]) {
+			visited[j] = 1;
+			path[len++] = (size_t)j;
+		}
+
+		const size_t first = plan->steps_n;
+		while (len-- > 0)
+			add_step(plan, r[path[len]].src, r[path[len]].dst);
+		add_chain(plan, first);
+	}
+
+	/* 2. Cycles: whatever was not visited. Move the first file out of
+	 * the way, run the cycle backwards, and move the first file into
+	 * its target */
+	for (i = 0; i < n; i++) {
+		if (visited[i] == 1)
+			continue;
+
+		size_t len = 0;
+		ssize_t j = (ssize_t)i;
+		do {
+			visited[j] = 1;
+			path[len++] = (size_t)j;
+			j = next[j];
+		} while (j != (ssize_t)i);
+
+		char *tmp = gen_tmp_name(r[i].src, plan->tmp_n);
+		plan->tmp_names = (char **)xrealloc(plan->tmp_names,
+			(plan->tmp_n + 1) * sizeof(char *));
+		plan->tmp_names[plan->tmp_n] = tmp;
+		plan->tmp_n++;
+
+		const size_t first = plan->steps_n;
+		add_step(plan, r[i].src, tmp);
+		while (len-- > 1)
+			add_step(plan, r[path[len]].src, r[path[len]].dst);
+		add_step(plan, tmp, r[i].dst);
+		add_chain(plan, first);
+	}
+
+	/* Renaming a directory changes the path of everything under it:
+	 * keep the original order if directories are involved */
+	plan->parallel = (dirs == 0 && plan->chains_n >= RENAME_PARALLEL_MIN);
+
+	free(path);
+	free(visited);
+	free(next);
+	free(prev);
+	free(r);
+
+	return plan;
+}
+
+/* Print PLAN as a shell script (one mv(1) command per step), so that it
+ * can be both parsed and run as is */
+void
+print_rename_plan(const struct rename_plan_t *plan)
+{
+	size_t i;
+	for (i = 0; i < plan->steps_n; i++) {
+		char *f = escape_str(plan->steps[i].from);
+		char *t = escape_str(plan->steps[i].to);
+		printf("mv -- %s %s\n", f ? f : plan->steps[i].from,
+			t ? t : plan->steps[i].to);
+		free(f);
+		free(t);
+	}
+}
+
+struct rename_run_t {
+	struct rename_plan_t *plan;
+	struct pool_t pool;
+};
+
+/* Run the chain I. If some rename fails, no more chains are run */
+static void
+run_rename_chain(void *arg, const size_t i)
+{
+	struct rename_run_t *r = (struct rename_run_t *)arg;
+	struct rename_chain_t *c = &r->plan->chains[i];
+
+	for (; c->done < c->n; c->done++) {
+		struct rename_step_t *s = &r->plan->steps[c->first + c->done];
+		c->err = rename_noreplace(s->from, s->to);
+		if (c->err == 0)
+			continue;
+
+		pool_stop(&r->pool);
+		break;
+	}
+}
+
+/* Undo all steps run so far, last first. Returns the number of steps
+ * that could not be undone */
+static size_t
+rollback_renames(const char *cmd, struct rename_plan_t *plan)
+{
+	size_t i = plan->chains_n, errs = 0;
+	while (i-- > 0) {
+		struct rename_chain_t *c = &plan->chains[i];
+		while (c->done > 0) {
+			struct rename_step_t *s = &plan->steps[c->first + c->done - 1];
+			int ret = rename_noreplace(s->to, s->from);
+			if (ret != 0) {
+				_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: %s: Cannot "
+					"restore file name: %s\n"), cmd, s->to, strerror(ret));
+				errs++;
+			}
+			c->done--;
+		}
+	}
+
+	return errs;
+}
+
+/* Run PLAN. If some rename fails, every rename made so far is undone.
+ * Returns zero on success or one on error. The number of renamed files
+ * is written into RENAMED */
+int
+run_rename_plan(const char *cmd, struct rename_plan_t *plan, size_t *renamed)
+{
+	*renamed = 0;
+	if (!plan || plan->steps_n == 0)
+		return EXIT_SUCCESS;
+
+	struct rename_run_t r;
+	r.plan = plan;
+	pool_init(&r.pool, plan->chains_n, run_rename_chain, &r);
+	if (plan->parallel == 0)
+		r.pool.max_threads = 1;
+	pool_run(&r.pool);
+
+	size_t i;
+	if (r.pool.stop == 0) {
+		*renamed = plan->renames;
+		return EXIT_SUCCESS;
+	}
+
+	for (i = 0; i < plan->chains_n; i++) {
+		struct rename_chain_t *c = &plan->chains[i];
+		if (c->err != 0) {
+			_err(ERR_NO_STORE, NOPRINT_PROMPT, "%s: %s: %s\n", cmd,
+				plan->steps[c->first + c->done].from, strerror(c->err));
+		}
+	}
+
+	size_t errs = rollback_renames(cmd, plan);
+	if (errs == 0) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: No file was renamed\n"),
+			cmd);
+	}
+
+	return EXIT_FAILURE;
+}
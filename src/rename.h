@@ -0,0 +1,72 @@
+/* rename.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef RENAME_H
+#define RENAME_H
+
+/* A file to be renamed */
+struct rename_t {
+	char *src;
+	char *dst;
+};
+
+/* A single call to rename(2). Steps moving a file to or from a
+ * temporary name are used to break rename cycles (a->b, b->a) */
+struct rename_step_t {
+	char *from;
+	char *to;
+};
+
+/* A sequence of steps that must be run in order. Distinct chains are
+ * independent of each other */
+struct rename_chain_t {
+	size_t first; /* Index of the first step in the steps array */
+	size_t n;     /* Number of steps */
+	size_t done;  /* Number of steps successfully run */
+	int err;      /* errno of the failed step, if any */
+	int pad;
+};
+
+struct rename_plan_t {
+	struct rename_step_t *steps;
+	struct rename_chain_t *chains;
+	char **tmp_names;
+	size_t steps_n;
+	size_t chains_n;
+	size_t tmp_n;    /* Number of cycles (one temporary name each) */
+	size_t renames;  /* Number of files to be renamed */
+	int parallel;    /* Chains can be run concurrently */
+	int pad;
+};
+
+__BEGIN_DECLS
+
+void free_rename_plan(struct rename_plan_t *);
+struct rename_plan_t *plan_renames(const char *, struct rename_t *, const size_t);
+void print_rename_plan(const struct rename_plan_t *);
+int  run_rename_plan(const char *, struct rename_plan_t *, size_t *);
+
+__END_DECLS
+
+#endif /* RENAME_H */
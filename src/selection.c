@@ -47,6 +47,7 @@
 #include "listing.h"
 #include "misc.h"
 #include "navigation.h"
+#include "persist.h"
 #include "readline.h"
 #include "selection.h"
 #include "sort.h"
@@ -77,7 +78,8 @@ save_sel(void)
 		return EXIT_SUCCESS;
 	}
 
-	FILE *fp = fopen(sel_file, "w");
+	struct persist_t p;
+	FILE *fp = persist_open(&p, sel_file, PERSIST_SYNC);
 	if (!fp) {
 		_err(0, NOPRINT_PROMPT, "sel: %s: %s\n", sel_file, strerror(errno));
 		return EXIT_FAILURE;
@@ -89,44 +91,182 @@ save_sel(void)
 		fputc('\n', fp);
 	}
 
-	fclose(fp);
+	if (persist_commit(&p) != EXIT_SUCCESS) {
+		_err(0, NOPRINT_PROMPT, "sel: %s: %s\n", sel_file, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
 	return EXIT_SUCCESS;
 }
 
-int
-select_file(char *file)
+/* Add FILE to the selection box, unless already there. If SELECTED is not
+ * NULL, it is the set of currently selected files, used to check FILE
+ * in constant time (for large batches of files), and FILE is added to it.
+ * Returns 1 if FILE was selected or 0 otherwise */
+static int
+add_sel_file(char *file, struct strset_t *selected)
 {
 	if (!file || !*file)
 		return 0;
 
-	int exists = 0, new_sel = 0, j;
 	size_t flen = strlen(file);
-	if (flen > 1 && file[flen - 1] == '/')
-		file[flen - 1] = '\0';
+	if (flen > 1 && file[flen - 1] == '/') {
+		flen--;
+		file[flen] = '\0';
+	}
 
 	/* Check if FILE is already in the selection box */
-	j = (int)sel_n;
-	while (--j >= 0) {
-		if (*file == *sel_elements[j].name
-		&& strcmp(sel_elements[j].name, file) == 0) {
-			exists = 1;
-			break;
+	int exists = 0;
+	if (selected) {
+		exists = strset_has(selected, file);
+	} else {
+		int j = (int)sel_n;
+		while (--j >= 0) {
+			if (*file == *sel_elements[j].name
+			&& strcmp(sel_elements[j].name, file) == 0) {
+				exists = 1;
+				break;
+			}
 		}
 	}
 
-	if (exists == 0) {
-		sel_elements = (struct sel_t *)xrealloc(sel_elements, (sel_n + 2) * sizeof(struct sel_t));
-		sel_elements[sel_n].name = savestring(file, strlen(file));
-		sel_elements[sel_n].size = (off_t)UNSET;
-		sel_n++;
-		sel_elements[sel_n].name = (char *)NULL;
-		sel_elements[sel_n].size = (off_t)UNSET;
-
-		new_sel++;
-	} else {
+	if (exists == 1) {
 		fprintf(stderr, _("sel: %s: Already selected\n"), file);
+		return 0;
 	}
 
+	sel_elements = (struct sel_t *)xrealloc(sel_elements, (sel_n + 2) * sizeof(struct sel_t));
+	sel_elements[sel_n].name = savestring(file, flen);
+	sel_elements[sel_n].size = (off_t)UNSET;
+	if (selected)
+		strset_add(selected, sel_elements[sel_n].name);
+	sel_n++;
+	sel_elements[sel_n].name = (char *)NULL;
+	sel_elements[sel_n].size = (off_t)UNSET;
+
+	return 1;
+}
+
+int
+select_file(char *file)
+{
+	return add_sel_file(file, NULL);
+}
+
+/* Initialize SET with the names of all currently selected files */
+static void
+init_selected_set(struct strset_t *set, const size_t n)
+{
+	strset_init(set, sel_n + n);
+
+	size_t i;
+	for (i = 0; i < sel_n; i++)
+		strset_add(set, sel_elements[i].name);
+}
+
+/* Select the file NAME, in DIR (or in the current directory, if DIR is NULL) */
+static int
+select_file_in_dir(const char *dir, const char *name, struct strset_t *selected)
+{
+	if (*name == '/')
+		return add_sel_file((char *)name, selected);
+
+	if (!dir)
+		dir = workspaces[cur_ws].path;
+	if (*dir == '/' && !dir[1])
+		dir = "";
+
+	char *tmp = (char *)xnmalloc(strlen(dir) + strlen(name) + 2, sizeof(char));
+	sprintf(tmp, "%s/%s", dir, name);
+	const int ret = add_sel_file(tmp, selected);
+	free(tmp);
+
+	return ret;
+}
+
+/* How file names in a listing are matched by sel_listing(): either
+ * against a regular expression, or against a set of names (the results
+ * of a glob pattern). Only one of them is used */
+struct sel_match_t {
+	regex_t *regex;
+	struct strset_t *names;
+	int invert;
+	int pad;
+};
+
+static int
+sel_name_matches(const struct sel_match_t *m, const char *name)
+{
+	const int found = m->regex
+		? regexec(m->regex, name, 0, NULL, 0) == EXIT_SUCCESS
+		: strset_has(m->names, name);
+
+	return m->invert == 1 ? !found : found;
+}
+
+/* Select all files in SEL_PATH (or in the current directory, if SEL_PATH is
+ * NULL) whose type is FILETYPE (a DT macro, or zero for any type) and
+ * whose name is matched by M. Both filters are applied in a single pass
+ * over the directory listing.
+ * Returns the number of selected files, or -1 on error */
+static int
+sel_listing(const char *sel_path, const mode_t filetype,
+	const struct sel_match_t *m)
+{
+	int new_sel = 0, i;
+	struct strset_t selected;
+
+	if (!sel_path) {
+		init_selected_set(&selected, files);
+
+		for (i = 0; i < (int)files; i++) {
+			if (filetype && file_info[i].type != filetype)
+				continue;
+			if (sel_name_matches(m, file_info[i].name) == 1)
+				new_sel += select_file_in_dir(NULL, file_info[i].name,
+					&selected);
+		}
+
+		strset_free(&selected);
+		return new_sel;
+	}
+
+	struct dirent **list = (struct dirent **)NULL;
+	const int filesn = scandir(sel_path, &list, skip_files, xalphasort);
+	if (filesn == -1) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "sel: %s: %s\n",
+			sel_path, strerror(errno));
+		return (-1);
+	}
+
+	init_selected_set(&selected, (size_t)filesn);
+
+	for (i = 0; i < filesn; i++) {
+		if (filetype) {
+			mode_t type = DT_UNKNOWN;
+#if defined(_DIRENT_HAVE_D_TYPE)
+			type = list[i]->d_type;
+#endif /* _DIRENT_HAVE_D_TYPE */
+			if (type == DT_UNKNOWN) {
+				struct stat attr;
+				if (lstat(list[i]->d_name, &attr) != -1)
+					type = get_dt(attr.st_mode);
+			}
+
+			if (type != filetype)
+				continue;
+		}
+
+		if (sel_name_matches(m, list[i]->d_name) == 1)
+			new_sel += select_file_in_dir(sel_path, list[i]->d_name,
+				&selected);
+	}
+
+	for (i = 0; i < filesn; i++)
+		free(list[i]);
+	free(list);
+	strset_free(&selected);
+
 	return new_sel;
 }
 
@@ -157,157 +297,64 @@ sel_glob(char *str, const char *sel_path, mode_t filetype)
 		return 0;
 	}
 
-	char **matches = (char **)NULL;
-	int i, k = 0;
-	struct dirent **ent = (struct dirent **)NULL;
+	size_t i;
+	int new_sel = 0;
 
 	if (invert) {
-		if (!sel_path) {
-			matches = (char **)xnmalloc(files + 2, sizeof(char *));
-
-			i = (int)files;
-			while (--i >= 0) {
-				if (filetype && file_info[i].type != filetype)
-					continue;
-
-				int found = 0;
-				int j = (int)gbuf.gl_pathc;
-				while (--j >= 0) {
-					if (*file_info[i].name == *gbuf.gl_pathv[j]
-					&& strcmp(file_info[i].name, gbuf.gl_pathv[j]) == 0) {
-						found = 1;
-						break;
-					}
-				}
-
-				if (!found) {
-					matches[k] = file_info[i].name;
-					k++;
-				}
-			}
-		} else {
-			ret = scandir(sel_path, &ent, skip_files, xalphasort);
-			if (ret == -1) {
-				_err(ERR_NO_STORE, NOPRINT_PROMPT, "sel: %s: %s\n",
-					sel_path, strerror(errno));
-				globfree(&gbuf);
-				return (-1);
-			}
-
-			matches = (char **)xnmalloc((size_t)ret + 2, sizeof(char *));
-
-			i = ret;
-			while (--i >= 0) {
-#if !defined(_DIRENT_HAVE_D_TYPE)
-				mode_t type;
-				struct stat attr;
-				if (lstat(ent[i]->d_name, &attr) == -1)
-					continue;
-				type = get_dt(attr.st_mode);
-				if (filetype && type != filetype)
-#else
-				if (filetype && ent[i]->d_type != filetype)
-#endif
-					continue;
-
-				int j = (int)gbuf.gl_pathc;
-				while (--j >= 0) {
-					if (*ent[i]->d_name == *gbuf.gl_pathv[j]
-					&& strcmp(ent[i]->d_name, gbuf.gl_pathv[j]) == 0)
-						break;
-				}
-
-				if (j == -1) {
-					matches[k] = ent[i]->d_name;
-					k++;
-				}
-			}
-		}
+		/* Select every file in the listing not matched by PATTERN */
+		struct strset_t names;
+		strset_init(&names, gbuf.gl_pathc);
+		for (i = 0; i < gbuf.gl_pathc; i++)
+			strset_add(&names, gbuf.gl_pathv[i]);
+
+		struct sel_match_t m = {0};
+		m.names = &names;
+		m.invert = 1;
+		new_sel = sel_listing(sel_path, filetype, &m);
+
+		strset_free(&names);
+		globfree(&gbuf);
+		return new_sel;
 	}
 
-	else {
-		matches = (char **)xnmalloc(gbuf.gl_pathc + 2,
-		    sizeof(char *));
-		mode_t t = 0;
-		if (filetype) {
-			switch (filetype) {
-			case DT_DIR: t = S_IFDIR; break;
-			case DT_REG: t = S_IFREG; break;
-			case DT_LNK: t = S_IFLNK; break;
-			case DT_SOCK: t = S_IFSOCK; break;
-			case DT_FIFO: t = S_IFIFO; break;
-			case DT_BLK: t = S_IFBLK; break;
-			case DT_CHR: t = S_IFCHR; break;
-			default: break;
-			}
+	mode_t t = 0;
+	if (filetype) {
+		switch (filetype) {
+		case DT_DIR: t = S_IFDIR; break;
+		case DT_REG: t = S_IFREG; break;
+		case DT_LNK: t = S_IFLNK; break;
+		case DT_SOCK: t = S_IFSOCK; break;
+		case DT_FIFO: t = S_IFIFO; break;
+		case DT_BLK: t = S_IFBLK; break;
+		case DT_CHR: t = S_IFCHR; break;
+		default: break;
 		}
+	}
 
-		i = (int)gbuf.gl_pathc;
-		while (--i >= 0) {
-			/* We need to run stat(3) here, so that the d_type macros
-			 * won't work: convert them into st_mode macros */
-			if (filetype) {
-				struct stat attr;
-				if (lstat(gbuf.gl_pathv[i], &attr) == -1)
-					continue;
-				if ((attr.st_mode & S_IFMT) != t)
-					continue;
-			}
+	struct strset_t selected;
+	init_selected_set(&selected, gbuf.gl_pathc);
 
-			if (*gbuf.gl_pathv[i] == '.' && (!gbuf.gl_pathv[i][1]
-			|| (gbuf.gl_pathv[i][1] == '.' && !gbuf.gl_pathv[i][2])))
+	for (i = 0; i < gbuf.gl_pathc; i++) {
+		/* We need to run stat(3) here, so that the d_type macros
+		 * won't work: convert them into st_mode macros */
+		if (filetype) {
+			struct stat attr;
+			if (lstat(gbuf.gl_pathv[i], &attr) == -1)
+				continue;
+			if ((attr.st_mode & S_IFMT) != t)
 				continue;
-
-			matches[k] = gbuf.gl_pathv[i];
-			k++;
 		}
-	}
 
-	matches[k] = (char *)NULL;
-	int new_sel = 0;
-
-	i = k;
-	while (--i >= 0) {
-		if (!matches[i])
+		if (*gbuf.gl_pathv[i] == '.' && (!gbuf.gl_pathv[i][1]
+		|| (gbuf.gl_pathv[i][1] == '.' && !gbuf.gl_pathv[i][2])))
 			continue;
 
-		if (!sel_path) {
-			if (*matches[i] == '/') {
-				new_sel += select_file(matches[i]);
-			} else {
-				char *tmp = (char *)NULL;
-				if (*workspaces[cur_ws].path == '/'
-				&& !*(workspaces[cur_ws].path + 1)) {
-					tmp = (char *)xnmalloc(strlen(matches[i]) + 2,
-								sizeof(char));
-					sprintf(tmp, "/%s", matches[i]);
-				} else {
-					tmp = (char *)xnmalloc(strlen(workspaces[cur_ws].path)
-								+ strlen(matches[i]) + 2, sizeof(char));
-					sprintf(tmp, "%s/%s", workspaces[cur_ws].path, matches[i]);
-				}
-				new_sel += select_file(tmp);
-				free(tmp);
-			}
-		} else {
-			char *tmp = (char *)xnmalloc(strlen(sel_path)
-						+ strlen(matches[i]) + 2, sizeof(char));
-			sprintf(tmp, "%s/%s", sel_path, matches[i]);
-			new_sel += select_file(tmp);
-			free(tmp);
-		}
+		new_sel += select_file_in_dir(sel_path, gbuf.gl_pathv[i], &selected);
 	}
 
-	free(matches);
+	strset_free(&selected);
 	globfree(&gbuf);
 
-	if (invert && sel_path) {
-		i = ret;
-		while (--i >= 0)
-			free(ent[i]);
-		free(ent);
-	}
-
 	return new_sel;
 }
 
@@ -333,82 +380,10 @@ sel_regex(char *str, const char *sel_path, mode_t filetype)
 		return (-1);
 	}
 
-	int new_sel = 0, i;
-
-	if (!sel_path) { /* Check pattern (STR) against files in CWD */
-		i = (int)files;
-		while (--i >= 0) {
-			if (filetype && file_info[i].type != filetype)
-				continue;
-
-			char tmp_path[PATH_MAX];
-			if (*workspaces[cur_ws].path == '/'
-			&& !*(workspaces[cur_ws].path + 1)) {
-				snprintf(tmp_path, PATH_MAX - 1, "/%s", file_info[i].name);
-			} else {
-				snprintf(tmp_path, PATH_MAX - 1, "%s/%s",
-					workspaces[cur_ws].path, file_info[i].name);
-			}
-
-			if (regexec(&regex, file_info[i].name, 0, NULL, 0) == EXIT_SUCCESS) {
-				if (!invert)
-					new_sel += select_file(tmp_path);
-			} else if (invert) {
-				new_sel += select_file(tmp_path);
-			}
-		}
-	} else { /* Check pattern against files in SEL_PATH */
-		struct dirent **list = (struct dirent **)NULL;
-		int filesn = scandir(sel_path, &list, skip_files, xalphasort);
-
-		if (filesn == -1) {
-			_err(ERR_NO_STORE, NOPRINT_PROMPT, "sel: %s: %s\n",
-				sel_path, strerror(errno));
-			return (-1);
-		}
-
-		mode_t t = 0;
-		if (filetype) {
-			switch (filetype) {
-			case DT_DIR: t = S_IFDIR; break;
-			case DT_REG: t = S_IFREG; break;
-			case DT_LNK: t = S_IFLNK; break;
-			case DT_SOCK: t = S_IFSOCK; break;
-			case DT_FIFO: t = S_IFIFO; break;
-			case DT_BLK: t = S_IFBLK; break;
-			case DT_CHR: t = S_IFCHR; break;
-			}
-		}
-
-		i = (int)filesn;
-		while (--i >= 0) {
-			if (filetype) {
-				struct stat attr;
-				if (lstat(list[i]->d_name, &attr) != -1) {
-					if ((attr.st_mode & S_IFMT) != t) {
-						free(list[i]);
-						continue;
-					}
-				}
-			}
-
-			char *tmp_path = (char *)xnmalloc(strlen(sel_path)
-							+ strlen(list[i]->d_name) + 2, sizeof(char));
-			sprintf(tmp_path, "%s/%s", sel_path, list[i]->d_name);
-
-			if (regexec(&regex, list[i]->d_name, 0, NULL, 0) == EXIT_SUCCESS) {
-				if (!invert)
-					new_sel += select_file(tmp_path);
-			} else if (invert) {
-				new_sel += select_file(tmp_path);
-			}
-
-			free(tmp_path);
-			free(list[i]);
-		}
-
-		free(list);
-	}
+	struct sel_match_t m = {0};
+	m.regex = &regex;
+	m.invert = invert;
+	const int new_sel = sel_listing(sel_path, filetype, &m);
 
 	regfree(&regex);
 	return new_sel;
@@ -540,23 +515,160 @@ check_sel_path(char **sel_path)
 	return dir;
 }
 
+/* Total sizes of selected directories are computed in the background by
+ * a worker pool, while the selection box is printed */
+#define SEL_SIZE_CACHE_MAX 4096
+
+/* Total sizes of selected directories, keyed by device and inode number.
+ * Unlike sel_elements, which is rebuilt every time the selections file is
+ * read, the cache survives selection reloads. An entry is valid as long as
+ * the directory modification time does not change */
+struct sel_size_val_t {
+	time_t mtime;
+	off_t size;
+	int apparent; /* Value of ApparentSize when the size was computed */
+	int pad;
+};
+
+static struct inode_set_t sel_size_cache = {NULL, NULL, NULL,
+	sizeof(struct sel_size_val_t), 0, 0};
+
+struct sel_size_job_t {
+	size_t i; /* Index in sel_elements */
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+};
+
+static struct sel_size_pool_t {
+	struct sel_size_job_t *jobs;
+	size_t n;
+	struct pool_t pool;
+} sel_pool;
+
+static void
+cache_sel_size(const struct sel_size_job_t *job)
+{
+	if (job->size < 0)
+		return;
+
+	if (sel_size_cache.n >= SEL_SIZE_CACHE_MAX)
+		inode_set_free(&sel_size_cache);
+
+	struct sel_size_val_t *v = (struct sel_size_val_t *)inode_set_get(
+		&sel_size_cache, job->dev, job->ino, NULL);
+
+	v->mtime = job->mtime;
+	v->size = job->size;
+	v->apparent = conf.apparent_size;
+}
+
+static void
+run_sel_size_job(void *arg, const size_t i)
+{
+	UNUSED(arg);
+	struct sel_size_job_t *job = &sel_pool.jobs[i];
+
+	struct tree_size_t ts;
+	job->size = tree_size(sel_elements[job->i].name, &ts, NULL) == 0
+		? ts.size : (off_t)-1;
+}
+
+/* Set the size of each selected file whose size is still unknown, either
+ * right away (files and cached directories), or by queueing a size job
+ * (directories), and start the threads running these jobs */
+static void
+start_sel_sizes(void)
+{
+	sel_pool.jobs = (struct sel_size_job_t *)NULL;
+	sel_pool.n = 0;
+
+	size_t i;
+	for (i = 0; i < sel_n; i++) {
+		if (sel_elements[i].size != (off_t)UNSET)
+			continue;
+
+		struct stat attr;
+		if (lstat(sel_elements[i].name, &attr) == -1) {
+			sel_elements[i].size = (off_t)-1;
+			continue;
+		}
+
+		if (!S_ISDIR(attr.st_mode)) {
+			sel_elements[i].size = (off_t)FILE_SIZE;
+			continue;
+		}
+
+		const struct sel_size_val_t *v = (struct sel_size_val_t *)
+			inode_set_find(&sel_size_cache, attr.st_dev, attr.st_ino);
+		if (v && v->mtime == attr.st_mtime
+		&& v->apparent == conf.apparent_size) {
+			sel_elements[i].size = v->size;
+			continue;
+		}
+
+		if (!sel_pool.jobs)
+			sel_pool.jobs = (struct sel_size_job_t *)xnmalloc(sel_n,
+				sizeof(struct sel_size_job_t));
+
+		struct sel_size_job_t *job = &sel_pool.jobs[sel_pool.n];
+		job->i = i;
+		job->dev = attr.st_dev;
+		job->ino = attr.st_ino;
+		job->mtime = attr.st_mtime;
+		job->size = (off_t)-1;
+		sel_pool.n++;
+	}
+
+	if (sel_pool.n == 0)
+		return;
+
+	pool_init(&sel_pool.pool, sel_pool.n, run_sel_size_job, NULL);
+	pool_start(&sel_pool.pool, 0);
+}
+
+/* Wait for the size jobs started by start_sel_sizes(), printing the
+ * progress, and return the total size of the selection */
 static off_t
-get_sel_file_size(size_t i)
+finish_sel_sizes(void)
 {
-	if (sel_elements[i].size != (off_t)UNSET)
-		return sel_elements[i].size;
+	size_t i;
 
-	struct stat attr;
-	if (lstat(sel_elements[i].name, &attr) == -1)
-		return (off_t)-1;
+	if (sel_pool.n > 0) {
+		HIDE_CURSOR;
+		size_t done = 0;
+		while (done < sel_pool.n) {
+			printf(_("\rCalculating file size... %zu/%zu"), done, sel_pool.n);
+			fflush(stdout);
+			const size_t d = pool_progress(&sel_pool.pool, done);
+			/* No thread running: the rest is done by pool_finish() */
+			if (d == done)
+				break;
+			done = d;
+		}
+
+		pool_finish(&sel_pool.pool);
+		putchar('\r'); ERASE_TO_RIGHT; UNHIDE_CURSOR; fflush(stdout);
 
-	int base = xargs.si == 1 ? 1000 : 1024;
-	if (S_ISDIR(attr.st_mode))
-		sel_elements[i].size = (off_t)(dir_size(sel_elements[i].name, 0) * base);
-	else
-		sel_elements[i].size = (off_t)FILE_SIZE;
+		for (i = 0; i < sel_pool.n; i++) {
+			sel_elements[sel_pool.jobs[i].i].size = sel_pool.jobs[i].size;
+			cache_sel_size(&sel_pool.jobs[i]);
+		}
+
+		free(sel_pool.jobs);
+		sel_pool.jobs = (struct sel_size_job_t *)NULL;
+		sel_pool.n = 0;
+	}
 
-	return sel_elements[i].size;
+	off_t total = 0;
+	for (i = 0; i < sel_n; i++) {
+		if (sel_elements[i].size != (off_t)-1
+		&& sel_elements[i].size != (off_t)UNSET)
+			total += sel_elements[i].size;
+	}
+
+	return total;
 }
 
 static inline void
@@ -576,28 +688,22 @@ print_selected_files(void)
 	printf(_("%sSelection Box%s\n\n"), BOLD, df_c);
 
 	size_t t = tab_offset, i;
-	off_t total = 0;
 	tab_offset = 0;
 
 	uint8_t epad = DIGINUM(sel_n);
 
+	start_sel_sizes();
+
 	flags |= IN_SELBOX_SCREEN;
 	for (i = 0; i < sel_n; i++) {
 		printf("%s%*zu%s ", el_c, epad, i + 1, df_c);
 		colors_list(sel_elements[i].name, NO_ELN, NO_PAD, PRINT_NEWLINE);
-
-		printf(_("Calculating file size... ")); fflush(stdout);
-		off_t s = get_sel_file_size(i);
-		putchar('\r'); ERASE_TO_RIGHT; fflush(stdout);
-
-		if (s != (off_t)-1)
-			total += s;
 	}
 	flags &= ~IN_SELBOX_SCREEN;
 	tab_offset = t;
 
 	putchar('\n');
-	print_total_size(total);
+	print_total_size(finish_sel_sizes());
 }
 
 static int
@@ -785,12 +891,14 @@ show_sel_files(void)
 	int t_lines = (int)w.ws_row;
 	t_lines -= 2;
 	size_t i;
-	off_t total = 0;
 
 	size_t t = tab_offset;
 	tab_offset = 0;
 	uint8_t epad = DIGINUM(sel_n);
 
+	/* Sizes are computed while the list is printed (and paged) */
+	start_sel_sizes();
+
 	flags |= IN_SELBOX_SCREEN;
 	for (i = 0; i < sel_n; i++) {
 		/* if (pager && counter > (term_lines-2)) { */
@@ -825,18 +933,13 @@ show_sel_files(void)
 
 		printf("%s%*zu%s ", el_c, epad, i + 1, df_c);
 		colors_list(sel_elements[i].name, NO_ELN, NO_PAD, PRINT_NEWLINE);
-
-		printf(_("Calculating file size... ")); fflush(stdout);
-		off_t s = get_sel_file_size(i);
-		putchar('\r'); ERASE_TO_RIGHT; fflush(stdout);
-		if (s != (off_t)-1)
-			total += s;
 	}
 	flags &= ~IN_SELBOX_SCREEN;
 	tab_offset = t;
 
-	char *human_size = get_size_unit(total);
-	printf(_("\n%s%sTotal size%s: %s\n"), df_c, BOLD, df_c, human_size);
+	putchar('\n');
+	char *human_size = get_size_unit(finish_sel_sizes());
+	printf(_("%s%sTotal size%s: %s\n"), df_c, BOLD, df_c, human_size);
 	free(human_size);
 
 	if (reset_pager)
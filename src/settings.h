@@ -283,8 +283,10 @@ xf=01;31:xs=00;32:"
 #define DEF_PRINTSEL 0
 #define DEF_PRINT_REMOVED_FILES 1
 #define DEF_PRIVATE_WS_SETTINGS 0
+#define DEF_WS_CACHE_SIZE 0 /* MiB */
 #define DEF_PROP_FIELDS "fpims" /* Files counter, permissions, owner/grp Ids, mod Time, Size (human readable) */
 #define DEF_PURGE_JUMPDB 0
+#define DEF_REFRESH_DELAY 250 /* Milliseconds */
 #define DEF_REFRESH_ON_EMPTY_LINE 1
 #define DEF_REFRESH_ON_RESIZE 1
 #define DEF_RELATIVE_TIME 0
@@ -387,6 +389,8 @@ alt-down:preview-page-down --inline-info --layout=reverse-list \
 #endif
 
 #define FALLBACK_SHELL "/bin/sh"
+/* Max time (in seconds) a command substitution may take */
+#define CMD_SUBST_TIMEOUT 10
 
 #if defined(__APPLE__)
 # define FALLBACK_OPENER "/usr/bin/open"
@@ -0,0 +1,408 @@
+/* snapshot.c -- binary snapshot of the list of commands found in PATH */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* Scanning PATH is by far the most expensive step of the startup
+ * process: every directory in PATH is read, and every file in it is
+ * checked for execute permission. Since these directories rarely change,
+ * the resulting list is saved into a binary file (SNAPSHOT_FILE, in the
+ * configuration directory), together with the state (device, inode, and
+ * modification time) of each directory in PATH. At startup, if PATH and
+ * the state of all its directories match the ones stored in the
+ * snapshot, the file is mapped into memory and used instead of scanning
+ * PATH again. Command names are used right from the mapped file: the
+ * mapping lives as long as the list of commands (see free_bin_commands()).
+ *
+ * Changing the mode of a file does not change the modification time of
+ * its directory. Files left out for not being executable are few, so
+ * their ctime is recorded as well (see struct snap_reject_t), and checked
+ * before using the snapshot. Checking the ctime of every command would
+ * cost about as much as scanning PATH: a command that loses its execute
+ * bit stays listed until its directory changes (running it then fails
+ * with a permission error, just as if it was changed in the middle of a
+ * session).
+ *
+ * Scope: only the PATH section is implemented. The config file, color
+ * scheme, keybindings, actions, aliases, prompts, bookmarks, jump
+ * database, tags, and directory history are still parsed from text: with
+ * the default files, the config file and color scheme take about 0.25ms
+ * together, and the rest about 0.1ms, while the jump database and the
+ * directory history are rewritten on every exit, which would invalidate
+ * their sections anyway. Config and color sections would need to record
+ * the state of every file they depend on (config, color scheme, prompts
+ * file) and of the CLIFM_* color variables, and to restore every global
+ * read_config() and set_colors() set, including those set as side
+ * effects (the prompt, the dividing line, the FZF options).
+ *
+ * File layout (native byte order, since the snapshot is never shared
+ * across machines):
+ *
+ *   struct snap_header_t
+ *   struct snap_stamp_t[paths_n]
+ *   struct snap_reject_t[rejects_n]
+ *   uint32_t offsets[cmds_n]
+ *   char strtab[strtab_size] (NUL terminated command names, followed by
+ *     the names of rejected files) */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aux.h"
+#include "snapshot.h"
+
+#define SNAP_MAGIC   "CLIFMSNP"
+/* Increase whenever the file layout changes */
+#define SNAP_VERSION 2
+
+/* Snapshot flags: options affecting the list of commands */
+#define SNAP_LIGHT_MODE (1 << 0)
+
+struct snap_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t paths_n;
+	uint32_t cmds_n;
+	uint32_t rejects_n;
+	uint32_t pad;
+	uint64_t strtab_size;
+};
+
+/* Files rejected while scanning PATH, to be saved by save_snapshot() */
+static struct {
+	struct snap_reject_t *v;
+	char **names;
+	size_t n;
+} rejects = {0};
+
+static char *
+get_snapshot_file(void)
+{
+	if (xargs.stealth_mode == 1 || config_ok == 0 || !config_dir)
+		return (char *)NULL;
+
+	const size_t len = config_dir_len + sizeof(SNAPSHOT_FILE) + 1;
+	char *file = (char *)xnmalloc(len, sizeof(char));
+	snprintf(file, len, "%s/%s", config_dir, SNAPSHOT_FILE);
+
+	return file;
+}
+
+static uint32_t
+get_snapshot_flags(void)
+{
+	return conf.light_mode == 1 ? SNAP_LIGHT_MODE : 0;
+}
+
+/* Return the current state of each directory in PATH (see the paths array),
+ * to be passed to open_snapshot() and save_snapshot().
+ * It must be taken before scanning PATH: if a directory is modified while
+ * being scanned, the snapshot will not match the next time */
+struct snap_stamp_t *
+get_path_stamps(void)
+{
+	struct snap_stamp_t *s = (struct snap_stamp_t *)xcalloc(path_n + 1,
+		sizeof(struct snap_stamp_t));
+
+	size_t i;
+	for (i = 0; i < path_n; i++) {
+		if (!paths[i].path || !*paths[i].path)
+			continue;
+
+		s[i].name_len = (uint32_t)strlen(paths[i].path);
+		s[i].name_hash = hashme32(paths[i].path, HASH_SEED);
+
+		struct stat a;
+		if (stat(paths[i].path, &a) == -1 || !S_ISDIR(a.st_mode))
+			continue;
+
+		s[i].dev = (uint64_t)a.st_dev;
+		s[i].ino = (uint64_t)a.st_ino;
+		s[i].mtime = (uint64_t)a.st_mtime;
+#if defined(__linux__)
+		s[i].mtime_nsec = (uint64_t)a.st_mtim.tv_nsec;
+#endif /* __linux__ */
+	}
+
+	return s;
+}
+
+static void
+get_ctime(const struct stat *a, uint64_t *sec, uint64_t *nsec)
+{
+	*sec = (uint64_t)a->st_ctime;
+#if defined(__linux__)
+	*nsec = (uint64_t)a->st_ctim.tv_nsec;
+#else
+	*nsec = 0;
+#endif /* __linux__ */
+}
+
+/* Record the file NAME, found in the directory paths[PATH_IDX], as left
+ * out of the list of commands. NAME is relative to the current directory,
+ * which must be the one being scanned */
+void
+add_snapshot_reject(const size_t path_idx, const char *name)
+{
+	rejects.v = (struct snap_reject_t *)xrealloc(rejects.v,
+		(rejects.n + 1) * sizeof(struct snap_reject_t));
+	rejects.names = (char **)xrealloc(rejects.names,
+		(rejects.n + 1) * sizeof(char *));
+
+	struct snap_reject_t *r = &rejects.v[rejects.n];
+	memset(r, 0, sizeof(struct snap_reject_t));
+	r->path_idx = (uint32_t)path_idx;
+
+	struct stat a;
+	if (stat(name, &a) != -1)
+		get_ctime(&a, &r->ctime, &r->ctime_nsec);
+
+	rejects.names[rejects.n] = savestring(name, strlen(name));
+	rejects.n++;
+}
+
+void
+free_snapshot_rejects(void)
+{
+	size_t i;
+	for (i = 0; i < rejects.n; i++)
+		free(rejects.names[i]);
+
+	free(rejects.names);
+	free(rejects.v);
+	memset(&rejects, 0, sizeof(rejects));
+}
+
+/* Return 1 if the string STR lives in the mapped snapshot SNAP, or zero
+ * otherwise */
+int
+in_snapshot(const struct snapshot_t *snap, const char *str)
+{
+	return (snap->map && str >= (const char *)snap->map
+		&& str < (const char *)snap->map + snap->map_size);
+}
+
+void
+close_snapshot(struct snapshot_t *snap)
+{
+	if (snap->map)
+		munmap(snap->map, snap->map_size);
+
+	memset(snap, 0, sizeof(struct snapshot_t));
+}
+
+/* Return 1 if the rejected file R, named NAME, changed since the snapshot
+ * was taken, or zero otherwise */
+static int
+reject_changed(const struct snap_reject_t *r, const char *name)
+{
+	if (r->path_idx >= path_n || !paths[r->path_idx].path)
+		return 1;
+
+	char file[PATH_MAX + 1];
+	snprintf(file, sizeof(file), "%s/%s", paths[r->path_idx].path, name);
+
+	uint64_t sec = 0, nsec = 0;
+	struct stat a;
+	if (stat(file, &a) != -1)
+		get_ctime(&a, &sec, &nsec);
+
+	return (sec != r->ctime || nsec != r->ctime_nsec);
+}
+
+/* Make sure the mapped file is a complete snapshot taken with the
+ * current PATH and options, and that no directory in PATH changed since
+ * then. On success, SNAP is set up to access the list of commands */
+static int
+check_snapshot(struct snapshot_t *snap, const struct snap_stamp_t *stamps)
+{
+	if (snap->map_size < sizeof(struct snap_header_t))
+		return EXIT_FAILURE;
+
+	const struct snap_header_t *h = (const struct snap_header_t *)snap->map;
+	if (memcmp(h->magic, SNAP_MAGIC, sizeof(h->magic)) != 0
+	|| h->version != SNAP_VERSION || h->flags != get_snapshot_flags()
+	|| h->paths_n != (uint32_t)path_n || h->strtab_size == 0)
+		return EXIT_FAILURE;
+
+	const size_t stamps_size = (size_t)h->paths_n * sizeof(struct snap_stamp_t);
+	const size_t rejects_size =
+		(size_t)h->rejects_n * sizeof(struct snap_reject_t);
+	const size_t offsets_size = (size_t)h->cmds_n * sizeof(uint32_t);
+	if (snap->map_size != sizeof(struct snap_header_t) + stamps_size
+	+ rejects_size + offsets_size + h->strtab_size)
+		return EXIT_FAILURE;
+
+	const char *p = (const char *)snap->map + sizeof(struct snap_header_t);
+	if (memcmp(p, stamps, stamps_size) != 0)
+		return EXIT_FAILURE;
+
+	const struct snap_reject_t *r =
+		(const struct snap_reject_t *)(p + stamps_size);
+	snap->offsets = (const uint32_t *)(p + stamps_size + rejects_size);
+	snap->strtab = p + stamps_size + rejects_size + offsets_size;
+	snap->cmds_n = (size_t)h->cmds_n;
+
+	if (snap->strtab[h->strtab_size - 1] != '\0')
+		return EXIT_FAILURE;
+
+	size_t i;
+	for (i = 0; i < snap->cmds_n; i++) {
+		if (snap->offsets[i] >= h->strtab_size)
+			return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < (size_t)h->rejects_n; i++) {
+		if (r[i].name_off >= h->strtab_size
+		|| reject_changed(&r[i], snap->strtab + r[i].name_off) == 1)
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* Map the snapshot file into memory. Returns EXIT_SUCCESS if the snapshot
+ * is valid for STAMPS (as returned by get_path_stamps()), in which case
+ * it must be released via close_snapshot(), or EXIT_FAILURE otherwise */
+int
+open_snapshot(struct snapshot_t *snap, const struct snap_stamp_t *stamps)
+{
+	memset(snap, 0, sizeof(struct snapshot_t));
+
+	char *file = get_snapshot_file();
+	if (!file)
+		return EXIT_FAILURE;
+
+	int fd = open(file, O_RDONLY | O_CLOEXEC);
+	free(file);
+	if (fd == -1)
+		return EXIT_FAILURE;
+
+	struct stat a;
+	if (fstat(fd, &a) == -1 || !S_ISREG(a.st_mode) || a.st_size <= 0) {
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	void *map = mmap(NULL, (size_t)a.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return EXIT_FAILURE;
+
+	snap->map = map;
+	snap->map_size = (size_t)a.st_size;
+
+	if (check_snapshot(snap, stamps) == EXIT_SUCCESS)
+		return EXIT_SUCCESS;
+
+	close_snapshot(snap);
+	return EXIT_FAILURE;
+}
+
+/* Save the list of N commands CMDS, found in PATH when it was in the state
+ * described by STAMPS, into the snapshot file, together with the files
+ * recorded by add_snapshot_reject(). The file is replaced atomically, so
+ * that a concurrent instance never maps a partial file */
+void
+save_snapshot(const struct snap_stamp_t *stamps, char *const *cmds,
+	const size_t n)
+{
+	char *file = get_snapshot_file();
+	if (!file)
+		return;
+
+	size_t i, strtab_size = 0;
+	for (i = 0; i < n; i++)
+		strtab_size += strlen(cmds[i]) + 1;
+	for (i = 0; i < rejects.n; i++)
+		strtab_size += strlen(rejects.names[i]) + 1;
+
+	if (strtab_size == 0 || strtab_size > UINT32_MAX) {
+		unlink(file);
+		free(file);
+		return;
+	}
+
+	const size_t stamps_size = path_n * sizeof(struct snap_stamp_t);
+	const size_t rejects_size = rejects.n * sizeof(struct snap_reject_t);
+	const size_t size = sizeof(struct snap_header_t) + stamps_size
+		+ rejects_size + (n * sizeof(uint32_t)) + strtab_size;
+	char *buf = (char *)xcalloc(size, sizeof(char));
+
+	struct snap_header_t *h = (struct snap_header_t *)buf;
+	memcpy(h->magic, SNAP_MAGIC, sizeof(h->magic));
+	h->version = SNAP_VERSION;
+	h->flags = get_snapshot_flags();
+	h->paths_n = (uint32_t)path_n;
+	h->cmds_n = (uint32_t)n;
+	h->rejects_n = (uint32_t)rejects.n;
+	h->strtab_size = (uint64_t)strtab_size;
+
+	char *p = buf + sizeof(struct snap_header_t);
+	memcpy(p, stamps, stamps_size);
+
+	struct snap_reject_t *r = (struct snap_reject_t *)(p + stamps_size);
+	uint32_t *offsets = (uint32_t *)(p + stamps_size + rejects_size);
+	char *strtab = p + stamps_size + rejects_size + (n * sizeof(uint32_t));
+
+	size_t off = 0;
+	for (i = 0; i < n; i++) {
+		const size_t len = strlen(cmds[i]) + 1;
+		offsets[i] = (uint32_t)off;
+		memcpy(strtab + off, cmds[i], len);
+		off += len;
+	}
+
+	for (i = 0; i < rejects.n; i++) {
+		const size_t len = strlen(rejects.names[i]) + 1;
+		r[i] = rejects.v[i];
+		r[i].name_off = (uint32_t)off;
+		memcpy(strtab + off, rejects.names[i], len);
+		off += len;
+	}
+
+	const size_t tmp_len = strlen(file) + 8;
+	char *tmp_file = (char *)xnmalloc(tmp_len, sizeof(char));
+	snprintf(tmp_file, tmp_len, "%s.XXXXXX", file);
+
+	int fd = mkstemp(tmp_file);
+	if (fd == -1)
+		goto END;
+
+	ssize_t ret = write(fd, buf, size);
+	if (close(fd) == -1 || ret == -1 || (size_t)ret != size
+	|| rename(tmp_file, file) == -1)
+		unlink(tmp_file);
+
+END:
+	free(tmp_file);
+	free(buf);
+	free(file);
+}
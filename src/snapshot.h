@@ -0,0 +1,75 @@
+/* snapshot.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#define SNAPSHOT_FILE "snapshot.cache"
+
+/* State of a source directory (a PATH entry) when the snapshot was taken.
+ * All fields are zero for directories that could not be accessed */
+struct snap_stamp_t {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t mtime;
+	uint64_t mtime_nsec;
+	uint32_t name_hash;
+	uint32_t name_len;
+};
+
+/* State of a file in a PATH directory that was left out of the list of
+ * commands for not being executable. Making it executable (chmod +x)
+ * changes its ctime, but not the modification time of its directory.
+ * Both ctime fields are zero if the file could not be accessed */
+struct snap_reject_t {
+	uint64_t ctime;
+	uint64_t ctime_nsec;
+	uint32_t path_idx; /* Index of its directory in the paths array */
+	uint32_t name_off; /* Offset of its name in strtab */
+};
+
+/* A snapshot file mapped into memory */
+struct snapshot_t {
+	void *map;
+	size_t map_size;
+	const uint32_t *offsets; /* Offset of each command name in strtab */
+	const char *strtab;
+	size_t cmds_n;
+};
+
+__BEGIN_DECLS
+
+void add_snapshot_reject(const size_t, const char *);
+void close_snapshot(struct snapshot_t *);
+void free_snapshot_rejects(void);
+struct snap_stamp_t *get_path_stamps(void);
+int  in_snapshot(const struct snapshot_t *, const char *);
+int  open_snapshot(struct snapshot_t *, const struct snap_stamp_t *);
+void save_snapshot(const struct snap_stamp_t *, char *const *, const size_t);
+
+__END_DECLS
+
+#endif /* SNAPSHOT_H */
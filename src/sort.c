@@ -34,6 +34,7 @@
 
 #include "checks.h"
 #include "aux.h" /* xatoi */
+#include "filter.h"
 #include "listing.h"
 #include "messages.h"
 
@@ -82,9 +83,7 @@ skip_files(const struct dirent *ent)
 		return 0;
 
 	/* Skip files matching FILTER */
-	// ADD FILTER TYPE CHECK!
-	if (filter.str
-	&& regexec(&regex_exp, ent->d_name, 0, NULL, 0) == EXIT_SUCCESS)
+	if (filter_match_name(ent->d_name) == 1)
 		return 0;
 
 	/* If not hidden files */
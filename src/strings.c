@@ -40,12 +40,12 @@
 #include <string.h>
 #include <time.h>
 #include <wchar.h>
-#if !defined(__HAIKU__) && !defined(__OpenBSD__) && !defined(__ANDROID__)
-# include <wordexp.h>
-#endif
 #include <limits.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fnmatch.h>
+#include <pwd.h>
+#include <unistd.h>
 
 #if defined(__OpenBSD__)
 typedef char *rl_cpvfunc_t;
@@ -55,6 +55,7 @@ typedef char *rl_cpvfunc_t;
 #endif /* __OpenBSD__ */
 
 #include "aux.h"
+#include "bookmarks.h"
 #include "checks.h"
 #include "exec.h"
 #include "misc.h"
@@ -1336,6 +1337,137 @@ insert_fields(char ***dst, char ***src, const size_t i, size_t *num)
 	return d;
 }
 
+/* Selected files and ELN's expanded for file operation commands are
+ * stored as raw (unescaped) file names: escaping them here only to have
+ * the command dequote them again is a waste of time for large
+ * selections. While parse_input_str() runs, RAW[I] is 1 if the word I
+ * holds a raw file name. The array is then handed over to the caller,
+ * along with the vector it describes (see is_raw_arg()). */
+static struct raw_args_t {
+	char *raw;
+	size_t n;   /* Words described by RAW */
+	size_t size;
+	int on;     /* Raw names are allowed for the command being parsed */
+	int allowed; /* The caller of parse_input_str() takes raw names */
+} raw_args = {0};
+
+/* Make RAW_ARGS describe a vector of N words */
+static void
+resize_raw_args(const size_t n)
+{
+	if (n + 1 > raw_args.size) {
+		raw_args.size = n + 1;
+		raw_args.raw = (char *)xrealloc(raw_args.raw,
+			raw_args.size * sizeof(char));
+	}
+
+	if (n > raw_args.n)
+		memset(raw_args.raw + raw_args.n, 0, n - raw_args.n);
+	raw_args.n = n;
+}
+
+/* Update RAW_ARGS after replacing the word at AT by N (escaped) words */
+static void
+splice_raw_args(const size_t at, const size_t n)
+{
+	if (raw_args.on == 0 || at >= raw_args.n)
+		return;
+
+	const size_t old_n = raw_args.n;
+	const size_t tail = old_n - at - 1;
+	resize_raw_args(old_n + n - 1);
+	memmove(raw_args.raw + at + n, raw_args.raw + at + 1, tail);
+	memset(raw_args.raw + at, 0, n);
+}
+
+static int
+is_raw_word(const size_t i)
+{
+	return (raw_args.on == 1 && i < raw_args.n && raw_args.raw[i] == 1);
+}
+
+/* Return 1 if the word I of a vector returned by parse_input_str() holds
+ * a raw file name, that is, one that must not be dequoted, or 0 otherwise.
+ * RAW is the array returned along with that vector (it may be NULL) */
+int
+is_raw_arg(const char *raw, const size_t i)
+{
+	return (raw && raw[i] == 1);
+}
+
+/* Return 1 if raw file names can be passed to the command in ARGS (with
+ * N arguments): its handler builds no shell command line out of them */
+static int
+takes_raw_args(char **args, const size_t n)
+{
+	const char *cmd = args[0];
+	if (!cmd || !*cmd || n == 0)
+		return 0;
+
+	/* c, v, paste (cp_mv_file) */
+	if (((*cmd == 'c' || *cmd == 'v') && !cmd[1])
+	|| strcmp(cmd, "paste") == 0)
+		return 1;
+	/* m with a single argument is an interactive rename */
+	if (*cmd == 'm' && !cmd[1])
+		return (n > 1);
+	/* r (remove_file), br (bulk_rename), bb (bleach_files) */
+	if ((*cmd == 'r' && !cmd[1]) || strcmp(cmd, "br") == 0
+	|| strcmp(cmd, "bulk") == 0 || strcmp(cmd, "bb") == 0
+	|| strcmp(cmd, "bleach") == 0)
+		return 1;
+	/* t (trash_files_args) */
+	if ((*cmd == 't' && !cmd[1]) || strcmp(cmd, "tr") == 0
+	|| strcmp(cmd, "trash") == 0)
+		return (args[1] && strcmp(args[1], "del") != 0);
+
+	return 0;
+}
+
+/* Replace the word at SUBSTR[AT] by the N words in WORDS, escaping them.
+ * The remaining words are moved into the new vector, not copied.
+ * Returns EXIT_FAILURE if some word could not be escaped, in which case
+ * SUBSTR is left untouched */
+static int
+splice_words(char ***substr, const size_t at, char **words, const size_t n)
+{
+	char **esc = (char **)xnmalloc(n + 1, sizeof(char *));
+	size_t i, j = 0;
+
+	for (i = 0; i < n; i++) {
+		esc[i] = escape_str(words[i]);
+		if (esc[i])
+			continue;
+
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: %s: Error quoting "
+			"file name\n"), PROGRAM_NAME, words[i]);
+		while (i-- > 0)
+			free(esc[i]);
+		free(esc);
+		return EXIT_FAILURE;
+	}
+
+	char **v = (char **)xnmalloc(args_n + n + 1, sizeof(char *));
+
+	for (i = 0; i < at; i++)
+		v[j++] = (*substr)[i];
+	for (i = 0; i < n; i++)
+		v[j++] = esc[i];
+	for (i = at + 1; i <= args_n; i++)
+		v[j++] = (*substr)[i];
+	v[j] = (char *)NULL;
+
+	free((*substr)[at]);
+	free(*substr);
+	free(esc);
+
+	*substr = v;
+	splice_raw_args(at, n);
+	args_n = j - 1;
+
+	return EXIT_SUCCESS;
+}
+
 /* Expand the ELN at SUBSTR[I] into the corresponding file name */
 static int
 eln_expand(char ***substr, const size_t i)
@@ -1346,9 +1478,11 @@ eln_expand(char ***substr, const size_t i)
 	 * NUM is > 0 and <= the amount of listed files (and this latter is
 	 * never greater than INT_MAX) */
 	int j = num - 1;
-	char *esc_str = escape_str(file_info[j].name);
+	char *name = raw_args.on == 1
+		? savestring(file_info[j].name, strlen(file_info[j].name))
+		: escape_str(file_info[j].name);
 
-	if (!esc_str) {
+	if (!name) {
 		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: %s: Error quoting file name\n"),
 			PROGRAM_NAME, file_info[num - 1].name);
 
@@ -1363,17 +1497,20 @@ eln_expand(char ***substr, const size_t i)
 	if (i == 0)
 		flags |= FIRST_WORD_IS_ELN;
 
-	/* Replace the ELN by the corresponding escaped file name */
+	/* Replace the ELN by the corresponding (escaped or raw) file name */
 	if (file_info[j].type == DT_DIR && file_info[j].name[file_info[j].len > 0
 	? file_info[j].len - 1 : 0] != '/') {
-		(*substr)[i] = (char *)xrealloc((*substr)[i], (strlen(esc_str) + 2) * sizeof(char));
-		sprintf((*substr)[i], "%s/", esc_str);
-		free(esc_str);
+		(*substr)[i] = (char *)xrealloc((*substr)[i], (strlen(name) + 2) * sizeof(char));
+		sprintf((*substr)[i], "%s/", name);
+		free(name);
 	} else {
 		free((*substr)[i]);
-		(*substr)[i] = esc_str;
+		(*substr)[i] = name;
 	}
 
+	if (raw_args.on == 1)
+		raw_args.raw[i] = 1;
+
 	return EXIT_SUCCESS;
 }
 
@@ -1401,24 +1538,28 @@ expand_sel(char ***substr)
 	size_t j = 0;
 	char **sel_array = (char **)xnmalloc(args_n + sel_n + 2, sizeof(char *));
 
-	/* 1. Copy all words before 'sel' */
+	/* 1. Move all words before 'sel' */
 	for (i = 0; i < (size_t)is_sel; i++) {
 		if (!(*substr)[i])
 			continue;
-		sel_array[j] = savestring((*substr)[i], strlen((*substr)[i]));
+		sel_array[j] = (*substr)[i];
 		j++;
 	}
 
-	/* 2. Add all selected files (in place of 'sel') */
+	const size_t start = j;
+
+	/* 2. Add all selected files (in place of 'sel'), escaped unless the
+	 * command takes raw file names */
 	for (i = 0; i < sel_n; i++) {
-		/* Escape selected file names and copy them into tmp array */
-		char *esc_str = escape_str(sel_elements[i].name);
-		if (!esc_str) {
+		char *name = raw_args.on == 1
+			? savestring(sel_elements[i].name, strlen(sel_elements[i].name))
+			: escape_str(sel_elements[i].name);
+		if (!name) {
 			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: %s: Error quoting "
-				"file name\n"), PROGRAM_NAME, sel_elements[j].name);
+				"file name\n"), PROGRAM_NAME, sel_elements[i].name);
 			/* Free elements selected thus far and all the input substrings */
 			size_t k = 0;
-			for (k = 0; k < j; k++)
+			for (k = start; k < j; k++)
 				free(sel_array[k]);
 			free(sel_array);
 
@@ -1430,27 +1571,32 @@ expand_sel(char ***substr)
 			return EXIT_FAILURE;
 		}
 
-		sel_array[j] = esc_str;
+		sel_array[j] = name;
 		j++;
 	}
 
-	/* 3. Add words after 'sel' as well */
+	/* 3. Move words after 'sel' as well */
 	for (i = (size_t)is_sel + 1; i <= args_n; i++) {
-		sel_array[j] = savestring((*substr)[i], strlen((*substr)[i]));
+		sel_array[j] = (*substr)[i];
 		j++;
 	}
 
 	sel_array[j] = (char *)NULL;
 
-	/* 4. Free the original input string and replace by the new sel_array */
-	for (i = 0; i <= args_n; i++)
-		free((*substr)[i]);
+	/* 4. Free the 'sel' keyword and the original array, and replace it
+	 * by the new sel_array */
+	free((*substr)[is_sel]);
 	free(*substr);
 
 	(*substr) = sel_array;
 
 	args_n = j - 1;
 
+	if (raw_args.on == 1) {
+		resize_raw_args(args_n + 1);
+		memset(raw_args.raw + start, 1, sel_n);
+	}
+
 	return EXIT_SUCCESS;
 }
 
@@ -1459,15 +1605,12 @@ expand_sel(char ***substr)
 static int
 expand_bm_name(char **name)
 {
-	size_t j;
 	int bm_exp = EXIT_FAILURE;
 	char *p = dequote_str(*name + 2, 0);
 	char *n = p ? p : *name + 2;
 
-	for (j = 0; j < bm_n; j++) {
-		if (!bookmarks[j].name || *n != *bookmarks[j].name
-		|| strcmp(n, bookmarks[j].name) != 0)
-			continue;
+	const ssize_t j = find_bookmark(BM_NAME, n);
+	if (j != -1) {
 
 		/* Do not expand bookmark names that conflicts with a file name in CWD */
 /*		int conflict = 0, k = (int)files;
@@ -1488,8 +1631,6 @@ expand_bm_name(char **name)
 		strcpy(*name, tmp);
 		free(q);
 		bm_exp = EXIT_SUCCESS;
-
-		break;
 	}
 
 	free(p);
@@ -1514,6 +1655,609 @@ expand_int_var(char **name)
 	}
 }
 
+/* Native word expansion
+ * wordexp(3) runs the system shell whenever command substitution is
+ * possible, that is, for a mere $HOME/src. Instead, we perform tilde and
+ * parameter expansion ourselves, and run the shell only for actual
+ * command substitution ($(CMD) and `CMD`), via get_cmd_output().
+ *
+ * Fields are built in escaped form (as returned by split_str()), so that
+ * quoted chars are neither split nor globbed. */
+
+struct wexp_t {
+	char **fields;
+	char *buf;      /* The field being built */
+	size_t fields_n;
+	size_t len;
+	size_t size;
+	int in_field;   /* BUF holds a (possibly empty) field */
+	int pad;
+};
+
+#define IS_PARAM_CHAR(c) (IS_DIGIT((c)) || IS_ALPHA((c)) || (c) == '_' \
+	|| ((c) >= 'A' && (c) <= 'Z'))
+
+static void
+wexp_putc(struct wexp_t *w, const char c)
+{
+	if (w->len + 2 > w->size) {
+		w->size = (w->size * 2) + NAME_MAX;
+		w->buf = (char *)xrealloc(w->buf, w->size * sizeof(char));
+	}
+
+	w->buf[w->len] = c;
+	w->len++;
+	w->in_field = 1;
+}
+
+static void
+wexp_end_field(struct wexp_t *w)
+{
+	if (w->in_field == 0)
+		return;
+
+	w->buf[w->len] = '\0';
+	w->fields = (char **)xrealloc(w->fields,
+		(w->fields_n + 1) * sizeof(char *));
+	w->fields[w->fields_n] = savestring(w->buf, w->len);
+	w->fields_n++;
+
+	w->len = 0;
+	w->in_field = 0;
+}
+
+/* Add the expansion result STR to the current field. If SPLIT is set,
+ * split it into fields at IFS chars, and let glob chars in it be globbed
+ * later. Otherwise, take it literally */
+static void
+wexp_add_result(struct wexp_t *w, const char *str, const int split)
+{
+	if (!str)
+		return;
+
+	const char *ifs = getenv("IFS");
+	if (!ifs)
+		ifs = " \t\n";
+
+	for (; *str; str++) {
+		if (split == 1 && *ifs && strchr(ifs, *str)) {
+			wexp_end_field(w);
+			continue;
+		}
+
+		if (*str == '\\' || (split == 0 && (*str == '*' || *str == '?'
+		|| *str == '[')))
+			wexp_putc(w, '\\');
+		wexp_putc(w, *str);
+	}
+
+	/* A quoted empty result still makes a field: "$EMPTY" */
+	if (split == 0)
+		w->in_field = 1;
+}
+
+/* Expand the tilde prefix at the beginning of WORD (~ or ~user). Returns
+ * the number of bytes consumed from WORD */
+static size_t
+wexp_tilde(struct wexp_t *w, const char *word)
+{
+	size_t n = 1;
+	while (word[n] && word[n] != '/') {
+		/* Quoted tilde prefixes are not expanded */
+		if (word[n] == '\\' || word[n] == '$' || word[n] == '`')
+			return 0;
+		n++;
+	}
+
+	const char *dir = (char *)NULL;
+	if (n == 1) {
+		dir = getenv("HOME");
+		if (!dir)
+			dir = user.home;
+	} else {
+		char name[NAME_MAX + 1];
+		xstrsncpy(name, word + 1, n - 1 < sizeof(name) ? n - 1
+			: sizeof(name) - 1);
+		struct passwd *pw = getpwnam(name);
+		if (pw)
+			dir = pw->pw_dir;
+	}
+
+	if (!dir)
+		return 0;
+
+	wexp_add_result(w, dir, 0);
+	return n;
+}
+
+/* Expand a parameter in its braced form (the contents of ${...}, passed
+ * via EXP). Supported forms: NAME, #NAME, NAME:-WORD, NAME-WORD, NAME:+WORD,
+ * and NAME+WORD. Returns EXIT_FAILURE for unsupported forms */
+static int
+wexp_braced_param(struct wexp_t *w, char *exp)
+{
+	int length = 0;
+	if (*exp == '#' && exp[1]) {
+		length = 1;
+		exp++;
+	}
+
+	char *p = exp;
+	while (IS_PARAM_CHAR(*p))
+		p++;
+	if (p == exp)
+		return EXIT_FAILURE;
+
+	const char op = *p;
+	*p = '\0';
+	const char *val = getenv(exp);
+
+	if (op == '\0') {
+		if (length == 1) {
+			char num[32];
+			snprintf(num, sizeof(num), "%zu", val ? strlen(val) : (size_t)0);
+			wexp_add_result(w, num, 1);
+		} else {
+			wexp_add_result(w, val, 1);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	if (length == 1)
+		return EXIT_FAILURE;
+
+	/* With a colon, an empty value counts as unset */
+	const int colon = (op == ':');
+	const char *q = p + 1 + colon;
+	const char kind = colon == 1 ? p[1] : op;
+	if (kind != '-' && kind != '+')
+		return EXIT_FAILURE;
+
+	const int set = val && (colon == 0 || *val);
+	if (kind == '-')
+		wexp_add_result(w, set ? val : q, 1);
+	else if (set)
+		wexp_add_result(w, q, 1);
+
+	return EXIT_SUCCESS;
+}
+
+/* Run the command substitution CMD and add its output */
+static void
+wexp_cmd_subst(struct wexp_t *w, const char *cmd)
+{
+	char *out = get_cmd_output(cmd);
+	wexp_add_result(w, out, 1);
+	free(out);
+}
+
+/* Return a pointer to the closing parenthesis of the command substitution
+ * starting at STR (right after "$("), or NULL if not found */
+static char *
+wexp_find_paren(char *str)
+{
+	int depth = 1;
+	for (; *str; str++) {
+		if (*str == '\\' && str[1]) {
+			str++;
+		} else if (*str == '(') {
+			depth++;
+		} else if (*str == ')') {
+			depth--;
+			if (depth == 0)
+				return str;
+		}
+	}
+
+	return (char *)NULL;
+}
+
+static void
+free_wexp(struct wexp_t *w)
+{
+	size_t i;
+	for (i = 0; i < w->fields_n; i++)
+		free(w->fields[i]);
+	free(w->fields);
+	free(w->buf);
+}
+
+/* Perform pathname expansion on the (escaped) field F, appending the
+ * resulting (unescaped) file names to RES */
+static void
+wexp_glob_field(char *f, char ***res, size_t *n)
+{
+	int has_glob = 0;
+	char *p;
+	for (p = f; *p; p++) {
+		if (*p == '\\' && p[1]) {
+			p++;
+		} else if (*p == '*' || *p == '?' || *p == '[') {
+			has_glob = 1;
+			break;
+		}
+	}
+
+	glob_t globbuf;
+	if (has_glob == 1 && glob(f, 0, NULL, &globbuf) == 0) {
+		*res = (char **)xrealloc(*res, (*n + globbuf.gl_pathc + 1)
+			* sizeof(char *));
+		size_t i;
+		for (i = 0; i < globbuf.gl_pathc; i++) {
+			(*res)[*n] = savestring(globbuf.gl_pathv[i],
+				strlen(globbuf.gl_pathv[i]));
+			(*n)++;
+		}
+		globfree(&globbuf);
+		return;
+	}
+
+	if (has_glob == 1)
+		globfree(&globbuf);
+
+	char *d = dequote_str(f, 0);
+	*res = (char **)xrealloc(*res, (*n + 2) * sizeof(char *));
+	(*res)[*n] = d ? d : savestring("", 0);
+	(*n)++;
+}
+
+/* Expand WORD, an (escaped) argument as returned by split_str(), performing
+ * tilde expansion, parameter expansion ($NAME, ${NAME} and the forms
+ * supported by wexp_braced_param()), and command substitution. Unquoted
+ * results are split into fields and globbed, just as the shell does.
+ * Returns the array of resulting (unescaped) fields, storing their number
+ * in N, or NULL if WORD must be kept as is */
+static char **
+expand_word(char *word, size_t *n)
+{
+	*n = 0;
+	struct wexp_t w;
+	memset(&w, 0, sizeof(struct wexp_t));
+
+	char *p = word;
+	int expanded = 0;
+
+	if (*p == '~') {
+		size_t len = wexp_tilde(&w, p);
+		if (len > 0) {
+			p += len;
+			expanded = 1;
+		}
+	}
+
+	while (*p) {
+		if (*p == '\\') {
+			wexp_putc(&w, *p);
+			p++;
+			if (*p) {
+				wexp_putc(&w, *p);
+				p++;
+			}
+			continue;
+		}
+
+		if (*p == '`') {
+			char *end = strchr(p + 1, '`');
+			if (!end)
+				goto UNSUPPORTED;
+			*end = '\0';
+			wexp_cmd_subst(&w, p + 1);
+			*end = '`';
+			p = end + 1;
+			expanded = 1;
+			continue;
+		}
+
+		if (*p != '$') {
+			wexp_putc(&w, *p);
+			p++;
+			continue;
+		}
+
+		/* Arithmetic expansion is left to the shell */
+		if (p[1] == '(' && p[2] == '(')
+			goto UNSUPPORTED;
+
+		if (p[1] == '(') {
+			char *end = wexp_find_paren(p + 2);
+			if (!end)
+				goto UNSUPPORTED;
+			*end = '\0';
+			wexp_cmd_subst(&w, p + 2);
+			*end = ')';
+			p = end + 1;
+		} else if (p[1] == '{') {
+			char *end = strchr(p + 2, '}');
+			if (!end)
+				goto UNSUPPORTED;
+			*end = '\0';
+			char *exp = savestring(p + 2, (size_t)(end - p - 2));
+			*end = '}';
+			int ret = wexp_braced_param(&w, exp);
+			free(exp);
+			if (ret != EXIT_SUCCESS)
+				goto UNSUPPORTED;
+			p = end + 1;
+		} else if (IS_PARAM_CHAR(p[1]) && !IS_DIGIT(p[1])) {
+			char *q = p + 1;
+			while (IS_PARAM_CHAR(*q))
+				q++;
+			const char c = *q;
+			*q = '\0';
+			wexp_add_result(&w, getenv(p + 1), 1);
+			*q = c;
+			p = q;
+		} else if (p[1] == '$' || p[1] == '?') {
+			char num[32];
+			snprintf(num, sizeof(num), "%d", p[1] == '$'
+				? (int)getpid() : exit_code);
+			wexp_add_result(&w, num, 1);
+			p += 2;
+		} else if (IS_DIGIT(p[1]) || p[1] == '#' || p[1] == '@'
+		|| p[1] == '*') {
+			/* Positional parameters: we have none */
+			if (p[1] == '#')
+				wexp_add_result(&w, "0", 1);
+			p += 2;
+		} else {
+			/* A lonely dollar sign */
+			wexp_putc(&w, *p);
+			p++;
+			continue;
+		}
+
+		expanded = 1;
+	}
+
+	wexp_end_field(&w);
+
+	if (expanded == 0 || w.fields_n == 0) {
+		free_wexp(&w);
+		return (char **)NULL;
+	}
+
+	char **res = (char **)NULL;
+	size_t i;
+	for (i = 0; i < w.fields_n; i++)
+		wexp_glob_field(w.fields[i], &res, n);
+
+	free_wexp(&w);
+	return res;
+
+UNSUPPORTED:
+	free_wexp(&w);
+	return (char **)NULL;
+}
+
+/* Listing-backed glob expansion
+ * Most patterns passed to internal commands refer to files in the
+ * current directory, whose names are already in memory (file_info). Match
+ * these patterns against the current listing instead of reading the
+ * directory again via glob(3). Patterns made only of literal characters
+ * and stars are compiled into a list of literal segments and matched
+ * without backtracking; anything else ('?' and bracket expressions) is
+ * handed to fnmatch(3). */
+
+void
+free_glob_pat(struct glob_pat_t *g)
+{
+	size_t i;
+	for (i = 0; i < g->segs_n; i++)
+		free(g->segs[i]);
+	free(g->segs);
+	free(g->lens);
+}
+
+/* Return 1 if PATTERN can be matched against the current listing: it
+ * must refer to the current directory only (no slashes, tilde, or
+ * braces), and the listing must hold every file glob(3) would see */
+static int
+is_listing_glob(const char *pattern)
+{
+	if (watch != 1 || conf.autols == 0 || files == 0 || filter.str
+	|| conf.only_dirs == 1 || !file_info)
+		return 0;
+
+	if (*pattern == '~' || (*pattern == '.' && conf.show_hidden == 0))
+		return 0;
+
+	const char *p;
+	for (p = pattern; *p; p++) {
+		if (*p == '/' || *p == '{')
+			return 0;
+		if (*p == '\\' && p[1])
+			p++;
+	}
+
+	return 1;
+}
+
+void
+compile_glob(const char *pattern, struct glob_pat_t *g)
+{
+	const size_t len = strlen(pattern);
+	char *buf = (char *)xnmalloc(len + 1, sizeof(char));
+	size_t n = 0;
+
+	memset(g, 0, sizeof(struct glob_pat_t));
+	g->simple = 1;
+	g->segs = (char **)xnmalloc(len + 1, sizeof(char *));
+	g->lens = (size_t *)xnmalloc(len + 1, sizeof(size_t));
+	g->lead_star = (*pattern == '*');
+
+	const char *p;
+	for (p = pattern; *p; p++) {
+		if (*p == '?' || *p == '[')
+			g->simple = 0;
+
+		if (*p == '*') {
+			if (n > 0) {
+				buf[n] = '\0';
+				g->segs[g->segs_n] = savestring(buf, n);
+				g->lens[g->segs_n] = n;
+				g->segs_n++;
+				n = 0;
+			}
+			g->trail_star = 1;
+			continue;
+		}
+
+		if (*p == '\\' && p[1])
+			p++;
+		buf[n] = *p;
+		n++;
+		g->trail_star = 0;
+	}
+
+	if (n > 0) {
+		buf[n] = '\0';
+		g->segs[g->segs_n] = savestring(buf, n);
+		g->lens[g->segs_n] = n;
+		g->segs_n++;
+	}
+
+	free(buf);
+}
+
+/* Find the first occurrence of the N bytes long NEEDLE in the LEN bytes
+ * long STR */
+static const char *
+find_seg(const char *str, const size_t len, const char *needle,
+	const size_t n)
+{
+	if (n > len)
+		return (const char *)NULL;
+
+	const char *end = str + (len - n);
+	const char *p;
+	for (p = str; p <= end; p++) {
+		if (*p == *needle && memcmp(p, needle, n) == 0)
+			return p;
+	}
+
+	return (const char *)NULL;
+}
+
+int
+match_simple_glob(const struct glob_pat_t *g, const char *name)
+{
+	const size_t len = strlen(name);
+
+	if (g->segs_n == 0) /* Either "*" or "" */
+		return g->lead_star == 1 ? 1 : (len == 0);
+
+	if (g->lead_star == 0 && g->trail_star == 0 && g->segs_n == 1)
+		return (len == g->lens[0] && memcmp(name, g->segs[0], len) == 0);
+
+	size_t first = 0, last = g->segs_n;
+	size_t start = 0, end = len;
+
+	if (g->lead_star == 0) { /* First segment is a prefix */
+		if (g->lens[0] > len || memcmp(name, g->segs[0], g->lens[0]) != 0)
+			return 0;
+		start = g->lens[0];
+		first = 1;
+	}
+
+	if (g->trail_star == 0) { /* Last segment is a suffix */
+		const size_t l = g->lens[g->segs_n - 1];
+		if (l > end - start || memcmp(name + len - l,
+		g->segs[g->segs_n - 1], l) != 0)
+			return 0;
+		end = len - l;
+		last--;
+	}
+
+	/* Middle segments are matched leftmost first */
+	size_t i;
+	for (i = first; i < last; i++) {
+		const char *p = find_seg(name + start, end - start, g->segs[i],
+			g->lens[i]);
+		if (!p)
+			return 0;
+		start = (size_t)(p - name) + g->lens[i];
+	}
+
+	return 1;
+}
+
+static int
+compare_glob_matches(const void *a, const void *b)
+{
+	return strcoll(*(char *const *)a, *(char *const *)b);
+}
+
+/* Expand the glob pattern PATTERN, matching it against the current
+ * listing if possible, or via glob(3) otherwise. Matches are stored in
+ * PATHV (PATHC entries), in the same order glob(3) would produce.
+ * Returns 0 if some file matched or 1 otherwise */
+static int
+xglob(const char *pattern, char ***pathv, size_t *pathc)
+{
+	*pathv = (char **)NULL;
+	*pathc = 0;
+
+	if (is_listing_glob(pattern) == 0) {
+		glob_t globbuf;
+		if (glob(pattern, GLOB_BRACE | GLOB_TILDE, NULL, &globbuf) != 0
+		|| globbuf.gl_pathc == 0) {
+			globfree(&globbuf);
+			return 1;
+		}
+
+		*pathv = (char **)xnmalloc(globbuf.gl_pathc + 1, sizeof(char *));
+		size_t i;
+		for (i = 0; i < globbuf.gl_pathc; i++) {
+			if (SELFORPARENT(globbuf.gl_pathv[i]))
+				continue;
+			(*pathv)[*pathc] = savestring(globbuf.gl_pathv[i],
+				strlen(globbuf.gl_pathv[i]));
+			(*pathc)++;
+		}
+
+		(*pathv)[*pathc] = (char *)NULL;
+		globfree(&globbuf);
+		return *pathc > 0 ? 0 : 1;
+	}
+
+	struct glob_pat_t g;
+	compile_glob(pattern, &g);
+
+	/* As glob(3), a leading dot must be matched explicitly */
+	const int dot_ok = (*pattern == '.'
+		|| (*pattern == '\\' && pattern[1] == '.'));
+	char **m = (char **)xnmalloc(files + 1, sizeof(char *));
+	size_t i, n = 0;
+
+	for (i = 0; i < files; i++) {
+		const char *name = file_info[i].name;
+		if (*name == '.' && dot_ok == 0)
+			continue;
+
+		if (g.simple == 1 ? match_simple_glob(&g, name) == 0
+		: fnmatch(pattern, name, FNM_PERIOD) != 0)
+			continue;
+
+		m[n] = savestring(name, strlen(name));
+		n++;
+	}
+
+	free_glob_pat(&g);
+
+	if (n == 0) {
+		free(m);
+		return 1;
+	}
+
+	if (n > 1)
+		qsort(m, n, sizeof(char *), compare_glob_matches);
+
+	m[n] = (char *)NULL;
+	*pathv = m;
+	*pathc = n;
+	return 0;
+}
+
 /* THIS IS A QUITE SHITTY FUNCTION, I KNOW. PLEASE REFACTOR IT!!!
  *
  * This function is one of the keys of CliFM. It will perform a series of
@@ -1548,8 +2292,8 @@ expand_int_var(char **name)
  * argument */
 
 /* This shit is HUGE! Almost 1000 LOC and a lot of indentation! */
-char **
-parse_input_str(char *str)
+static char **
+parse_input(char *str)
 {
 	if (!str)
 		return (char **)NULL;
@@ -1562,6 +2306,8 @@ parse_input_str(char *str)
 #endif /* NO_TAGS */
 
 	flags &= ~FIRST_WORD_IS_ELN;
+	raw_args.n = 0;
+	raw_args.on = 0;
 
 	/* If internal command plus fused parameter, split it */
 	if (is_fused_param(str) == EXIT_SUCCESS) {
@@ -1944,6 +2690,10 @@ parse_input_str(char *str)
 				 * #   2.e) SEL EXPANSION   #
 				 * ##########################*/
 
+	raw_args.on = raw_args.allowed == 1 ? takes_raw_args(substr, args_n) : 0;
+	if (raw_args.on == 1)
+		resize_raw_args(args_n + 1);
+
 	/*  if (is_sel && *substr[0] != '/') { */
 	if (is_sel > 0) {
 		if ((size_t)is_sel == args_n)
@@ -1976,7 +2726,7 @@ parse_input_str(char *str)
 		 * #   2.g) USER DEFINED VARIABLES EXPANSION   #
 		 * #############################################*/
 
-		if (int_vars && usrvar_n > 0) {
+		if (int_vars && usrvar_n > 0 && is_raw_word(i) == 0) {
 			if (substr[i][0] == '$' && substr[i][1] && substr[i][1] != '('
 			&& substr[i][1] != '{')
 				expand_int_var(&substr[i]);
@@ -1986,7 +2736,7 @@ parse_input_str(char *str)
 				 * #  2.h) ENVIRONEMNT VARIABLES  #
 				 * ###############################*/
 
-		if (*substr[i] == '$') {
+		if (*substr[i] == '$' && is_raw_word(i) == 0) {
 			char *p = getenv(substr[i] + 1);
 			if (p) {
 				substr[i] = (char *)xrealloc(substr[i], (strlen(p) + 1) * sizeof(char));
@@ -1998,7 +2748,7 @@ parse_input_str(char *str)
 					 * #  2.i) TILDE: ~user and home  #
 					 * ################################ */
 
-		if (*substr[i] == '~') { //&& substr[i][1] && substr[i][1] != '/') {
+		if (*substr[i] == '~' && is_raw_word(i) == 0) {
 			char *p = tilde_expand(substr[i]);
 			if (p) {
 				free(substr[i]);
@@ -2036,7 +2786,10 @@ parse_input_str(char *str)
 #ifndef _NO_TAGS
 	if (ntags > 0) {
 		for(i = 0; i < ntags; i++) {
+			const size_t old_n = args_n;
 			size_t tn = expand_tag(&substr, tag_index[i]);
+			if (tn > 0)
+				splice_raw_args((size_t)tag_index[i], args_n + 1 - old_n);
 			/* TN is the amount of files tagged as SUBSTR[TAG_INDEX[I]]
 			 * Let's update the index of the next tag expression using this
 			 * value: if the next tag expression was at index 2, and if
@@ -2101,6 +2854,7 @@ parse_input_str(char *str)
 				substr = ret;
 				ret = (char **)NULL;
 				args_n += (c > 0 ? c - 1 : 0);
+				splice_raw_args((size_t)index, c);
 			}
 		}
 
@@ -2153,6 +2907,7 @@ parse_input_str(char *str)
 				substr = ret;
 				ret = (char **)NULL;
 				args_n += (c > 0 ? c - 1 : 0);
+				splice_raw_args((size_t)index, c);
 			}
 		}
 
@@ -2204,6 +2959,7 @@ parse_input_str(char *str)
 				substr = ret;
 				ret = (char **)NULL;
 				args_n += (c > 0 ? c - 1 : 0);
+				splice_raw_args((size_t)index, c);
 			}
 		}
 
@@ -2237,10 +2993,8 @@ parse_input_str(char *str)
 
 	int *glob_array = (int *)xnmalloc(int_array_max, sizeof(int));
 	size_t glob_n = 0;
-#if !defined(__HAIKU__) && !defined(__OpenBSD__) && !defined(__ANDROID__)
 	int *word_array = (int *)xnmalloc(int_array_max, sizeof(int));
 	size_t word_n = 0;
-#endif /* !__HAIKU__ && !__OpenBSD__ && !__ANDROID__ */
 
 	for (i = 0; substr[i]; i++) {
 		if (is_action == 1 && i == 0)
@@ -2255,6 +3009,10 @@ parse_input_str(char *str)
 				continue;
 		}
 
+		/* Raw file names (expanded from ELN's or sel) are not patterns */
+		if (is_raw_word(i) == 1)
+			continue;
+
 		/* Ignore the first string of the search function: it will be
 		 * expanded by the search function itself */
 		if (substr[0][0] == '/' && i == 0)
@@ -2285,21 +3043,19 @@ parse_input_str(char *str)
 				}
 			}
 
-#if !defined(__HAIKU__) && !defined(__OpenBSD__) && !defined(__ANDROID__)
 			/* Command substitution, tilde and environment variables
-			 * expansion is made by wordexp() */
+			 * expansion is made by expand_word() */
 			if ((substr[i][j] == '$' && (substr[i][j + 1] == '('
 			|| substr[i][j + 1] == '{')) // command substitution
 			|| (substr[i][j] == '`' && substr[i][j + 1] != ' ') // command substitution
 			|| substr[i][j] == '~' || substr[i][j] == '$') { // tilde and env vars expansion
-				/* Unlike glob() and tilde_expand(), wordexp() can expand tilde
-				 * and env vars even in the middle of a string. Ex: $HOME/Downloads */
+				/* Unlike glob() and tilde_expand(), expand_word() can expand
+				 * env vars even in the middle of a string. Ex: $HOME/Downloads */
 				if (word_n < int_array_max) {
 					word_array[word_n] = (int)i;
 					word_n++;
 				}
 			}
-#endif /* __HAIKU__ && !OpenBSD && !__ANDROID__ */
 		}
 	}
 
@@ -2337,70 +3093,29 @@ parse_input_str(char *str)
 		*/
 		size_t g = 0;
 		for (g = 0; g < (size_t)glob_n; g++) {
-			glob_t globbuf;
+			char **pathv = (char **)NULL;
+			size_t pathc = 0;
+			const size_t at = (size_t)glob_array[g] + old_pathc;
 
-			if (glob(substr[glob_array[g] + (int)old_pathc],
-				GLOB_BRACE | GLOB_TILDE, NULL, &globbuf) != EXIT_SUCCESS) {
-				globfree(&globbuf);
+			if (xglob(substr[at], &pathv, &pathc) != EXIT_SUCCESS)
 				continue;
-			}
-
-			if (globbuf.gl_pathc) {
-				size_t j = 0;
-				char **glob_cmd = (char **)NULL;
-				glob_cmd = (char **)xcalloc(args_n + globbuf.gl_pathc + 1, sizeof(char *));
-
-				for (i = 0; i < ((size_t)glob_array[g] + old_pathc); i++) {
-					glob_cmd[j] = savestring(substr[i], strlen(substr[i]));
-					j++;
-				}
 
-				for (i = 0; i < globbuf.gl_pathc; i++) {
-					if (SELFORPARENT(globbuf.gl_pathv[i]))
-						continue;
-
-					/* Escape the globbed file name and copy it */
-					char *esc_str = escape_str(globbuf.gl_pathv[i]);
-					if (esc_str) {
-						glob_cmd[j] = esc_str;
-						j++;
-					} else {
-						_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: %s: Error "
-							"quoting file name\n"), PROGRAM_NAME,
-							globbuf.gl_pathv[i]);
-						size_t k = 0;
-						for (k = 0; k < j; k++)
-							free(glob_cmd[k]);
-						free(glob_cmd);
-						glob_cmd = (char **)NULL;
-
-						for (k = 0; k <= args_n; k++)
-							free(substr[k]);
-						free(substr);
-						globfree(&globbuf);
-						return (char **)NULL;
-					}
-				}
-
-				for (i = (size_t)glob_array[g] + old_pathc + 1;
-				i <= args_n; i++) {
-					glob_cmd[j] = savestring(substr[i], strlen(substr[i]));
-					j++;
-				}
+			const int ret = splice_words(&substr, at, pathv, pathc);
 
-				glob_cmd[j] = (char *)NULL;
+			for (i = 0; i < pathc; i++)
+				free(pathv[i]);
+			free(pathv);
 
+			if (ret != EXIT_SUCCESS) {
 				for (i = 0; i <= args_n; i++)
 					free(substr[i]);
 				free(substr);
-
-				substr = glob_cmd;
-				glob_cmd = (char **)NULL;
-				args_n = j - 1;
+				free(glob_array);
+				free(word_array);
+				return (char **)NULL;
 			}
 
-			old_pathc += (globbuf.gl_pathc - 1);
-			globfree(&globbuf);
+			old_pathc += (pathc - 1);
 		}
 	}
 
@@ -2409,78 +3124,35 @@ parse_input_str(char *str)
 		/* #############################################
 		 * #    4) COMMAND & PARAMETER SUBSTITUTION    #
 		 * ############################################# */
-#if !defined(__HAIKU__) && !defined(__OpenBSD__) && !defined(__ANDROID__)
 	if (word_n > 0) {
 		size_t old_pathc = 0;
 		size_t w = 0;
 		for (w = 0; w < (size_t)word_n; w++) {
-			wordexp_t wordbuf;
-			if (wordexp(substr[word_array[w] + (int)old_pathc],
-				&wordbuf, 0) != EXIT_SUCCESS) {
-				wordfree(&wordbuf);
+			size_t wordc = 0;
+			const size_t at = (size_t)word_array[w] + old_pathc;
+			char **wordv = expand_word(substr[at], &wordc);
+			if (!wordv)
 				continue;
-			}
 
-			if (wordbuf.we_wordc) {
-				size_t j = 0;
-				char **word_cmd = (char **)NULL;
+			const int ret = splice_words(&substr, at, wordv, wordc);
 
-				word_cmd = (char **)xcalloc(args_n + wordbuf.we_wordc + 1,
-							sizeof(char *));
-
-				for (i = 0; i < ((size_t)word_array[w] + old_pathc); i++) {
-					word_cmd[j] = savestring(substr[i], strlen(substr[i]));
-					j++;
-				}
-
-				for (i = 0; i < wordbuf.we_wordc; i++) {
-					/* Escape the globbed file name and copy it */
-					char *esc_str = escape_str(wordbuf.we_wordv[i]);
-					if (esc_str) {
-						word_cmd[j] = esc_str;
-						j++;
-					} else {
-						_err(ERR_NO_STORE, NOPRINT_PROMPT, _("%s: %s: Error "
-							"quoting file name\n"), PROGRAM_NAME,
-							wordbuf.we_wordv[i]);
-
-						size_t k = 0;
-						for (k = 0; k < j; k++)
-							free(word_cmd[k]);
-						free(word_cmd);
-
-						word_cmd = (char **)NULL;
-
-						for (k = 0; k <= args_n; k++)
-							free(substr[k]);
-						free(substr);
-						return (char **)NULL;
-					}
-				}
-
-				for (i = (size_t)word_array[w] + old_pathc + 1;
-				i <= args_n; i++) {
-					word_cmd[j] = savestring(substr[i], strlen(substr[i]));
-					j++;
-				}
-
-				word_cmd[j] = (char *)NULL;
+			for (i = 0; i < wordc; i++)
+				free(wordv[i]);
+			free(wordv);
 
+			if (ret != EXIT_SUCCESS) {
 				for (i = 0; i <= args_n; i++)
 					free(substr[i]);
 				free(substr);
-				substr = word_cmd;
-				word_cmd = (char **)NULL;
-				args_n = j - 1;
+				free(word_array);
+				return (char **)NULL;
 			}
 
-			old_pathc += (wordbuf.we_wordc - 1);
-			wordfree(&wordbuf);
+			old_pathc += (wordc - 1);
 		}
 	}
 
 	free(word_array);
-#endif /* !__HAIKU__ && !__OpenBSD && !__ANDROID__ */
 
 	if (substr[0] && (*substr[0] == 'd' || *substr[0] == 'u')
 	&& (strcmp(substr[0], "desel") == 0 || strcmp(substr[0], "undel") == 0
@@ -2503,16 +3175,25 @@ parse_input_str(char *str)
 	/* Let's store all strings currently in substr plus REGEX expanded
 	 * files, if any, in a temporary array */
 	char **tmp = (char **)xnmalloc(files + args_n + 2, sizeof(char *));
+	/* TMP_RAW[N] is 1 if TMP[N] is a raw file name */
+	char *tmp_raw = (char *)xcalloc(files + args_n + 2, sizeof(char));
 	size_t j, n = 0;
+	int reg_expanded = 0;
+	/* File names already in tmp, to skip duplicate regex matches */
+	struct strset_t seen;
+	strset_init(&seen, files + args_n);
 
 	for (i = 0; substr[i]; i++) {
 		if (n > (files + args_n))
 			break;
 
 		/* Ignore the first string of the search function: it will be
-		 * expanded by the search function itself */
-		if (*substr[0] == '/') {
+		 * expanded by the search function itself. Raw file names are not
+		 * regular expressions either */
+		if (*substr[0] == '/' || is_raw_word(i) == 1) {
 			tmp[n] = substr[i];
+			tmp_raw[n] = (char)is_raw_word(i);
+			strset_add(&seen, substr[i]);
 			n++;
 			continue;
 		}
@@ -2527,6 +3208,7 @@ parse_input_str(char *str)
 		free(dstr);
 		if (ret != EXIT_SUCCESS) {
 			tmp[n] = substr[i];
+			strset_add(&seen, substr[i]);
 			n++;
 			continue;
 		}
@@ -2535,6 +3217,7 @@ parse_input_str(char *str)
 		if (regcomp(&regex, substr[i], REG_NOSUB | REG_EXTENDED) != EXIT_SUCCESS) {
 			regfree(&regex);
 			tmp[n] = substr[i];
+			strset_add(&seen, substr[i]);
 			n++;
 			continue;
 		}
@@ -2546,30 +3229,29 @@ parse_input_str(char *str)
 				continue;
 
 			/* Make sure the matching file name is not already in the tmp array */
-			int m = (int)n, found = 0;
-			while (--m >= 0) {
-				if (*file_info[j].name == *tmp[m]
-				&& strcmp(file_info[j].name, tmp[m]) == 0)
-					found = 1;
-			}
-
-			if (found == 1)
+			if (strset_add(&seen, file_info[j].name) == 0)
 				continue;
 
 			tmp[n] = file_info[j].name;
+			tmp_raw[n] = (char)raw_args.on;
 			n++;
 			reg_found = 1;
 		}
 
 		if (reg_found == 0) {
 			tmp[n] = substr[i];
+			strset_add(&seen, substr[i]);
 			n++;
+		} else {
+			reg_expanded = 1;
 		}
 
 		regfree(&regex);
 	}
 
-	if (n > 0) {
+	/* If nothing was expanded, TMP holds exactly the words in SUBSTR:
+	 * there is nothing to rebuild */
+	if (reg_expanded == 1 && n > 0) {
 		tmp[n] = (char *)NULL;
 		char **tmp_files = (char **)xnmalloc(n + 2, sizeof(char *));
 		size_t k = 0;
@@ -2587,8 +3269,15 @@ parse_input_str(char *str)
 		tmp_files = (char **)NULL;
 		args_n = k - 1;
 		free(tmp_files);
+
+		if (raw_args.on == 1) {
+			resize_raw_args(n);
+			memcpy(raw_args.raw, tmp_raw, n);
+		}
 	}
 
+	strset_free(&seen);
+	free(tmp_raw);
 	free(tmp);
 	substr = (char **)xrealloc(substr, (args_n + 2) * sizeof(char *));
 	substr[args_n + 1] = (char *)NULL;
@@ -2596,6 +3285,34 @@ parse_input_str(char *str)
 	return substr;
 }
 
+/* Split the command line STR into words, performing all expansions.
+ * If RAW is not NULL, and the command takes them, selected files and
+ * expanded ELN's are stored as raw file names: *RAW is then set to an
+ * array telling which words are raw (see is_raw_arg()), to be freed
+ * along with the returned vector, or to NULL if no word is */
+char **
+parse_input_str(char *str, char **raw)
+{
+	if (raw)
+		*raw = (char *)NULL;
+
+	raw_args.allowed = raw ? 1 : 0;
+	char **substr = parse_input(str);
+
+	if (substr && raw && raw_args.on == 1) {
+		resize_raw_args(args_n + 1);
+		if (memchr(raw_args.raw, 1, raw_args.n)) {
+			*raw = raw_args.raw;
+			raw_args.raw = (char *)NULL;
+			raw_args.size = 0;
+		}
+	}
+
+	raw_args.n = 0;
+	raw_args.on = raw_args.allowed = 0;
+	return substr;
+}
+
 /* Reduce "$HOME" to tilde ("~"). The new_path variable is always either
  * "$HOME" or "$HOME/file", that's why there's no need to check for
  * "/file"
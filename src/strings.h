@@ -29,11 +29,25 @@
 #define UPDATE_ARGS    1
 #define NO_UPDATE_ARGS 0
 
+/* A glob pattern compiled by compile_glob() */
+struct glob_pat_t {
+	char **segs;    /* Literal (unescaped) segments between stars */
+	size_t *lens;
+	size_t segs_n;
+	int lead_star;  /* The pattern starts with a star */
+	int trail_star; /* The pattern ends with a star */
+	int simple;     /* Only literals and stars */
+	int pad;
+};
+
 __BEGIN_DECLS
 
+void compile_glob(const char *, struct glob_pat_t *);
 char *dequote_str(char *, int);
 char *escape_str(const char *);
 int  *expand_range(char *, int);
+void free_glob_pat(struct glob_pat_t *);
+int  is_raw_arg(const char *, const size_t);
 //int  fuzzy_match(char *, char *, const int, const int);
 
 //int  fuzzy_match(char *, char *, const int);
@@ -44,7 +58,8 @@ char *get_last_chr(char *, const char, const int);
 //char *get_last_space(char *, const int);
 char **get_substr(char *, const char);
 char *home_tilde(char *, int *);
-char **parse_input_str(char *);
+int  match_simple_glob(const struct glob_pat_t *, const char *);
+char **parse_input_str(char *, char **);
 char *remove_quotes(char *);
 char *replace_slashes(char *, const char);
 char *replace_substr(char *, char *, char *);
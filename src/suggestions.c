@@ -47,6 +47,8 @@ typedef char *rl_cpvfunc_t;
 #endif
 
 #include "aux.h"
+#include "history.h"
+#include "bookmarks.h"
 #include "checks.h"
 #include "colors.h"
 #include "fuzzy_match.h"
@@ -1989,23 +1991,22 @@ check_bookmark_names(char *word, const size_t len)
 		l = w == q ? strlen(w) : len;
 	}
 
+	/* Named bookmarks matching W, case insensitively */
+	size_t *ids = (size_t *)NULL;
+	const size_t n = get_bm_name_range(w, l, &ids);
+
 	size_t i;
-	for (i = 0; i < bm_n; i++) {
-		if (!bookmarks[i].name || !*bookmarks[i].name)
-			continue;
+	for (i = 0; i < n; i++) {
+		const char *name = bookmarks[ids[i]].name;
 
-		if (conf.case_sens_list == 0
-		? (TOUPPER(*w) == TOUPPER(*bookmarks[i].name)
-		&& strncasecmp(w, bookmarks[i].name, l) == 0)
-		: (*w == *bookmarks[i].name
-		&& strncmp(w, bookmarks[i].name, l) == 0)) {
-			if (prefix == 2 && !*(bookmarks[i].name + l)) // full match
+		if (conf.case_sens_list == 0 || strncmp(w, name, l) == 0) {
+			if (prefix == 2 && !*(name + l)) // full match
 				break;
 
-			char *p = escape_str(bookmarks[i].name);
+			char *p = escape_str(name);
 
 			suggestion.type = prefix == 2 ? BM_PREFIX_SUG : BM_NAME_SUG;
-			print_suggestion(p ? p : bookmarks[i].name, len - prefix, sx_c);
+			print_suggestion(p ? p : (char *)name, len - prefix, sx_c);
 
 			free(p);
 			free(q);
@@ -2065,7 +2066,9 @@ check_dirhist(char *word, const size_t len)
 
 	int i = dirhist_total_index;
 	while (--i >= 0) {
-		if (!old_pwd[i] || !*old_pwd[i] || *old_pwd[i] == _ESC)
+		/* Skip invalid entries and older duplicates */
+		if (!old_pwd[i] || !*old_pwd[i] || *old_pwd[i] == _ESC
+		|| dirhist_is_latest(i) == 0)
 			continue;
 
 		if (conf.fuzzy_match == 0 || rl_point < rl_end) {
@@ -33,96 +33,37 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#if defined(_LINUX_XATTR)
+# include <sys/xattr.h>
+#endif /* _LINUX_XATTR */
 
 #include "aux.h"
 #include "checks.h"
 #include "colors.h"
 #include "exec.h"
+#include "filter.h"
 #include "misc.h"
 #include "navigation.h"
+#include "persist.h"
 #include "readline.h"
 #include "sort.h"
 #include "trash.h"
 #include "listing.h"
+#include "messages.h"
 
-static size_t
-count_trashed_files(void)
-{
-	size_t n = 0;
-	if (trash_ok && trash_files_dir) {
-		n = (size_t)count_dir(trash_files_dir, NO_CPOP);
-		if (n <= 2)
-			n = 0;
-		else
-			n -= 2;
-	}
+#define TRASH_SORT_NAME 0
+#define TRASH_SORT_DATE 1
+#define TRASH_SORT_DIR  2
 
-	return n;
-}
-
-/* Recursively check directory permissions (write and execute). Returns
- * zero if OK, and one if at least one subdirectory does not have
- * write/execute permissions */
-static int
-recur_perm_check(const char *dirname)
-{
-	DIR *dir;
-	struct dirent *ent;
-#if !defined(_DIRENT_HAVE_D_TYPE)
-	struct stat attr;
-#endif
-
-	if (!(dir = opendir(dirname)))
-		return EXIT_FAILURE;
-
-	while ((ent = readdir(dir)) != NULL) {
-#if !defined(_DIRENT_HAVE_D_TYPE)
-		if (lstat(ent->d_name, &attr) == -1)
-			continue;
-		if (S_ISDIR(attr.st_mode)) {
-#else
-		if (ent->d_type == DT_DIR) {
-#endif
-			char dirpath[PATH_MAX] = "";
-
-			if (*ent->d_name == '.' && (!ent->d_name[1]
-			|| (ent->d_name[1] == '.' && !ent->d_name[2])))
-				continue;
-
-			snprintf(dirpath, PATH_MAX, "%s/%s", dirname, ent->d_name);
-
-			if (access(dirpath, W_OK | X_OK) != 0) {
-				/* recur_perm_error_flag needs to be a global variable.
-				  * Otherwise, since this function calls itself
-				  * recursivelly, the flag would be reset upon every
-				  * new call, without preserving the error code, which
-				  * is what the flag is aimed to do. On the other side,
-				  * if I use a local static variable for this flag, it
-				  * will never drop the error value, and all subsequent
-				  * calls to the function will allways return error
-				  * (even if there's no actual error) */
-				recur_perm_error_flag = 1;
-				fprintf(stderr, _("%s: Permission denied\n"), dirpath);
-			}
-
-			recur_perm_check(dirpath);
-		}
-	}
-
-	closedir(dir);
-
-	if (recur_perm_error_flag)
-		return EXIT_FAILURE;
-
-	return EXIT_SUCCESS;
-}
+/* Returned by copy_tree() for files only mv(1) can move faithfully */
+#define XDEV_USE_MV (-1)
 
 /* Check whether the current user has enough permissions (write, execute)
  * to modify the contents of the parent directory of 'file'. 'file' needs
  * to be an absolute path. Returns zero if yes and one if no. Useful to
  * know if a file can be removed from or copied into the parent. In case
- * FILE is a directory, the function checks all its subdirectories for
- * appropriate permissions, including the immutable bit */
+ * FILE is a directory, the directory itself is checked for appropriate
+ * permissions, including the immutable bit */
 static int
 wx_parent_check(char *file)
 {
@@ -164,46 +105,19 @@ wx_parent_check(char *file)
 		} else if (ret == 1) {
 			fprintf(stderr, _("%s: Directory is immutable\n"), file);
 			exit_status = EXIT_FAILURE;
-		} else if (access(parent, W_OK | X_OK) == 0) {
-		/* Check the parent for appropriate permissions */
-			int files_n = count_dir(parent, NO_CPOP);
-
-			if (files_n > 2) {
-				/* I manually check here subdir because recur_perm_check()
-				 * will only check the contents of subdir, but not subdir
-				 * itself */
-				/* If the parent is ok and not empty, check subdir */
-				if (access(file, W_OK | X_OK) == 0) {
-					/* If subdir is ok and not empty, recusivelly check
-					 * subdir */
-					files_n = count_dir(file, NO_CPOP);
-
-					if (files_n > 2) {
-						/* Reset the recur_perm_check() error flag. See
-						 * the note in the function block. */
-						recur_perm_error_flag = 0;
-
-						if (recur_perm_check(file) == 0) {
-							exit_status = EXIT_SUCCESS;
-						} else {
-							/* recur_perm_check itself will print the
-							 * error messages */
-							exit_status = EXIT_FAILURE;
-						}
-					} else { /* Subdir is ok and empty */
-						exit_status = EXIT_SUCCESS;
-					}
-				} else { /* No permission for subdir */
-					fprintf(stderr, _("%s: Permission denied\n"),
-					    file);
-					exit_status = EXIT_FAILURE;
-				}
-			} else {
-				exit_status = EXIT_SUCCESS;
-			}
-		} else { /* No permission for parent */
+		} else if (access(parent, W_OK | X_OK) != 0) {
 			fprintf(stderr, _("%s: Permission denied\n"), parent);
 			exit_status = EXIT_FAILURE;
+		} else if (access(file, W_OK | X_OK) != 0) {
+			/* Moving a directory to a different parent requires write
+			 * access to the directory itself (its '..' entry is updated).
+			 * Subdirectories only matter if the directory is moved to a
+			 * different file system: they are checked while copying (see
+			 * xdev_move()) */
+			fprintf(stderr, _("%s: Permission denied\n"), file);
+			exit_status = EXIT_FAILURE;
+		} else {
+			exit_status = EXIT_SUCCESS;
 		}
 		break;
 
@@ -253,75 +167,1293 @@ wx_parent_check(char *file)
 		break;
 	}
 
-	if (parent)
-		free(parent);
-
-	return exit_status;
+	if (parent)
+		free(parent);
+
+	return exit_status;
+}
+
+/* The trash catalog
+ * An index of the trash can contents (one entry per trashed file:
+ * trashed name, original path, deletion date, size, and file type), so
+ * that we do not need to scan Trash/files and read every .trashinfo file
+ * each time the trash is listed or a file is untrashed.
+ *
+ * It is kept in memory and backed by an append-only journal (CATALOG_FILE
+ * in the trash directory). Each command appends its changes ('+' and '-'
+ * records), followed by a stamp record ('@') holding the modification
+ * times of Trash/files and Trash/info. If the stamp does not match (the
+ * trash was modified by a third party, or the journal is truncated), the
+ * catalog is rebuilt from the trash directory itself. Once dead records
+ * outnumber live ones, the journal is rewritten (compacted). */
+
+#define CATALOG_FILE   "clifm.catalog"
+#define CATALOG_HEADER "#clifm-trash-catalog 1"
+#define CATALOG_MIN_IDX 256
+/* Do not bother compacting the journal below this number of dead records */
+#define CATALOG_MIN_DEAD 64
+
+struct trash_entry_t {
+	char *name;    /* Name in Trash/files (NULL if the entry was removed) */
+	char *orig;    /* Decoded original path (NULL if unknown) */
+	off_t size;
+	time_t date;   /* Deletion date */
+	mode_t mode;
+	uint32_t hash; /* Hash of NAME */
+};
+
+struct trash_stamp_t {
+	time_t files_sec;
+	time_t info_sec;
+	long files_nsec;
+	long info_nsec;
+};
+
+static struct trash_catalog_t {
+	struct trash_entry_t *ent;
+	size_t *idx;     /* Open addressing index: entry number + 1 (0 == empty) */
+	char *trash;     /* Trash directory this catalog refers to */
+	FILE *journal;   /* Open while a command is modifying the catalog */
+	size_t n;        /* Used entries (live and dead) */
+	size_t cap;
+	size_t live;
+	size_t idx_size; /* Always a power of two */
+	struct trash_stamp_t stamp;
+	int loaded;
+	int pad;
+} tcat;
+
+static int
+get_trash_stamp(struct trash_stamp_t *s)
+{
+	struct stat a, b;
+	if (stat(trash_files_dir, &a) == -1 || stat(trash_info_dir, &b) == -1)
+		return EXIT_FAILURE;
+
+	s->files_sec = a.st_mtime;
+	s->info_sec = b.st_mtime;
+#if defined(__linux__)
+	s->files_nsec = a.st_mtim.tv_nsec;
+	s->info_nsec = b.st_mtim.tv_nsec;
+#else
+	s->files_nsec = s->info_nsec = 0;
+#endif /* __linux__ */
+
+	return EXIT_SUCCESS;
+}
+
+static int
+same_trash_stamp(const struct trash_stamp_t *a, const struct trash_stamp_t *b)
+{
+	return (a->files_sec == b->files_sec && a->info_sec == b->info_sec
+	&& a->files_nsec == b->files_nsec && a->info_nsec == b->info_nsec);
+}
+
+static void
+reset_trash_catalog(void)
+{
+	size_t i;
+	for (i = 0; i < tcat.n; i++) {
+		free(tcat.ent[i].name);
+		free(tcat.ent[i].orig);
+	}
+
+	free(tcat.ent);
+	free(tcat.idx);
+	tcat.ent = (struct trash_entry_t *)NULL;
+	tcat.idx = (size_t *)NULL;
+	tcat.n = tcat.cap = tcat.live = tcat.idx_size = 0;
+	tcat.loaded = 0;
+}
+
+void
+free_trash_catalog(void)
+{
+	if (tcat.journal) {
+		fclose(tcat.journal);
+		tcat.journal = (FILE *)NULL;
+	}
+
+	reset_trash_catalog();
+	free(tcat.trash);
+	tcat.trash = (char *)NULL;
+}
+
+static void
+index_trash_entry(const size_t n)
+{
+	size_t mask = tcat.idx_size - 1;
+	size_t i = tcat.ent[n].hash & mask;
+
+	while (tcat.idx[i] != 0)
+		i = (i + 1) & mask;
+
+	tcat.idx[i] = n + 1;
+}
+
+/* Rebuild the index of the catalog, dropping removed entries */
+static void
+reindex_trash_catalog(const size_t min)
+{
+	size_t i, j = 0;
+	for (i = 0; i < tcat.n; i++) {
+		if (!tcat.ent[i].name) {
+			free(tcat.ent[i].orig);
+			continue;
+		}
+		if (i != j)
+			tcat.ent[j] = tcat.ent[i];
+		j++;
+	}
+	tcat.n = tcat.live = j;
+
+	size_t size = CATALOG_MIN_IDX;
+	while (size < (min > tcat.n ? min : tcat.n) * 2)
+		size <<= 1;
+
+	if (size != tcat.idx_size) {
+		free(tcat.idx);
+		tcat.idx = (size_t *)xnmalloc(size, sizeof(size_t));
+		tcat.idx_size = size;
+	}
+	memset(tcat.idx, 0, size * sizeof(size_t));
+
+	for (i = 0; i < tcat.n; i++)
+		index_trash_entry(i);
+}
+
+/* Return the entry number of the trashed file NAME, or -1 if not found.
+ * Removed entries are kept in the index (as tombstones) until the next
+ * reindex, so that probe chains are not broken */
+static ssize_t
+find_trash_entry(const char *name)
+{
+	if (!name || !tcat.idx)
+		return (-1);
+
+	uint32_t hash = hashme32(name, HASH_SEED);
+	size_t mask = tcat.idx_size - 1;
+	size_t i = hash & mask;
+
+	while (tcat.idx[i] != 0) {
+		struct trash_entry_t *e = &tcat.ent[tcat.idx[i] - 1];
+		if (e->name && e->hash == hash && strcmp(e->name, name) == 0)
+			return (ssize_t)(tcat.idx[i] - 1);
+		i = (i + 1) & mask;
+	}
+
+	return (-1);
+}
+
+static void
+insert_trash_entry(char *name, char *orig, const off_t size,
+	const time_t date, const mode_t mode)
+{
+	ssize_t old = find_trash_entry(name);
+	if (old != -1) { /* Replace the previous entry */
+		free(tcat.ent[old].orig);
+		tcat.ent[old].orig = orig;
+		tcat.ent[old].size = size;
+		tcat.ent[old].date = date;
+		tcat.ent[old].mode = mode;
+		free(name);
+		return;
+	}
+
+	if (tcat.n == tcat.cap) {
+		tcat.cap = tcat.cap ? tcat.cap * 2 : 64;
+		tcat.ent = (struct trash_entry_t *)xrealloc(tcat.ent,
+			tcat.cap * sizeof(struct trash_entry_t));
+	}
+
+	/* Keep the load factor of the index below 1/2 */
+	if ((tcat.n + 1) * 2 > tcat.idx_size)
+		reindex_trash_catalog(tcat.n + 1);
+
+	struct trash_entry_t *e = &tcat.ent[tcat.n];
+	e->name = name;
+	e->orig = orig;
+	e->size = size;
+	e->date = date;
+	e->mode = mode;
+	e->hash = hashme32(name, HASH_SEED);
+
+	index_trash_entry(tcat.n);
+	tcat.n++;
+	tcat.live++;
+}
+
+static void
+remove_trash_entry(const char *name)
+{
+	ssize_t n = find_trash_entry(name);
+	if (n == -1)
+		return;
+
+	free(tcat.ent[n].name);
+	tcat.ent[n].name = (char *)NULL;
+	tcat.live--;
+}
+
+/* Return the next space separated field in the string pointed to by P */
+static char *
+next_catalog_field(char **p)
+{
+	char *s = *p;
+	if (!s || !*s)
+		return (char *)NULL;
+
+	char *e = strchr(s, ' ');
+	if (e) {
+		*e = '\0';
+		*p = e + 1;
+	} else {
+		*p = (char *)NULL;
+	}
+
+	return s;
+}
+
+/* Get the original path (url decoded) from the trash info file INFO */
+static char *
+read_trashinfo(const char *info, time_t *date)
+{
+	FILE *fp = fopen(info, "r");
+	if (!fp)
+		return (char *)NULL;
+
+	char *orig = (char *)NULL;
+	/* The max length for line is Path=(5) + PATH_MAX + \n(1) */
+	char line[PATH_MAX + 6];
+	memset(line, '\0', PATH_MAX + 6);
+
+	while (fgets(line, (int)sizeof(line), fp)) {
+		size_t len = strlen(line);
+		if (len > 0 && line[len - 1] == '\n')
+			line[len - 1] = '\0';
+
+		if (strncmp(line, "Path=", 5) == 0 && line[5]) {
+			free(orig);
+			orig = url_decode(line + 5);
+		} else if (date && strncmp(line, "DeletionDate=", 13) == 0) {
+			struct tm tm;
+			memset(&tm, 0, sizeof(struct tm));
+			if (sscanf(line + 13, "%d-%d-%dT%d:%d:%d", &tm.tm_year,
+			&tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min,
+			&tm.tm_sec) == 6) {
+				tm.tm_year -= 1900;
+				tm.tm_mon--;
+				tm.tm_isdst = -1;
+				*date = mktime(&tm);
+			}
+		}
+	}
+
+	fclose(fp);
+	return orig;
+}
+
+static int
+write_catalog_entry(FILE *fp, const struct trash_entry_t *e)
+{
+	char *name = url_encode(e->name);
+	char *orig = e->orig ? url_encode(e->orig) : (char *)NULL;
+	if (!name) {
+		free(orig);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(fp, "+ %lld %lld %o %s %s\n", (long long)e->date,
+		(long long)e->size, (unsigned int)e->mode, name, orig ? orig : "-");
+
+	free(name);
+	free(orig);
+	return EXIT_SUCCESS;
+}
+
+static void
+write_catalog_stamp(FILE *fp)
+{
+	if (get_trash_stamp(&tcat.stamp) == EXIT_FAILURE)
+		return;
+
+	fprintf(fp, "@ %lld %ld %lld %ld\n", (long long)tcat.stamp.files_sec,
+		tcat.stamp.files_nsec, (long long)tcat.stamp.info_sec,
+		tcat.stamp.info_nsec);
+}
+
+/* Rewrite the catalog file with live entries only */
+static void
+compact_trash_catalog(void)
+{
+	reindex_trash_catalog(0);
+
+	char file[PATH_MAX], tmp[PATH_MAX];
+	snprintf(file, sizeof(file), "%s/%s", trash_dir, CATALOG_FILE);
+	snprintf(tmp, sizeof(tmp), "%s/%s.tmp", trash_dir, CATALOG_FILE);
+
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd == -1)
+		return;
+
+	FILE *fp = fdopen(fd, "w");
+	if (!fp) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+
+	fprintf(fp, "%s\n", CATALOG_HEADER);
+	size_t i;
+	for (i = 0; i < tcat.n; i++)
+		write_catalog_entry(fp, &tcat.ent[i]);
+	write_catalog_stamp(fp);
+
+	if (fclose(fp) != 0 || rename(tmp, file) == -1)
+		unlink(tmp);
+}
+
+/* Rebuild the catalog from the trash directory */
+static void
+rebuild_trash_catalog(void)
+{
+	reset_trash_catalog();
+
+	DIR *dir = opendir(trash_files_dir);
+	if (!dir)
+		return;
+
+	int fd = dirfd(dir);
+	struct dirent *ent;
+	struct stat a;
+
+	while ((ent = readdir(dir)) != NULL) {
+		char *n = ent->d_name;
+		if (*n == '.' && (!n[1] || (n[1] == '.' && !n[2])))
+			continue;
+
+		if (fstatat(fd, n, &a, AT_SYMLINK_NOFOLLOW) == -1)
+			continue;
+
+		char info[PATH_MAX];
+		snprintf(info, sizeof(info), "%s/%s.trashinfo", trash_info_dir, n);
+		time_t date = 0;
+		char *orig = read_trashinfo(info, &date);
+
+		insert_trash_entry(savestring(n, strlen(n)), orig, a.st_size,
+			date, a.st_mode);
+	}
+
+	closedir(dir);
+	tcat.loaded = 1;
+	compact_trash_catalog();
+}
+
+/* Load the catalog file. Returns zero if it is consistent with the current
+ * state of the trash directory, or one otherwise */
+static int
+read_trash_catalog(const struct trash_stamp_t *cur)
+{
+	char file[PATH_MAX];
+	snprintf(file, sizeof(file), "%s/%s", trash_dir, CATALOG_FILE);
+
+	FILE *fp = fopen(file, "r");
+	if (!fp)
+		return EXIT_FAILURE;
+
+	reset_trash_catalog();
+
+	char *line = (char *)NULL;
+	size_t line_size = 0;
+	ssize_t len;
+	int ok = 0, lnum = 0;
+
+	while ((len = getline(&line, &line_size, fp)) > 0) {
+		/* A line not ending with a new line char means the journal
+		 * was truncated */
+		if (line[len - 1] != '\n') {
+			ok = 0;
+			break;
+		}
+		line[len - 1] = '\0';
+
+		if (lnum++ == 0) {
+			if (strcmp(line, CATALOG_HEADER) != 0)
+				break;
+			continue;
+		}
+
+		char *p = line + 2;
+		if (!*line || line[1] != ' ') {
+			ok = 0;
+			break;
+		}
+
+		if (*line == '@') {
+			struct trash_stamp_t s;
+			long long fs = 0, is = 0;
+			ok = (sscanf(p, "%lld %ld %lld %ld", &fs, &s.files_nsec, &is,
+				&s.info_nsec) == 4);
+			s.files_sec = (time_t)fs;
+			s.info_sec = (time_t)is;
+			ok = (ok && same_trash_stamp(&s, cur));
+			continue;
+		}
+
+		ok = 0;
+		if (*line == '-') {
+			char *name = url_decode(p);
+			remove_trash_entry(name);
+			free(name);
+			continue;
+		}
+
+		if (*line != '+')
+			break;
+
+		char *date = next_catalog_field(&p);
+		char *size = next_catalog_field(&p);
+		char *mode = next_catalog_field(&p);
+		char *name = next_catalog_field(&p);
+		char *orig = next_catalog_field(&p);
+		if (!date || !size || !mode || !name || !orig)
+			break;
+
+		insert_trash_entry(url_decode(name), (*orig == '-' && !orig[1])
+			? (char *)NULL : url_decode(orig), (off_t)strtoll(size, NULL, 10),
+			(time_t)strtoll(date, NULL, 10), (mode_t)strtoul(mode, NULL, 8));
+	}
+
+	free(line);
+	fclose(fp);
+
+	tcat.loaded = 1;
+	return ok == 1 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Make sure the catalog is loaded and up to date */
+static void
+load_trash_catalog(void)
+{
+	if (tcat.trash && strcmp(tcat.trash, trash_dir) != 0)
+		free_trash_catalog();
+
+	if (!tcat.trash)
+		tcat.trash = savestring(trash_dir, strlen(trash_dir));
+
+	struct trash_stamp_t cur;
+	if (get_trash_stamp(&cur) == EXIT_FAILURE) {
+		reset_trash_catalog();
+		return;
+	}
+
+	if (tcat.loaded == 1 && same_trash_stamp(&tcat.stamp, &cur))
+		return;
+
+	if (tcat.loaded == 0 && read_trash_catalog(&cur) == EXIT_SUCCESS) {
+		tcat.stamp = cur;
+		return;
+	}
+
+	rebuild_trash_catalog();
+}
+
+static FILE *
+get_catalog_journal(void)
+{
+	if (tcat.journal)
+		return tcat.journal;
+
+	char file[PATH_MAX];
+	snprintf(file, sizeof(file), "%s/%s", trash_dir, CATALOG_FILE);
+
+	int fd = open(file, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fd == -1)
+		return (FILE *)NULL;
+
+	tcat.journal = fdopen(fd, "a");
+	if (!tcat.journal)
+		close(fd);
+
+	return tcat.journal;
+}
+
+/* Record the file NAME (originally ORIG) as trashed */
+static void
+catalog_add(const char *name, const char *orig, const struct stat *a,
+	const time_t date)
+{
+	if (tcat.loaded == 0)
+		return;
+
+	insert_trash_entry(savestring(name, strlen(name)),
+		orig ? savestring(orig, strlen(orig)) : (char *)NULL,
+		a->st_size, date, a->st_mode);
+
+	FILE *fp = get_catalog_journal();
+	if (fp)
+		write_catalog_entry(fp, &tcat.ent[find_trash_entry(name)]);
+}
+
+/* Record the file NAME as no longer in the trash can */
+static void
+catalog_del(const char *name)
+{
+	if (tcat.loaded == 0)
+		return;
+
+	remove_trash_entry(name);
+
+	FILE *fp = get_catalog_journal();
+	char *p = fp ? url_encode((char *)name) : (char *)NULL;
+	if (p) {
+		fprintf(fp, "- %s\n", p);
+		free(p);
+	}
+}
+
+/* Close the journal, stamping it with the current state of the trash
+ * directory. Must be called after modifying the trash can */
+static void
+sync_trash_catalog(void)
+{
+	if (tcat.journal) {
+		write_catalog_stamp(tcat.journal);
+		fclose(tcat.journal);
+		tcat.journal = (FILE *)NULL;
+	} else if (tcat.loaded == 1) {
+		get_trash_stamp(&tcat.stamp);
+	}
+
+	if (tcat.loaded == 1 && tcat.n - tcat.live > CATALOG_MIN_DEAD
+	&& tcat.n - tcat.live > tcat.live)
+		compact_trash_catalog();
+}
+
+/* Return the original directory of the trashed entry E, writing its length
+ * into LEN */
+static const char *
+get_orig_dir(const struct trash_entry_t *e, size_t *len)
+{
+	if (!e->orig) {
+		*len = 0;
+		return "";
+	}
+
+	char *p = strrchr(e->orig, '/');
+	if (!p || p == e->orig) {
+		*len = 1;
+		return "/";
+	}
+
+	*len = (size_t)(p - e->orig);
+	return e->orig;
+}
+
+static int
+cmp_trash_name(const void *a, const void *b)
+{
+	const char *s1 = (*(struct trash_entry_t *const *)a)->name;
+	const char *s2 = (*(struct trash_entry_t *const *)b)->name;
+	int ret;
+
+	if (conf.unicode)
+		ret = strcoll(s1, s2);
+	else if (conf.case_sens_list)
+		ret = strcmp(s1, s2);
+	else
+		ret = strcasecmp(*s1 == '.' ? s1 + 1 : s1, *s2 == '.' ? s2 + 1 : s2);
+
+	return conf.sort_reverse ? -ret : ret;
+}
+
+/* Newest first */
+static int
+cmp_trash_date(const void *a, const void *b)
+{
+	const struct trash_entry_t *e1 = *(struct trash_entry_t *const *)a;
+	const struct trash_entry_t *e2 = *(struct trash_entry_t *const *)b;
+
+	if (e1->date != e2->date) {
+		int ret = e1->date > e2->date ? -1 : 1;
+		return conf.sort_reverse ? -ret : ret;
+	}
+
+	return cmp_trash_name(a, b);
+}
+
+static int
+cmp_trash_dir(const void *a, const void *b)
+{
+	const struct trash_entry_t *e1 = *(struct trash_entry_t *const *)a;
+	const struct trash_entry_t *e2 = *(struct trash_entry_t *const *)b;
+	size_t l1 = 0, l2 = 0;
+	const char *d1 = get_orig_dir(e1, &l1);
+	const char *d2 = get_orig_dir(e2, &l2);
+
+	int ret = strncmp(d1, d2, l1 < l2 ? l1 : l2);
+	if (ret == 0 && l1 != l2)
+		ret = l1 < l2 ? -1 : 1;
+	if (ret != 0)
+		return ret;
+
+	return cmp_trash_name(a, b);
+}
+
+/* Return a sorted (according to SORT: TRASH_SORT_NAME, TRASH_SORT_DATE,
+ * or TRASH_SORT_DIR) list of trashed entries, writing the number of
+ * entries into N. Hidden and filtered files are skipped, just as in the
+ * files list */
+static struct trash_entry_t **
+get_trash_list(const int sort, size_t *n)
+{
+	*n = 0;
+	load_trash_catalog();
+	if (tcat.live == 0)
+		return (struct trash_entry_t **)NULL;
+
+	struct trash_entry_t **list = (struct trash_entry_t **)xnmalloc(
+		tcat.live + 1, sizeof(struct trash_entry_t *));
+
+	size_t i;
+	for (i = 0; i < tcat.n; i++) {
+		char *name = tcat.ent[i].name;
+		if (!name || (conf.show_hidden == 0 && *name == '.'))
+			continue;
+		if (filter_match_name(name) == 1)
+			continue;
+		list[*n] = &tcat.ent[i];
+		(*n)++;
+	}
+
+	list[*n] = (struct trash_entry_t *)NULL;
+
+	qsort(list, *n, sizeof(struct trash_entry_t *),
+		sort == TRASH_SORT_DATE ? cmp_trash_date
+		: (sort == TRASH_SORT_DIR ? cmp_trash_dir : cmp_trash_name));
+
+	return list;
+}
+
+/* Same as get_trash_list(), but returning a copy of the names only */
+static char **
+get_trash_names(size_t *n)
+{
+	struct trash_entry_t **list = get_trash_list(TRASH_SORT_NAME, n);
+	if (!list)
+		return (char **)NULL;
+
+	char **names = (char **)xnmalloc(*n + 1, sizeof(char *));
+	size_t i;
+	for (i = 0; i < *n; i++)
+		names[i] = savestring(list[i]->name, strlen(list[i]->name));
+	names[i] = (char *)NULL;
+
+	free(list);
+	return names;
+}
+
+static void
+free_trash_names(char **names, const size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+		free(names[i]);
+	free(names);
+}
+
+/* Directories found while walking a file tree (see purge_tree() and
+ * copy_tree()). They are listed, and then closed, one at a time: the depth
+ * of the tree is not limited by the number of file descriptors. Since a
+ * directory is always appended after its parent, walking the list
+ * backwards visits children before their parents */
+struct walk_dir_t {
+	char *path;
+	char *dest; /* Path of the copy (copy_tree() only) */
+	struct stat a;
+};
+
+struct walk_list_t {
+	struct walk_dir_t *dirs;
+	size_t n;
+	size_t size;
+};
+
+static void
+walk_list_push(struct walk_list_t *l, char *path, char *dest,
+	const struct stat *a)
+{
+	if (l->n == l->size) {
+		l->size = l->size == 0 ? 32 : l->size * 2;
+		l->dirs = (struct walk_dir_t *)xrealloc(l->dirs,
+			l->size * sizeof(struct walk_dir_t));
+	}
+
+	l->dirs[l->n].path = path;
+	l->dirs[l->n].dest = dest;
+	l->dirs[l->n].a = *a;
+	l->n++;
+}
+
+static void
+walk_list_free(struct walk_list_t *l)
+{
+	size_t i;
+	for (i = 0; i < l->n; i++) {
+		free(l->dirs[i].path);
+		free(l->dirs[i].dest);
+	}
+	free(l->dirs);
+}
+
+/* Return a newly allocated string holding DIR/NAME */
+static char *
+walk_path(const char *dir, const char *name)
+{
+	const size_t dir_len = strlen(dir);
+	const size_t len = dir_len + strlen(name) + 2;
+	char *p = (char *)xnmalloc(len, sizeof(char));
+	snprintf(p, len, "%s%s%s", dir,
+		(dir_len > 0 && dir[dir_len - 1] == '/') ? "" : "/", name);
+	return p;
+}
+
+/* Open for reading the directory D, relative to the directory whose file
+ * descriptor is DFD. Fails with ENOENT if D was replaced (say, by a
+ * symbolic link) since it was found.
+ * Returns NULL, with errno set, on error */
+static DIR *
+walk_opendir(const int dfd, const struct walk_dir_t *d)
+{
+	const int fd = openat(dfd, d->path,
+		O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1)
+		return (DIR *)NULL;
+
+	struct stat a;
+	DIR *dir = (DIR *)NULL;
+	int err = 0;
+	if (fstat(fd, &a) == -1)
+		err = errno;
+	else if (a.st_dev != d->a.st_dev || a.st_ino != d->a.st_ino)
+		err = ENOENT;
+	else if (!(dir = fdopendir(fd)))
+		err = errno;
+
+	if (err != 0) {
+		close(fd);
+		errno = err;
+	}
+
+	return dir;
+}
+
+/* Remove the contents of the directory I in L, except subdirectories,
+ * which are appended to L.
+ * Returns zero on success or an errno value otherwise */
+static int
+purge_dir(const int dfd, struct walk_list_t *l, const size_t i)
+{
+	DIR *dir = walk_opendir(dfd, &l->dirs[i]);
+	if (!dir)
+		return errno;
+
+	/* L->DIRS might be reallocated below, but not the path itself */
+	const char *path = l->dirs[i].path;
+	const int fd = dirfd(dir);
+	int err = EXIT_SUCCESS;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		char *n = ent->d_name;
+		if (*n == '.' && (!n[1] || (n[1] == '.' && !n[2])))
+			continue;
+
+		if (unlinkat(fd, n, 0) == 0 || errno == ENOENT)
+			continue;
+
+		/* Linux returns EISDIR for directories, while POSIX mandates EPERM */
+		int ret = errno;
+		struct stat a;
+		if (ret == EISDIR || ret == EPERM) {
+			if (fstatat(fd, n, &a, AT_SYMLINK_NOFOLLOW) == -1)
+				ret = errno;
+			else if (S_ISDIR(a.st_mode))
+				ret = EXIT_SUCCESS;
+		}
+
+		if (ret == EXIT_SUCCESS)
+			walk_list_push(l, walk_path(path, n), (char *)NULL, &a);
+		else if (err == EXIT_SUCCESS)
+			err = ret;
+	}
+
+	closedir(dir);
+	return err;
+}
+
+/* Permanently remove the file NAME from the directory whose file
+ * descriptor is DFD, recursively if it is a directory. No more than one
+ * directory is open at a time, no matter how deep the tree is.
+ * Returns zero on success or an errno value otherwise */
+static int
+purge_tree(const int dfd, const char *name)
+{
+	if (unlinkat(dfd, name, 0) == 0 || errno == ENOENT)
+		return EXIT_SUCCESS;
+
+	/* Linux returns EISDIR for directories, while POSIX mandates EPERM */
+	if (errno != EISDIR && errno != EPERM)
+		return errno;
+
+	struct stat a;
+	if (fstatat(dfd, name, &a, AT_SYMLINK_NOFOLLOW) == -1)
+		return errno;
+	if (!S_ISDIR(a.st_mode))
+		return EPERM;
+
+	struct walk_list_t l = {NULL, 0, 0};
+	walk_list_push(&l, savestring(name, strlen(name)), (char *)NULL, &a);
+
+	int err = EXIT_SUCCESS;
+	size_t i;
+	for (i = 0; i < l.n; i++) {
+		const int ret = purge_dir(dfd, &l, i);
+		if (ret != EXIT_SUCCESS && err == EXIT_SUCCESS)
+			err = ret;
+	}
+
+	/* Children first */
+	i = l.n;
+	while (i-- > 0) {
+		if (unlinkat(dfd, l.dirs[i].path, AT_REMOVEDIR) == -1
+		&& err == EXIT_SUCCESS)
+			err = errno;
+	}
+
+	walk_list_free(&l);
+	return err;
+}
+
+struct trash_purge_t {
+	char **names;
+	int *errors;
+	int files_fd;
+	int info_fd;
+};
+
+/* Remove the trashed file I (and its info file) */
+static void
+purge_trashed_file(void *arg, const size_t i)
+{
+	struct trash_purge_t *p = (struct trash_purge_t *)arg;
+
+	int ret = purge_tree(p->files_fd, p->names[i]);
+	if (ret == EXIT_SUCCESS) {
+		char info[NAME_MAX + 12];
+		snprintf(info, sizeof(info), "%s.trashinfo", p->names[i]);
+		if (unlinkat(p->info_fd, info, 0) == -1 && errno != ENOENT)
+			ret = errno;
+	}
+
+	p->errors[i] = ret;
+}
+
+/* Permanently remove N trashed files (NAMES) from the trash can, using
+ * a worker pool. Returns zero if all files were removed, or one
+ * otherwise. The number of removed files is written into REMOVED */
+static int
+purge_trashed_files(char **names, const size_t n, size_t *removed)
+{
+	*removed = 0;
+	if (n == 0)
+		return EXIT_SUCCESS;
+
+	struct trash_purge_t p;
+	p.files_fd = open(trash_files_dir, O_RDONLY | O_DIRECTORY);
+	p.info_fd = open(trash_info_dir, O_RDONLY | O_DIRECTORY);
+	if (p.files_fd == -1 || p.info_fd == -1) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: %s\n",
+			p.files_fd == -1 ? trash_files_dir : trash_info_dir,
+			strerror(errno));
+		if (p.files_fd != -1)
+			close(p.files_fd);
+		if (p.info_fd != -1)
+			close(p.info_fd);
+		return EXIT_FAILURE;
+	}
+
+	p.names = names;
+	p.errors = (int *)xnmalloc(n, sizeof(int));
+
+	struct pool_t pool;
+	pool_init(&pool, n, purge_trashed_file, &p);
+	pool_run(&pool);
+
+	size_t i;
+	close(p.files_fd);
+	close(p.info_fd);
+
+	int exit_status = EXIT_SUCCESS;
+	for (i = 0; i < n; i++) {
+		if (p.errors[i] != EXIT_SUCCESS) {
+			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("trash: %s: Error removing "
+				"trashed file: %s\n"), names[i], strerror(p.errors[i]));
+			exit_status = EXIT_FAILURE;
+			continue;
+		}
+
+		catalog_del(names[i]);
+		(*removed)++;
+	}
+
+	free(p.errors);
+	return exit_status;
+}
+
+/* Set the access and modification times of the file DEST (a symbolic link
+ * itself if NOFOLLOW is set) to those stored in A */
+static void
+copy_file_times(const char *dest, const struct stat *a, const int nofollow)
+{
+	struct timespec ts[2];
+	ts[0].tv_sec = a->st_atime;
+	ts[1].tv_sec = a->st_mtime;
+#if defined(__linux__)
+	ts[0].tv_nsec = a->st_atim.tv_nsec;
+	ts[1].tv_nsec = a->st_mtim.tv_nsec;
+#else
+	ts[0].tv_nsec = ts[1].tv_nsec = 0;
+#endif /* __linux__ */
+
+	utimensat(AT_FDCWD, dest, ts, nofollow ? AT_SYMLINK_NOFOLLOW : 0);
+}
+
+/* Try to preserve the ownership of the file DEST (a symbolic link itself if
+ * NOFOLLOW is set). This fails unless we are root, which is not an error */
+static void
+copy_file_owner(const char *dest, const struct stat *a, const int nofollow)
+{
+	if (fchownat(AT_FDCWD, dest, a->st_uid, a->st_gid,
+	nofollow ? AT_SYMLINK_NOFOLLOW : 0) == -1)
+		return;
+}
+
+static int
+copy_reg_file(const char *src, const char *dest, const struct stat *a)
+{
+	int sfd = open(src, O_RDONLY);
+	if (sfd == -1)
+		return errno;
+
+	int dfd = open(dest, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (dfd == -1) {
+		int err = errno;
+		close(sfd);
+		return err;
+	}
+
+	char buf[65536];
+	ssize_t r;
+	int err = EXIT_SUCCESS;
+
+	while ((r = read(sfd, buf, sizeof(buf))) != 0) {
+		if (r == -1) {
+			if (errno == EINTR)
+				continue;
+			err = errno;
+			break;
+		}
+
+		char *p = buf;
+		while (r > 0) {
+			ssize_t w = write(dfd, p, (size_t)r);
+			if (w == -1) {
+				if (errno == EINTR)
+					continue;
+				err = errno;
+				break;
+			}
+			p += w;
+			r -= w;
+		}
+
+		if (err != EXIT_SUCCESS)
+			break;
+	}
+
+	close(sfd);
+
+	if (err == EXIT_SUCCESS) {
+		copy_file_owner(dest, a, 0);
+		fchmod(dfd, a->st_mode & 07777);
+	}
+
+	if (close(dfd) == -1 && err == EXIT_SUCCESS)
+		err = errno;
+
+	if (err == EXIT_SUCCESS)
+		copy_file_times(dest, a, 0);
+
+	return err;
+}
+
+#if defined(_LINUX_XATTR)
+/* Return 1 if the file PATH has extended attributes (ACLs included) other
+ * than its SELinux label, which is set anew by the target file system, or
+ * 0 otherwise */
+static int
+has_xattrs(const char *path)
+{
+	char list[4096];
+	ssize_t len = llistxattr(path, list, sizeof(list));
+	if (len == -1)
+		return errno == ERANGE;
+
+	ssize_t i = 0;
+	while (i < len) {
+		if (strcmp(list + i, "security.selinux") != 0)
+			return 1;
+		i += (ssize_t)strlen(list + i) + 1;
+	}
+
+	return 0;
+}
+#endif /* _LINUX_XATTR */
+
+/* Copy the file SRC, whose attributes are A, into DEST. SRC is not a
+ * directory.
+ * Returns zero, XDEV_USE_MV, or an errno value */
+static int
+copy_entry(const char *src, const char *dest, const struct stat *a)
+{
+	if (a->st_nlink > 1)
+		return XDEV_USE_MV;
+#if defined(_LINUX_XATTR)
+	if (has_xattrs(src) == 1)
+		return XDEV_USE_MV;
+#endif /* _LINUX_XATTR */
+
+	int err = EXIT_SUCCESS;
+
+	switch (a->st_mode & S_IFMT) {
+	case S_IFREG:
+		err = copy_reg_file(src, dest, a);
+		break;
+
+	case S_IFLNK: {
+		char target[PATH_MAX + 1];
+		ssize_t len = readlink(src, target, sizeof(target) - 1);
+		if (len == -1) {
+			err = errno;
+			break;
+		}
+		target[len] = '\0';
+
+		if (symlink(target, dest) == -1) {
+			err = errno;
+			break;
+		}
+
+		copy_file_owner(dest, a, 1);
+		copy_file_times(dest, a, 1);
+		}
+		break;
+
+	case S_IFIFO:
+		if (mkfifo(dest, a->st_mode & 07777) == -1)
+			err = errno;
+		break;
+
+	default: /* Sockets and devices: let mv(1) handle them */
+		return XDEV_USE_MV;
+	}
+
+	if (err != EXIT_SUCCESS)
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: %s\n",
+			src, strerror(err));
+
+	return err;
+}
+
+/* Check whether the directory SRC can be copied (and then removed), and
+ * create its copy DEST, to be filled in later.
+ * Returns zero, XDEV_USE_MV, or an errno value */
+static int
+copy_dir_start(const char *src, const char *dest)
+{
+#if defined(_LINUX_XATTR)
+	if (has_xattrs(src) == 1)
+		return XDEV_USE_MV;
+#endif /* _LINUX_XATTR */
+
+	if (access(src, W_OK | X_OK) != 0) {
+		fprintf(stderr, _("%s: Permission denied\n"), src);
+		return EACCES;
+	}
+
+	if (mkdir(dest, S_IRWXU) == -1) {
+		const int err = errno;
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: %s\n",
+			src, strerror(err));
+		return err;
+	}
+
+	return EXIT_SUCCESS;
 }
 
+/* Copy the contents of the directory I in L, except subdirectories, which
+ * are created empty and appended to L.
+ * Returns zero, XDEV_USE_MV, or an errno value */
 static int
-trash_clear(void)
+copy_dir(struct walk_list_t *l, const size_t i)
 {
-	struct dirent **trash_files = (struct dirent **)NULL;
-	int files_n = -1, exit_status = EXIT_SUCCESS;
-
-	if (xchdir(trash_files_dir, NO_TITLE) == -1) {
-		_err(0, NOPRINT_PROMPT, "trash: %s: %s\n",
-			trash_files_dir, strerror(errno));
-		return EXIT_FAILURE;
+	DIR *dir = walk_opendir(AT_FDCWD, &l->dirs[i]);
+	if (!dir) {
+		const int err = errno;
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: %s\n",
+			l->dirs[i].path, strerror(err));
+		return err;
 	}
 
-	files_n = scandir(trash_files_dir, &trash_files, skip_files, xalphasort);
+	/* L->DIRS might be reallocated below, but not the paths themselves */
+	const char *src = l->dirs[i].path;
+	const char *dest = l->dirs[i].dest;
+	const int fd = dirfd(dir);
+	int err = EXIT_SUCCESS;
 
-	if (!files_n) {
-		puts(_("trash: No trashed files"));
-		return EXIT_SUCCESS;
+	struct dirent *ent;
+	while (err == EXIT_SUCCESS && (ent = readdir(dir)) != NULL) {
+		char *n = ent->d_name;
+		if (*n == '.' && (!n[1] || (n[1] == '.' && !n[2])))
+			continue;
+
+		char *s = walk_path(src, n);
+		char *d = walk_path(dest, n);
+
+		struct stat a;
+		if (fstatat(fd, n, &a, AT_SYMLINK_NOFOLLOW) == -1) {
+			err = errno;
+			_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: %s\n",
+				s, strerror(err));
+		} else if (!S_ISDIR(a.st_mode)) {
+			err = copy_entry(s, d, &a);
+		} else if ((err = copy_dir_start(s, d)) == EXIT_SUCCESS) {
+			walk_list_push(l, s, d, &a);
+			continue;
+		}
+
+		free(s);
+		free(d);
 	}
 
-	int ret = EXIT_SUCCESS;
-	size_t i;
-	for (i = 0; i < (size_t)files_n; i++) {
-		size_t info_file_len = strlen(trash_files[i]->d_name) + 11;
-		char *info_file = (char *)xnmalloc(info_file_len, sizeof(char));
-		sprintf(info_file, "%s.trashinfo", trash_files[i]->d_name);
+	closedir(dir);
+	return err;
+}
+
+/* Copy SRC into DEST. Since the source will be removed once copied,
+ * directories lacking write or execute permission are reported as soon as
+ * found (and the copy aborted): this way the tree is traversed only once,
+ * instead of checking permissions beforehand.
+ * No more than one directory is open at a time, no matter how deep the
+ * tree is. The owner, mode, and times of directories are copied once the
+ * whole tree was, since copying their contents modifies them.
+ * Only directories, regular files, symbolic links, and FIFOs are copied.
+ * If SRC holds anything else, or anything this copy would not preserve
+ * (hard links and extended attributes), XDEV_USE_MV is returned, and the
+ * move is left to mv(1) (see xdev_move()).
+ * Returns zero on success or an errno value otherwise */
+static int
+copy_tree(const char *src, const char *dest)
+{
+	struct stat a;
+	if (lstat(src, &a) == -1) {
+		int err = errno;
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: %s\n",
+			src, strerror(err));
+		return err;
+	}
 
-		char *file1 = (char *)NULL;
-		file1 = (char *)xnmalloc(strlen(trash_files_dir) +
-					strlen(trash_files[i]->d_name) + 2, sizeof(char));
+	if (!S_ISDIR(a.st_mode))
+		return copy_entry(src, dest, &a);
 
-		sprintf(file1, "%s/%s", trash_files_dir, trash_files[i]->d_name);
+	int err = copy_dir_start(src, dest);
+	if (err != EXIT_SUCCESS)
+		return err;
 
-		char *file2 = (char *)NULL;
-		file2 = (char *)xnmalloc(strlen(trash_info_dir) +
-					strlen(info_file) + 2, sizeof(char));
-		sprintf(file2, "%s/%s", trash_info_dir, info_file);
+	struct walk_list_t l = {NULL, 0, 0};
+	walk_list_push(&l, savestring(src, strlen(src)),
+		savestring(dest, strlen(dest)), &a);
 
-		char *tmp_cmd[] = {"rm", "-rf", "--", file1, file2, NULL};
-		ret = launch_execve(tmp_cmd, FOREGROUND, E_NOFLAG);
+	size_t i;
+	for (i = 0; i < l.n && err == EXIT_SUCCESS; i++)
+		err = copy_dir(&l, i);
+
+	/* Children first: setting times on a directory is useless once
+	 * something is created in it, and its mode might deny writing */
+	i = l.n;
+	while (err == EXIT_SUCCESS && i-- > 0) {
+		const struct walk_dir_t *d = &l.dirs[i];
+		copy_file_owner(d->dest, &d->a, 0);
+		chmod(d->dest, d->a.st_mode & 07777);
+		copy_file_times(d->dest, &d->a, 0);
+	}
 
-		free(file1);
-		free(file2);
+	walk_list_free(&l);
+	return err;
+}
 
-		if (ret != EXIT_SUCCESS) {
-			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("trash: %s: Error removing "
-				"trashed file\n"),  trash_files[i]->d_name);
-			exit_status = ret;
-			/* If there is at least one error, return error */
-		}
+/* Move SRC to DEST, in a different file system: copy SRC, and remove it
+ * only if the whole tree was successfully copied. Otherwise, remove the
+ * partial copy, leaving the source untouched.
+ * Trees the native copy cannot reproduce faithfully (see copy_tree()) are
+ * moved by mv(1) instead. So is everything if extended attributes cannot
+ * be checked.
+ * Returns zero on success or an errno value otherwise */
+static int
+xdev_move(const char *src, const char *dest)
+{
+#if defined(_LINUX_XATTR)
+	int ret = copy_tree(src, dest);
+#else
+	int ret = XDEV_USE_MV;
+#endif /* _LINUX_XATTR */
+
+	if (ret == XDEV_USE_MV) {
+		purge_tree(AT_FDCWD, dest);
+		char *cmd[] = {"mv", "--", (char *)src, (char *)dest, NULL};
+		ret = launch_execve(cmd, FOREGROUND, E_NOFLAG);
+		return ret == EXIT_SUCCESS ? EXIT_SUCCESS : EIO;
+	}
 
-		free(info_file);
-		free(trash_files[i]);
+	if (ret != EXIT_SUCCESS) {
+		purge_tree(AT_FDCWD, dest);
+		return ret;
 	}
 
-	free(trash_files);
+	ret = purge_tree(AT_FDCWD, src);
+	if (ret != EXIT_SUCCESS)
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("trash: %s: Error removing "
+			"source file: %s\n"), src, strerror(ret));
 
-	if (xchdir(workspaces[cur_ws].path, NO_TITLE) == -1) {
-		_err(0, NOPRINT_PROMPT, "trash: '%s': %s\n",
-			workspaces[cur_ws].path, strerror(errno));
-		return EXIT_FAILURE;
+	return ret;
+}
+
+static int
+trash_clear(void)
+{
+	size_t files_n = 0, removed = 0;
+	char **names = get_trash_names(&files_n);
+
+	if (files_n == 0) {
+		puts(_("trash: No trashed files"));
+		return EXIT_SUCCESS;
 	}
 
-	if (ret == EXIT_SUCCESS) {
+	int exit_status = purge_trashed_files(names, files_n, &removed);
+	free_trash_names(names, files_n);
+
+	if (exit_status == EXIT_SUCCESS) {
 		if (conf.autols == 1)
 			reload_dirlist();
 		print_reload_msg(_("Trash can emptied\n"));
@@ -356,6 +1488,8 @@ trash_element(const char *suffix, const struct tm *tm, char *file)
 		return EXIT_FAILURE;
 
 	int ret = -1;
+	struct tm dtm = *tm;
+	time_t date = mktime(&dtm);
 
 	/* Create the trashed file name: orig_filename.suffix, where SUFFIX is
 	 * current date and time */
@@ -396,9 +1530,16 @@ trash_element(const char *suffix, const struct tm *tm, char *file)
 	dest = (char *)xnmalloc(strlen(trash_files_dir) + strlen(file_suffix) + 2,
 			sizeof(char));
 	sprintf(dest, "%s/%s", trash_files_dir, file_suffix);
-	char *tmp_cmd[] = {"mv", "--", file, dest, NULL};
 
-	ret = launch_execve(tmp_cmd, FOREGROUND, E_NOFLAG);
+	/* Within the same file system this is just a rename. Otherwise, copy
+	 * the file into the trash can and then remove the original */
+	ret = renameat(AT_FDCWD, file, AT_FDCWD, dest) == 0 ? EXIT_SUCCESS : errno;
+	if (ret == EXDEV)
+		ret = xdev_move(file, dest);
+	else if (ret != EXIT_SUCCESS)
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: %s\n",
+			file, strerror(ret));
+
 	free(dest);
 	dest = (char *)NULL;
 
@@ -415,7 +1556,10 @@ trash_element(const char *suffix, const struct tm *tm, char *file)
 	char *info_file = (char *)xnmalloc(info_file_len, sizeof(char));
 	sprintf(info_file, "%s/%s.trashinfo", trash_info_dir, file_suffix);
 
-	FILE *info_fp = fopen(info_file, "w");
+	/* The info file is not synced to disk (trashing lots of files would be
+	 * way too slow), but it never appears half-written */
+	struct persist_t p;
+	FILE *info_fp = persist_open(&p, info_file, PERSIST_NOFLAG);
 	if (!info_fp) { /* If error creating the info file */
 		_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: %s\n",
 			info_file, strerror(errno));
@@ -425,8 +1569,7 @@ trash_element(const char *suffix, const struct tm *tm, char *file)
 						+ strlen(file_suffix) + 2, sizeof(char));
 		sprintf(trash_file, "%s/%s", trash_files_dir, file_suffix);
 
-		char *tmp_cmd2[] = {"rm", "-rf", "--", trash_file, NULL};
-		ret = launch_execve(tmp_cmd2, FOREGROUND, E_NOFLAG);
+		ret = purge_tree(AT_FDCWD, trash_file);
 		free(trash_file);
 		if (ret != EXIT_SUCCESS) {
 			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("trash: %s/%s: Failed "
@@ -453,7 +1596,7 @@ trash_element(const char *suffix, const struct tm *tm, char *file)
 			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("trash: %s: Failed "
 				"encoding path\n"), file);
 
-			fclose(info_fp);
+			persist_cancel(&p);
 			free(info_file);
 			free(file_suffix);
 			return EXIT_FAILURE;
@@ -463,9 +1606,13 @@ trash_element(const char *suffix, const struct tm *tm, char *file)
 		    "[Trash Info]\nPath=%s\nDeletionDate=%d-%d-%dT%d:%d:%d\n",
 		    url_str, tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
 		    tm->tm_hour, tm->tm_min, tm->tm_sec);
-		fclose(info_fp);
+		if (persist_commit(&p) != EXIT_SUCCESS)
+			_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: %s\n",
+				info_file, strerror(errno));
 		free(url_str);
 		url_str = (char *)NULL;
+
+		catalog_add(file_suffix, *file != '/' ? full_path : file, &attr, date);
 	}
 
 	free(info_file);
@@ -473,9 +1620,9 @@ trash_element(const char *suffix, const struct tm *tm, char *file)
 	return EXIT_SUCCESS;
 }
 
-/* Remove NAME file and the corresponding .trashinfo file from the trash can */
+/* Make sure NAME, and its corresponding .trashinfo file, are in the trash can */
 static int
-remove_file_from_trash(char *name)
+check_trashed_file(char *name)
 {
 	char rm_file[PATH_MAX], rm_info[PATH_MAX];
 	snprintf(rm_file, sizeof(rm_file), "%s/%s", trash_files_dir, name);
@@ -483,7 +1630,7 @@ remove_file_from_trash(char *name)
 
 	int err = 0, err_file = 0, err_info = 0;
 	struct stat a;
-	if (stat(rm_file, &a) == -1) {
+	if (lstat(rm_file, &a) == -1) {
 		_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: %s\n",
 			rm_file, strerror(errno));
 		err_file = err = errno;
@@ -498,77 +1645,78 @@ remove_file_from_trash(char *name)
 	if (err_file != EXIT_SUCCESS || err_info != EXIT_SUCCESS)
 		return err;
 
-	char *cmd[] = {"rm", "-rf", "--", rm_file, rm_info, NULL};
-	return launch_execve(cmd, FOREGROUND, E_NOFLAG);
+	return EXIT_SUCCESS;
 }
 
 static int
 remove_from_trash(char **args)
 {
 	int exit_status = EXIT_SUCCESS;
+	size_t i, removed_files = 0;
 
 	/* Remove from trash files passed as parameters */
-	size_t i = 2;
 	if (args[2]) {
-		size_t removed_files = 0;
-		for (; args[i]; i++) {
+		for (i = 2; args[i]; i++) {
 			if (*args[i] == '*' && !args[i][1])
 				return trash_clear();
+		}
+
+		char **names = (char **)xnmalloc(i, sizeof(char *));
+		size_t n = 0;
+		for (i = 2; args[i]; i++) {
 			char *d = (char *)NULL;
 			if (strchr(args[i], '\\'))
 				d = dequote_str(args[i], 0);
-			if (remove_file_from_trash(d ? d : args[i]) != EXIT_SUCCESS)
+			char *name = d ? d : args[i];
+			if (check_trashed_file(name) != EXIT_SUCCESS) {
 				exit_status = EXIT_FAILURE;
-			else
-				removed_files++;
-			free(d);
+				free(d);
+				continue;
+			}
+			names[n] = d ? d : savestring(name, strlen(name));
+			n++;
 		}
 
+		if (purge_trashed_files(names, n, &removed_files) != EXIT_SUCCESS)
+			exit_status = EXIT_FAILURE;
+		free_trash_names(names, n);
+
 		if (conf.autols == 1 && exit_status == EXIT_SUCCESS)
 			reload_dirlist();
 		print_reload_msg(_("%zu file(s) removed from the trash can\n"),
 			removed_files);
-		print_reload_msg(_("%zu total trashed file(s)\n"),
-			trash_n - removed_files);
+		print_reload_msg(_("%zu total trashed file(s)\n"), tcat.live);
 		return exit_status;
 	}
 
 	/* No parameters */
 
 	/* List trashed files */
-	/* Change CWD to the trash directory. Otherwise, scandir() will fail */
+	size_t files_n = 0;
+	char **trash_files = get_trash_names(&files_n);
+
+	if (files_n == 0) {
+		puts(_("trash: No trashed files"));
+		return EXIT_SUCCESS;
+	}
+
+	/* Change CWD to the trash directory to colorize trashed files */
 	if (xchdir(trash_files_dir, NO_TITLE) == -1) {
 		_err(0, NOPRINT_PROMPT, "trash: %s: %s\n",
 			trash_files_dir, strerror(errno));
+		free_trash_names(trash_files, files_n);
 		return EXIT_FAILURE;
 	}
 
-	struct dirent **trash_files = (struct dirent **)NULL;
-	int files_n = scandir(trash_files_dir, &trash_files,
-					skip_files, (conf.unicode) ? alphasort : (conf.case_sens_list)
-					? xalphasort : alphasort_insensitive);
-
-	if (files_n) {
-		printf(_("%sTrashed files%s\n\n"), BOLD, df_c);
-		for (i = 0; i < (size_t)files_n; i++) {
-			colors_list(trash_files[i]->d_name, (int)i + 1, NO_PAD,
-			    PRINT_NEWLINE);
-		}
-	} else {
-		puts(_("trash: No trashed files"));
-		/* Restore CWD and return */
-		if (xchdir(workspaces[cur_ws].path, NO_TITLE) == -1) {
-			_err(0, NOPRINT_PROMPT, "trash: %s: %s\n",
-			    workspaces[cur_ws].path, strerror(errno));
-		}
-
-		return EXIT_SUCCESS;
-	}
+	printf(_("%sTrashed files%s\n\n"), BOLD, df_c);
+	for (i = 0; i < files_n; i++)
+		colors_list(trash_files[i], (int)i + 1, NO_PAD, PRINT_NEWLINE);
 
 	/* Restore CWD and continue */
 	if (xchdir(workspaces[cur_ws].path, NO_TITLE) == -1) {
 		_err(0, NOPRINT_PROMPT, "trash: %s: %s\n",
 		    workspaces[cur_ws].path, strerror(errno));
+		free_trash_names(trash_files, files_n);
 		return EXIT_FAILURE;
 	}
 
@@ -586,112 +1734,77 @@ remove_from_trash(char **args)
 	rm_elements = get_substr(line, ' ');
 	free(line);
 
-	if (!rm_elements)
+	if (!rm_elements) {
+		free_trash_names(trash_files, files_n);
 		return EXIT_FAILURE;
-
-	/* Remove files */
-	int ret = -1;
+	}
 
 	/* First check for exit, wildcard, and non-number args */
+	int quit = 0, all = 0;
 	for (i = 0; rm_elements[i]; i++) {
-		/* Quit */
 		if (strcmp(rm_elements[i], "q") == 0) {
-			size_t j;
-			for (j = 0; rm_elements[j]; j++)
-				free(rm_elements[j]);
-			free(rm_elements);
-
-			for (j = 0; j < (size_t)files_n; j++)
-				free(trash_files[j]);
-			free(trash_files);
-
-			if (conf.autols == 1)
-				reload_dirlist();
-
-			return exit_status;
+			quit = 1;
+			break;
 		}
 
-		/* Asterisk */
-		else if (strcmp(rm_elements[i], "*") == 0) {
-			size_t j, removed_files = 0;
-			for (j = 0; j < (size_t)files_n; j++) {
-				ret = remove_file_from_trash(trash_files[j]->d_name);
-				if (ret != EXIT_SUCCESS) {
-					_err(ERR_NO_STORE, NOPRINT_PROMPT, _("trash: %s: Cannot "
-						"remove file from the trash can\n"),
-						trash_files[j]->d_name);
-					exit_status = EXIT_FAILURE;
-				} else {
-					removed_files++;
-				}
-
-				free(trash_files[j]);
-			}
-
-			free(trash_files);
-
-			for (j = 0; rm_elements[j]; j++)
-				free(rm_elements[j]);
-			free(rm_elements);
-
-			if (conf.autols == 1)
-				reload_dirlist();
-			print_reload_msg(_("%zu file(s) removed from the trash can\n"),
-				removed_files);
-
-			return exit_status;
+		if (strcmp(rm_elements[i], "*") == 0) {
+			all = 1;
+			break;
 		}
 
-		else if (!is_number(rm_elements[i])) {
+		if (!is_number(rm_elements[i])) {
 			fprintf(stderr, _("trash: %s: Invalid ELN\n"), rm_elements[i]);
 			exit_status = EXIT_FAILURE;
-
-			size_t j;
-			for (j = 0; rm_elements[j]; j++)
-				free(rm_elements[j]);
-			free(rm_elements);
-
-			for (j = 0; j < (size_t)files_n; j++)
-				free(trash_files[j]);
-			free(trash_files);
-
-			return exit_status;
+			break;
 		}
 	}
 
-	size_t removed_files = 0;
-	/* If all args are numbers, and neither 'q' nor wildcard */
-	for (i = 0; rm_elements[i]; i++) {
-		int rm_num = atoi(rm_elements[i]);
-		if (rm_num <= 0 || rm_num > files_n) {
-			fprintf(stderr, _("trash: %d: Invalid ELN\n"), rm_num);
-			free(rm_elements[i]);
-			exit_status = EXIT_FAILURE;
-			continue;
-		}
+	size_t n = 0;
+	char **names = (char **)NULL;
+
+	if (all == 1) {
+		names = trash_files;
+		n = files_n;
+	} else if (quit == 0 && exit_status == EXIT_SUCCESS) {
+		/* If all args are numbers, and neither 'q' nor wildcard */
+		names = (char **)xnmalloc(i + 1, sizeof(char *));
+		for (i = 0; rm_elements[i]; i++) {
+			int rm_num = atoi(rm_elements[i]);
+			if (rm_num <= 0 || (size_t)rm_num > files_n) {
+				fprintf(stderr, _("trash: %d: Invalid ELN\n"), rm_num);
+				exit_status = EXIT_FAILURE;
+				continue;
+			}
 
-		ret = remove_file_from_trash(trash_files[rm_num - 1]->d_name);
-		if (ret != EXIT_SUCCESS) {
-			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("trash: %s: Cannot remove "
-				"file from the trash can\n"), trash_files[rm_num - 1]->d_name);
-			exit_status = EXIT_FAILURE;
-		} else {
-			removed_files++;
+			/* Skip duplicated ELNs */
+			size_t j;
+			for (j = 0; j < n && names[j] != trash_files[rm_num - 1]; j++);
+			if (j == n) {
+				names[n] = trash_files[rm_num - 1];
+				n++;
+			}
 		}
-
-		free(rm_elements[i]);
 	}
 
+	for (i = 0; rm_elements[i]; i++)
+		free(rm_elements[i]);
 	free(rm_elements);
 
-	for (i = 0; i < (size_t)files_n; i++)
-		free(trash_files[i]);
-	free(trash_files);
+	if (n > 0 && purge_trashed_files(names, n, &removed_files) != EXIT_SUCCESS)
+		exit_status = EXIT_FAILURE;
+
+	if (names != trash_files)
+		free(names);
+	free_trash_names(trash_files, files_n);
+
+	if (quit == 0 && n == 0)
+		return exit_status;
 
 	if (conf.autols == 1)
 		reload_dirlist();
-	print_reload_msg(_("%zu file(s) removed from the trash can\n"),
-		removed_files);
+	if (quit == 0)
+		print_reload_msg(_("%zu file(s) removed from the trash can\n"),
+			removed_files);
 
 	return exit_status;
 }
@@ -706,56 +1819,29 @@ untrash_element(char *file)
 	snprintf(undel_file, PATH_MAX, "%s/%s", trash_files_dir, file);
 	snprintf(undel_info, PATH_MAX, "%s/%s.trashinfo", trash_info_dir, file);
 
-	FILE *info_fp;
-	info_fp = fopen(undel_info, "r");
-	if (!info_fp) {
-		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("undel: Info file for '%s' not "
-			"found. Try restoring the file manually\n"), file);
-		return errno;
-	}
-
-	char *orig_path = (char *)NULL;
-	/* The max length for line is Path=(5) + PATH_MAX + \n(1) */
-	char line[PATH_MAX + 6];
-	memset(line, '\0', PATH_MAX + 6);
-
-	while (fgets(line, (int)sizeof(line), info_fp)) {
-		if (strncmp(line, "Path=", 5) == 0) {
-			char *p = strchr(line, '=');
-			if (!p || !*(++p))
-				break;
-			orig_path = savestring(p, strlen(p));
+	/* Get the original path from the catalog, falling back to the info
+	 * file if the file is not cataloged */
+	char *url_decoded = (char *)NULL;
+	ssize_t e = find_trash_entry(file);
+	if (e != -1 && tcat.ent[e].orig) {
+		url_decoded = savestring(tcat.ent[e].orig, strlen(tcat.ent[e].orig));
+	} else {
+		if (access(undel_info, F_OK) == -1) {
+			_err(ERR_NO_STORE, NOPRINT_PROMPT, _("undel: Info file for '%s' "
+				"not found. Try restoring the file manually\n"), file);
+			return errno;
 		}
+		url_decoded = read_trashinfo(undel_info, NULL);
 	}
 
-	fclose(info_fp);
-
 	/* If original path is NULL or empty, return error */
-	if (!orig_path)
-		return EXIT_FAILURE;
-
-	if (*orig_path == '\0') {
-		free(orig_path);
-		return EXIT_FAILURE;
-	}
-
-	/* Remove new line char from original path, if any */
-	size_t orig_path_len = strlen(orig_path);
-	if (orig_path_len > 0 && orig_path[orig_path_len - 1] == '\n')
-		orig_path[orig_path_len - 1] = '\0';
-
-	/* Decode original path's URL format */
-	char *url_decoded = url_decode(orig_path);
-	if (!url_decoded) {
-		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("undel: %s: Error decoding "
-			"original path\n"), orig_path);
-		free(orig_path);
+	if (!url_decoded || !*url_decoded) {
+		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("undel: %s: Error getting "
+			"original path\n"), file);
+		free(url_decoded);
 		return EXIT_FAILURE;
 	}
 
-	free(orig_path);
-	orig_path = (char *)NULL;
-
 	/* Check existence and permissions of parent directory */
 	char *parent = (char *)NULL;
 	parent = strbfrlst(url_decoded, '/');
@@ -799,31 +1885,90 @@ untrash_element(char *file)
 	}
 
 	free(url_decoded);
+	catalog_del(file);
 
-	char *cmd[] = {"rm", "-rf", "--", undel_info, NULL};
-	ret = launch_execve(cmd, FOREGROUND, E_NOFLAG);
-	if (ret != EXIT_SUCCESS) {
+	if (unlink(undel_info) == -1 && errno != ENOENT) {
 		_err(ERR_NO_STORE, NOPRINT_PROMPT, _("undel: %s: Error removing "
-			"info file\n"), undel_info);
-		return ret;
+			"info file: %s\n"), undel_info, strerror(errno));
+		return errno;
 	}
 
 	return EXIT_SUCCESS;
 }
 
-int
-untrash_function(char **comm)
+/* Untrash all trashed files originally located in DIR (or in any of its
+ * subdirectories) */
+static int
+untrash_dir(char *dir)
 {
-	if (!comm)
+	if (!dir || !*dir) {
+		puts(_(UNTRASH_USAGE));
 		return EXIT_FAILURE;
+	}
 
-	if (trash_ok == 0 || !trash_dir || !trash_files_dir || !trash_info_dir) {
-		fprintf(stderr, _("%s: Trash function disabled\n"), PROGRAM_NAME);
+	char *p = normalize_path(dir, strlen(dir));
+	if (!p)
 		return EXIT_FAILURE;
+
+	size_t plen = strlen(p);
+	if (plen > 1 && p[plen - 1] == '/')
+		p[--plen] = '\0';
+
+	size_t files_n = 0, n = 0, i;
+	struct trash_entry_t **list = get_trash_list(TRASH_SORT_DIR, &files_n);
+	char **names = (char **)xnmalloc(files_n + 1, sizeof(char *));
+
+	/* Sorted by original directory: parents are restored before their
+	 * children */
+	for (i = 0; i < files_n; i++) {
+		char *o = list[i]->orig;
+		if (!o || strncmp(o, p, plen) != 0
+		|| (o[plen] != '/' && !(plen == 1 && *p == '/')))
+			continue;
+		names[n] = savestring(list[i]->name, strlen(list[i]->name));
+		n++;
+	}
+
+	free(list);
+
+	if (n == 0) {
+		printf(_("undel: %s: No trashed files from this directory\n"), p);
+		free(p);
+		free(names);
+		return EXIT_SUCCESS;
+	}
+
+	free(p);
+
+	int exit_status = EXIT_SUCCESS;
+	size_t untrashed_files = 0;
+	for (i = 0; i < n; i++) {
+		if (untrash_element(names[i]) != EXIT_SUCCESS)
+			exit_status = EXIT_FAILURE;
+		else
+			untrashed_files++;
 	}
 
+	free_trash_names(names, n);
+
+	if (conf.autols == 1 && untrashed_files > 0)
+		reload_dirlist();
+	print_reload_msg(_("%zu file(s) untrashed\n"), untrashed_files);
+	print_reload_msg(_("%zu total trashed file(s)\n"), tcat.live);
+
+	return exit_status;
+}
+
+static int
+untrash_files(char **comm)
+{
 	int exit_status = EXIT_SUCCESS;
 
+	/* An option, so that a trashed file named "dir" can still be
+	 * untrashed by name */
+	if (comm[1] && *comm[1] == '-' && strcmp(comm[1], "--dir") == 0)
+		return untrash_dir(comm[2]);
+
 	if (comm[1] && *comm[1] != '*' && strcmp(comm[1], "a") != 0
 	&& strcmp(comm[1], "all") != 0) {
 		size_t j, untrashed_files = 0;
@@ -838,37 +1983,20 @@ untrash_function(char **comm)
 			free(d);
 		}
 		if (exit_status == EXIT_SUCCESS) {
-			size_t n = count_trashed_files();
 			if (conf.autols == 1)
 				reload_dirlist();
 			print_reload_msg(_("%zu file(s) untrashed\n"), untrashed_files);
-			print_reload_msg(_("%zu total trashed file(s)\n"), n);
+			print_reload_msg(_("%zu total trashed file(s)\n"), tcat.live);
 		}
 
 		return exit_status;
 	}
 
-	/* Change CWD to the trash directory to make scandir() work */
-	if (xchdir(trash_files_dir, NO_TITLE) == -1) {
-		_err(0, NOPRINT_PROMPT, "undel: %s: %s\n",
-			trash_files_dir, strerror(errno));
-		return EXIT_FAILURE;
-	}
-
 	/* Get trashed files */
-	struct dirent **trash_files = (struct dirent **)NULL;
-	int trash_files_n = scandir(trash_files_dir, &trash_files,
-	    skip_files, (conf.unicode) ? alphasort : (conf.case_sens_list)
-			? xalphasort : alphasort_insensitive);
-	if (trash_files_n <= 0) {
+	size_t trash_files_n = 0;
+	char **trash_files = get_trash_names(&trash_files_n);
+	if (trash_files_n == 0) {
 		puts(_("trash: No trashed files"));
-
-		if (xchdir(workspaces[cur_ws].path, NO_TITLE) == -1) {
-			_err(0, NOPRINT_PROMPT, "undel: %s: %s\n",
-			    workspaces[cur_ws].path, strerror(errno));
-			return EXIT_FAILURE;
-		}
-
 		return EXIT_SUCCESS;
 	}
 
@@ -876,40 +2004,42 @@ untrash_function(char **comm)
 	if (comm[1] && (strcmp(comm[1], "*") == 0 || strcmp(comm[1], "a") == 0
 	|| strcmp(comm[1], "all") == 0)) {
 		size_t j;
-		for (j = 0; j < (size_t)trash_files_n; j++) {
-			if (untrash_element(trash_files[j]->d_name) != 0)
+		for (j = 0; j < trash_files_n; j++) {
+			if (untrash_element(trash_files[j]) != 0)
 				exit_status = EXIT_FAILURE;
-			free(trash_files[j]);
-		}
-		free(trash_files);
-
-		if (xchdir(workspaces[cur_ws].path, NO_TITLE) == -1) {
-			_err(0, NOPRINT_PROMPT, "undel: %s: %s\n",
-			    workspaces[cur_ws].path, strerror(errno));
-			return EXIT_FAILURE;
 		}
+		free_trash_names(trash_files, trash_files_n);
 
 		if (conf.autols == 1)
 			reload_dirlist();
-		print_reload_msg(_("0 trashed files\n"));
+		print_reload_msg(_("%zu trashed files\n"), tcat.live);
 
 		return exit_status;
 	}
 
+	/* Change CWD to the trash directory to colorize trashed files */
+	if (xchdir(trash_files_dir, NO_TITLE) == -1) {
+		_err(0, NOPRINT_PROMPT, "undel: %s: %s\n",
+			trash_files_dir, strerror(errno));
+		free_trash_names(trash_files, trash_files_n);
+		return EXIT_FAILURE;
+	}
+
 	/* List trashed files */
 	printf(_("%sTrashed files%s\n\n"), BOLD, df_c);
 	size_t i;
 	uint8_t tpad = DIGINUM(trash_files_n);
 
-	for (i = 0; i < (size_t)trash_files_n; i++) {
+	for (i = 0; i < trash_files_n; i++) {
 		printf("%s%*zu%s ", el_c, tpad, i + 1, df_c);
-		colors_list(trash_files[i]->d_name, NO_ELN, NO_PAD, PRINT_NEWLINE);
+		colors_list(trash_files[i], NO_ELN, NO_PAD, PRINT_NEWLINE);
 	}
 
 	/* Go back to previous path */
 	if (xchdir(workspaces[cur_ws].path, NO_TITLE) == -1) {
 		_err(0, NOPRINT_PROMPT, "undel: %s: %s\n",
 			workspaces[cur_ws].path, strerror(errno));
+		free_trash_names(trash_files, trash_files_n);
 		return EXIT_FAILURE;
 	}
 
@@ -932,6 +2062,7 @@ untrash_function(char **comm)
 		for (i = 0; undel_elements[i]; i++)
 			undel_n++;
 	} else {
+		free_trash_names(trash_files, trash_files_n);
 		return EXIT_FAILURE;
 	}
 
@@ -943,8 +2074,8 @@ untrash_function(char **comm)
 			free_and_return = reload_files = 1;
 		} else if (strcmp(undel_elements[i], "*") == 0) {
 			size_t j;
-			for (j = 0; j < (size_t)trash_files_n; j++)
-				if (untrash_element(trash_files[j]->d_name) != 0)
+			for (j = 0; j < trash_files_n; j++)
+				if (untrash_element(trash_files[j]) != 0)
 					exit_status = EXIT_FAILURE;
 
 			free_and_return = 1;
@@ -962,9 +2093,7 @@ untrash_function(char **comm)
 			free(undel_elements[j]);
 		free(undel_elements);
 
-		for (j = 0; j < (size_t)trash_files_n; j++)
-			free(trash_files[j]);
-		free(trash_files);
+		free_trash_names(trash_files, trash_files_n);
 
 		if (conf.autols == 1 && reload_files == 1)
 			reload_dirlist();
@@ -976,70 +2105,108 @@ untrash_function(char **comm)
 	for (i = 0; i < (size_t)undel_n; i++) {
 		int undel_num = atoi(undel_elements[i]);
 
-		if (undel_num <= 0 || undel_num > trash_files_n) {
+		if (undel_num <= 0 || (size_t)undel_num > trash_files_n) {
 			fprintf(stderr, _("undel: %d: Invalid ELN\n"), undel_num);
 			free(undel_elements[i]);
 			continue;
 		}
 
 		/* If valid ELN */
-		if (untrash_element(trash_files[undel_num - 1]->d_name) != EXIT_SUCCESS)
+		if (untrash_element(trash_files[undel_num - 1]) != EXIT_SUCCESS)
 			exit_status = EXIT_FAILURE;
 
 		free(undel_elements[i]);
 	}
 
 	free(undel_elements);
-
-	/* Free trashed files list */
-	for (i = 0; i < (size_t)trash_files_n; i++)
-		free(trash_files[i]);
-	free(trash_files);
+	free_trash_names(trash_files, trash_files_n);
 
 	/* If some trashed file still remains, reload the undel screen */
-	trash_n = (size_t)count_dir(trash_files_dir, NO_CPOP);
+	trash_n = tcat.live;
+	if (trash_n) {
+		sync_trash_catalog();
+		untrash_files(comm);
+	}
+
+	return exit_status;
+}
+
+int
+untrash_function(char **comm)
+{
+	if (!comm)
+		return EXIT_FAILURE;
 
-	if (trash_n <= 2)
-		trash_n = 0;
+	if (trash_ok == 0 || !trash_dir || !trash_files_dir || !trash_info_dir) {
+		fprintf(stderr, _("%s: Trash function disabled\n"), PROGRAM_NAME);
+		return EXIT_FAILURE;
+	}
 
-	if (trash_n)
-		untrash_function(comm);
+	load_trash_catalog();
+	int exit_status = untrash_files(comm);
+	sync_trash_catalog();
 
 	return exit_status;
 }
 
-/* List files currently in the trash can */
+static void
+print_trash_date(const time_t date)
+{
+	char buf[MAX_TIME_STR];
+	struct tm t;
+
+	if (date > 0 && localtime_r(&date, &t))
+		strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", &t);
+	else
+		xstrsncpy(buf, "-", sizeof(buf));
+
+	printf("%s%-16s%s ", dd_c, buf, df_c);
+}
+
+/* List files currently in the trash can, sorted according to SORT
+ * (TRASH_SORT_NAME, TRASH_SORT_DATE, or TRASH_SORT_DIR) */
 static int
-list_trashed_files(void)
+list_trashed_files(const int sort)
 {
+	size_t files_n = 0;
+	struct trash_entry_t **list = get_trash_list(sort, &files_n);
+
+	if (files_n == 0) {
+		puts(_("trash: No trashed files"));
+		free(list);
+		return (-1);
+	}
+
 	if (xchdir(trash_files_dir, NO_TITLE) == -1) {
 		_err(0, NOPRINT_PROMPT, "trash: %s: %s\n",
 			trash_files_dir, strerror(errno));
+		free(list);
 		return EXIT_FAILURE;
 	}
 
-	struct dirent **trash_files = (struct dirent **)NULL;
-	int files_n = scandir(trash_files_dir, &trash_files,
-			skip_files, (conf.unicode) ? alphasort : (conf.case_sens_list)
-			? xalphasort : alphasort_insensitive);
-
-	if (files_n == -1) {
-		_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s\n", strerror(errno));
-		return EXIT_FAILURE;
-	}
-	if (files_n <= 0) {
-		puts(_("trash: No trashed files"));
-		return (-1);
-	}
-
 	uint8_t tpad = DIGINUM(files_n);
-	size_t i;
-	for (i = 0; i < (size_t)files_n; i++) {
+	const char *dir = (char *)NULL;
+	size_t i, dir_len = 0;
+
+	for (i = 0; i < files_n; i++) {
+		if (sort == TRASH_SORT_DIR) {
+			size_t len = 0;
+			const char *d = get_orig_dir(list[i], &len);
+			if (!dir || len != dir_len || strncmp(d, dir, len) != 0) {
+				printf("%s%s%.*s%s:\n", i > 0 ? "\n" : "", BOLD,
+					(int)(len > 0 ? len : 1), len > 0 ? d : "?", df_c);
+				dir = d;
+				dir_len = len;
+			}
+		}
+
 		printf("%s%*zu%s ", el_c, tpad, i + 1, df_c);
-		colors_list(trash_files[i]->d_name, NO_ELN, NO_PAD, PRINT_NEWLINE);
-		free(trash_files[i]);
+		if (sort == TRASH_SORT_DATE)
+			print_trash_date(list[i]->date);
+		colors_list(list[i]->name, NO_ELN, NO_PAD, PRINT_NEWLINE);
 	}
-	free(trash_files);
+
+	free(list);
 
 	if (xchdir(workspaces[cur_ws].path, NO_TITLE) == -1) {
 		_err(0, NOPRINT_PROMPT, "trash: %s: %s\n",
@@ -1105,7 +2272,8 @@ check_trash_file(char *deq_file)
 
 /* Print the list of successfully trashed files */
 static void
-print_trashed_files(char **args, const int *trashed, const size_t trashed_n)
+print_trashed_files(char **args, const char *raw, const int *trashed,
+	const size_t trashed_n)
 {
 	if (print_removed_files == 0)
 		return;
@@ -1115,16 +2283,18 @@ print_trashed_files(char **args, const int *trashed, const size_t trashed_n)
 		if (!args[trashed[i]] || !*args[trashed[i]])
 			continue;
 		char *p = (char *)NULL;
-		if (strchr(args[trashed[i]], '\\'))
+		if (is_raw_arg(raw, (size_t)trashed[i]) == 0
+		&& strchr(args[trashed[i]], '\\'))
 			p = dequote_str(args[trashed[i]], 0);
 		printf("%s\n", p ? p : args[trashed[i]]);
 		free(p);
 	}
 }
 
-/* Trash files passed as arguments to the trash command */
+/* Trash files passed as arguments to the trash command. RAW tells which
+ * of them are raw file names (see is_raw_arg()) */
 static int
-trash_files_args(char **args)
+trash_files_args(char **args, const char *raw)
 {
 	time_t rawtime = time(NULL);
 	struct tm tm;
@@ -1139,7 +2309,8 @@ trash_files_args(char **args)
 	int *successfully_trashed = (int *)xnmalloc(i + 1, sizeof(int));
 
 	for (i = 1; args[i]; i++) {
-		char *deq_file = dequote_str(args[i], 0);
+		char *deq_file = is_raw_arg(raw, i) == 1
+			? savestring(args[i], strlen(args[i])) : dequote_str(args[i], 0);
 		if (!deq_file) {
 			_err(ERR_NO_STORE, NOPRINT_PROMPT, "trash: %s: Error dequoting "
 				"file\n", args[i]);
@@ -1177,7 +2348,7 @@ trash_files_args(char **args)
 	if (exit_status == EXIT_SUCCESS) {
 		if (conf.autols == 1 && cwd == 1)
 			reload_dirlist();
-		print_trashed_files(args, successfully_trashed, n);
+		print_trashed_files(args, raw, successfully_trashed, n);
 		print_reload_msg(_("%zu file(s) trashed\n"), trashed_files);
 		print_reload_msg(_("%zu total trashed file(s)\n"),
 			trash_n + trashed_files);
@@ -1192,7 +2363,7 @@ trash_files_args(char **args)
 			xgetchar();
 			reload_dirlist();
 		}
-		print_trashed_files(args, successfully_trashed, n);
+		print_trashed_files(args, raw, successfully_trashed, n);
 		print_reload_msg(_("%zu file(s) trashed\n"), trashed_files);
 		print_reload_msg(_("%zu total trashed file(s)\n"),
 			trash_n + trashed_files);
@@ -1203,7 +2374,7 @@ trash_files_args(char **args)
 }
 
 int
-trash_function(char **args)
+trash_function(char **args, const char *raw)
 {
 	if (!args)
 		return EXIT_FAILURE;
@@ -1213,26 +2384,42 @@ trash_function(char **args)
 		return EXIT_FAILURE;
 	}
 
-	/* List trashed files ('tr' or 'tr ls') */
+	load_trash_catalog();
+
+	/* List trashed files ('tr' or 'tr ls [date|dir]') */
 	if (!args[1] || (*args[1] == 'l'
 	&& (strcmp(args[1], "ls") == 0 || strcmp(args[1], "list") == 0))) {
-		int ret = list_trashed_files();
+		int sort = TRASH_SORT_NAME;
+		if (args[1] && args[2]) {
+			if (strcmp(args[2], "date") == 0) {
+				sort = TRASH_SORT_DATE;
+			} else if (strcmp(args[2], "dir") == 0) {
+				sort = TRASH_SORT_DIR;
+			} else {
+				fprintf(stderr, "%s\n", _(TRASH_USAGE));
+				return EXIT_FAILURE;
+			}
+		}
+
+		int ret = list_trashed_files(sort);
 		if (ret == -1 || ret == EXIT_SUCCESS)
 			return EXIT_SUCCESS;
 		return EXIT_FAILURE;
 	}
 
-	trash_n = count_trashed_files();
+	trash_n = tcat.live;
 
+	int exit_status = EXIT_SUCCESS;
 	if (*args[1] == 'd' && strcmp(args[1], "del") == 0)
-		return remove_from_trash(args);
-
-	if ((*args[1] == 'c' && strcmp(args[1], "clear") == 0)
+		exit_status = remove_from_trash(args);
+	else if ((*args[1] == 'c' && strcmp(args[1], "clear") == 0)
 	|| (*args[1] == 'e' && strcmp(args[1], "empty") == 0))
-		return trash_clear();
-	else {
-		return trash_files_args(args);
-	}
+		exit_status = trash_clear();
+	else
+		exit_status = trash_files_args(args, raw);
+
+	sync_trash_catalog();
+	return exit_status;
 }
 #else
 void *_skip_me_trash;
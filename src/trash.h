@@ -29,7 +29,8 @@
 
 __BEGIN_DECLS
 
-int trash_function(char **);
+void free_trash_catalog(void);
+int trash_function(char **, const char *);
 int untrash_function(char **);
 
 __END_DECLS
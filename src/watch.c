@@ -0,0 +1,518 @@
+/* watch.c -- watch directories for changes (inotify) */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The watch manager
+ * A single inotify instance (inotify_fd), created at startup and kept
+ * open for the whole session, watches every directory we are interested
+ * in: the current directory, the directories of stored workspace
+ * listings, the parent directories of selected files, and the trash
+ * directory. Watched directories are reference counted per owner (see
+ * the WATCH_* macros in watch.h), so that a directory is watched only
+ * once no matter how many owners want it, and unwatched as soon as
+ * nobody does.
+ *
+ * Events are read either after running a command (read_inotify()), or
+ * while waiting for input at the prompt (wait_for_input(), called by
+ * my_rl_getc()). In the latter case no more than one refresh is made
+ * every RefreshDelay milliseconds: events arriving in the meantime are
+ * coalesced into the next refresh. */
+
+#include "helpers.h"
+
+#ifdef LINUX_INOTIFY
+
+#include <errno.h>
+#include <poll.h>
+#include <readline/readline.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aux.h"
+#include "listing.h"
+#include "misc.h"
+#include "persist.h"
+#include "prompt.h"
+#include "strings.h"
+#ifndef _NO_SUGGESTIONS
+# include "suggestions.h"
+#endif /* !_NO_SUGGESTIONS */
+#include "watch.h"
+
+#define OWNER_BIT(o) (1 << (o))
+
+/* Stored workspace listings are reused only if nothing changed in their
+ * directories, including the contents and attributes of files (sizes,
+ * times, permissions, and owners, as shown in long view). Only these
+ * watches get such events */
+#define WS_WATCH_MASK (IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE)
+
+struct watch_t {
+	char *path;
+	size_t changes; /* Number of events received for PATH so far */
+	int refs[WATCH_OWNERS];
+	int wd;
+	int pad;
+};
+
+static struct watch_t *watches = (struct watch_t *)NULL;
+static size_t watches_n = 0;
+
+/* Owners (OWNER_BIT) having changes not handled yet */
+static int pending = 0;
+/* Time of the last refresh, used to coalesce events */
+static struct timespec last_refresh = {0, 0};
+
+/* Watch descriptors held on behalf of the selection and the trash */
+static int *sel_wds = (int *)NULL;
+static size_t sel_wds_n = 0;
+static uint32_t sel_sig = 0;
+#ifndef _NO_TRASH
+static int trash_wd = -1;
+#endif /* !_NO_TRASH */
+
+static struct watch_t *
+get_watch(const int wd)
+{
+	size_t i;
+	for (i = 0; i < watches_n; i++) {
+		if (watches[i].wd == wd)
+			return &watches[i];
+	}
+
+	return (struct watch_t *)NULL;
+}
+
+static void
+remove_watch_entry(struct watch_t *w)
+{
+	free(w->path);
+	watches_n--;
+	if (w != &watches[watches_n])
+		*w = watches[watches_n];
+}
+
+/* Watch the directory DIR on behalf of OWNER. Returns the corresponding
+ * watch descriptor, or -1 in case of error */
+int
+add_watch(const char *dir, const int owner)
+{
+	if (inotify_fd < 0 || !dir || !*dir)
+		return (-1);
+
+	/* If DIR is a symlink to a directory and it does not end with a slash,
+	 * inotify_add_watch(3) fails with ENOTDIR */
+	char rpath[PATH_MAX];
+	snprintf(rpath, sizeof(rpath), "%s/", dir);
+
+	/* If DIR is already watched, we get the same watch descriptor, and
+	 * the events watched by other owners are kept (IN_MASK_ADD) */
+	const int wd = inotify_add_watch(inotify_fd, rpath, INOTIFY_MASK
+		| IN_MASK_ADD | (owner == WATCH_WS ? WS_WATCH_MASK : 0));
+	if (wd < 0)
+		return (-1);
+
+	struct watch_t *w = get_watch(wd);
+	if (!w) {
+		watches = (struct watch_t *)xrealloc(watches,
+			(watches_n + 1) * sizeof(struct watch_t));
+		w = &watches[watches_n];
+		watches_n++;
+		memset(w, 0, sizeof(struct watch_t));
+		w->path = savestring(dir, strlen(dir));
+		w->wd = wd;
+	}
+
+	w->refs[owner]++;
+	return wd;
+}
+
+/* OWNER is not interested anymore in the directory watched via WD. Stop
+ * watching it if nobody else is */
+void
+del_watch(const int wd, const int owner)
+{
+	struct watch_t *w = get_watch(wd);
+	if (!w)
+		return;
+
+	if (w->refs[owner] > 0)
+		w->refs[owner]--;
+
+	int i, used = 0;
+	for (i = 0; i < WATCH_OWNERS; i++) {
+		if (w->refs[i] > 0)
+			used = 1;
+	}
+
+	if (used == 0) {
+		inotify_rm_watch(inotify_fd, wd);
+		remove_watch_entry(w);
+		return;
+	}
+
+	/* Stop getting events only workspace listings care about */
+	if (owner == WATCH_WS && w->refs[WATCH_WS] == 0) {
+		char rpath[PATH_MAX];
+		snprintf(rpath, sizeof(rpath), "%s/", w->path);
+		const int ret = inotify_add_watch(inotify_fd, rpath, INOTIFY_MASK);
+		/* PATH is now a different directory: leave the watch alone */
+		if (ret >= 0 && ret != wd)
+			inotify_rm_watch(inotify_fd, ret);
+	}
+}
+
+void
+free_watches(void)
+{
+	size_t i;
+	for (i = 0; i < watches_n; i++)
+		free(watches[i].path);
+	free(watches);
+	watches = (struct watch_t *)NULL;
+	watches_n = 0;
+
+	free(sel_wds);
+	sel_wds = (int *)NULL;
+	sel_wds_n = 0;
+
+	/* Closing the inotify instance removes all its watches */
+	if (inotify_fd != UNSET)
+		close(inotify_fd);
+	inotify_fd = inotify_wd = UNSET;
+}
+
+/* Return the number of events received so far for the directory watched
+ * via WD, or (size_t)-1 if it is not watched anymore. Used to know whether
+ * a directory changed between two points in time */
+size_t
+watch_changes(const int wd)
+{
+	read_watch_events();
+	const struct watch_t *w = get_watch(wd);
+	return w ? w->changes : (size_t)-1;
+}
+
+/* Return 1 if EVENT, received for the current directory, requires the
+ * files list to be refreshed, or 0 otherwise */
+static int
+is_cwd_event(const struct inotify_event *event)
+{
+	struct stat a;
+
+	/* The file was created, but doesn't exist anymore */
+	if ((event->mask & IN_CREATE) && event->len
+	&& lstat(event->name, &a) != 0)
+		return 0;
+
+	/* A file was renamed, but the destiny file name is already in the
+	 * files list */
+	if (event->mask & IN_MOVED_TO) {
+		int j = (int)files;
+		while (--j >= 0) {
+			if (*file_info[j].name == *event->name
+			&& strcmp(file_info[j].name, event->name) == 0)
+				return 0;
+		}
+	}
+
+	/* The file was removed, but is still there (recreated) */
+	if ((event->mask & IN_DELETE) && event->len
+	&& lstat(event->name, &a) == 0)
+		return 0;
+
+	return (event->mask & INOTIFY_MASK) ? 1 : 0;
+}
+
+static void
+handle_watch_event(const struct inotify_event *event)
+{
+	int i;
+
+	/* Events were lost: assume every watched directory changed */
+	if (event->mask & IN_Q_OVERFLOW) {
+		size_t n;
+		for (n = 0; n < watches_n; n++) {
+			watches[n].changes++;
+			for (i = 0; i < WATCH_OWNERS; i++) {
+				if (watches[n].refs[i] > 0)
+					pending |= OWNER_BIT(i);
+			}
+		}
+		return;
+	}
+
+	struct watch_t *w = get_watch(event->wd);
+	if (!w)
+		return;
+
+	w->changes++;
+
+	/* Changes in files themselves matter to workspace listings only */
+	if (!(event->mask & (INOTIFY_MASK | IN_IGNORED)))
+		return;
+
+	if (w->refs[WATCH_CWD] > 0 && is_cwd_event(event) == 1)
+		pending |= OWNER_BIT(WATCH_CWD);
+	if (w->refs[WATCH_SEL] > 0)
+		pending |= OWNER_BIT(WATCH_SEL);
+	if (w->refs[WATCH_TRASH] > 0)
+		pending |= OWNER_BIT(WATCH_TRASH);
+	/* Stored workspace listings just check the CHANGES counter */
+
+	/* The directory was removed or unmounted: the kernel already
+	 * removed the watch */
+	if (event->mask & IN_IGNORED)
+		remove_watch_entry(w);
+}
+
+/* Read all available events, recording which owners must be notified */
+void
+read_watch_events(void)
+{
+	if (inotify_fd < 0)
+		return;
+
+	char buf[EVENT_BUF_LEN];
+	ssize_t len;
+
+	while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+		char *ptr = buf;
+		while (ptr + EVENT_SIZE <= buf + len) {
+			struct inotify_event *event = (struct inotify_event *)ptr;
+			ptr += EVENT_SIZE + event->len;
+#ifdef INOTIFY_DEBUG
+			printf("%s (%u:%d): %x\n", event->len ? event->name : "",
+				event->len, event->wd, event->mask);
+#endif /* INOTIFY_DEBUG */
+			handle_watch_event(event);
+		}
+	}
+}
+
+/* Watch the current directory instead of the previous one. Called
+ * whenever the files list is built */
+void
+watch_cwd(void)
+{
+	/* Events queued before this point are already reflected by the
+	 * listing we have just made */
+	read_watch_events();
+
+	const int old_wd = inotify_wd;
+	/* Add the new watch before removing the old one, so that the
+	 * watch is kept if the directory did not change */
+	inotify_wd = add_watch(workspaces[cur_ws].path, WATCH_CWD);
+	if (old_wd >= 0)
+		del_watch(old_wd, WATCH_CWD);
+
+	watch = inotify_wd >= 0 ? 1 : 0;
+	pending &= ~OWNER_BIT(WATCH_CWD);
+	clock_gettime(CLOCK_MONOTONIC, &last_refresh);
+
+	if (inotify_wd < 0 && inotify_fd >= 0)
+		_err('w', PRINT_PROMPT, "%s: inotify: %s: %s\n",
+			PROGRAM_NAME, workspaces[cur_ws].path, strerror(errno));
+}
+
+/* Watch the parent directories of selected files, so that the selected
+ * files counter in the prompt is updated if they are removed. Called
+ * whenever the list of selected files is (re)loaded */
+void
+watch_sel_parents(void)
+{
+	if (inotify_fd < 0)
+		return;
+
+	/* Do nothing if the selection did not change */
+	uint32_t sig = (uint32_t)sel_n;
+	size_t i;
+	for (i = 0; i < sel_n; i++)
+		sig = (sig * 31) ^ hashme32(sel_elements[i].name, HASH_SEED);
+	if (sig == sel_sig)
+		return;
+	sel_sig = sig;
+
+	int *old_wds = sel_wds;
+	const size_t old_wds_n = sel_wds_n;
+
+	sel_wds = sel_n > 0 ? (int *)xnmalloc(sel_n, sizeof(int)) : (int *)NULL;
+	sel_wds_n = 0;
+
+	char *prev = (char *)NULL;
+	size_t prev_len = 0;
+	for (i = 0; i < sel_n; i++) {
+		char *name = sel_elements[i].name;
+		char *p = strrchr(name, '/');
+		if (!p)
+			continue;
+
+		/* Selected files usually come in groups sharing the same parent */
+		size_t len = p == name ? 1 : (size_t)(p - name);
+		if (prev && len == prev_len && strncmp(name, prev, len) == 0)
+			continue;
+		prev = name;
+		prev_len = len;
+
+		char dir[PATH_MAX];
+		xstrsncpy(dir, name, len < sizeof(dir) ? len : sizeof(dir) - 1);
+		const int wd = add_watch(dir, WATCH_SEL);
+		if (wd >= 0) {
+			sel_wds[sel_wds_n] = wd;
+			sel_wds_n++;
+		}
+	}
+
+	for (i = 0; i < old_wds_n; i++)
+		del_watch(old_wds[i], WATCH_SEL);
+	free(old_wds);
+}
+
+/* Watch the trash directory, so that the trashed files counter in the
+ * prompt is kept up to date */
+void
+watch_trash(void)
+{
+#ifndef _NO_TRASH
+	if (trash_wd >= 0)
+		del_watch(trash_wd, WATCH_TRASH);
+	trash_wd = trash_ok == 1 ? add_watch(trash_files_dir, WATCH_TRASH) : -1;
+#endif /* !_NO_TRASH */
+}
+
+/* Check for changes in the current directory after running a command */
+void
+read_inotify(void)
+{
+	read_watch_events();
+
+	/* The prompt, including its counters, is about to be generated
+	 * anyway */
+	const int refresh = pending & OWNER_BIT(WATCH_CWD);
+	pending = 0;
+
+	if (refresh && exit_code == EXIT_SUCCESS) {
+#ifdef INOTIFY_DEBUG
+		puts("INOTIFY_REFRESH");
+#endif /* INOTIFY_DEBUG */
+		reload_dirlist();
+	}
+}
+
+/* Handle pending changes while waiting for input at the prompt */
+static void
+process_pending_events(void)
+{
+	int refresh = pending & OWNER_BIT(WATCH_CWD);
+
+	if (pending & (OWNER_BIT(WATCH_SEL) | OWNER_BIT(WATCH_TRASH))) {
+		if (update_prompt_counters() == 1)
+			refresh = 1;
+	}
+
+	pending = 0;
+	clock_gettime(CLOCK_MONOTONIC, &last_refresh);
+
+	if (refresh == 0)
+		return;
+
+#ifndef _NO_SUGGESTIONS
+	if (suggestion.printed && suggestion_buf)
+		free_suggestion();
+#endif /* !_NO_SUGGESTIONS */
+
+	/* The files list is printed right below the prompt otherwise */
+	if (conf.clear_screen == 0)
+		putchar('\n');
+
+	reload_dirlist();
+	watch_sel_parents();
+	redisplay_prompt();
+}
+
+/* Milliseconds left before we can refresh again */
+static int
+refresh_wait_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	const long elapsed = (long)(now.tv_sec - last_refresh.tv_sec) * 1000
+		+ (now.tv_nsec - last_refresh.tv_nsec) / 1000000;
+
+	return elapsed >= (long)conf.refresh_delay ? 0
+		: (int)((long)conf.refresh_delay - elapsed);
+}
+
+/* Wait until FD (the terminal) has input available. Meanwhile, write
+ * state files modified a while ago, if any, and, if waiting in the main
+ * prompt, keep the files list and the prompt up to date */
+void
+wait_for_input(const int fd)
+{
+	const int watching = (inotify_fd >= 0 && conf.autols == 1
+		&& (flags & IN_MAIN_PROMPT) && kbind_busy == 0 && rl_nohist == 0);
+
+	struct pollfd pfd[2];
+	pfd[0].fd = fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = inotify_fd;
+	pfd[1].events = POLLIN;
+
+	while (1) {
+		int timeout = stores_flush_wait();
+		if (timeout == 0) {
+			flush_stores(FLUSH_IDLE);
+			continue;
+		}
+
+		if (watching == 1 && pending != 0) {
+			const int wait = refresh_wait_time();
+			if (wait == 0) {
+				process_pending_events();
+				continue;
+			}
+			if (timeout == -1 || wait < timeout)
+				timeout = wait;
+		}
+
+		/* Nothing to do but waiting: let read(2) block */
+		if (watching == 0 && timeout == -1)
+			return;
+
+		pfd[0].revents = pfd[1].revents = 0;
+		/* Interrupted (say, by SIGWINCH): let read(2) handle it */
+		if (poll(pfd, watching == 1 ? 2 : 1, timeout) == -1)
+			return;
+
+		if (pfd[1].revents & POLLIN)
+			read_watch_events();
+
+		if (pfd[0].revents != 0)
+			return;
+	}
+}
+
+#endif /* LINUX_INOTIFY */
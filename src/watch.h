@@ -0,0 +1,52 @@
+/* watch.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef WATCH_H
+#define WATCH_H
+
+/* Owners of watched directories */
+#define WATCH_CWD    0 /* The current directory */
+#define WATCH_WS     1 /* Directories of stored workspace listings */
+#define WATCH_SEL    2 /* Parent directories of selected files */
+#define WATCH_TRASH  3 /* The trash directory */
+#define WATCH_OWNERS 4
+
+__BEGIN_DECLS
+
+#ifdef LINUX_INOTIFY
+int    add_watch(const char *, const int);
+void   del_watch(const int, const int);
+void   free_watches(void);
+void   read_inotify(void);
+void   read_watch_events(void);
+void   wait_for_input(const int);
+size_t watch_changes(const int);
+void   watch_cwd(void);
+void   watch_sel_parents(void);
+void   watch_trash(void);
+#endif /* LINUX_INOTIFY */
+
+__END_DECLS
+
+#endif /* WATCH_H */